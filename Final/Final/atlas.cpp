@@ -0,0 +1,412 @@
+#include <GLEW/glew.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "stb_image.h"
+
+#include "atlas.h"
+
+#include "image.h"
+
+#include "residency.h"
+
+/**
+ * One source image and its placement. x and y are the bottom-left texel of the
+ * image itself (inside its gutter) in its layer, rows counted from the bottom
+ * to match stbi_set_flip_vertically_on_load(true).
+ */
+struct atlas_entry {
+	std::string path;
+	long file_size;							// Used to detect a stale offline pack
+	int width, height;
+	int layer, x, y;
+};
+typedef struct atlas_entry AtlasEntry;
+
+namespace glob {
+	unsigned int atlas_texture_array = 0;
+	std::vector<AtlasEntry> atlas_entries;
+	std::vector<std::vector<unsigned char>> atlas_layers;	// RGB texels of every layer, kept only until upload/save
+	AtlasStats atlas_counters;
+	int atlas_max_dimension = 0;					// image_max_dimension() when the atlas was built, reused when restreaming
+}
+
+static long file_size(const std::string& path) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return -1;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+/**
+ * Layer files sit next to the manifest: "data/atlas.txt" -> "data/atlas_layer0.ppm".
+ */
+static std::string layer_path(const char* manifest_path, int layer) {
+	std::string base = manifest_path;
+	size_t dot = base.find_last_of('.');
+	if (dot != std::string::npos)
+		base = base.substr(0, dot);
+	return base + "_layer" + std::to_string(layer) + ".ppm";
+}
+
+/**
+ * Shelf-pack the entries (whose width and height are already set) into layers
+ * no larger than max_size. Entries are packed tallest first into one strip as
+ * wide as the widest image; the strip is then cut into layers at shelf
+ * boundaries. Returns false if an image does not fit in a layer at all.
+ */
+static bool atlas_pack(std::vector<AtlasEntry>& entries, int max_size, int& layer_width, int& layer_height, int& layers) {
+	std::vector<AtlasEntry*> order;
+	layer_width = 0;
+	for (AtlasEntry& entry : entries) {
+		order.push_back(&entry);
+		layer_width = std::max(layer_width, entry.width + 2 * ATLAS_GUTTER);
+	}
+	std::sort(order.begin(), order.end(), [](const AtlasEntry* a, const AtlasEntry* b) { return a->height > b->height; });
+
+	if (layer_width > max_size) {
+		std::cerr << "ERROR::ATLAS::PACK::IMAGE_LARGER_THAN_MAX_TEXTURE_SIZE" << std::endl;
+		return false;
+	}
+
+	int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+	layers = 1;
+	layer_height = 0;
+
+	for (AtlasEntry* entry : order) {
+		int padded_width = entry->width + 2 * ATLAS_GUTTER;
+		int padded_height = entry->height + 2 * ATLAS_GUTTER;
+		if (padded_height > max_size) {
+			std::cerr << "ERROR::ATLAS::PACK::IMAGE_LARGER_THAN_MAX_TEXTURE_SIZE" << std::endl;
+			return false;
+		}
+
+		if (shelf_x + padded_width > layer_width) {
+			shelf_y += shelf_height;
+			shelf_x = 0;
+			shelf_height = 0;
+		}	// start a new shelf above the current one
+		if (shelf_y + padded_height > max_size) {
+			++layers;
+			shelf_x = 0;
+			shelf_y = 0;
+			shelf_height = 0;
+		}	// start a new layer
+
+		entry->layer = layers - 1;
+		entry->x = shelf_x + ATLAS_GUTTER;
+		entry->y = shelf_y + ATLAS_GUTTER;
+
+		shelf_x += padded_width;
+		shelf_height = std::max(shelf_height, padded_height);
+		layer_height = std::max(layer_height, shelf_y + shelf_height);
+	}
+	return true;
+}
+
+/**
+ * Copy an image into its layer and fill its gutter by repeating the edge
+ * texels outwards, so filtering near the border never picks up a neighbour.
+ */
+static void atlas_blit(std::vector<unsigned char>& layer, int layer_width, int layer_height, const AtlasEntry& entry, const unsigned char* pixels) {
+	for (int row = -ATLAS_GUTTER; row < entry.height + ATLAS_GUTTER; ++row) {
+		int y = entry.y + row;
+		if (y < 0 || y >= layer_height)
+			continue;
+		int source_row = std::min(std::max(row, 0), entry.height - 1);
+
+		for (int column = -ATLAS_GUTTER; column < entry.width + ATLAS_GUTTER; ++column) {
+			int x = entry.x + column;
+			if (x < 0 || x >= layer_width)
+				continue;
+			int source_column = std::min(std::max(column, 0), entry.width - 1);
+
+			memcpy(&layer[((size_t)y * layer_width + x) * 3], &pixels[((size_t)source_row * entry.width + source_column) * 3], 3);
+		}
+	}
+}
+
+/**
+ * Read an offline pack. Fails (so the caller packs at load time) if the
+ * manifest is missing, lists different images, or a source image changed size.
+ */
+static bool atlas_load_manifest(const std::vector<std::string>& image_paths, const char* manifest_path) {
+	using namespace glob;
+
+	std::ifstream manifest(manifest_path);
+	if (!manifest.is_open())
+		return false;
+
+	std::string tag;
+	int version, layer_width, layer_height, layers, gutter, max_dimension;
+	manifest >> tag >> version >> layer_width >> layer_height >> layers >> gutter >> max_dimension;
+	if (tag != "atlas" || version != 2 || gutter != ATLAS_GUTTER || max_dimension != atlas_max_dimension)
+		return false;
+
+	std::vector<AtlasEntry> entries;
+	AtlasEntry entry;
+	while (manifest >> tag >> entry.layer >> entry.x >> entry.y >> entry.width >> entry.height >> entry.file_size) {
+		std::getline(manifest >> std::ws, entry.path);
+		if (tag != "image" || file_size(entry.path) != entry.file_size)
+			return false;
+		entries.push_back(entry);
+	}
+	if (entries.size() != image_paths.size())
+		return false;
+	for (const std::string& path : image_paths) {
+		if (std::none_of(entries.begin(), entries.end(), [&](const AtlasEntry& e) { return e.path == path; }))
+			return false;
+	}
+
+	std::vector<std::vector<unsigned char>> layer_texels(layers);
+	for (int layer = 0; layer < layers; ++layer) {
+		int width, height, channels;
+		stbi_set_flip_vertically_on_load(true);
+		unsigned char* pixels = stbi_load(layer_path(manifest_path, layer).c_str(), &width, &height, &channels, 3);
+		if (pixels == nullptr || width != layer_width || height != layer_height) {
+			stbi_image_free(pixels);
+			return false;
+		}
+		layer_texels[layer].assign(pixels, pixels + (size_t)width * height * 3);
+		stbi_image_free(pixels);
+	}
+
+	atlas_entries = entries;
+	atlas_layers.swap(layer_texels);
+	atlas_counters.layer_width = layer_width;
+	atlas_counters.layer_height = layer_height;
+	atlas_counters.layers = layers;
+	return true;
+}
+
+/**
+ * Decode every image and pack it into freshly allocated layers.
+ */
+static bool atlas_pack_images(const std::vector<std::string>& image_paths) {
+	using namespace glob;
+
+	int max_size;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+	std::vector<AtlasEntry> entries(image_paths.size());
+	std::vector<Image> images(image_paths.size());
+	bool ok = true;
+
+	for (size_t i = 0; i < image_paths.size() && ok; ++i) {
+		entries[i].path = image_paths[i];
+		entries[i].file_size = file_size(image_paths[i]);
+		ok = image_load(image_paths[i], images[i], atlas_max_dimension);			// Downscaled to the resolution policy before packing
+		entries[i].width = images[i].width;
+		entries[i].height = images[i].height;
+	}
+
+	int layer_width = 0, layer_height = 0, layers = 0;
+	if (ok)
+		ok = atlas_pack(entries, max_size, layer_width, layer_height, layers);
+
+	if (ok) {
+		std::vector<std::vector<unsigned char>> layer_texels(layers, std::vector<unsigned char>((size_t)layer_width * layer_height * 3, 0));
+		for (size_t i = 0; i < entries.size(); ++i)
+			atlas_blit(layer_texels[entries[i].layer], layer_width, layer_height, entries[i], images[i].texels.data());
+
+		atlas_entries = entries;
+		atlas_layers.swap(layer_texels);
+		atlas_counters.layer_width = layer_width;
+		atlas_counters.layer_height = layer_height;
+		atlas_counters.layers = layers;
+	}
+
+	return ok;
+}
+
+static void atlas_upload() {
+	using namespace glob;
+
+	if (atlas_texture_array == 0)
+		glGenTextures(1, &atlas_texture_array);										// Restreaming re-specifies the same texture
+	glBindTexture(GL_TEXTURE_2D_ARRAY, atlas_texture_array);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	// Neighbouring images must not wrap into each other
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	/**
+	 * Allocate every level for all layers, then fill them one layer at a time
+	 * from a mip chain built on the CPU, so only one chain is held at once.
+	 */
+	int width = atlas_counters.layer_width, height = atlas_counters.layer_height;
+	for (int level = 0; ; ++level) {
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGB, width, height, atlas_counters.layers, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		if (width == 1 && height == 1)
+			break;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);											// Rows of RGB texels are not padded to 4 bytes
+	for (int layer = 0; layer < atlas_counters.layers; ++layer) {
+		Image base;
+		base.width = atlas_counters.layer_width;
+		base.height = atlas_counters.layer_height;
+		base.texels.swap(atlas_layers[layer]);
+
+		std::vector<Image> levels;
+		image_build_mips(base, levels);
+
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, base.width, base.height, 1, GL_RGB, GL_UNSIGNED_BYTE, base.texels.data());
+		for (size_t level = 0; level < levels.size(); ++level)
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (int)level + 1, 0, 0, layer, levels[level].width, levels[level].height, 1, GL_RGB, GL_UNSIGNED_BYTE, levels[level].texels.data());
+
+		base.texels.swap(atlas_layers[layer]);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+static void atlas_measure() {
+	using namespace glob;
+
+	size_t total = (size_t)atlas_counters.layer_width * atlas_counters.layer_height * atlas_counters.layers;
+	atlas_counters.image_texels = 0;
+	atlas_counters.gutter_texels = 0;
+	for (const AtlasEntry& entry : atlas_entries) {
+		atlas_counters.image_texels += (size_t)entry.width * entry.height;
+		atlas_counters.gutter_texels += (size_t)(entry.width + 2 * ATLAS_GUTTER) * (entry.height + 2 * ATLAS_GUTTER) - (size_t)entry.width * entry.height;
+	}
+	atlas_counters.empty_texels = total - atlas_counters.image_texels - atlas_counters.gutter_texels;
+}
+
+static bool atlas_save(const char* manifest_path) {
+	using namespace glob;
+
+	std::ofstream manifest(manifest_path);
+	if (!manifest.is_open()) {
+		std::cerr << "ERROR::ATLAS::SAVE::CANNOT_OPEN " << manifest_path << std::endl;
+		return false;
+	}
+	manifest << "atlas 2 " << atlas_counters.layer_width << " " << atlas_counters.layer_height << " " << atlas_counters.layers << " " << ATLAS_GUTTER << " " << atlas_max_dimension << "\n";
+	for (const AtlasEntry& entry : atlas_entries)
+		manifest << "image " << entry.layer << " " << entry.x << " " << entry.y << " " << entry.width << " " << entry.height << " " << entry.file_size << " " << entry.path << "\n";
+
+	/**
+	 * PPM stores rows top to bottom while the layers are bottom to top.
+	 */
+	for (int layer = 0; layer < atlas_counters.layers; ++layer) {
+		FILE* file = fopen(layer_path(manifest_path, layer).c_str(), "wb");
+		if (file == nullptr) {
+			std::cerr << "ERROR::ATLAS::SAVE::CANNOT_OPEN " << layer_path(manifest_path, layer) << std::endl;
+			return false;
+		}
+		fprintf(file, "P6\n%d %d\n255\n", atlas_counters.layer_width, atlas_counters.layer_height);
+		size_t row_bytes = (size_t)atlas_counters.layer_width * 3;
+		for (int row = atlas_counters.layer_height - 1; row >= 0; --row)
+			fwrite(&atlas_layers[layer][row * row_bytes], 1, row_bytes, file);
+		fclose(file);
+	}
+	return true;
+}
+
+/**
+ * Residency callback: rebuild the layers from the same sources atlas_init used
+ * and re-specify the full chain in place. Packing is deterministic, so every
+ * region keeps its coordinates.
+ */
+static bool atlas_restream(unsigned int /*texture*/, const std::string& manifest_path) {
+	using namespace glob;
+
+	std::vector<std::string> image_paths;
+	for (const AtlasEntry& entry : atlas_entries)
+		image_paths.push_back(entry.path);
+
+	AtlasStats layout = atlas_counters;
+	bool ok = (!manifest_path.empty() && atlas_load_manifest(image_paths, manifest_path.c_str())) || atlas_pack_images(image_paths);
+	if (ok && (atlas_counters.layer_width != layout.layer_width || atlas_counters.layer_height != layout.layer_height || atlas_counters.layers != layout.layers)) {
+		std::cerr << "ERROR::ATLAS::RESTREAM::LAYOUT_CHANGED" << std::endl;
+		ok = false;
+	}
+	atlas_counters = layout;
+
+	if (ok)
+		atlas_upload();
+	atlas_layers.clear();
+	atlas_layers.shrink_to_fit();
+	return ok;
+}
+
+bool atlas_init(const std::vector<std::string>& image_paths, const char* manifest_path, bool save_pack) {
+	using namespace glob;
+
+	atlas_max_dimension = image_max_dimension();
+
+	bool offline = !save_pack && manifest_path != nullptr && atlas_load_manifest(image_paths, manifest_path);
+	if (!offline && !atlas_pack_images(image_paths))
+		return false;
+	if (save_pack && manifest_path != nullptr && atlas_save(manifest_path))
+		std::cout << "Texture atlas saved to " << manifest_path << std::endl;
+
+	atlas_upload();
+	atlas_measure();
+	atlas_layers.clear();														// Texels live in VRAM from here on
+	atlas_layers.shrink_to_fit();
+
+	residency_register(atlas_texture_array, GL_TEXTURE_2D_ARRAY, manifest_path != nullptr ? manifest_path : "", atlas_restream);
+
+	std::cout << "Texture atlas " << (offline ? "loaded from " : "packed at load") << (offline ? manifest_path : "") << std::endl;
+	return true;
+}
+
+AtlasRegion atlas_region(const char* image_path) {
+	using namespace glob;
+
+	AtlasRegion region;
+	for (const AtlasEntry& entry : atlas_entries) {
+		if (entry.path != image_path)
+			continue;
+
+		region.layer = entry.layer;
+		region.rect = glm::vec4(
+			(float)entry.x / atlas_counters.layer_width,
+			(float)entry.y / atlas_counters.layer_height,
+			(float)entry.width / atlas_counters.layer_width,
+			(float)entry.height / atlas_counters.layer_height);
+		return region;
+	}
+
+	std::cerr << "ERROR::ATLAS::REGION::IMAGE_NOT_PACKED " << image_path << std::endl;
+	return region;
+}
+
+unsigned int atlas_texture() {
+	return glob::atlas_texture_array;
+}
+
+AtlasStats atlas_stats() {
+	return glob::atlas_counters;
+}
+
+void atlas_report() {
+	AtlasStats stats = atlas_stats();
+	size_t total = stats.image_texels + stats.gutter_texels + stats.empty_texels;
+
+	std::cout << "Texture atlas: " << stats.layers << " layer(s) of " << stats.layer_width << "x" << stats.layer_height
+		<< ", " << glob::atlas_entries.size() << " images\n"
+		<< "\timages: " << 100.0 * stats.image_texels / total << "%, gutters: " << 100.0 * stats.gutter_texels / total
+		<< "%, empty: " << 100.0 * stats.empty_texels / total << "% ("
+		<< (stats.gutter_texels + stats.empty_texels) * 3 / (1024 * 1024) << " MiB of padding at level 0)" << std::endl;
+}
+
+void atlas_destroy() {
+	using namespace glob;
+
+	residency_unregister(atlas_texture_array);
+	glDeleteTextures(1, &atlas_texture_array);
+	atlas_texture_array = 0;
+	atlas_entries.clear();
+}
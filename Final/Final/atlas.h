@@ -0,0 +1,54 @@
+#pragma once
+#ifndef __ATLAS_H__
+#define __ATLAS_H__
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+const int ATLAS_GUTTER = 16;				// Edge-extended border around every image, protects the first 4 mip levels from bleeding
+
+/**
+ * Where one source image ended up in the atlas texture array.
+ *
+ *	rect.xy is the offset and rect.zw the scale that map the image's original
+ *	[0, 1] texture coordinates into its layer: uv' = rect.xy + uv * rect.zw.
+ */
+struct atlas_region {
+	int layer = -1;							// -1 if the image is not in the atlas
+	glm::vec4 rect = glm::vec4(0.f, 0.f, 1.f, 1.f);
+};
+typedef struct atlas_region AtlasRegion;
+
+/**
+ * Texel accounting for the packed layers.
+ */
+struct atlas_statistics {
+	int layer_width;
+	int layer_height;
+	int layers;
+	size_t image_texels;					// texels covered by source images
+	size_t gutter_texels;					// texels spent on borders
+	size_t empty_texels;					// texels no image or border uses
+};
+typedef struct atlas_statistics AtlasStats;
+
+/**
+ * Build the atlas texture array from the given images. If manifest_path names
+ * an up-to-date offline pack its layers are loaded directly; otherwise the
+ * images are decoded and packed at load time. With save_pack set, a fresh pack
+ * is written to manifest_path (plus one .ppm per layer) for later launches.
+ * Images larger than image_max_dimension() are downscaled before packing.
+ */
+bool atlas_init(const std::vector<std::string>& image_paths, const char* manifest_path, bool save_pack = false);
+
+AtlasRegion atlas_region(const char* image_path);
+
+unsigned int atlas_texture();				// GL_TEXTURE_2D_ARRAY handle
+
+AtlasStats atlas_stats();
+
+void atlas_report();						// Print layer size and padding waste
+
+void atlas_destroy();
+#endif//__ATLAS_H__
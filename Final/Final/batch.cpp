@@ -0,0 +1,425 @@
+#include <GLEW/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "batch.h"
+
+#include "shader.h"
+
+#include "ring.h"
+
+#include "residency.h"
+
+#include "lightbuffer.h"
+
+#include "clusters.h"
+
+#include "shadows.h"
+
+#include "deferred.h"
+
+/**
+ * Matches DrawElementsIndirectCommand from the GL spec.
+ */
+struct draw_command {
+	unsigned int count;
+	unsigned int instance_count;
+	unsigned int first_index;
+	int base_vertex;
+	unsigned int base_instance;
+};
+
+/**
+ * Per-draw data read by shaders/batched.*.glsl through gl_DrawIDARB. Layout
+ * follows std430: two mat4, two vec4 and four scalars is 176 bytes.
+ * light_list indexes the draw's entry in the light list buffer: a count
+ * followed by that many indices into the light buffer (see lightbuffer.h).
+ * It is -1 when the fragment shader reads its lights from the clusters.
+ */
+struct draw_data {
+	glm::mat4 model;
+	glm::mat4 normal_model;
+	glm::vec4 diffuse_region;
+	glm::vec4 specular_region;
+	int diffuse_layer;
+	int specular_layer;
+	float specular_strength;
+	int light_list;
+};
+
+namespace glob {
+	Shader* batched_shader = nullptr;
+	bool batch_available = false;
+
+	int storage_alignment = 256;				// GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+
+	std::vector<BatchItem> batch_items;
+}
+
+bool batch_init() {
+	using namespace glob;
+
+	/**
+	 * gl_DrawID is only core in 4.6, so the shaders always rely on
+	 * ARB_shader_draw_parameters. The shaders are GLSL 4.30 for their SSBOs
+	 * and binding qualifiers, so a context with glMultiDrawElementsIndirect
+	 * and SSBOs only as extensions falls back rather than failing to compile.
+	 */
+	batch_available = GLEW_VERSION_4_3 && GLEW_ARB_shader_draw_parameters;
+	if (!batch_available) {
+		std::cout << "Multi-draw indirect unavailable, drawing one Model per call" << std::endl;
+		return false;
+	}
+
+	/**
+	 * Like the lit variants, the fragment shader takes its lights from the
+	 * clusters whenever they are enabled.
+	 */
+	std::string defines = clusters_enabled() ? "#define LIGHT_CLUSTERS\n" + cluster_defines() : "";
+	if (shadows_enabled())
+		defines += shadow_defines();
+	batched_shader = new Shader("shaders/batched.vs.glsl", "shaders/batched.fs.glsl", nullptr, defines);
+
+	batched_shader->use();
+	batched_shader->setInt("atlas", 0);			// Every diffuse and specular map lives in one texture array
+
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_alignment);	// Per-draw data is bound from the frame ring at this alignment
+
+	return true;
+}
+
+bool batch_supported() {
+	return glob::batch_available;
+}
+
+void batch_begin() {
+	glob::batch_items.clear();
+}
+
+void batch_add(const Model& model, const Material* material) {
+	glob::batch_items.push_back({ &model, material });
+}
+
+BatchStats batch_submit(glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos) {
+	using namespace glob;
+
+	BatchStats stats = { (unsigned int)batch_items.size(), 0, 0, 0 };
+
+	/**
+	 * Cull on the CPU and fill the command and per-draw arrays with what
+	 * survives. Every batched mesh lives in the textured format, so a single
+	 * multi-draw covers the whole list; Models moved to another format (baked
+	 * ones, see lightmap.h) are drawn one by one instead.
+	 */
+	Frustum frustum = geometry_frustum(projection * view);
+
+	std::vector<draw_command> commands;
+	std::vector<draw_data> draws;
+	std::vector<int> light_lists;
+	bool clustered = clusters_enabled();
+	unsigned int atlas = 0;
+	commands.reserve(batch_items.size());
+	draws.reserve(batch_items.size());
+
+	for (const BatchItem& item : batch_items) {
+		const Model& model = *item.model;
+		if (model.mesh.index_count == 0)
+			continue;
+		if (!geometry_visible(frustum, model.mesh, model.model)) {
+			++stats.culled;
+			continue;
+		}
+		if (model.mesh.format != VERTEX_FORMAT_TEXTURED) {
+			if (item.material)
+				draw_material_model(model, *item.material, projection, view, dir_light, viewPos);
+			else
+				draw_model(model, projection, view, dir_light, viewPos);
+			++stats.drawn;
+			++stats.draw_calls;
+			continue;
+		}
+		if (commands.size() == BATCH_MAX_DRAWS) {
+			std::cerr << "ERROR::BATCH::SUBMIT::TOO_MANY_DRAWS" << std::endl;
+			break;
+		}
+
+		if (atlas == 0)
+			atlas = model.texture;
+		if (model.texture != atlas || (item.material && item.material->specular_map != atlas)) {
+			std::cerr << "ERROR::BATCH::SUBMIT::TEXTURE_NOT_IN_ATLAS" << std::endl;
+			continue;
+		}	// one texture array binding covers the whole batch
+
+		draw_data draw;
+		draw.model = model.model;
+		draw.normal_model = glm::mat4(glm::mat3(glm::transpose(glm::inverse(model.model))));
+		draw.diffuse_region = model.texture_region;
+		draw.specular_region = item.material ? item.material->specular_region : glm::vec4(0.f, 0.f, 1.f, 1.f);
+		draw.diffuse_layer = model.texture_layer;
+		draw.specular_layer = item.material ? item.material->specular_layer : -1;
+		draw.specular_strength = item.material ? item.material->shine : model.shine;
+
+		/**
+		 * Without clusters: lights reaching the Model's bounding sphere,
+		 * capped so every draw shades at most MAX_LIGHTS_PER_DRAW of them.
+		 */
+		draw.light_list = -1;
+		if (!clustered) {
+			glm::vec3 center;
+			float radius;
+			int indices[MAX_LIGHTS_PER_DRAW];
+			geometry_world_sphere(model.mesh, model.model, center, radius);
+			int light_count = lightbuffer_select(center, radius, indices);
+			draw.light_list = (int)light_lists.size();
+			light_lists.push_back(light_count);
+			light_lists.insert(light_lists.end(), indices, indices + light_count);
+		}
+
+		commands.push_back({ model.mesh.index_count, 1, model.mesh.first_index, (int)model.mesh.base_vertex, 0 });
+		draws.push_back(draw);
+	}
+
+	stats.drawn += (unsigned int)commands.size();
+	if (commands.empty())
+		return stats;
+
+	/**
+	 * Stream commands and per-draw data through this frame's section of the
+	 * ring buffer, so neither write waits on draws from earlier frames.
+	 */
+	RingAllocation command_slice = ring_alloc(commands.size() * sizeof(draw_command), sizeof(unsigned int));
+	RingAllocation draw_slice = ring_alloc(draws.size() * sizeof(draw_data), storage_alignment);
+	RingAllocation light_slice = {};
+	if (!clustered)
+		light_slice = ring_alloc(light_lists.size() * sizeof(int), storage_alignment);
+	if (command_slice.ptr == nullptr || draw_slice.ptr == nullptr || (!clustered && light_slice.ptr == nullptr))
+		return stats;
+
+	memcpy(command_slice.ptr, commands.data(), command_slice.size);
+	memcpy(draw_slice.ptr, draws.data(), draw_slice.size);
+	ring_commit(command_slice);
+	ring_commit(draw_slice);
+	if (!clustered) {
+		memcpy(light_slice.ptr, light_lists.data(), light_slice.size);
+		ring_commit(light_slice);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, atlas);
+	residency_touch(atlas);														// Only reached when at least one draw survived culling
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_slice.buffer);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, draw_slice.buffer, draw_slice.offset, draw_slice.size);
+	if (!clustered)
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, light_slice.buffer, light_slice.offset, light_slice.size);
+
+	batched_shader->use();
+	lightbuffer_bind(batched_shader);
+	if (clustered)
+		clusters_bind(batched_shader);
+	if (shadows_enabled())
+		shadows_bind(batched_shader);
+	batched_shader->setFloat("ambientStrength", ambient_strength);
+	batched_shader->setVec3("dirLight.direction", dir_light.direction);
+	batched_shader->setVec3("dirLight.color", dir_light.color);
+	batched_shader->setVec3("viewPos", viewPos);
+	batched_shader->setMat4("projection", projection);
+	batched_shader->setMat4("view", view);
+
+	geometry_bind(VERTEX_FORMAT_TEXTURED);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)command_slice.offset, (int)commands.size(), 0);
+	++stats.draw_calls;
+
+	return stats;
+}
+
+void batch_benchmark(const std::vector<BatchItem>& items, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos, int frames) {
+	if (!glob::batch_available) {
+		std::cout << "Batching benchmark skipped: multi-draw indirect unavailable" << std::endl;
+		return;
+	}
+
+	unsigned int query;
+	glGenQueries(1, &query);
+
+	/**
+	 * Time each path over the same frames. glFinish brackets the CPU timer so
+	 * queued work from the other path is not counted, and a GL_TIME_ELAPSED
+	 * query measures the GPU side.
+	 */
+	for (int path = 0; path < 2; ++path) {
+		glFinish();
+		auto start = std::chrono::high_resolution_clock::now();
+		unsigned long long gpu_ns = 0;
+
+		for (int frame = 0; frame < frames; ++frame) {
+			ring_begin_frame();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glBeginQuery(GL_TIME_ELAPSED, query);
+
+			if (path == 0) {
+				for (const BatchItem& item : items) {
+					if (item.material)
+						draw_material_model(*item.model, *item.material, projection, view, dir_light, viewPos);
+					else
+						draw_model(*item.model, projection, view, dir_light, viewPos);
+				}
+			}	// one call per Model
+			else {
+				batch_begin();
+				for (const BatchItem& item : items)
+					batch_add(*item.model, item.material);
+				batch_submit(projection, view, dir_light, viewPos);
+			}	// one multi-draw
+
+			glEndQuery(GL_TIME_ELAPSED);
+			ring_end_frame();
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			gpu_ns += elapsed;
+		}
+
+		glFinish();
+		double cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		std::cout << (path == 0 ? "Per-Model draws:  " : "Multi-draw batch: ")
+			<< cpu_ms / frames << " ms/frame wall, "
+			<< gpu_ns / 1e6 / frames << " ms/frame GPU ("
+			<< (path == 0 ? items.size() : 1) << " draw calls)" << std::endl;
+	}
+
+	glDeleteQueries(1, &query);
+}
+
+void batch_benchmark_lights(const std::vector<BatchItem>& items, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos, int frames) {
+	const unsigned int light_counts[] = { 1, 10, 100, 1000, 10000 };
+
+	/**
+	 * Scatter lights over a box around every item's bounding sphere, each
+	 * reaching about a quarter of the box so most draws see many candidates.
+	 */
+	glm::vec3 low = glm::vec3(1e30f), high = glm::vec3(-1e30f);
+	for (const BatchItem& item : items) {
+		glm::vec3 center;
+		float radius;
+		geometry_world_sphere(item.model->mesh, item.model->model, center, radius);
+		low = glm::min(low, center - radius);
+		high = glm::max(high, center + radius);
+	}
+	float reach = glm::length(high - low) / 4.f;
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	unsigned int scene_lights = lightbuffer_count();
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);				// Clusters are rebuilt every frame, as the render loop does
+
+	unsigned int query;
+	glGenQueries(1, &query);
+
+	for (unsigned int count : light_counts) {
+		lightbuffer_truncate(scene_lights);
+		while (lightbuffer_count() < count) {
+			glm::vec3 position = low + glm::vec3(unit(random), unit(random), unit(random)) * (high - low);
+			glm::vec3 color = glm::vec3(unit(random), unit(random), unit(random)) * 0.5f + 0.25f;
+			float intensity = std::max(color.r, std::max(color.g, color.b));
+			glm::vec3 attenuation = glm::vec3(1.f, 0.f, (intensity / LIGHT_CUTOFF - 1.f) / (reach * reach));
+			int added = unit(random) < 0.25f
+				? lightbuffer_add_spot(position, glm::vec3(0.f, -1.f, 0.f), color, attenuation, 20.f, 30.f)
+				: lightbuffer_add_point(position, color, attenuation);
+			if (added < 0)
+				break;
+		}
+		if (lightbuffer_count() < count)
+			break;
+
+		auto upload_start = std::chrono::high_resolution_clock::now();
+		lightbuffer_upload();
+		glFinish();
+		double upload_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - upload_start).count();
+
+		for (int path = glob::batch_available ? 0 : 1; path < (deferred_enabled() ? 3 : 2); ++path) {
+			LightBufferStats before = lightbuffer_stats();
+			ClusterStats clusters_before = clusters_stats();
+			glFinish();
+			auto start = std::chrono::high_resolution_clock::now();
+			unsigned long long gpu_ns = 0;
+
+			for (int frame = 0; frame < frames; ++frame) {
+				ring_begin_frame();
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				clusters_invalidate();			// time a full assignment every frame, as a moving camera would
+				clusters_build(projection, view, viewport[2], viewport[3]);
+
+				if (path == 0) {
+					batch_begin();
+					for (const BatchItem& item : items)
+						batch_add(*item.model, item.material);
+					batch_submit(projection, view, dir_light, viewPos);
+				}
+				else if (path == 1) {
+					for (const BatchItem& item : items) {
+						if (item.material)
+							draw_material_model(*item.model, *item.material, projection, view, dir_light, viewPos);
+						else
+							draw_model(*item.model, projection, view, dir_light, viewPos);
+					}
+				}
+				else {
+					deferred_begin(viewport[2], viewport[3]);
+					for (const BatchItem& item : items)
+						deferred_draw(*item.model, item.material, projection, view);
+					deferred_end(projection, view, dir_light, viewPos);
+				}
+
+				glEndQuery(GL_TIME_ELAPSED);
+				ring_end_frame();
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+				gpu_ns += elapsed;
+			}
+
+			glFinish();
+			double cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			LightBufferStats after = lightbuffer_stats();
+			ClusterStats clusters_after = clusters_stats();
+			unsigned long long selections = after.selections - before.selections;
+
+			const char* names[3] = { "multi-draw batch: ", "per-Model draws:  ", "deferred:         " };
+			std::cout << count << " lights, " << names[path]
+				<< cpu_ms / frames << " ms/frame wall, " << gpu_ns / 1e6 / frames << " ms/frame GPU, ";
+			if (clusters_enabled())
+				std::cout << (clusters_after.build_ms - clusters_before.build_ms) / frames << " ms/frame clustering, "
+					<< (double)clusters_after.light_refs / CLUSTER_COUNT << " lights per cluster ("
+					<< (clusters_after.occupied ? (double)clusters_after.light_refs / clusters_after.occupied : 0.0) << " per occupied, "
+					<< clusters_after.full << " capped)";
+			else
+				std::cout << (after.select_ms - before.select_ms) / frames << " ms/frame selecting, "
+					<< (selections ? (double)(after.selected - before.selected) / selections : 0.0) << " lights per draw";
+			std::cout << " (upload " << upload_ms << " ms)" << std::endl;
+		}
+	}
+
+	glDeleteQueries(1, &query);
+	lightbuffer_truncate(scene_lights);
+	lightbuffer_upload();
+}
+
+void batch_destroy() {
+	using namespace glob;
+
+	if (!batch_available)
+		return;
+
+	glDeleteProgram(batched_shader->ID);
+	delete batched_shader;
+	batched_shader = nullptr;
+	batch_available = false;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "models.h"
+
+const int BATCH_MAX_DRAWS = 256;			// Capacity of the indirect command and per-draw buffers
+
+/**
+ * One object queued for the batched path. material may be nullptr for models
+ * drawn with draw_model (no specular map).
+ */
+struct batch_item {
+	const Model* model;
+	const Material* material;
+};
+typedef struct batch_item BatchItem;
+
+/**
+ * Counters for the last batch_submit call.
+ */
+struct batch_stats {
+	unsigned int queued;		// Items added since batch_begin
+	unsigned int culled;		// Items rejected by frustum culling
+	unsigned int drawn;			// Commands written to the indirect buffer
+	unsigned int draw_calls;	// glMultiDrawElementsIndirect calls issued
+};
+typedef struct batch_stats BatchStats;
+
+bool batch_init();					// Returns false (and leaves the batched path disabled) without GL 4.3 and ARB_shader_draw_parameters
+
+bool batch_supported();
+
+void batch_begin();
+
+void batch_add(const Model& model, const Material* material = nullptr);
+
+BatchStats batch_submit(glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos);
+
+/**
+ * Render the same items frames times through each path (one draw call per
+ * Model, then one glMultiDrawElementsIndirect) and print CPU and GPU time
+ * per frame for both.
+ */
+void batch_benchmark(const std::vector<BatchItem>& items, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos, int frames);
+
+/**
+ * Sweep the light buffer from its current lights up to 10k (random point and
+ * spot lights spread over the items' bounds) and print per-frame CPU, GPU and
+ * clustering (or per-draw light selection) time for each path (plus deferred
+ * shading when it is enabled), with the average
+ * lights per cluster. The extra lights are removed afterwards.
+ */
+void batch_benchmark_lights(const std::vector<BatchItem>& items, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos, int frames);
+
+void batch_destroy();
+#endif//__BATCH_H__
@@ -0,0 +1,371 @@
+#include <GLEW/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "capture.h"
+
+#include "image.h"
+
+/**
+ * One pixel pack buffer and the readback last issued into it.
+ */
+struct capture_slot {
+	unsigned int buffer = 0;
+	size_t size = 0;						// bytes allocated
+	GLsync fence = 0;						// 0 while the slot holds no frame
+	unsigned long long frame = 0;
+	int x = 0;								// where the read pixels go in the frame
+	int y = 0;
+	int width = 0;
+	int height = 0;
+};
+typedef struct capture_slot CaptureSlot;
+
+/**
+ * A frame being copied out of its slots, then waiting for an encoder. RGBA
+ * rows run bottom to top.
+ */
+struct capture_job {
+	unsigned long long frame;
+	int width;
+	int height;
+	std::vector<unsigned char> pixels;
+	int pending;							// readbacks not yet copied in
+	bool closed;							// capture_end_frame was called, so no more readbacks will come
+};
+typedef struct capture_job CaptureJob;
+
+namespace glob {
+	bool capture_on = false;
+	std::string capture_directory;
+	CaptureSlot capture_slots[CAPTURE_SLOTS];
+	int capture_next = 0;					// slot the next readback goes to; also the oldest one in use
+	std::deque<CaptureJob> capture_assembling;	// frames with readbacks in flight, oldest first
+
+	std::mutex capture_lock;				// guards everything below and the encoder counters
+	std::condition_variable capture_ready;	// a job was queued, or the encoders should stop
+	std::condition_variable capture_space;	// a job was taken or finished
+	std::deque<CaptureJob> capture_queue;
+	std::vector<std::vector<unsigned char>> capture_free;	// pixel storage of written frames, reused
+	int capture_busy = 0;					// encoders working on a job
+	bool capture_stopping = false;
+	std::vector<std::thread> capture_encoders;
+
+	CaptureStats capture_counters;
+}
+
+/**
+ * Encoder thread: drop the alpha channel, write the file, hand the storage
+ * back.
+ */
+static void encode_frames() {
+	using namespace glob;
+
+	std::unique_lock<std::mutex> lock(capture_lock);
+	for (;;) {
+		capture_ready.wait(lock, [] { return capture_stopping || !capture_queue.empty(); });
+		if (capture_queue.empty())
+			return;							// stopping, and nothing is left to write
+		CaptureJob job = std::move(capture_queue.front());
+		capture_queue.pop_front();
+		++capture_busy;
+		capture_space.notify_all();
+		lock.unlock();
+
+		auto start = std::chrono::high_resolution_clock::now();
+		Image image;
+		image.width = job.width;
+		image.height = job.height;
+		image.texels.resize((size_t)job.width * job.height * 3);
+		for (size_t i = 0, pixels = (size_t)job.width * job.height; i < pixels; ++i) {
+			image.texels[i * 3] = job.pixels[i * 4];
+			image.texels[i * 3 + 1] = job.pixels[i * 4 + 1];
+			image.texels[i * 3 + 2] = job.pixels[i * 4 + 2];
+		}
+
+		char name[32];
+		snprintf(name, sizeof(name), "/frame_%06llu.%s", job.frame, capture_counters.format == CAPTURE_FORMAT_PNG ? "png" : "ppm");
+		std::string path = capture_directory + name;
+		bool written = capture_counters.format == CAPTURE_FORMAT_PNG ? image_save_png(image, path.c_str()) : image_save_ppm(image, path.c_str());
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		lock.lock();
+		--capture_busy;
+		capture_counters.encode_ms += ms;
+		if (written) {
+			++capture_counters.frames_written;
+			capture_counters.bytes_written += image.texels.size();
+		}
+		else
+			++capture_counters.failures;
+		capture_free.push_back(std::move(job.pixels));
+		capture_space.notify_all();
+	}
+}
+
+bool capture_init(const std::string& directory, capture_format format, int encoders) {
+	using namespace glob;
+
+	if (capture_on)
+		capture_destroy();
+
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+	FILE* probe = fopen((directory + "/.capture").c_str(), "wb");
+	if (probe == nullptr) {
+		std::cerr << "ERROR::CAPTURE::DIRECTORY_NOT_WRITABLE " << directory << std::endl;
+		return false;
+	}
+	fclose(probe);
+	remove((directory + "/.capture").c_str());
+
+	if (encoders <= 0)
+		encoders = std::min(CAPTURE_MAX_ENCODERS, std::max(1, (int)std::thread::hardware_concurrency() - 1));
+
+	capture_counters = CaptureStats();
+	capture_counters.format = format;
+	capture_counters.encoders = encoders;
+	capture_directory = directory;
+	capture_next = 0;
+	capture_stopping = false;
+	for (CaptureSlot& slot : capture_slots) {
+		slot = CaptureSlot();
+		glGenBuffers(1, &slot.buffer);
+	}
+	for (int i = 0; i < encoders; ++i)
+		capture_encoders.emplace_back(encode_frames);
+
+	capture_on = true;
+	return true;
+}
+
+bool capture_enabled() {
+	return glob::capture_on;
+}
+
+/**
+ * Copy the pixels read into slot into their frame, waiting for the readback
+ * if the GPU has not finished it.
+ */
+static void retire_slot(CaptureSlot& slot) {
+	using namespace glob;
+
+	if (slot.fence == 0)
+		return;
+
+	GLenum status = glClientWaitSync(slot.fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		auto start = std::chrono::high_resolution_clock::now();
+		do {
+			status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);	// 1 ms per wait
+		} while (status == GL_TIMEOUT_EXPIRED);
+
+		++capture_counters.fence_waits;
+		capture_counters.fence_wait_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	if (status == GL_WAIT_FAILED)
+		std::cerr << "ERROR::CAPTURE::FENCE_WAIT_FAILED" << std::endl;
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	CaptureJob* job = nullptr;
+	for (CaptureJob& assembling : capture_assembling) {
+		if (assembling.frame == slot.frame)
+			job = &assembling;
+	}
+	if (job == nullptr)
+		return;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	const unsigned char* mapped = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (size_t)slot.width * slot.height * 4, GL_MAP_READ_BIT);
+	if (mapped != nullptr) {
+		size_t row_bytes = (size_t)slot.width * 4;
+		for (int row = 0; row < slot.height; ++row)
+			memcpy(&job->pixels[((size_t)(slot.y + row) * job->width + slot.x) * 4], mapped + row * row_bytes, row_bytes);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else {
+		std::cerr << "ERROR::CAPTURE::MAP_FAILED" << std::endl;
+		std::lock_guard<std::mutex> lock(capture_lock);
+		++capture_counters.failures;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	--job->pending;
+}
+
+/**
+ * Hand the oldest frames to the encoders once every readback of theirs is
+ * copied in, waiting for room in the queue if the encoders are behind.
+ */
+static void queue_finished() {
+	using namespace glob;
+
+	while (!capture_assembling.empty() && capture_assembling.front().closed && capture_assembling.front().pending == 0) {
+		std::unique_lock<std::mutex> lock(capture_lock);
+		if (capture_queue.size() >= CAPTURE_QUEUE_FRAMES) {
+			auto start = std::chrono::high_resolution_clock::now();
+			capture_space.wait(lock, [] { return capture_queue.size() < CAPTURE_QUEUE_FRAMES; });
+			++capture_counters.backpressure_waits;
+			capture_counters.backpressure_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+		capture_queue.push_back(std::move(capture_assembling.front()));
+		capture_assembling.pop_front();
+		capture_counters.queue_peak = std::max(capture_counters.queue_peak, capture_queue.size());
+		capture_ready.notify_one();
+	}
+}
+
+void capture_begin_frame(int width, int height) {
+	using namespace glob;
+
+	if (!capture_on)
+		return;
+
+	CaptureJob job;
+	job.frame = capture_counters.frames_read++;
+	job.width = width;
+	job.height = height;
+	job.pending = 0;
+	job.closed = false;
+	{
+		std::lock_guard<std::mutex> lock(capture_lock);
+		if (!capture_free.empty()) {
+			job.pixels = std::move(capture_free.back());
+			capture_free.pop_back();
+		}
+	}
+	job.pixels.resize((size_t)width * height * 4);
+	capture_assembling.push_back(std::move(job));
+}
+
+void capture_tile(int x, int y, int width, int height) {
+	using namespace glob;
+
+	if (!capture_on || capture_assembling.empty() || capture_assembling.back().closed || width <= 0 || height <= 0)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	CaptureSlot& slot = capture_slots[capture_next];
+	retire_slot(slot);						// read CAPTURE_SLOTS readbacks ago, so normally long finished
+	queue_finished();
+
+	/**
+	 * RGBA rows are 4-byte aligned, the layout drivers read back without
+	 * converting; encoders drop the alpha.
+	 */
+	size_t bytes = (size_t)width * height * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	if (slot.size < bytes) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+		slot.size = bytes;
+	}
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);	// into the buffer, returns without waiting
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frame = capture_assembling.back().frame;
+	slot.x = x;
+	slot.y = y;
+	slot.width = width;
+	slot.height = height;
+	++capture_assembling.back().pending;
+	++capture_counters.readbacks;
+	capture_next = (capture_next + 1) % CAPTURE_SLOTS;
+
+	capture_counters.render_thread_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void capture_end_frame() {
+	using namespace glob;
+
+	if (!capture_on || capture_assembling.empty())
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	capture_assembling.back().closed = true;
+	queue_finished();
+	capture_counters.render_thread_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void capture_frame(int width, int height) {
+	capture_begin_frame(width, height);
+	capture_tile(0, 0, width, height);
+	capture_end_frame();
+}
+
+void capture_flush() {
+	using namespace glob;
+
+	if (!capture_on)
+		return;
+
+	for (int i = 0; i < CAPTURE_SLOTS; ++i)
+		retire_slot(capture_slots[(capture_next + i) % CAPTURE_SLOTS]);	// oldest first
+	for (CaptureJob& job : capture_assembling)
+		job.closed = true;					// a frame left open has had all the readbacks it will get
+	queue_finished();
+
+	std::unique_lock<std::mutex> lock(capture_lock);
+	capture_space.wait(lock, [] { return capture_queue.empty() && capture_busy == 0; });
+}
+
+CaptureStats capture_stats() {
+	std::lock_guard<std::mutex> lock(glob::capture_lock);
+	return glob::capture_counters;
+}
+
+void capture_report() {
+	if (!glob::capture_on)
+		return;
+
+	CaptureStats stats = capture_stats();
+	std::cout << "Frame capture: " << stats.frames_written << " of " << stats.frames_read << " frames written to " << glob::capture_directory << "/ as "
+		<< (stats.format == CAPTURE_FORMAT_PNG ? "PNG" : "PPM") << " by " << stats.encoders << " encoder thread(s), " << stats.bytes_written / (1024.0 * 1024.0)
+		<< " MiB, " << stats.failures << " failures\n"
+		<< "\t" << stats.readbacks << " readbacks, render thread " << (stats.frames_read ? stats.render_thread_ms / stats.frames_read : 0.0) << " ms per frame, " << stats.fence_waits
+		<< " fence waits (" << stats.fence_wait_ms << " ms), " << stats.backpressure_waits << " waits on a full queue (" << stats.backpressure_ms << " ms), queue peak "
+		<< stats.queue_peak << " of " << CAPTURE_QUEUE_FRAMES << ", " << (stats.frames_written ? stats.encode_ms / stats.frames_written : 0.0)
+		<< " ms encoding per frame" << std::endl;
+}
+
+void capture_destroy() {
+	using namespace glob;
+
+	if (!capture_on)
+		return;
+
+	capture_flush();
+	{
+		std::lock_guard<std::mutex> lock(capture_lock);
+		capture_stopping = true;
+	}
+	capture_ready.notify_all();
+	for (std::thread& encoder : capture_encoders)
+		encoder.join();
+	capture_encoders.clear();
+	capture_assembling.clear();
+	capture_free.clear();
+
+	for (CaptureSlot& slot : capture_slots) {
+		glDeleteBuffers(1, &slot.buffer);
+		slot = CaptureSlot();
+	}
+	capture_on = false;
+}
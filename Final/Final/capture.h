@@ -0,0 +1,78 @@
+#pragma once
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <cstddef>
+#include <string>
+
+const int CAPTURE_SLOTS = 3;				// Pixel buffers readbacks rotate through, so a frame is mapped two frames after it was read
+const int CAPTURE_QUEUE_FRAMES = 8;			// Frames waiting for an encoder before capture_frame blocks
+const int CAPTURE_MAX_ENCODERS = 4;			// Encoder threads at most, however many cores there are
+
+enum capture_format {
+	CAPTURE_FORMAT_PPM,						// no encoding at all, the fastest to write
+	CAPTURE_FORMAT_PNG
+};
+
+/**
+ * Counters since capture_init. Render thread time is what capture_frame cost
+ * the frame: issuing the readback, mapping the slot it reuses and copying it
+ * out, plus any waiting.
+ */
+struct capture_statistics {
+	capture_format format;
+	int encoders;
+	unsigned long long frames_read;			// frames begun
+	unsigned long long readbacks;			// one per frame, or per tile of tiled frames
+	unsigned long long frames_written;
+	unsigned long long failures;			// frames an encoder could not write
+	size_t bytes_written;
+	double render_thread_ms;
+	unsigned long long fence_waits;			// slots mapped before the GPU had finished their readback
+	double fence_wait_ms;
+	unsigned long long backpressure_waits;	// capture_frame calls that blocked on a full queue
+	double backpressure_ms;
+	size_t queue_peak;
+	double encode_ms;						// summed over encoders
+};
+typedef struct capture_statistics CaptureStats;
+
+/**
+ * Dump every frame to directory (created if missing) as frame_000000.ppm or
+ * .png and so on. Readbacks go through CAPTURE_SLOTS pixel pack buffers with
+ * a fence each, so glReadPixels returns at once and the frame is copied out
+ * only after the GPU has written it. Encoding and writing run on encoders
+ * threads (one per core but the render thread's if <= 0); when they fall
+ * CAPTURE_QUEUE_FRAMES frames behind, capture_frame waits for them rather
+ * than dropping frames or growing without bound.
+ */
+bool capture_init(const std::string& directory, capture_format format, int encoders = 0);
+
+bool capture_enabled();
+
+/**
+ * Queue the lower left width x height pixels of the bound read buffer. Call
+ * after drawing, before swapping buffers.
+ */
+void capture_frame(int width, int height);
+
+/**
+ * Frames drawn in tiles: capture_begin_frame opens a width x height frame,
+ * each capture_tile reads the bound read buffer's lower left width x height
+ * pixels into it at (x, y), and the frame is queued once capture_end_frame
+ * has been called and every tile has been copied in.
+ */
+void capture_begin_frame(int width, int height);
+
+void capture_tile(int x, int y, int width, int height);
+
+void capture_end_frame();
+
+void capture_flush();						// Hand the frames still in pixel buffers to the encoders and wait until all are written
+
+CaptureStats capture_stats();
+
+void capture_report();
+
+void capture_destroy();						// Flush, stop the encoders and release the pixel buffers
+#endif//__CAPTURE_H__
@@ -0,0 +1,424 @@
+#include <GLEW/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "clusters.h"
+
+#include "lightbuffer.h"
+
+const int CLUSTER_COMPUTE_GROUP = 64;		// local_size_x of shaders/clusters.cs.glsl
+
+namespace glob {
+	bool clusters_active = false;
+	bool clusters_compute = false;
+	int cluster_calibrations = 0;				// builds left that time both assigners
+
+	unsigned int cluster_grid_buffer = 0;
+	unsigned int cluster_grid_texture = 0;
+	unsigned int cluster_index_buffer = 0;
+	unsigned int cluster_index_texture = 0;
+	unsigned int cluster_bounds_buffer = 0;		// compute path only
+	Shader* cluster_shader = nullptr;
+
+	/**
+	 * View-space bounding box of every cluster, as low/high pairs (the
+	 * std430 layout of ClusterBounds in shaders/clusters.cs.glsl).
+	 */
+	std::vector<glm::vec4> cluster_bounds;
+	glm::mat4 cluster_projection = glm::mat4(0.f);
+	glm::vec2 cluster_tile_size = glm::vec2(1.f);
+	float cluster_near = 0.1f;
+	float cluster_far = 100.f;
+
+	std::vector<unsigned int> cluster_grid;			// offset and count per cluster
+	std::vector<unsigned int> cluster_slots;		// CPU path: MAX_LIGHTS_PER_CLUSTER indices per cluster
+	std::vector<unsigned int> cluster_indices;		// CPU path: slots packed for upload
+	bool cluster_grid_stale = false;				// compute path: cluster_grid not read back since the last build
+
+	/**
+	 * What the current assignment was built for; a build with all of it
+	 * unchanged keeps the lists as they are.
+	 */
+	bool cluster_assigned = false;
+	glm::mat4 cluster_view = glm::mat4(0.f);
+	int cluster_width = 0;
+	int cluster_height = 0;
+	unsigned long long cluster_light_version = 0;
+
+	ClusterStats cluster_counters;
+}
+
+void clusters_init(bool use_compute) {
+	using namespace glob;
+
+	clusters_compute = use_compute && GLEW_VERSION_4_3;			// shaders/clusters.cs.glsl is GLSL 4.30
+	cluster_calibrations = clusters_compute ? CLUSTER_CALIBRATION_BUILDS : 0;
+
+	glGenBuffers(1, &cluster_grid_buffer);
+	glGenBuffers(1, &cluster_index_buffer);
+	glGenTextures(1, &cluster_grid_texture);
+	glGenTextures(1, &cluster_index_texture);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, cluster_grid_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)CLUSTER_COUNT * 2 * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, cluster_index_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glBindTexture(GL_TEXTURE_BUFFER, cluster_grid_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, cluster_grid_buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, cluster_index_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, cluster_index_buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	if (clusters_compute) {
+		glGenBuffers(1, &cluster_bounds_buffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, cluster_bounds_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)CLUSTER_COUNT * 2 * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		cluster_shader = new Shader(Shader::COMPUTE, "shaders/clusters.cs.glsl", cluster_defines());
+	}
+
+	cluster_bounds.assign(CLUSTER_COUNT * 2, glm::vec4(0.f));
+	cluster_grid.assign(CLUSTER_COUNT * 2, 0);
+	cluster_slots.assign(CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER, 0);
+	cluster_projection = glm::mat4(0.f);
+	cluster_counters = ClusterStats();
+	cluster_counters.compute = clusters_compute;
+	clusters_active = true;
+}
+
+bool clusters_enabled() {
+	return glob::clusters_active;
+}
+
+std::string cluster_defines() {
+	return "#define CLUSTER_GRID_X " + std::to_string(CLUSTER_GRID_X) + "\n"
+		+ "#define CLUSTER_GRID_Y " + std::to_string(CLUSTER_GRID_Y) + "\n"
+		+ "#define CLUSTER_GRID_Z " + std::to_string(CLUSTER_GRID_Z) + "\n"
+		+ "#define MAX_LIGHTS_PER_CLUSTER " + std::to_string(MAX_LIGHTS_PER_CLUSTER) + "\n";
+}
+
+/**
+ * Depth slice holding view depth d (distance in front of the camera).
+ */
+static int cluster_slice(float d) {
+	using namespace glob;
+
+	int slice = (int)floorf(logf(d / cluster_near) / logf(cluster_far / cluster_near) * CLUSTER_GRID_Z);
+	return std::max(0, std::min(slice, CLUSTER_GRID_Z - 1));
+}
+
+/**
+ * Recompute every cluster's view-space box. Each tile corner is a line from
+ * the near to the far plane (through the eye for perspective, parallel for
+ * orthographic), cut at the slice's two depths.
+ */
+static void clusters_build_bounds(glm::mat4 projection) {
+	using namespace glob;
+
+	glm::mat4 inverse = glm::inverse(projection);
+	auto unproject = [&inverse](float x, float y, float z) {
+		glm::vec4 point = inverse * glm::vec4(x, y, z, 1.f);
+		return glm::vec3(point) / point.w;
+	};
+	cluster_near = -unproject(0.f, 0.f, -1.f).z;
+	cluster_far = -unproject(0.f, 0.f, 1.f).z;
+
+	for (int y = 0; y < CLUSTER_GRID_Y; ++y) {
+		for (int x = 0; x < CLUSTER_GRID_X; ++x) {
+			glm::vec3 near_points[4], far_points[4];
+			for (int corner = 0; corner < 4; ++corner) {
+				float ndc_x = -1.f + 2.f * (x + (corner & 1)) / CLUSTER_GRID_X;
+				float ndc_y = -1.f + 2.f * (y + (corner >> 1)) / CLUSTER_GRID_Y;
+				near_points[corner] = unproject(ndc_x, ndc_y, -1.f);
+				far_points[corner] = unproject(ndc_x, ndc_y, 1.f);
+			}
+
+			for (int z = 0; z < CLUSTER_GRID_Z; ++z) {
+				float depths[2] = {
+					cluster_near * powf(cluster_far / cluster_near, (float)z / CLUSTER_GRID_Z),
+					cluster_near * powf(cluster_far / cluster_near, (float)(z + 1) / CLUSTER_GRID_Z)
+				};
+				glm::vec3 low = glm::vec3(1e30f), high = glm::vec3(-1e30f);
+				for (int corner = 0; corner < 4; ++corner) {
+					glm::vec3 line = far_points[corner] - near_points[corner];
+					for (float depth : depths) {
+						glm::vec3 point = near_points[corner] + line * ((-depth - near_points[corner].z) / line.z);
+						low = glm::min(low, point);
+						high = glm::max(high, point);
+					}
+				}
+				int cluster = (z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x;
+				cluster_bounds[cluster * 2] = glm::vec4(low, 0.f);
+				cluster_bounds[cluster * 2 + 1] = glm::vec4(high, 0.f);
+			}
+		}
+	}
+
+	if (clusters_compute) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, cluster_bounds_buffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, cluster_bounds.size() * sizeof(glm::vec4), cluster_bounds.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+}
+
+/**
+ * Project the view-space box around each light's range sphere (cut to the
+ * depth range) to find the tiles and slices it may touch, then test the sphere
+ * against each of those clusters' boxes.
+ */
+static void clusters_assign_cpu(glm::mat4 projection, glm::mat4 view) {
+	using namespace glob;
+
+	std::vector<unsigned int> counts(CLUSTER_COUNT, 0);
+	const glm::vec4* lights = lightbuffer_position_ranges();
+	unsigned int light_count = lightbuffer_count();
+
+	for (unsigned int light = 0; light < light_count; ++light) {
+		glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(lights[light]), 1.f));
+		float range = lights[light].w;
+		float depth = -center.z;
+		if (depth + range < cluster_near || depth - range > cluster_far)
+			continue;
+		float depth_low = std::max(depth - range, cluster_near);
+		float depth_high = std::min(depth + range, cluster_far);
+
+		glm::vec3 ndc_low = glm::vec3(1e30f), ndc_high = glm::vec3(-1e30f);
+		for (int corner = 0; corner < 8; ++corner) {
+			glm::vec4 point = projection * glm::vec4(
+				center.x + ((corner & 1) ? range : -range),
+				center.y + ((corner & 2) ? range : -range),
+				-((corner & 4) ? depth_high : depth_low), 1.f);
+			glm::vec3 ndc = glm::vec3(point) / point.w;
+			ndc_low = glm::min(ndc_low, ndc);
+			ndc_high = glm::max(ndc_high, ndc);
+		}
+		if (ndc_high.x < -1.f || ndc_low.x > 1.f || ndc_high.y < -1.f || ndc_low.y > 1.f)
+			continue;									// Off screen
+		ndc_low = glm::clamp(ndc_low, -1.f, 1.f);
+		ndc_high = glm::clamp(ndc_high, -1.f, 1.f);
+
+		int x0 = std::max(0, (int)floorf((ndc_low.x * 0.5f + 0.5f) * CLUSTER_GRID_X));
+		int x1 = std::min(CLUSTER_GRID_X - 1, (int)floorf((ndc_high.x * 0.5f + 0.5f) * CLUSTER_GRID_X));
+		int y0 = std::max(0, (int)floorf((ndc_low.y * 0.5f + 0.5f) * CLUSTER_GRID_Y));
+		int y1 = std::min(CLUSTER_GRID_Y - 1, (int)floorf((ndc_high.y * 0.5f + 0.5f) * CLUSTER_GRID_Y));
+		int z0 = cluster_slice(depth_low);
+		int z1 = cluster_slice(depth_high);
+
+		for (int z = z0; z <= z1; ++z) {
+			for (int y = y0; y <= y1; ++y) {
+				for (int x = x0; x <= x1; ++x) {
+					int cluster = (z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x;
+					if (counts[cluster] == MAX_LIGHTS_PER_CLUSTER)
+						continue;
+					glm::vec3 closest = glm::clamp(center, glm::vec3(cluster_bounds[cluster * 2]), glm::vec3(cluster_bounds[cluster * 2 + 1]));
+					glm::vec3 offset = closest - center;
+					if (glm::dot(offset, offset) > range * range)
+						continue;
+					cluster_slots[cluster * MAX_LIGHTS_PER_CLUSTER + counts[cluster]++] = light;
+				}
+			}
+		}
+	}
+
+	/**
+	 * Pack the lists and upload both buffers, orphaning the copies earlier
+	 * frames may still be reading.
+	 */
+	cluster_indices.clear();
+	for (int cluster = 0; cluster < CLUSTER_COUNT; ++cluster) {
+		cluster_grid[cluster * 2] = (unsigned int)cluster_indices.size();
+		cluster_grid[cluster * 2 + 1] = counts[cluster];
+		const unsigned int* slots = &cluster_slots[cluster * MAX_LIGHTS_PER_CLUSTER];
+		cluster_indices.insert(cluster_indices.end(), slots, slots + counts[cluster]);
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, cluster_grid_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, cluster_grid.size() * sizeof(unsigned int), cluster_grid.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, cluster_index_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+	if (!cluster_indices.empty())
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, cluster_indices.size() * sizeof(unsigned int), cluster_indices.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+/**
+ * One invocation per cluster writes its list straight into its
+ * MAX_LIGHTS_PER_CLUSTER slots of the index buffer.
+ */
+static void clusters_assign_compute(glm::mat4 view) {
+	using namespace glob;
+
+	cluster_shader->use();
+	lightbuffer_bind(cluster_shader);
+	cluster_shader->setInt("lightCount", (int)lightbuffer_count());
+	cluster_shader->setMat4("view", view);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, cluster_bounds_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, cluster_grid_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cluster_index_buffer);
+	glDispatchCompute((CLUSTER_COUNT + CLUSTER_COMPUTE_GROUP - 1) / CLUSTER_COMPUTE_GROUP, 1, 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);	// Read through texelFetch, or by clusters_stats
+
+	cluster_grid_stale = true;
+}
+
+/**
+ * Run both assigners, each until the GPU is done with it, and pick the one
+ * faster on average so far. The CPU goes last, so its lists are the ones
+ * drawn with; both fill the same buffers.
+ */
+static void clusters_calibrate(glm::mat4 projection, glm::mat4 view) {
+	using namespace glob;
+
+	glFinish();
+	auto start = std::chrono::high_resolution_clock::now();
+	clusters_assign_compute(view);
+	glFinish();
+	auto compute_end = std::chrono::high_resolution_clock::now();
+	clusters_assign_cpu(projection, view);
+	glFinish();
+	auto cpu_end = std::chrono::high_resolution_clock::now();
+	cluster_grid_stale = false;
+
+	ClusterStats& stats = cluster_counters;
+	stats.calibration_compute_ms += std::chrono::duration<double, std::milli>(compute_end - start).count();
+	stats.calibration_cpu_ms += std::chrono::duration<double, std::milli>(cpu_end - compute_end).count();
+	++stats.calibration_builds;
+	stats.compute = stats.calibration_compute_ms < stats.calibration_cpu_ms;
+	if (--cluster_calibrations == 0)
+		clusters_compute = stats.compute;
+}
+
+void clusters_build(glm::mat4 projection, glm::mat4 view, int width, int height) {
+	using namespace glob;
+
+	if (!clusters_active || width <= 0 || height <= 0)
+		return;
+
+	if (cluster_assigned && projection == cluster_projection && view == cluster_view && width == cluster_width && height == cluster_height
+		&& lightbuffer_version() == cluster_light_version) {
+		++cluster_counters.reuses;
+		return;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (projection != cluster_projection) {
+		clusters_build_bounds(projection);
+		cluster_projection = projection;
+	}
+	cluster_tile_size = glm::vec2((float)width / CLUSTER_GRID_X, (float)height / CLUSTER_GRID_Y);
+
+	cluster_assigned = true;
+	cluster_view = view;
+	cluster_width = width;
+	cluster_height = height;
+	cluster_light_version = lightbuffer_version();
+	cluster_counters.lights = lightbuffer_count();
+
+	if (cluster_calibrations > 0) {
+		clusters_calibrate(projection, view);
+		return;
+	}
+
+	if (clusters_compute)
+		clusters_assign_compute(view);
+	else
+		clusters_assign_cpu(projection, view);
+
+	++cluster_counters.builds;
+	cluster_counters.build_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void clusters_invalidate() {
+	glob::cluster_assigned = false;
+}
+
+void clusters_bind(Shader* shader) {
+	using namespace glob;
+
+	glActiveTexture(GL_TEXTURE0 + CLUSTER_GRID_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, cluster_grid_texture);
+	glActiveTexture(GL_TEXTURE0 + CLUSTER_INDEX_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, cluster_index_texture);
+	glActiveTexture(GL_TEXTURE0);
+
+	/**
+	 * The fragment shader finds its slice as log(depth) * x + y, the inverse of
+	 * the exponential spacing in cluster_slice.
+	 */
+	float scale = CLUSTER_GRID_Z / logf(cluster_far / cluster_near);
+	shader->setInt("clusterGrid", CLUSTER_GRID_TEXTURE_UNIT);
+	shader->setInt("clusterLights", CLUSTER_INDEX_TEXTURE_UNIT);
+	shader->setVec2("clusterTileSize", cluster_tile_size);
+	shader->setVec2("clusterDepth", scale, -scale * logf(cluster_near));
+}
+
+ClusterStats clusters_stats() {
+	using namespace glob;
+
+	if (cluster_grid_stale) {
+		glBindBuffer(GL_TEXTURE_BUFFER, cluster_grid_buffer);
+		glGetBufferSubData(GL_TEXTURE_BUFFER, 0, cluster_grid.size() * sizeof(unsigned int), cluster_grid.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		cluster_grid_stale = false;
+	}
+
+	ClusterStats stats = cluster_counters;
+	stats.occupied = stats.full = stats.max_lights = 0;
+	stats.light_refs = 0;
+	for (size_t cluster = 0; cluster < cluster_grid.size() / 2; ++cluster) {
+		unsigned int count = cluster_grid[cluster * 2 + 1];
+		stats.occupied += count > 0;
+		stats.full += count == MAX_LIGHTS_PER_CLUSTER;
+		stats.max_lights = std::max(stats.max_lights, count);
+		stats.light_refs += count;
+	}
+	return stats;
+}
+
+void clusters_report() {
+	if (!clusters_enabled())
+		return;
+
+	ClusterStats stats = clusters_stats();
+
+	std::cout << "Light clusters: " << CLUSTER_GRID_X << "x" << CLUSTER_GRID_Y << "x" << CLUSTER_GRID_Z << " assigned "
+		<< (stats.compute ? "by compute shader" : "on the CPU") << ", " << stats.builds << " builds ("
+		<< (stats.builds ? stats.build_ms / stats.builds : 0.0) << " ms each), " << stats.reuses << " frames reused the last build\n";
+	if (stats.calibration_builds)
+		std::cout << "\tpicked by timing " << stats.calibration_builds << " builds both ways: compute shader " << stats.calibration_compute_ms / stats.calibration_builds
+			<< " ms, CPU " << stats.calibration_cpu_ms / stats.calibration_builds << " ms each\n";
+	std::cout
+		<< "\tlast build: " << stats.lights << " lights, " << (double)stats.light_refs / CLUSTER_COUNT << " lights per cluster on average, "
+		<< (stats.occupied ? (double)stats.light_refs / stats.occupied : 0.0) << " per occupied cluster (" << stats.occupied << " of " << CLUSTER_COUNT
+		<< "), max " << stats.max_lights << ", " << stats.full << " capped at " << MAX_LIGHTS_PER_CLUSTER << std::endl;
+}
+
+void clusters_destroy() {
+	using namespace glob;
+
+	if (!clusters_active)
+		return;
+
+	if (cluster_shader) {
+		glDeleteProgram(cluster_shader->ID);
+		delete cluster_shader;
+		cluster_shader = nullptr;
+	}
+	glDeleteTextures(1, &cluster_grid_texture);
+	glDeleteTextures(1, &cluster_index_texture);
+	glDeleteBuffers(1, &cluster_grid_buffer);
+	glDeleteBuffers(1, &cluster_index_buffer);
+	glDeleteBuffers(1, &cluster_bounds_buffer);
+	cluster_grid_texture = cluster_index_texture = cluster_grid_buffer = cluster_index_buffer = cluster_bounds_buffer = 0;
+	cluster_assigned = false;
+	clusters_active = false;
+}
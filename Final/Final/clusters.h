@@ -0,0 +1,84 @@
+#pragma once
+#ifndef __CLUSTERS_H__
+#define __CLUSTERS_H__
+
+#include <string>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+const int CLUSTER_GRID_X = 16;				// Columns of screen tiles
+const int CLUSTER_GRID_Y = 9;				// Rows of screen tiles
+const int CLUSTER_GRID_Z = 24;				// Depth slices, spaced exponentially between the near and far planes
+const int CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+const int MAX_LIGHTS_PER_CLUSTER = 64;		// Lights one cluster lists at most, so fragment cost stays bounded however many exist
+const int CLUSTER_GRID_TEXTURE_UNIT = 3;	// Texture unit of the per-cluster offset and count buffer
+const int CLUSTER_INDEX_TEXTURE_UNIT = 4;	// Texture unit of the light index buffer
+const int CLUSTER_CALIBRATION_BUILDS = 3;	// Builds that run both assigners to pick the faster one
+
+/**
+ * GPU layout: two texture buffers read by the fragment shaders.
+ *
+ *	grid	RG32UI, one texel per cluster: first index and light count
+ *	indices	R32UI, indices into the light buffer (see lightbuffer.h)
+ *
+ * Cluster (x, y, z) is texel (z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x,
+ * with x and y counted from the bottom-left of the viewport and z from the
+ * near plane. Lights are listed in light buffer order, so when a cluster is
+ * full it keeps the lowest indices (the scene's own lights come first).
+ *
+ * Lights per cluster describe the grid of the last clusters_build; with the
+ * compute path it is read back from the GPU when the stats are asked for.
+ */
+struct cluster_statistics {
+	bool compute;							// lights assigned by shaders/clusters.cs.glsl instead of on the CPU
+	unsigned long long calibration_builds;	// builds that ran both assigners, not counted below
+	double calibration_compute_ms;			// summed over them, each waiting for the GPU to finish
+	double calibration_cpu_ms;
+	unsigned long long builds;
+	unsigned long long reuses;				// builds skipped because nothing they depend on changed
+	double build_ms;						// CPU time in clusters_build, including uploads or the dispatch
+	unsigned int lights;					// lights in the buffer at the last build
+	unsigned int occupied;					// clusters listing at least one light
+	unsigned int full;						// clusters that hit MAX_LIGHTS_PER_CLUSTER
+	unsigned int max_lights;				// longest list
+	unsigned long long light_refs;			// indices in every list together
+};
+typedef struct cluster_statistics ClusterStats;
+
+/**
+ * Allocate the grid and index buffers. When use_compute is set and the
+ * context has GL 4.3, the first CLUSTER_CALIBRATION_BUILDS builds assign
+ * lights both with a compute shader and on the CPU, each followed by
+ * glFinish, and the faster one on average is used; a software renderer
+ * usually ends up on the CPU. Otherwise lights are assigned on the CPU.
+ */
+void clusters_init(bool use_compute);
+
+bool clusters_enabled();					// False until clusters_init, and after clusters_destroy
+
+/**
+ * Assign every light in the light buffer to the clusters its range sphere
+ * touches. Call once per frame after lightbuffer_upload, with the matrices and
+ * viewport size the frame is drawn with; cluster bounds are only rebuilt when
+ * the projection or size changes. While the matrices, size and lights
+ * (lightbuffer_version) all stay the same the last assignment is kept.
+ */
+void clusters_build(glm::mat4 projection, glm::mat4 view, int width, int height);
+
+void clusters_invalidate();					// Make the next clusters_build assign lights again even if nothing changed
+
+/**
+ * Bind both texture buffers and set "clusterGrid", "clusterLights",
+ * "clusterTileSize" and "clusterDepth". The shader also reads "view".
+ */
+void clusters_bind(Shader* shader);
+
+std::string cluster_defines();				// "#define ..." lines for the grid size, for shaders reading the clusters
+
+ClusterStats clusters_stats();
+
+void clusters_report();
+
+void clusters_destroy();
+#endif//__CLUSTERS_H__
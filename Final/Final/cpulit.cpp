@@ -0,0 +1,67 @@
+#include "cpulit.h"
+
+#include "geometry.h"
+
+#include "lightbuffer.h"
+
+#include "utils.h"
+
+static int read_texture(unsigned int handle, std::vector<CpuTexture>& textures) {
+	for (size_t i = 0; i < textures.size(); ++i) {
+		if (textures[i].handle == handle)
+			return (int)i;
+	}
+
+	CpuTexture texture;
+	texture.handle = handle;
+	if (!read_texture_layers(handle, texture.layers))
+		return -1;
+
+	textures.push_back(std::move(texture));
+	return (int)textures.size() - 1;
+}
+
+void cpulit_read(const std::vector<BatchItem>& items, std::vector<CpuMesh>& meshes, std::vector<CpuTexture>& textures) {
+	meshes.clear();
+	textures.clear();
+	for (const BatchItem& item : items) {
+		const Model& model = *item.model;
+		if (model.mesh.index_count == 0 || model.mesh.format == VERTEX_FORMAT_COLORED)
+			continue;
+
+		std::vector<float> vertices;
+		CpuMesh mesh;
+		mesh.item = item;
+		if (!geometry_read(model.mesh, vertices, mesh.indices))
+			continue;
+
+		unsigned int stride = geometry_vertex_stride(model.mesh.format) / sizeof(float);
+		for (size_t i = 0; i + 8 <= vertices.size(); i += stride) {
+			mesh.positions.push_back(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
+			mesh.normals.push_back(glm::vec3(vertices[i + 3], vertices[i + 4], vertices[i + 5]));
+			mesh.coords.push_back(glm::vec2(vertices[i + 6], vertices[i + 7]));
+		}
+
+		mesh.texture = read_texture(model.texture, textures);
+		mesh.specular_texture = item.material ? read_texture(item.material->specular_map, textures) : -1;
+		if (mesh.texture < 0 || (item.material && mesh.specular_texture < 0))
+			continue;
+		meshes.push_back(std::move(mesh));
+	}
+}
+
+void cpulit_copy_lights(CpuLights& lights, DirectionalLight dir_light, glm::vec3 view_pos) {
+	unsigned int count = lightbuffer_count();
+	lights.position_ranges.assign(lightbuffer_position_ranges(), lightbuffer_position_ranges() + count);
+	lights.color_types.assign(lightbuffer_color_types(), lightbuffer_color_types() + count);
+	lights.direction_outers.assign(lightbuffer_direction_outers(), lightbuffer_direction_outers() + count);
+	lights.attenuations.assign(lightbuffer_attenuations(), lightbuffer_attenuations() + count);
+	lights.dir_light = dir_light;
+	lights.view_pos = view_pos;
+}
+
+glm::vec3 cpulit_sample(const CpuTexture& texture, int layer, glm::vec2 coord) {
+	glm::vec3 rgb;
+	image_sample_bilinear(texture.layers[layer], coord.x, coord.y, &rgb[0]);
+	return rgb;
+}
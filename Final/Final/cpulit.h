@@ -0,0 +1,120 @@
+#pragma once
+#ifndef __CPULIT_H__
+#define __CPULIT_H__
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "lights.h"
+#include "batch.h"
+#include "image.h"
+
+/**
+ * Texture array read back from the GPU, one Image per layer.
+ */
+struct cpu_texture {
+	unsigned int handle;
+	std::vector<Image> layers;
+};
+typedef struct cpu_texture CpuTexture;
+
+/**
+ * Object space vertices of one item, with the textures it samples.
+ */
+struct cpu_mesh {
+	BatchItem item;							// transform, shine and regions are read from here every frame
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> coords;
+	std::vector<unsigned int> indices;
+	int texture;							// index in the textures read with it
+	int specular_texture;					// -1 without a material
+};
+typedef struct cpu_mesh CpuMesh;
+
+/**
+ * What the lit shader reads besides the Model: the light buffer's blocks,
+ * copied once per frame, the directional light and the camera.
+ */
+struct cpu_lights {
+	std::vector<glm::vec4> position_ranges;
+	std::vector<glm::vec4> color_types;
+	std::vector<glm::vec4> direction_outers;
+	std::vector<glm::vec4> attenuations;
+	DirectionalLight dir_light;
+	glm::vec3 view_pos;
+};
+typedef struct cpu_lights CpuLights;
+
+/**
+ * Read the lit items' meshes and textures back from the GPU for the CPU
+ * renderers, replacing meshes and textures. Colored and empty Models, and
+ * those whose textures can't be read, are skipped.
+ */
+void cpulit_read(const std::vector<BatchItem>& items, std::vector<CpuMesh>& meshes, std::vector<CpuTexture>& textures);
+
+void cpulit_copy_lights(CpuLights& lights, DirectionalLight dir_light, glm::vec3 view_pos);
+
+glm::vec3 cpulit_sample(const CpuTexture& texture, int layer, glm::vec2 coord);	// Bilinear, like the GL samplers
+
+/**
+ * The lit shader's main() (shaders/lit.fs.glsl) at world with the
+ * interpolated normal and texture coordinate: Phong for every light in the
+ * range and the directional light, diffuse and specular maps sampled
+ * bilinearly. visible(light_dir, distance) decides whether a light reaches
+ * world, and is only asked when the light would add more than its ambient
+ * term; the directional light is 1e30 away. A template so a visibility test
+ * that always passes costs nothing.
+ */
+template <typename Visible>
+glm::vec3 cpulit_shade(const CpuLights& lights, const CpuMesh& mesh, const std::vector<CpuTexture>& textures, glm::vec3 world, glm::vec3 normal, glm::vec2 coord, Visible visible) {
+	const Model& model = *mesh.item.model;
+	float shine = mesh.item.material ? mesh.item.material->shine : model.shine;
+	glm::vec3 specular_sample = glm::vec3(1.f);
+	if (mesh.specular_texture >= 0) {
+		const Material& material = *mesh.item.material;
+		glm::vec2 uv = (coord - glm::vec2(model.texture_region.x, model.texture_region.y)) / glm::vec2(model.texture_region.z, model.texture_region.w);
+		glm::vec2 specular_coord = glm::vec2(material.specular_region.x, material.specular_region.y) + uv * glm::vec2(material.specular_region.z, material.specular_region.w);
+		specular_sample = cpulit_sample(textures[mesh.specular_texture], material.specular_layer, specular_coord);
+	}
+
+	glm::vec3 norm = glm::normalize(normal);
+	glm::vec3 view_dir = glm::normalize(lights.view_pos - world);
+	glm::vec3 light = glm::vec3(0.f);
+	for (size_t i = 0; i < lights.position_ranges.size(); ++i) {
+		glm::vec3 position = glm::vec3(lights.position_ranges[i]);
+		glm::vec3 color = glm::vec3(lights.color_types[i]);
+		float distance = glm::length(position - world);
+		if (distance > lights.position_ranges[i].w)
+			continue;
+		const glm::vec4& attenuation_inner = lights.attenuations[i];
+		float attenuation = 1.f / (attenuation_inner.x + attenuation_inner.y * distance + attenuation_inner.z * (distance * distance));
+		glm::vec3 light_dir = glm::normalize(position - world);
+
+		light += color * glob::ambient_strength * attenuation;
+		if (lights.color_types[i].w > 0.5f) {
+			const glm::vec4& direction_outer = lights.direction_outers[i];
+			float theta = glm::dot(-light_dir, glm::vec3(direction_outer));
+			attenuation *= glm::clamp((theta - direction_outer.w) / std::max(attenuation_inner.w - direction_outer.w, 1e-4f), 0.f, 1.f);
+		}
+
+		float diff = std::max(glm::dot(norm, light_dir), 0.f);
+		float spec = std::pow(std::max(glm::dot(view_dir, glm::reflect(-light_dir, norm)), 0.f), 32.f);
+		if (attenuation > 0.f && (diff > 0.f || spec > 0.f) && visible(light_dir, distance))
+			light += (diff * color + shine * spec * color * specular_sample) * attenuation;
+	}
+
+	if (lights.dir_light.color != glm::vec3(0.f)) {
+		glm::vec3 light_dir = glm::normalize(-lights.dir_light.direction);
+		float diff = std::max(glm::dot(norm, light_dir), 0.f);
+		float spec = std::pow(std::max(glm::dot(view_dir, glm::reflect(-light_dir, norm)), 0.f), 32.f);
+		light += lights.dir_light.color * glob::ambient_strength;
+		if ((diff > 0.f || spec > 0.f) && visible(light_dir, 1e30f))
+			light += diff * lights.dir_light.color + shine * spec * lights.dir_light.color * specular_sample;
+	}
+
+	return light * cpulit_sample(textures[mesh.texture], model.texture_layer, coord);
+}
+#endif//__CPULIT_H__
@@ -0,0 +1,311 @@
+#include <GLEW/glew.h>
+
+#include <chrono>
+#include <iostream>
+
+#include "deferred.h"
+
+#include "shader.h"
+
+#include "geometry.h"
+
+#include "residency.h"
+
+#include "lightbuffer.h"
+
+#include "clusters.h"
+
+#include "shadows.h"
+
+const int DEFERRED_QUERIES = 3;				// Samples-passed queries in flight, read back frames later so they never stall
+
+namespace glob {
+	bool deferred_active = false;
+
+	Shader* gbuffer_shader = nullptr;
+	Shader* gbuffer_specular_shader = nullptr;	// SPECULAR_MAP variant, for Models drawn with a Material
+	Shader* deferred_light_shader = nullptr;
+
+	unsigned int gbuffer_fbo = 0;
+	unsigned int gbuffer_albedo = 0;
+	unsigned int gbuffer_normal = 0;
+	unsigned int gbuffer_depth = 0;
+	int gbuffer_width = 0;
+	int gbuffer_height = 0;
+	int deferred_target = 0;					// framebuffer bound at deferred_begin, which the lighting pass draws into
+
+	unsigned int deferred_queries[DEFERRED_QUERIES] = {};
+	bool deferred_query_pending[DEFERRED_QUERIES] = {};
+	int deferred_query_index = 0;
+	bool deferred_query_active = false;			// a query brackets the current geometry pass
+
+	DeferredStats deferred_counters;
+}
+
+bool deferred_init() {
+	using namespace glob;
+
+	if (!clusters_enabled()) {
+		std::cout << "Deferred shading needs the light clusters, drawing forward" << std::endl;
+		return false;
+	}
+
+	gbuffer_shader = new Shader("shaders/single_texture.vs.glsl", "shaders/gbuffer.fs.glsl");
+	gbuffer_specular_shader = new Shader("shaders/single_texture.vs.glsl", "shaders/gbuffer.fs.glsl", nullptr, "#define SPECULAR_MAP\n");
+	deferred_light_shader = new Shader("shaders/deferred.vs.glsl", "shaders/deferred.fs.glsl", nullptr, cluster_defines() + (shadows_enabled() ? shadow_defines() : ""));
+
+	glGenQueries(DEFERRED_QUERIES, deferred_queries);
+	deferred_counters = DeferredStats();
+	deferred_active = true;
+	return true;
+}
+
+bool deferred_enabled() {
+	return glob::deferred_active;
+}
+
+static unsigned int gbuffer_texture(GLenum internal_format, GLenum format, GLenum type, int width, int height) {
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return texture;
+}
+
+static void gbuffer_release() {
+	using namespace glob;
+
+	unsigned int textures[3] = { gbuffer_albedo, gbuffer_normal, gbuffer_depth };
+	glDeleteTextures(3, textures);
+	glDeleteFramebuffers(1, &gbuffer_fbo);
+	gbuffer_albedo = gbuffer_normal = gbuffer_depth = gbuffer_fbo = 0;
+	gbuffer_width = gbuffer_height = 0;
+}
+
+static void gbuffer_allocate(int width, int height) {
+	using namespace glob;
+
+	gbuffer_release();
+
+	gbuffer_albedo = gbuffer_texture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+	gbuffer_normal = gbuffer_texture(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, width, height);
+	gbuffer_depth = gbuffer_texture(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, width, height);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &gbuffer_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, gbuffer_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gbuffer_albedo, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gbuffer_normal, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gbuffer_depth, 0);
+	const GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, attachments);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "ERROR::DEFERRED::GBUFFER::INCOMPLETE " << width << "x" << height << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	gbuffer_width = width;
+	gbuffer_height = height;
+}
+
+void deferred_begin(int width, int height) {
+	using namespace glob;
+
+	if (!deferred_active)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &deferred_target);
+	if (width != gbuffer_width || height != gbuffer_height)
+		gbuffer_allocate(width, height);
+
+	/**
+	 * Collect the samples-passed count of the oldest query once the GPU is
+	 * done with it, then reuse it to measure this frame's overdraw. If it is
+	 * still in flight this frame goes unmeasured rather than waiting.
+	 */
+	int query = deferred_query_index;
+	if (deferred_query_pending[query]) {
+		GLuint available = 0;
+		glGetQueryObjectuiv(deferred_queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 samples = 0;
+			glGetQueryObjectui64v(deferred_queries[query], GL_QUERY_RESULT, &samples);
+			deferred_counters.samples = samples;
+			deferred_counters.overdraw = (double)samples / ((double)gbuffer_width * gbuffer_height);
+			deferred_counters.frame_bytes = deferred_bandwidth(gbuffer_width, gbuffer_height, deferred_counters.overdraw);
+			deferred_query_pending[query] = false;
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, gbuffer_fbo);
+	glClearColor(0.f, 0.f, 0.f, 0.f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glClearColor(0.f, 0.f, 0.f, 1.f);			// main()'s clear color for the default framebuffer
+
+	deferred_query_active = !deferred_query_pending[query];
+	if (deferred_query_active) {
+		glBeginQuery(GL_SAMPLES_PASSED, deferred_queries[query]);
+		deferred_query_pending[query] = true;
+		deferred_query_index = (deferred_query_index + 1) % DEFERRED_QUERIES;
+	}
+
+	deferred_counters.geometry_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void deferred_draw(const Model& model, const Material* material, glm::mat4 projection, glm::mat4 view) {
+	using namespace glob;
+
+	if (!deferred_active || model.mesh.index_count == 0)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	Shader* shader = material ? gbuffer_specular_shader : gbuffer_shader;
+	shader->use();
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, model.texture);
+	residency_touch(model.texture);
+	shader->setInt("aTexture", 0);
+	shader->setFloat("textureLayer", (float)model.texture_layer);
+	shader->setFloat("specularStrength", material ? material->shine : model.shine);
+
+	if (material) {
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, material->specular_map);
+		residency_touch(material->specular_map);
+		glActiveTexture(GL_TEXTURE0);
+		shader->setInt("specularMap", 1);
+		shader->setFloat("specularLayer", (float)material->specular_layer);
+		shader->setVec4("specularRegion", material->specular_region);
+		shader->setVec4("textureRegion", model.texture_region);
+	}
+
+	shader->setMat3("normalModel", glm::mat3(glm::transpose(glm::inverse(model.model))));
+	shader->setMat4("projection", projection);
+	shader->setMat4("view", view);
+	shader->setMat4("model", model.model);
+
+	geometry_draw(model.mesh, GL_TRIANGLES);
+
+	deferred_counters.geometry_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void deferred_end(glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos) {
+	using namespace glob;
+
+	if (!deferred_active)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (deferred_query_active)
+		glEndQuery(GL_SAMPLES_PASSED);
+	deferred_query_active = false;
+	glBindFramebuffer(GL_FRAMEBUFFER, deferred_target);
+
+	/**
+	 * Every pixel is shaded once, whatever the polygon mode, and writes the
+	 * depth it was lit at (see deferred.fs.glsl).
+	 */
+	GLint polygon_mode[2];
+	glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glDepthFunc(GL_ALWAYS);
+
+	deferred_light_shader->use();
+	const unsigned int textures[3] = { gbuffer_albedo, gbuffer_normal, gbuffer_depth };
+	const char* names[3] = { "gAlbedoSpecular", "gNormal", "gDepth" };
+	for (int i = 0; i < 3; ++i) {
+		glActiveTexture(GL_TEXTURE0 + DEFERRED_TEXTURE_UNIT + i);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		deferred_light_shader->setInt(names[i], DEFERRED_TEXTURE_UNIT + i);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	lightbuffer_bind(deferred_light_shader);
+	clusters_bind(deferred_light_shader);
+	if (shadows_enabled())
+		shadows_bind(deferred_light_shader);
+	deferred_light_shader->setMat4("inverseViewProjection", glm::inverse(projection * view));
+	deferred_light_shader->setMat4("view", view);
+	deferred_light_shader->setFloat("ambientStrength", ambient_strength);
+	deferred_light_shader->setVec3("dirLight.direction", dir_light.direction);
+	deferred_light_shader->setVec3("dirLight.color", dir_light.color);
+	deferred_light_shader->setVec3("viewPos", viewPos);
+
+	/**
+	 * The full-screen triangle is generated from gl_VertexID; any vertex
+	 * array will do, and reusing the geometry arena's keeps its binding cache valid.
+	 */
+	geometry_bind(VERTEX_FORMAT_TEXTURED);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glDepthFunc(GL_LESS);
+	glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+
+	++deferred_counters.frames;
+	deferred_counters.lighting_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+size_t deferred_bandwidth(int width, int height, double overdraw) {
+	double pixels = (double)width * height;
+
+	/**
+	 * Clear: every attachment once. Geometry: each sample that passes reads
+	 * and writes depth and writes both color targets. Lighting: every
+	 * attachment read once, then color and depth written.
+	 */
+	double clear = pixels * DEFERRED_GBUFFER_BYTES;
+	double geometry = pixels * overdraw * (DEFERRED_GBUFFER_BYTES + 4);
+	double lighting = pixels * (DEFERRED_GBUFFER_BYTES + 4 + 4);
+	return (size_t)(clear + geometry + lighting);
+}
+
+DeferredStats deferred_stats() {
+	using namespace glob;
+
+	DeferredStats stats = deferred_counters;
+	stats.width = gbuffer_width;
+	stats.height = gbuffer_height;
+	return stats;
+}
+
+void deferred_report() {
+	if (!deferred_enabled())
+		return;
+
+	DeferredStats stats = deferred_stats();
+	double frames = stats.frames ? (double)stats.frames : 1.0;
+
+	std::cout << "Deferred shading: " << stats.frames << " frames at " << stats.width << "x" << stats.height
+		<< ", G-buffer " << DEFERRED_GBUFFER_BYTES << " bytes/pixel (" << (double)stats.width * stats.height * DEFERRED_GBUFFER_BYTES / (1024.0 * 1024.0) << " MiB)"
+		<< ", " << stats.geometry_ms / frames << " ms geometry + " << stats.lighting_ms / frames << " ms lighting CPU per frame\n"
+		<< "\toverdraw " << stats.overdraw << " (" << stats.samples << " samples), estimated G-buffer traffic "
+		<< stats.frame_bytes / (1024.0 * 1024.0) << " MiB/frame, "
+		<< stats.frame_bytes * 60.0 / (1024.0 * 1024.0 * 1024.0) << " GiB/s at 60 fps\n"
+		<< "\tsame overdraw at 1920x1080: " << deferred_bandwidth(1920, 1080, stats.overdraw) / (1024.0 * 1024.0)
+		<< " MiB/frame, at 3840x2160: " << deferred_bandwidth(3840, 2160, stats.overdraw) / (1024.0 * 1024.0) << " MiB/frame" << std::endl;
+}
+
+void deferred_destroy() {
+	using namespace glob;
+
+	if (!deferred_active)
+		return;
+
+	gbuffer_release();
+	glDeleteQueries(DEFERRED_QUERIES, deferred_queries);
+	Shader* shaders[3] = { gbuffer_shader, gbuffer_specular_shader, deferred_light_shader };
+	for (Shader* shader : shaders) {
+		glDeleteProgram(shader->ID);
+		delete shader;
+	}
+	gbuffer_shader = gbuffer_specular_shader = deferred_light_shader = nullptr;
+	deferred_active = false;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef __DEFERRED_H__
+#define __DEFERRED_H__
+
+#include <glm/glm.hpp>
+
+#include "models.h"
+
+/**
+ * G-buffer layout, 12 bytes per pixel:
+ *
+ *	RGBA8			albedo.rgb, specular strength (scaled by the specular map)
+ *	RG16			octahedral world-space normal
+ *	DEPTH24			depth, world position is rebuilt from it
+ *
+ * The lighting pass is one full-screen triangle that shades each pixel with
+ * the lights of its cluster (see clusters.h), so lighting costs lit pixels
+ * times the lights reaching them rather than Models times lights.
+ */
+const int DEFERRED_GBUFFER_BYTES = 12;		// Bytes per pixel of the three attachments
+const int DEFERRED_TEXTURE_UNIT = 5;		// First of three texture units the lighting pass samples the G-buffer from
+
+/**
+ * Bandwidth is estimated from what the passes write and read per pixel;
+ * texture and light fetches are left out, since the forward path pays them too.
+ */
+struct deferred_statistics {
+	int width;
+	int height;
+	unsigned long long frames;
+	unsigned long long samples;				// fragments that passed the depth test in the geometry pass, last frame measured
+	double overdraw;						// samples per pixel
+	size_t frame_bytes;						// estimated G-buffer traffic of that frame
+	double geometry_ms;						// CPU time issuing the geometry pass
+	double lighting_ms;						// CPU time issuing the lighting pass
+};
+typedef struct deferred_statistics DeferredStats;
+
+/**
+ * Build the geometry and lighting pass shaders. Needs the light clusters
+ * (clusters_init) for the lighting pass; returns false without them.
+ */
+bool deferred_init();
+
+bool deferred_enabled();
+
+/**
+ * Bind the G-buffer (reallocating it if the viewport size changed) and clear
+ * it. Draw opaque Models with deferred_draw, then light them with deferred_end.
+ */
+void deferred_begin(int width, int height);
+
+void deferred_draw(const Model& model, const Material* material, glm::mat4 projection, glm::mat4 view);
+
+/**
+ * Light every covered pixel into the default framebuffer and write the
+ * G-buffer's depth with it, so forward draws after this are depth tested.
+ */
+void deferred_end(glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos);
+
+/**
+ * Estimated bytes written and read per frame at width x height: clearing and
+ * filling the G-buffer (overdraw samples per pixel), then reading it back
+ * once in the lighting pass and writing color and depth.
+ */
+size_t deferred_bandwidth(int width, int height, double overdraw);
+
+DeferredStats deferred_stats();
+
+void deferred_report();						// Print last frame's overdraw and bandwidth, and the same at 1080p and 4K
+
+void deferred_destroy();
+#endif//__DEFERRED_H__
@@ -0,0 +1,291 @@
+#include <GLEW/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "dynres.h"
+
+#include "shader.h"
+
+#include "geometry.h"
+
+const int DYNRES_FULL_STEPS = (int)(1.f / DYNRES_STEP + 0.5f);			// Scale 1 in DYNRES_STEPs
+const int DYNRES_MIN_STEPS = (int)(DYNRES_MIN_SCALE / DYNRES_STEP + 0.5f);
+
+namespace glob {
+	bool dynres_active = false;
+	Shader* upscale_shader = nullptr;
+
+	unsigned int dynres_fbo = 0;
+	unsigned int dynres_color = 0;
+	unsigned int dynres_depth = 0;
+	int dynres_texture_width = 0;				// The target is as large as the window; the scene uses its lower left part
+	int dynres_texture_height = 0;
+	int dynres_steps = DYNRES_FULL_STEPS;		// Current scale in DYNRES_STEPs
+	int dynres_samples = 0;						// GPU times filtered at the current scale
+	int dynres_target = 0;						// framebuffer bound at dynres_begin, which the upscale draws into
+	int dynres_viewport[4] = {};
+
+	unsigned int dynres_queries[DYNRES_QUERIES][2] = {};	// Timestamps before and after the scene
+	bool dynres_query_pending[DYNRES_QUERIES] = {};
+	int dynres_query_steps[DYNRES_QUERIES] = {};	// Scale each timing was measured at
+	int dynres_query_index = 0;
+	bool dynres_query_active = false;
+
+	DynresStats dynres_counters;
+}
+
+bool dynres_init(float target_ms, float sharpness) {
+	using namespace glob;
+
+	if (target_ms <= 0.f) {
+		std::cerr << "ERROR::DYNRES::BAD_TARGET " << target_ms << std::endl;
+		return false;
+	}
+
+	upscale_shader = new Shader("shaders/deferred.vs.glsl", "shaders/upscale.fs.glsl");
+	for (int i = 0; i < DYNRES_QUERIES; ++i)
+		glGenQueries(2, dynres_queries[i]);
+
+	dynres_counters = DynresStats();
+	dynres_counters.target_ms = target_ms;
+	dynres_counters.sharpness = std::max(sharpness, 0.f);
+	dynres_counters.state = DYNRES_SETTLING;
+	dynres_counters.scale = dynres_counters.desired_scale = dynres_counters.min_scale_seen = 1.f;
+	dynres_steps = DYNRES_FULL_STEPS;
+	dynres_samples = 0;
+	dynres_active = true;
+	return true;
+}
+
+bool dynres_enabled() {
+	return glob::dynres_active;
+}
+
+static void target_release() {
+	using namespace glob;
+
+	glDeleteTextures(1, &dynres_color);
+	glDeleteRenderbuffers(1, &dynres_depth);
+	glDeleteFramebuffers(1, &dynres_fbo);
+	dynres_color = dynres_depth = dynres_fbo = 0;
+	dynres_texture_width = dynres_texture_height = 0;
+}
+
+static void target_allocate(int width, int height) {
+	using namespace glob;
+
+	target_release();
+
+	glGenTextures(1, &dynres_color);
+	glBindTexture(GL_TEXTURE_2D, dynres_color);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &dynres_depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, dynres_depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &dynres_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, dynres_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dynres_color, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, dynres_depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "ERROR::DYNRES::TARGET::INCOMPLETE " << width << "x" << height << std::endl;
+
+	dynres_texture_width = width;
+	dynres_texture_height = height;
+}
+
+/**
+ * Feed one scene GPU time to the controller. Times measured before the last
+ * resize say nothing about the current scale and are only reported.
+ */
+static void control(float gpu_ms, int measured_steps) {
+	using namespace glob;
+
+	DynresStats& stats = dynres_counters;
+	stats.gpu_ms = gpu_ms;
+	++stats.timed;
+	if (measured_steps != dynres_steps)
+		return;
+
+	stats.filtered_ms = dynres_samples == 0 ? gpu_ms : stats.filtered_ms * 0.75f + gpu_ms * 0.25f;
+	++dynres_samples;
+
+	float scale = dynres_steps * DYNRES_STEP;
+	float desired = scale * std::sqrt(stats.target_ms * DYNRES_HEADROOM / std::max(stats.filtered_ms, 1e-3f));
+	stats.desired_scale = std::min(std::max(desired, DYNRES_MIN_SCALE), 1.f);
+
+	/**
+	 * Drop straight to the step below the desired scale as soon as the target
+	 * is missed, but rise one step at a time once the new scale has been
+	 * measured for a while, so the scale doesn't oscillate around the target.
+	 */
+	int steps = dynres_steps;
+	int desired_steps = std::max(DYNRES_MIN_STEPS, std::min(DYNRES_FULL_STEPS, (int)std::floor(desired / DYNRES_STEP)));
+	if (stats.filtered_ms > stats.target_ms && desired_steps < steps)
+		steps = desired_steps;
+	else if (stats.filtered_ms < stats.target_ms * DYNRES_HEADROOM && dynres_samples >= DYNRES_SETTLE_FRAMES && desired >= (steps + 1) * DYNRES_STEP && steps < DYNRES_FULL_STEPS)
+		steps = steps + 1;
+
+	if (steps != dynres_steps) {
+		if (steps < dynres_steps)
+			++stats.lowered;
+		else
+			++stats.raised;
+		dynres_steps = steps;
+		dynres_samples = 0;
+		stats.state = DYNRES_SETTLING;
+	}
+	else if (dynres_samples < DYNRES_SETTLE_FRAMES)
+		stats.state = DYNRES_SETTLING;
+	else if ((steps == DYNRES_MIN_STEPS && stats.filtered_ms > stats.target_ms) || (steps == DYNRES_FULL_STEPS && desired > 1.f))
+		stats.state = DYNRES_LIMITED;
+	else
+		stats.state = DYNRES_HOLDING;
+}
+
+/**
+ * Read back every timing the GPU has finished, oldest first.
+ */
+static void collect_timings() {
+	using namespace glob;
+
+	for (int i = 1; i <= DYNRES_QUERIES; ++i) {
+		int slot = (dynres_query_index + i) % DYNRES_QUERIES;
+		if (!dynres_query_pending[slot])
+			continue;
+
+		GLuint available = 0;
+		glGetQueryObjectuiv(dynres_queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(dynres_queries[slot][0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(dynres_queries[slot][1], GL_QUERY_RESULT, &end);
+		dynres_query_pending[slot] = false;
+		control((float)((end - begin) / 1e6), dynres_query_steps[slot]);
+	}
+}
+
+void dynres_begin(int width, int height, int* scene_width, int* scene_height) {
+	using namespace glob;
+
+	*scene_width = width;
+	*scene_height = height;
+	if (!dynres_active)
+		return;
+
+	collect_timings();
+
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &dynres_target);
+	glGetIntegerv(GL_VIEWPORT, dynres_viewport);
+	if (width != dynres_texture_width || height != dynres_texture_height)
+		target_allocate(width, height);
+
+	DynresStats& stats = dynres_counters;
+	stats.scale = dynres_steps * DYNRES_STEP;
+	stats.width = *scene_width = std::max(1, (int)(width * stats.scale + 0.5f));
+	stats.height = *scene_height = std::max(1, (int)(height * stats.scale + 0.5f));
+	++stats.frames;
+	stats.scale_sum += stats.scale;
+	stats.min_scale_seen = std::min(stats.min_scale_seen, stats.scale);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, dynres_fbo);
+	glViewport(0, 0, stats.width, stats.height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	/**
+	 * Timestamps rather than GL_TIME_ELAPSED, which the shadow passes inside
+	 * the scene already use and which can't nest. A frame whose query pair is
+	 * still in flight goes untimed rather than waiting. Flushing after the
+	 * first timestamp and before the second keeps drivers that run a whole
+	 * batch of commands tile by tile (llvmpipe) from recording both within
+	 * one tile's work; elsewhere it only submits the scene a little sooner.
+	 */
+	dynres_query_active = !dynres_query_pending[dynres_query_index];
+	if (dynres_query_active) {
+		glQueryCounter(dynres_queries[dynres_query_index][0], GL_TIMESTAMP);
+		glFlush();
+	}
+}
+
+void dynres_end() {
+	using namespace glob;
+
+	if (!dynres_active)
+		return;
+
+	if (dynres_query_active) {
+		glFlush();
+		glQueryCounter(dynres_queries[dynres_query_index][1], GL_TIMESTAMP);
+		dynres_query_pending[dynres_query_index] = true;
+		dynres_query_steps[dynres_query_index] = dynres_steps;
+		dynres_query_index = (dynres_query_index + 1) % DYNRES_QUERIES;
+	}
+	dynres_query_active = false;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, dynres_target);
+	glViewport(dynres_viewport[0], dynres_viewport[1], dynres_viewport[2], dynres_viewport[3]);
+
+	GLint polygon_mode[2];
+	glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glDisable(GL_DEPTH_TEST);
+
+	const DynresStats& stats = dynres_counters;
+	upscale_shader->use();
+	glActiveTexture(GL_TEXTURE0 + DYNRES_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, dynres_color);
+	glActiveTexture(GL_TEXTURE0);
+	upscale_shader->setInt("scene", DYNRES_TEXTURE_UNIT);
+	upscale_shader->setVec2("sceneScale", (float)stats.width / dynres_texture_width, (float)stats.height / dynres_texture_height);
+	upscale_shader->setVec2("texelSize", 1.f / dynres_texture_width, 1.f / dynres_texture_height);
+	upscale_shader->setFloat("sharpness", stats.width == dynres_texture_width && stats.height == dynres_texture_height ? 0.f : stats.sharpness);	// nothing to restore at full size
+
+	geometry_bind(VERTEX_FORMAT_TEXTURED);		// The full-screen triangle comes from gl_VertexID, as in the deferred lighting pass
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glEnable(GL_DEPTH_TEST);
+	glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+}
+
+DynresStats dynres_stats() {
+	return glob::dynres_counters;
+}
+
+void dynres_report() {
+	DynresStats stats = dynres_stats();
+	if (!glob::dynres_active || stats.frames == 0)
+		return;
+
+	const char* states[] = { "settling", "holding", "limited" };
+	std::cout << "Dynamic resolution: " << stats.target_ms << " ms GPU target, scale " << stats.scale << " (" << stats.width << "x" << stats.height << ", "
+		<< states[stats.state] << "), " << stats.scale_sum / stats.frames << " average, " << stats.min_scale_seen << " lowest\n"
+		<< "\t" << stats.lowered << " resizes down, " << stats.raised << " up over " << stats.frames << " frames, last scene GPU time " << stats.gpu_ms
+		<< " ms (" << stats.filtered_ms << " filtered, asking for scale " << stats.desired_scale << "), " << stats.timed << " frames timed, upscale sharpness "
+		<< stats.sharpness << std::endl;
+}
+
+void dynres_destroy() {
+	using namespace glob;
+
+	if (!dynres_active)
+		return;
+
+	target_release();
+	for (int i = 0; i < DYNRES_QUERIES; ++i)
+		glDeleteQueries(2, dynres_queries[i]);
+	glDeleteProgram(upscale_shader->ID);
+	delete upscale_shader;
+	upscale_shader = nullptr;
+	dynres_active = false;
+}
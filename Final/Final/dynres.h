@@ -0,0 +1,75 @@
+#pragma once
+#ifndef __DYNRES_H__
+#define __DYNRES_H__
+
+const float DYNRES_MIN_SCALE = 0.5f;		// Smallest fraction of the window's width and height drawn
+const float DYNRES_STEP = 0.05f;			// Scales are multiples of this, so small swings don't resize the targets
+const float DYNRES_HEADROOM = 0.9f;			// Fraction of the target GPU time the controller aims for
+const int DYNRES_QUERIES = 4;				// Timestamp query pairs in flight, read back frames later so they never stall
+const int DYNRES_SETTLE_FRAMES = 8;			// Frames measured at a new scale before it may rise again
+const float DYNRES_DEFAULT_SHARPNESS = 0.5f;	// Upscale sharpening ("--upscale-sharpness" overrides, 0 is plain bilinear)
+const int DYNRES_TEXTURE_UNIT = 11;			// Texture unit the upscale samples the scene from
+
+/**
+ * What the controller is doing:
+ *
+ *	SETTLING	just changed scale; waiting for GPU times measured at it
+ *	HOLDING		the scene fits the target, or is near enough not to resize
+ *	LIMITED		over the target at DYNRES_MIN_SCALE, or under it at full size
+ */
+enum dynres_state {
+	DYNRES_SETTLING,
+	DYNRES_HOLDING,
+	DYNRES_LIMITED
+};
+
+/**
+ * Controller state and counters since dynres_init.
+ */
+struct dynres_statistics {
+	float target_ms;						// GPU time the scene may take per frame
+	float sharpness;
+	dynres_state state;
+	float scale;							// current fraction of the window's width and height
+	int width, height;						// size the scene is drawn at
+	float gpu_ms;							// last scene GPU time read back
+	float filtered_ms;						// smoothed over the frames since the last resize
+	float desired_scale;					// what the filtered time asks for
+	unsigned long long frames;
+	unsigned long long timed;				// frames whose GPU time was read back
+	unsigned long long lowered;				// resizes down
+	unsigned long long raised;				// resizes up
+	double scale_sum;						// for the average scale
+	float min_scale_seen;
+};
+typedef struct dynres_statistics DynresStats;
+
+/**
+ * Draw the scene into an offscreen target that shrinks until the scene's
+ * GPU time, measured by a pair of GL_TIMESTAMP queries around it, meets
+ * target_ms. It then grows back while there is room again. Pixel cost is
+ * taken as proportional to area, so a measured time t asks for
+ * scale * sqrt(target_ms * DYNRES_HEADROOM / t). Drops happen at once,
+ * rises one DYNRES_STEP at a time after DYNRES_SETTLE_FRAMES. The target is
+ * upscaled to the window with the given sharpening.
+ */
+bool dynres_init(float target_ms, float sharpness = DYNRES_DEFAULT_SHARPNESS);
+
+bool dynres_enabled();
+
+/**
+ * Update the scale from the GPU times read back since the last frame, then
+ * bind the offscreen target for a width x height window, set the viewport to
+ * the scaled size (returned in scene_width and scene_height) and clear it.
+ * Draw the scene, then call dynres_end.
+ */
+void dynres_begin(int width, int height, int* scene_width, int* scene_height);
+
+void dynres_end();							// Upscale the scene into the framebuffer and viewport bound at dynres_begin
+
+DynresStats dynres_stats();
+
+void dynres_report();
+
+void dynres_destroy();
+#endif//__DYNRES_H__
@@ -1,13 +1,26 @@
 #include <GLEW/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <atomic>
+
 #include "events.h"
 
 namespace events {
+	std::atomic<unsigned long long> pending_size(0);	// width << 32 | height, 0 when applied
+
 	/**
 	 * Callback to handle framebuffer resize events.
 	 */
 	void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-		glViewport(0, 0, width, height);	//set viewport to the full width and height of the new framebuffer
+		pending_size.store((unsigned long long)width << 32 | (unsigned int)height);	// leave the viewport to the render thread
+	}
+
+	bool take_framebuffer_size(int* width, int* height) {
+		unsigned long long size = pending_size.exchange(0);
+		if (size == 0)
+			return false;
+		*width = (int)(size >> 32);
+		*height = (int)(size & 0xffffffffu);
+		return true;
 	}
 }
\ No newline at end of file
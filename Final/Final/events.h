@@ -6,5 +6,12 @@ namespace events {
 	 *	framebuffer resize event.
 	 */
 	void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+
+	/**
+	 * The size of the last resize not yet applied, if any. Events are polled
+	 * on the main thread, which need not hold the GL context, so the render
+	 * thread sets the viewport.
+	 */
+	bool take_framebuffer_size(int* width, int* height);
 }
 #endif//__EVENTS_H__
\ No newline at end of file
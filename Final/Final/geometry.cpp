@@ -0,0 +1,397 @@
+#include <GLEW/glew.h>
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "geometry.h"
+
+/**
+ * One contiguous free region of a buffer. Offsets and sizes are in the unit of
+ * the buffer they describe (bytes for vertices, indices for the index buffer).
+ */
+struct free_block {
+	size_t offset;
+	size_t size;
+};
+
+/**
+ * First-fit sub-allocator over a fixed-size buffer. Free blocks are kept
+ * sorted by offset so neighbours can be merged when a range is released.
+ */
+struct range_allocator {
+	size_t capacity = 0;
+	size_t used = 0;
+	std::vector<free_block> free_blocks;
+};
+typedef struct range_allocator RangeAllocator;
+
+/**
+ * Describes one attribute of a vertex format: its shader location, number of
+ * floats and byte offset inside the vertex.
+ */
+struct vertex_attribute {
+	unsigned int location;
+	int components;
+	size_t offset;
+};
+
+struct vertex_layout {
+	unsigned int stride;
+	unsigned int attribute_count;
+	vertex_attribute attributes[4];
+};
+
+static const vertex_layout layouts[VERTEX_FORMAT_COUNT] = {
+	{ 8 * sizeof(float), 3, { { 0, 3, 0 }, { 1, 3, 3 * sizeof(float) }, { 2, 2, 6 * sizeof(float) } } },	// VERTEX_FORMAT_TEXTURED
+	{ 6 * sizeof(float), 2, { { 0, 3, 0 }, { 1, 3, 3 * sizeof(float) } } },								// VERTEX_FORMAT_COLORED
+	{ 10 * sizeof(float), 4, { { 0, 3, 0 }, { 1, 3, 3 * sizeof(float) }, { 2, 2, 6 * sizeof(float) }, { 3, 2, 8 * sizeof(float) } } }	// VERTEX_FORMAT_LIGHTMAPPED
+};
+
+namespace glob {
+	unsigned int arena_VBO = 0;
+	unsigned int arena_IBO = 0;
+	unsigned int arena_VAOs[VERTEX_FORMAT_COUNT] = { 0 };
+	int bound_vertex_format = -1;
+	unsigned int arena_mesh_count = 0;
+
+	RangeAllocator vertex_allocator;
+	RangeAllocator index_allocator;
+}
+
+static void allocator_reset(RangeAllocator& allocator, size_t capacity) {
+	allocator.capacity = capacity;
+	allocator.used = 0;
+	allocator.free_blocks.clear();
+	allocator.free_blocks.push_back({ 0, capacity });
+}
+
+/**
+ * Find the first free block that fits size units starting at a multiple of
+ * alignment. Returns false when no block is large enough.
+ */
+static bool allocator_alloc(RangeAllocator& allocator, size_t size, size_t alignment, size_t& offset) {
+	for (size_t i = 0; i < allocator.free_blocks.size(); ++i) {
+		free_block block = allocator.free_blocks[i];
+		size_t aligned = (block.offset + alignment - 1) / alignment * alignment;	// Alignment need not be a power of two (vertex strides)
+		if (aligned + size > block.offset + block.size)
+			continue;
+
+		allocator.free_blocks.erase(allocator.free_blocks.begin() + i);
+
+		size_t tail = block.offset + block.size - (aligned + size);
+		if (tail > 0)
+			allocator.free_blocks.insert(allocator.free_blocks.begin() + i, { aligned + size, tail });	// Space left after the allocation
+		if (aligned > block.offset)
+			allocator.free_blocks.insert(allocator.free_blocks.begin() + i, { block.offset, aligned - block.offset });	// Padding before the allocation
+
+		allocator.used += size;
+		offset = aligned;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Give a range back to the allocator and merge it with its neighbours.
+ */
+static void allocator_free(RangeAllocator& allocator, size_t offset, size_t size) {
+	if (size == 0)
+		return;
+
+	size_t i = 0;
+	while (i < allocator.free_blocks.size() && allocator.free_blocks[i].offset < offset)
+		++i;
+	allocator.free_blocks.insert(allocator.free_blocks.begin() + i, { offset, size });
+	allocator.used -= size;
+
+	if (i + 1 < allocator.free_blocks.size()
+		&& allocator.free_blocks[i].offset + allocator.free_blocks[i].size == allocator.free_blocks[i + 1].offset) {
+		allocator.free_blocks[i].size += allocator.free_blocks[i + 1].size;
+		allocator.free_blocks.erase(allocator.free_blocks.begin() + i + 1);
+	}	// merge with next block
+	if (i > 0
+		&& allocator.free_blocks[i - 1].offset + allocator.free_blocks[i - 1].size == allocator.free_blocks[i].offset) {
+		allocator.free_blocks[i - 1].size += allocator.free_blocks[i].size;
+		allocator.free_blocks.erase(allocator.free_blocks.begin() + i);
+	}	// merge with previous block
+}
+
+static void allocator_measure(const RangeAllocator& allocator, size_t& largest_free, float& fragmentation) {
+	size_t total_free = 0;
+	largest_free = 0;
+	for (const free_block& block : allocator.free_blocks) {
+		total_free += block.size;
+		if (block.size > largest_free)
+			largest_free = block.size;
+	}
+	fragmentation = total_free > 0 ? 1.f - (float)largest_free / (float)total_free : 0.f;
+}
+
+void geometry_init(size_t vertex_bytes, size_t index_count) {
+	using namespace glob;
+
+	/**
+	 * Allocate storage for the shared buffers once. Meshes are copied into
+	 * sub-ranges with glBufferSubData.
+	 */
+	glGenBuffers(1, &arena_VBO);
+	glGenBuffers(1, &arena_IBO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, arena_VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertex_bytes, NULL, GL_STATIC_DRAW);
+
+	/**
+	 * Create one VAO per vertex format. Every VAO reads from the same VBO
+	 * starting at byte 0; meshes are selected with base vertex offsets, so the
+	 * attribute pointers never change after this point.
+	 */
+	glGenVertexArrays(VERTEX_FORMAT_COUNT, arena_VAOs);
+	for (int format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+		const vertex_layout& layout = layouts[format];
+
+		glBindVertexArray(arena_VAOs[format]);
+		glBindBuffer(GL_ARRAY_BUFFER, arena_VBO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena_IBO);	// Element buffer binding is VAO state
+
+		for (unsigned int i = 0; i < layout.attribute_count; ++i) {
+			const vertex_attribute& attribute = layout.attributes[i];
+			glVertexAttribPointer(attribute.location, attribute.components,
+				GL_FLOAT, GL_FALSE,
+				layout.stride,
+				(void*)attribute.offset);
+			glEnableVertexAttribArray(attribute.location);
+		}
+	}
+
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+	bound_vertex_format = -1;
+
+	allocator_reset(vertex_allocator, vertex_bytes);
+	allocator_reset(index_allocator, index_count);
+	arena_mesh_count = 0;
+}
+
+MeshRange geometry_upload_indexed(vertex_format format, const void* vertices, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count) {
+	using namespace glob;
+
+	MeshRange mesh;
+	mesh.format = format;
+
+	size_t stride = layouts[format].stride;
+	size_t vertex_offset, index_offset;
+
+	if (!allocator_alloc(vertex_allocator, vertex_count * stride, stride, vertex_offset)) {
+		std::cerr << "ERROR::GEOMETRY::ARENA::VERTEX_BUFFER_FULL" << std::endl;
+		return mesh;
+	}
+	if (!allocator_alloc(index_allocator, index_count, 1, index_offset)) {
+		allocator_free(vertex_allocator, vertex_offset, vertex_count * stride);
+		std::cerr << "ERROR::GEOMETRY::ARENA::INDEX_BUFFER_FULL" << std::endl;
+		return mesh;
+	}
+
+	/**
+	 * Every format starts with a vec3 position. Fit a bounding sphere around
+	 * the center of the mesh's axis aligned bounds.
+	 */
+	const char* bytes = (const char*)vertices;
+	glm::vec3 lower = glm::vec3(0.f), upper = glm::vec3(0.f);
+	for (unsigned int i = 0; i < vertex_count; ++i) {
+		const float* position = (const float*)(bytes + i * stride);
+		glm::vec3 point = glm::vec3(position[0], position[1], position[2]);
+		lower = i == 0 ? point : glm::min(lower, point);
+		upper = i == 0 ? point : glm::max(upper, point);
+	}
+	mesh.bounds_center = (lower + upper) * 0.5f;
+	for (unsigned int i = 0; i < vertex_count; ++i) {
+		const float* position = (const float*)(bytes + i * stride);
+		mesh.bounds_radius = glm::max(mesh.bounds_radius, glm::length(glm::vec3(position[0], position[1], position[2]) - mesh.bounds_center));
+	}
+
+	mesh.base_vertex = (unsigned int)(vertex_offset / stride);
+	mesh.vertex_count = vertex_count;
+	mesh.first_index = (unsigned int)index_offset;
+	mesh.index_count = index_count;
+
+	glBindBuffer(GL_ARRAY_BUFFER, arena_VBO);
+	glBufferSubData(GL_ARRAY_BUFFER, vertex_offset, vertex_count * stride, vertices);
+
+	geometry_bind(format);																// Element buffer is only reachable through a VAO in core profile
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, index_offset * sizeof(unsigned int), index_count * sizeof(unsigned int), indices);
+
+	++arena_mesh_count;
+	return mesh;
+}
+
+/**
+ * Upload an unindexed triangle list. Identical vertices are merged and an
+ * index list is generated, so meshes built for glDrawArrays shrink in the arena.
+ */
+MeshRange geometry_upload(vertex_format format, const void* vertices, unsigned int vertex_count) {
+	size_t stride = layouts[format].stride;
+	const char* bytes = (const char*)vertices;
+
+	std::unordered_map<std::string, unsigned int> lookup;
+	std::vector<char> unique;
+	std::vector<unsigned int> indices;
+	indices.reserve(vertex_count);
+
+	for (unsigned int i = 0; i < vertex_count; ++i) {
+		std::string key(bytes + i * stride, stride);
+		auto found = lookup.find(key);
+		if (found == lookup.end()) {
+			unsigned int index = (unsigned int)lookup.size();
+			lookup.emplace(key, index);
+			unique.insert(unique.end(), key.begin(), key.end());
+			indices.push_back(index);
+		}
+		else {
+			indices.push_back(found->second);
+		}
+	}
+
+	return geometry_upload_indexed(format, unique.data(), (unsigned int)lookup.size(), indices.data(), (unsigned int)indices.size());
+}
+
+void geometry_free(MeshRange& mesh) {
+	using namespace glob;
+
+	if (mesh.index_count == 0)
+		return;
+
+	allocator_free(vertex_allocator, (size_t)mesh.base_vertex * layouts[mesh.format].stride, (size_t)mesh.vertex_count * layouts[mesh.format].stride);
+	allocator_free(index_allocator, mesh.first_index, mesh.index_count);
+	--arena_mesh_count;
+
+	mesh.vertex_count = 0;
+	mesh.index_count = 0;
+}
+
+bool geometry_read(const MeshRange& mesh, std::vector<float>& vertices, std::vector<unsigned int>& indices) {
+	using namespace glob;
+
+	if (mesh.index_count == 0)
+		return false;
+
+	size_t stride = layouts[mesh.format].stride;
+	vertices.resize(mesh.vertex_count * stride / sizeof(float));
+	indices.resize(mesh.index_count);
+
+	glBindBuffer(GL_ARRAY_BUFFER, arena_VBO);
+	glGetBufferSubData(GL_ARRAY_BUFFER, (size_t)mesh.base_vertex * stride, mesh.vertex_count * stride, vertices.data());
+	geometry_bind(mesh.format);
+	glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (size_t)mesh.first_index * sizeof(unsigned int), mesh.index_count * sizeof(unsigned int), indices.data());
+	return true;
+}
+
+void geometry_bind(vertex_format format) {
+	using namespace glob;
+
+	if (bound_vertex_format == format)
+		return;
+
+	glBindVertexArray(arena_VAOs[format]);
+	bound_vertex_format = format;
+}
+
+void geometry_draw(const MeshRange& mesh, unsigned int mode) {
+	geometry_bind(mesh.format);
+	glDrawElementsBaseVertex(mode, mesh.index_count, GL_UNSIGNED_INT,
+		(void*)(mesh.first_index * sizeof(unsigned int)),
+		mesh.base_vertex);
+}
+
+unsigned int geometry_vertex_stride(vertex_format format) {
+	return layouts[format].stride;
+}
+
+/**
+ * Gribb/Hartmann plane extraction. glm matrices are column major, so row i of
+ * the matrix is (m[0][i], m[1][i], m[2][i], m[3][i]).
+ */
+Frustum geometry_frustum(const glm::mat4& m) {
+	Frustum frustum;
+	glm::vec4 row_x = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row_y = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row_z = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row_w = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	frustum.planes[0] = row_w + row_x;	// left
+	frustum.planes[1] = row_w - row_x;	// right
+	frustum.planes[2] = row_w + row_y;	// bottom
+	frustum.planes[3] = row_w - row_y;	// top
+	frustum.planes[4] = row_w + row_z;	// near
+	frustum.planes[5] = row_w - row_z;	// far
+
+	for (glm::vec4& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));	// Normalize so plane distances are in world units
+	return frustum;
+}
+
+void geometry_world_sphere(const MeshRange& mesh, const glm::mat4& model, glm::vec3& center, float& radius) {
+	center = glm::vec3(model * glm::vec4(mesh.bounds_center, 1.f));
+	float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	radius = mesh.bounds_radius * scale;
+}
+
+bool geometry_visible(const Frustum& frustum, const MeshRange& mesh, const glm::mat4& model) {
+	glm::vec3 center;
+	float radius;
+	geometry_world_sphere(mesh, model, center, radius);
+
+	for (const glm::vec4& plane : frustum.planes) {
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;			// Sphere is completely behind one plane
+	}
+	return true;
+}
+
+ArenaStats geometry_stats() {
+	using namespace glob;
+
+	ArenaStats stats;
+	stats.vertex_capacity = vertex_allocator.capacity;
+	stats.vertex_used = vertex_allocator.used;
+	allocator_measure(vertex_allocator, stats.vertex_largest_free, stats.vertex_fragmentation);
+
+	stats.index_capacity = index_allocator.capacity;
+	stats.index_used = index_allocator.used;
+	allocator_measure(index_allocator, stats.index_largest_free, stats.index_fragmentation);
+
+	stats.mesh_count = arena_mesh_count;
+	return stats;
+}
+
+void geometry_report() {
+	ArenaStats stats = geometry_stats();
+
+	std::cout << "Static geometry arena: " << stats.mesh_count << " meshes\n"
+		<< "\tvertices: " << stats.vertex_used << " / " << stats.vertex_capacity << " bytes ("
+		<< 100.f * stats.vertex_used / stats.vertex_capacity << "% used, "
+		<< 100.f * stats.vertex_fragmentation << "% fragmented)\n"
+		<< "\tindices:  " << stats.index_used << " / " << stats.index_capacity << " ("
+		<< 100.f * stats.index_used / stats.index_capacity << "% used, "
+		<< 100.f * stats.index_fragmentation << "% fragmented)" << std::endl;
+}
+
+void geometry_destroy() {
+	using namespace glob;
+
+	glBindVertexArray(0);
+	glDeleteVertexArrays(VERTEX_FORMAT_COUNT, arena_VAOs);
+	glDeleteBuffers(1, &arena_VBO);
+	glDeleteBuffers(1, &arena_IBO);
+
+	for (int format = 0; format < VERTEX_FORMAT_COUNT; ++format)
+		arena_VAOs[format] = 0;
+	arena_VBO = arena_IBO = 0;
+	bound_vertex_format = -1;
+	arena_mesh_count = 0;
+
+	vertex_allocator = RangeAllocator();
+	index_allocator = RangeAllocator();
+}
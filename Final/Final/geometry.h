@@ -0,0 +1,96 @@
+#pragma once
+#ifndef __GEOMETRY_H__
+#define __GEOMETRY_H__
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * Vertex layouts that can live in the static geometry arena. Each layout owns
+ * exactly one VAO, which is shared by every mesh stored in that layout.
+ */
+enum vertex_format {
+	VERTEX_FORMAT_TEXTURED = 0,		// position (vec3), normal (vec3), texture coordinate (vec2)
+	VERTEX_FORMAT_COLORED,			// position (vec3), color (vec3)
+	VERTEX_FORMAT_LIGHTMAPPED,		// VERTEX_FORMAT_TEXTURED plus a lightmap coordinate (vec2, see lightmap.h)
+	VERTEX_FORMAT_COUNT
+};
+
+/**
+ * Location of one mesh inside the shared vertex and index buffers.
+ */
+struct mesh_range {
+	vertex_format format = VERTEX_FORMAT_TEXTURED;
+	unsigned int base_vertex = 0;	// First vertex of the mesh, counted in strides of its format
+	unsigned int vertex_count = 0;	// Number of unique vertices stored for the mesh
+	unsigned int first_index = 0;	// First index of the mesh in the shared index buffer
+	unsigned int index_count = 0;	// Number of indices to draw (0 if the upload failed)
+
+	glm::vec3 bounds_center = glm::vec3(0.f);	// Object space bounding sphere, used for culling
+	float bounds_radius = 0.f;
+};
+typedef struct mesh_range MeshRange;
+
+/**
+ * Six clip planes (left, right, bottom, top, near, far) with normals pointing
+ * into the frustum, extracted from a combined projection * view matrix.
+ */
+struct frustum {
+	glm::vec4 planes[6];
+};
+typedef struct frustum Frustum;
+
+/**
+ * Snapshot of how full and how fragmented the arena is.
+ *
+ *	fragmentation is 1 - (largest free block / total free space), so 0 means all
+ *	free space is contiguous and values near 1 mean it is scattered in small holes.
+ */
+struct arena_stats {
+	size_t vertex_capacity;			// bytes
+	size_t vertex_used;				// bytes
+	size_t vertex_largest_free;		// bytes
+	float vertex_fragmentation;
+
+	size_t index_capacity;			// indices
+	size_t index_used;				// indices
+	size_t index_largest_free;		// indices
+	float index_fragmentation;
+
+	unsigned int mesh_count;
+};
+typedef struct arena_stats ArenaStats;
+
+void geometry_init(size_t vertex_bytes, size_t index_count);	// Create the shared VBO/IBO pair and one VAO per vertex format
+
+MeshRange geometry_upload(vertex_format format, const void* vertices, unsigned int vertex_count);
+MeshRange geometry_upload_indexed(vertex_format format, const void* vertices, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count);
+
+void geometry_free(MeshRange& mesh);							// Return a mesh's ranges to the arena
+
+/**
+ * Read a mesh back from the arena: vertex_count vertices of its format as
+ * floats, and its indices counted from its first vertex. Stalls on the GPU,
+ * so only for offline work such as lightmap baking.
+ */
+bool geometry_read(const MeshRange& mesh, std::vector<float>& vertices, std::vector<unsigned int>& indices);
+
+void geometry_bind(vertex_format format);						// Bind the shared VAO of a format (no-op if already bound)
+
+void geometry_draw(const MeshRange& mesh, unsigned int mode);	// Bind the mesh's VAO and draw it with its base vertex
+
+unsigned int geometry_vertex_stride(vertex_format format);
+
+Frustum geometry_frustum(const glm::mat4& view_projection);
+
+bool geometry_visible(const Frustum& frustum, const MeshRange& mesh, const glm::mat4& model);	// Test the mesh's bounding sphere against the frustum
+
+void geometry_world_sphere(const MeshRange& mesh, const glm::mat4& model, glm::vec3& center, float& radius);	// Bounding sphere in world space (radius scaled by the largest axis)
+
+ArenaStats geometry_stats();
+
+void geometry_report();											// Print utilization and fragmentation to stdout
+
+void geometry_destroy();										// Delete the shared buffers and VAOs
+#endif//__GEOMETRY_H__
@@ -0,0 +1,239 @@
+#include <GLEW/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <map>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "hotreload.h"
+#include "shader.h"
+
+#ifndef __linux__
+const double HOTRELOAD_POLL_SECONDS = 0.25;	// How often modification times are checked without inotify
+#endif
+
+/**
+ * A Shader recompiling in the background, and when its change was noticed.
+ */
+struct hotreload_job {
+	Shader* shader;
+	std::chrono::high_resolution_clock::time_point start;
+};
+typedef struct hotreload_job HotReloadJob;
+
+namespace glob {
+	std::string hotreload_directory;
+	std::vector<HotReloadJob> hotreload_jobs;
+	HotReloadStats hotreload_counters;
+	bool hotreload_active = false;
+#ifdef __linux__
+	int hotreload_fd = -1;
+#else
+	std::map<std::string, long long> hotreload_mtimes;
+	std::chrono::high_resolution_clock::time_point hotreload_last_poll;
+#endif
+}
+
+#ifndef __linux__
+static long long modification_time(const std::string& path) {
+#ifdef _WIN32
+	struct _stat info;
+	return _stat(path.c_str(), &info) == 0 ? (long long)info.st_mtime : -1;
+#else
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 ? (long long)info.st_mtime : -1;
+#endif
+}
+#endif
+
+bool hotreload_init(const char* directory) {
+	using namespace glob;
+
+	hotreload_destroy();
+	hotreload_directory = directory;
+	hotreload_counters = HotReloadStats();
+
+#ifdef __linux__
+	/**
+	 * Editors either rewrite the file in place (IN_CLOSE_WRITE) or write a
+	 * temporary and rename it over the original (IN_MOVED_TO).
+	 */
+	hotreload_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (hotreload_fd < 0 || inotify_add_watch(hotreload_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		std::cerr << "ERROR::HOTRELOAD::WATCH_FAILED " << directory << std::endl;
+		hotreload_destroy();
+		return false;
+	}
+#else
+	hotreload_last_poll = std::chrono::high_resolution_clock::now();
+#endif
+	hotreload_active = true;
+	return true;
+}
+
+/**
+ * Paths (as Shaders name them, "directory/file") saved since the last call.
+ */
+static std::set<std::string> hotreload_changed_files() {
+	using namespace glob;
+
+	std::set<std::string> changed;
+#ifdef __linux__
+	alignas(struct inotify_event) char buffer[4096];
+	ssize_t length;
+	while ((length = read(hotreload_fd, buffer, sizeof(buffer))) > 0) {
+		for (char* event = buffer; event < buffer + length; ) {
+			const struct inotify_event* info = (const struct inotify_event*)event;
+			if (info->len > 0)
+				changed.insert(hotreload_directory + "/" + info->name);
+			event += sizeof(struct inotify_event) + info->len;
+		}
+	}
+#else
+	auto now = std::chrono::high_resolution_clock::now();
+	if (std::chrono::duration<double>(now - hotreload_last_poll).count() < HOTRELOAD_POLL_SECONDS)
+		return changed;
+	hotreload_last_poll = now;
+
+	std::set<std::string> files;
+	for (const Shader* shader : Shader::instances()) {
+		for (const std::string& path : { shader->vertexSource(), shader->fragmentSource(), shader->geometrySource() }) {
+			if (path.compare(0, hotreload_directory.size(), hotreload_directory) == 0)
+				files.insert(path);
+		}
+	}
+	for (const std::string& path : files) {
+		long long mtime = modification_time(path);
+		auto known = hotreload_mtimes.find(path);
+		if (known != hotreload_mtimes.end() && known->second != mtime)
+			changed.insert(path);
+		hotreload_mtimes[path] = mtime;
+	}
+#endif
+	return changed;
+}
+
+/**
+ * Fragment (or compute) shader path plus the defines of its variant, if any.
+ */
+static std::string shader_label(const Shader* shader) {
+	std::string defines;
+	size_t line = 0;
+	const std::string& source = shader->sourceDefines();
+	while (line < source.size()) {
+		size_t end = source.find('\n', line);
+		if (end == std::string::npos)
+			end = source.size();
+		std::string define = source.substr(line, end - line);
+		if (define.compare(0, 8, "#define ") == 0)
+			define = define.substr(8);
+		defines += (defines.empty() ? "" : ", ") + define;
+		line = end + 1;
+	}
+	return (shader->computeOnly() ? shader->vertexSource() : shader->fragmentSource()) + (defines.empty() ? "" : " [" + defines + "]");
+}
+
+void hotreload_update() {
+	using namespace glob;
+
+	if (!hotreload_active)
+		return;
+
+	/**
+	 * Start (or restart, if a second save lands mid-compile) a reload of every
+	 * Shader built from a changed file.
+	 */
+	std::set<std::string> changed = hotreload_changed_files();
+	if (!changed.empty()) {
+		auto now = std::chrono::high_resolution_clock::now();
+		for (Shader* shader : Shader::instances()) {
+			bool uses = false;
+			for (const std::string& path : changed)
+				uses |= shader->usesFile(path);
+			if (!uses)
+				continue;
+
+			hotreload_jobs.erase(std::remove_if(hotreload_jobs.begin(), hotreload_jobs.end(),
+				[shader](const HotReloadJob& job) { return job.shader == shader; }), hotreload_jobs.end());
+			if (shader->reload())
+				hotreload_jobs.push_back({ shader, now });
+			else
+				++hotreload_counters.failures;
+		}
+	}
+
+	/**
+	 * Swap in whatever finished. A failed compile or link has already printed
+	 * its log; the old program simply stays.
+	 */
+	for (size_t i = 0; i < hotreload_jobs.size(); ) {
+		HotReloadJob job = hotreload_jobs[i];
+		if (std::find(Shader::instances().begin(), Shader::instances().end(), job.shader) == Shader::instances().end()) {
+			hotreload_jobs.erase(hotreload_jobs.begin() + i);		// Deleted mid-reload
+			continue;
+		}
+		Shader::ReloadStatus status = job.shader->pollReload();
+		if (status == Shader::RELOAD_COMPILING) {
+			++i;
+			continue;
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - job.start).count();
+		if (status == Shader::RELOAD_SWAPPED) {
+			++hotreload_counters.reloads;
+			hotreload_counters.last_ms = ms;
+			hotreload_counters.max_ms = std::max(hotreload_counters.max_ms, ms);
+			hotreload_counters.total_ms += ms;
+			std::cout << "Reloaded " << shader_label(job.shader) << " in " << ms << " ms" << std::endl;
+		}
+		else {
+			++hotreload_counters.failures;
+			std::cerr << "ERROR::HOTRELOAD::KEPT_PREVIOUS_PROGRAM " << shader_label(job.shader) << std::endl;
+		}
+		hotreload_jobs.erase(hotreload_jobs.begin() + i);
+	}
+}
+
+HotReloadStats hotreload_stats() {
+	return glob::hotreload_counters;
+}
+
+void hotreload_report() {
+	HotReloadStats stats = hotreload_stats();
+	if (stats.reloads + stats.failures == 0)
+		return;
+
+	std::cout << "Shader hot reload: " << stats.reloads << " programs swapped";
+	if (stats.reloads > 0)
+		std::cout << " (" << stats.total_ms / stats.reloads << " ms average, " << stats.max_ms << " ms worst)";
+	std::cout << ", " << stats.failures << " failed and kept the previous program" << std::endl;
+}
+
+void hotreload_destroy() {
+	using namespace glob;
+
+	for (HotReloadJob& job : hotreload_jobs) {
+		if (std::find(Shader::instances().begin(), Shader::instances().end(), job.shader) != Shader::instances().end())
+			job.shader->cancelReload();
+	}
+	hotreload_jobs.clear();
+#ifdef __linux__
+	if (hotreload_fd >= 0)
+		close(hotreload_fd);
+	hotreload_fd = -1;
+#else
+	hotreload_mtimes.clear();
+#endif
+	hotreload_active = false;
+}
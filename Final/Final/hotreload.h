@@ -0,0 +1,36 @@
+#pragma once
+#ifndef __HOTRELOAD_H__
+#define __HOTRELOAD_H__
+
+/**
+ * Latency is measured from the frame a change was noticed to the frame the
+ * new program replaced the old one.
+ */
+struct hotreload_statistics {
+	unsigned int reloads;			// programs swapped
+	unsigned int failures;			// reloads that kept the previous program
+	double last_ms;
+	double max_ms;
+	double total_ms;
+};
+typedef struct hotreload_statistics HotReloadStats;
+
+/**
+ * Watch directory for saved shader sources (inotify on Linux, modification
+ * times elsewhere). Every Shader built from a changed file is recompiled.
+ */
+bool hotreload_init(const char* directory);
+
+/**
+ * Call once per frame. Starts reloads for changed files and swaps in every
+ * program that finished compiling; never waits on the driver when it supports
+ * GL_COMPLETION_STATUS_KHR.
+ */
+void hotreload_update();
+
+HotReloadStats hotreload_stats();
+
+void hotreload_report();
+
+void hotreload_destroy();
+#endif//__HOTRELOAD_H__
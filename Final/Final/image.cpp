@@ -0,0 +1,757 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_SSE2
+#endif
+
+/**
+ * AVX2 (+FMA) code is compiled for every x86 build and only called after a runtime
+ * CPU check; GCC/Clang need the target attribute to accept the intrinsics.
+ */
+#if defined(IMAGE_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define IMAGE_AVX2
+#define IMAGE_AVX2_TARGET __attribute__((target("avx2,fma")))
+#elif defined(IMAGE_SSE2) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#define IMAGE_AVX2
+#define IMAGE_AVX2_TARGET
+#endif
+
+#include "stb_image.h"
+
+#include "image.h"
+
+const int LINEAR_TO_SRGB_STEPS = 16384;		// Resolution of the encode table, fine enough for the darkest sRGB steps
+const int MIP_ROWS_PER_WORKER = 16;			// Smaller levels are not worth another thread
+
+/**
+ * Source texels that contribute to one output texel along one axis, with the
+ * fraction of the output texel each of them covers.
+ */
+struct filter_span {
+	int first;
+	std::vector<float> weights;
+};
+typedef struct filter_span FilterSpan;
+
+/**
+ * One mip level in linear light. Texels are RGBA floats (alpha unused) so each
+ * is exactly one 128-bit lane.
+ */
+struct linear_level {
+	int width = 0;
+	int height = 0;
+	std::vector<float> texels;
+};
+typedef struct linear_level LinearLevel;
+
+/**
+ * Row kernels for one instruction set.
+ *	combine: dst = sum of rows[k] * weights[k] over count floats
+ *	halve:   dst texel x = (src texel 2x + src texel 2x + 1) / 2, for width output texels
+ */
+struct mip_kernels {
+	void (*combine)(float* dst, const float* const* rows, const float* weights, size_t taps, size_t count);
+	void (*halve)(float* dst, const float* src, int width);
+	bool sse;
+};
+typedef struct mip_kernels MipKernels;
+
+namespace glob {
+	int image_default_max_dimension = 0;
+	ImageStats image_counters;
+
+	float srgb_to_linear[256];
+	unsigned char linear_to_srgb[LINEAR_TO_SRGB_STEPS];
+	bool image_tables_ready = false;
+}
+
+static void image_build_tables() {
+	using namespace glob;
+
+	if (image_tables_ready)
+		return;
+
+	for (int value = 0; value < 256; ++value) {
+		float c = value / 255.f;
+		srgb_to_linear[value] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+	for (int step = 0; step < LINEAR_TO_SRGB_STEPS; ++step) {
+		float c = (float)step / (LINEAR_TO_SRGB_STEPS - 1);
+		float encoded = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+		linear_to_srgb[step] = (unsigned char)std::min(255.f, std::max(0.f, encoded * 255.f + 0.5f));
+	}
+	image_tables_ready = true;
+}
+
+static std::vector<FilterSpan> area_filter(int source_size, int target_size) {
+	std::vector<FilterSpan> spans(target_size);
+	double scale = (double)source_size / target_size;
+
+	for (int target = 0; target < target_size; ++target) {
+		double begin = target * scale;
+		double end = (target + 1) * scale;
+		int first = (int)std::floor(begin);
+		int last = std::min(source_size, (int)std::ceil(end));
+
+		spans[target].first = first;
+		for (int source = first; source < last; ++source) {
+			double overlap = std::min(end, source + 1.0) - std::max(begin, (double)source);
+			spans[target].weights.push_back((float)(overlap / scale));
+		}
+	}
+	return spans;
+}
+
+/**
+ * acc += row * weight over count floats. This is where the vertical pass
+ * spends its time, so it is vectorized; the tail is scalar.
+ */
+static void accumulate_row(float* acc, const float* row, float weight, size_t count) {
+	size_t i = 0;
+#ifdef IMAGE_SSE2
+	__m128 w = _mm_set1_ps(weight);
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(_mm_loadu_ps(row + i), w)));
+#endif
+	for (; i < count; ++i)
+		acc[i] += row[i] * weight;
+}
+
+/**
+ * Filter one source row horizontally into linear-light floats.
+ */
+static void filter_row(const unsigned char* source, const std::vector<FilterSpan>& columns, std::vector<float>& linear, float* out) {
+	using namespace glob;
+
+	for (size_t i = 0; i < linear.size(); ++i)
+		linear[i] = srgb_to_linear[source[i]];
+
+	for (size_t column = 0; column < columns.size(); ++column) {
+		const FilterSpan& span = columns[column];
+		float r = 0.f, g = 0.f, b = 0.f;
+		const float* texel = &linear[(size_t)span.first * 3];
+		for (float weight : span.weights) {
+			r += texel[0] * weight;
+			g += texel[1] * weight;
+			b += texel[2] * weight;
+			texel += 3;
+		}
+		out[column * 3 + 0] = r;
+		out[column * 3 + 1] = g;
+		out[column * 3 + 2] = b;
+	}
+}
+
+static void downscale_texels(const unsigned char* source, int source_width, int source_height, unsigned char* target, int width, int height) {
+	using namespace glob;
+
+	image_build_tables();
+
+	std::vector<FilterSpan> columns = area_filter(source_width, width);
+	std::vector<FilterSpan> rows = area_filter(source_height, height);
+
+	size_t source_stride = (size_t)source_width * 3;
+	size_t target_stride = (size_t)width * 3;
+	std::vector<float> linear(source_stride);
+	std::vector<float> filtered(target_stride);
+	std::vector<float> acc(target_stride);
+
+	/**
+	 * Neighbouring output rows share the source row on their boundary, so
+	 * keep the last horizontally filtered row instead of filtering it twice.
+	 */
+	std::vector<float> boundary(target_stride);
+	int boundary_row = -1;
+
+	for (int row = 0; row < height; ++row) {
+		std::fill(acc.begin(), acc.end(), 0.f);
+
+		const FilterSpan& span = rows[row];
+		for (size_t tap = 0; tap < span.weights.size(); ++tap) {
+			int source_row = span.first + (int)tap;
+			if (source_row == boundary_row) {
+				accumulate_row(acc.data(), boundary.data(), span.weights[tap], target_stride);
+				continue;
+			}
+
+			filter_row(source + source_row * source_stride, columns, linear, filtered.data());
+			accumulate_row(acc.data(), filtered.data(), span.weights[tap], target_stride);
+			if (tap + 1 == span.weights.size()) {
+				boundary.swap(filtered);
+				boundary_row = source_row;
+			}
+		}
+
+		unsigned char* out = target + row * target_stride;
+		for (size_t i = 0; i < target_stride; ++i) {
+			int step = (int)(acc[i] * (LINEAR_TO_SRGB_STEPS - 1) + 0.5f);
+			out[i] = linear_to_srgb[std::min(LINEAR_TO_SRGB_STEPS - 1, std::max(0, step))];
+		}
+	}
+}
+
+static void combine_rows_scalar(float* dst, const float* const* rows, const float* weights, size_t taps, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		float sum = 0.f;
+		for (size_t tap = 0; tap < taps; ++tap)
+			sum += rows[tap][i] * weights[tap];
+		dst[i] = sum;
+	}
+}
+
+static void halve_row_scalar(float* dst, const float* src, int width) {
+	for (int x = 0; x < width; ++x) {
+		for (int channel = 0; channel < 4; ++channel)
+			dst[x * 4 + channel] = 0.5f * (src[x * 8 + channel] + src[x * 8 + 4 + channel]);
+	}
+}
+
+#ifdef IMAGE_SSE2
+static void combine_rows_sse2(float* dst, const float* const* rows, const float* weights, size_t taps, size_t count) {
+	for (size_t i = 0; i < count; i += 4) {									// Rows are whole RGBA texels, so count is a multiple of 4
+		__m128 sum = _mm_setzero_ps();
+		for (size_t tap = 0; tap < taps; ++tap)
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[tap] + i), _mm_set1_ps(weights[tap])));
+		_mm_storeu_ps(dst + i, sum);
+	}
+}
+
+static void halve_row_sse2(float* dst, const float* src, int width) {
+	__m128 half = _mm_set1_ps(0.5f);
+	for (int x = 0; x < width; ++x)
+		_mm_storeu_ps(dst + x * 4, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(src + x * 8), _mm_loadu_ps(src + x * 8 + 4)), half));
+}
+#endif
+
+#ifdef IMAGE_AVX2
+IMAGE_AVX2_TARGET static void combine_rows_avx2(float* dst, const float* const* rows, const float* weights, size_t taps, size_t count) {
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 sum = _mm256_setzero_ps();
+		for (size_t tap = 0; tap < taps; ++tap)
+			sum = _mm256_fmadd_ps(_mm256_loadu_ps(rows[tap] + i), _mm256_set1_ps(weights[tap]), sum);
+		_mm256_storeu_ps(dst + i, sum);
+	}
+	for (; i < count; i += 4) {
+		__m128 sum = _mm_setzero_ps();
+		for (size_t tap = 0; tap < taps; ++tap)
+			sum = _mm_fmadd_ps(_mm_loadu_ps(rows[tap] + i), _mm_set1_ps(weights[tap]), sum);
+		_mm_storeu_ps(dst + i, sum);
+	}
+}
+
+/**
+ * Two output texels per iteration: regroup four source texels into
+ * (0, 2) and (1, 3) lane pairs and add them.
+ */
+IMAGE_AVX2_TARGET static void halve_row_avx2(float* dst, const float* src, int width) {
+	__m256 half = _mm256_set1_ps(0.5f);
+	int x = 0;
+	for (; x + 2 <= width; x += 2) {
+		__m256 a = _mm256_loadu_ps(src + x * 8);
+		__m256 b = _mm256_loadu_ps(src + x * 8 + 8);
+		__m256 even = _mm256_permute2f128_ps(a, b, 0x20);
+		__m256 odd = _mm256_permute2f128_ps(a, b, 0x31);
+		_mm256_storeu_ps(dst + x * 4, _mm256_mul_ps(_mm256_add_ps(even, odd), half));
+	}
+	if (x < width)
+		_mm_storeu_ps(dst + x * 4, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(src + x * 8), _mm_loadu_ps(src + x * 8 + 4)), _mm_set1_ps(0.5f)));
+}
+#endif
+
+static MipKernels mip_kernels_for(image_simd simd) {
+#ifdef IMAGE_AVX2
+	if (simd == IMAGE_SIMD_AVX2)
+		return { combine_rows_avx2, halve_row_avx2, true };
+#endif
+#ifdef IMAGE_SSE2
+	if (simd >= IMAGE_SIMD_SSE2)
+		return { combine_rows_sse2, halve_row_sse2, true };
+#endif
+	return { combine_rows_scalar, halve_row_scalar, false };
+}
+
+/**
+ * Odd widths: each output texel covers a little more than two source texels.
+ */
+static void filter_columns(float* dst, const float* src, const std::vector<FilterSpan>& columns, bool sse) {
+	for (size_t column = 0; column < columns.size(); ++column) {
+		const FilterSpan& span = columns[column];
+		const float* texel = src + (size_t)span.first * 4;
+#ifdef IMAGE_SSE2
+		if (sse) {
+			__m128 sum = _mm_setzero_ps();
+			for (size_t tap = 0; tap < span.weights.size(); ++tap)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(texel + tap * 4), _mm_set1_ps(span.weights[tap])));
+			_mm_storeu_ps(dst + column * 4, sum);
+			continue;
+		}
+#endif
+		for (int channel = 0; channel < 4; ++channel) {
+			float sum = 0.f;
+			for (size_t tap = 0; tap < span.weights.size(); ++tap)
+				sum += texel[tap * 4 + channel] * span.weights[tap];
+			dst[column * 4 + channel] = sum;
+		}
+	}
+}
+
+static void decode_row(const unsigned char* source, int width, float* out) {
+	for (int x = 0; x < width; ++x) {
+		out[x * 4 + 0] = glob::srgb_to_linear[source[x * 3 + 0]];
+		out[x * 4 + 1] = glob::srgb_to_linear[source[x * 3 + 1]];
+		out[x * 4 + 2] = glob::srgb_to_linear[source[x * 3 + 2]];
+		out[x * 4 + 3] = 0.f;
+	}
+}
+
+static void encode_row(const float* source, int width, unsigned char* out) {
+	for (int x = 0; x < width; ++x) {
+		for (int channel = 0; channel < 3; ++channel) {
+			int step = (int)(source[x * 4 + channel] * (LINEAR_TO_SRGB_STEPS - 1) + 0.5f);
+			out[x * 3 + channel] = glob::linear_to_srgb[std::min(LINEAR_TO_SRGB_STEPS - 1, std::max(0, step))];
+		}
+	}
+}
+
+/**
+ * Reduce source rows [first_row, last_row) of the next level. The source is
+ * either the sRGB8 base image (decoded a row at a time, so level 0 never
+ * exists in float) or the previous linear level. linear_out may be null for
+ * the last level, which nothing reads back.
+ */
+static void reduce_rows(const Image* base, const LinearLevel* previous, int source_width,
+	const std::vector<FilterSpan>& rows, const std::vector<FilterSpan>& columns, const MipKernels& kernels,
+	int first_row, int last_row, LinearLevel* linear_out, Image& out) {
+	size_t source_floats = (size_t)source_width * 4;
+	std::vector<std::vector<float>> decoded;
+	std::vector<const float*> row_pointers;
+	std::vector<float> combined(source_floats);
+	std::vector<float> reduced((size_t)out.width * 4);
+
+	for (int row = first_row; row < last_row; ++row) {
+		const FilterSpan& span = rows[row];
+		row_pointers.resize(span.weights.size());
+		if (decoded.size() < span.weights.size())
+			decoded.resize(span.weights.size(), std::vector<float>(base ? source_floats : 0));
+
+		for (size_t tap = 0; tap < span.weights.size(); ++tap) {
+			size_t source_row = (size_t)span.first + tap;
+			if (base != nullptr) {
+				decode_row(&base->texels[source_row * source_width * 3], source_width, decoded[tap].data());
+				row_pointers[tap] = decoded[tap].data();
+			}
+			else
+				row_pointers[tap] = &previous->texels[source_row * source_floats];
+		}
+		kernels.combine(combined.data(), row_pointers.data(), span.weights.data(), span.weights.size(), source_floats);
+
+		float* linear = linear_out ? &linear_out->texels[(size_t)row * out.width * 4] : reduced.data();
+		if (source_width % 2 == 0)
+			kernels.halve(linear, combined.data(), out.width);
+		else
+			filter_columns(linear, combined.data(), columns, kernels.sse);
+
+		encode_row(linear, out.width, &out.texels[(size_t)row * out.width * 3]);
+	}
+}
+
+image_simd image_best_simd() {
+#if defined(IMAGE_AVX2) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return IMAGE_SIMD_AVX2;
+	return IMAGE_SIMD_SSE2;
+#elif defined(IMAGE_AVX2)
+	int info[4];
+	__cpuid(info, 1);
+	bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;		// OSXSAVE, and the OS preserves XMM and YMM state
+	bool fma = (info[2] & (1 << 12)) != 0;
+	__cpuidex(info, 7, 0);
+	if (os_saves_ymm && fma && (info[1] & (1 << 5)))
+		return IMAGE_SIMD_AVX2;
+	return IMAGE_SIMD_SSE2;
+#elif defined(IMAGE_SSE2)
+	return IMAGE_SIMD_SSE2;
+#else
+	return IMAGE_SIMD_SCALAR;
+#endif
+}
+
+const char* image_simd_name(image_simd simd) {
+	switch (simd) {
+	case IMAGE_SIMD_AVX2: return "AVX2";
+	case IMAGE_SIMD_SSE2: return "SSE2";
+	default: return "scalar";
+	}
+}
+
+void image_build_mips(const Image& image, std::vector<Image>& levels, int threads, image_simd simd) {
+	using namespace glob;
+
+	image_build_tables();
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (threads <= 0)
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+	MipKernels kernels = mip_kernels_for(std::min(simd, image_best_simd()));
+
+	levels.clear();
+	LinearLevel previous, current;
+	int width = image.width, height = image.height;
+
+	while (width > 1 || height > 1) {
+		Image out;
+		out.width = std::max(1, width / 2);
+		out.height = std::max(1, height / 2);
+		out.texels.resize((size_t)out.width * out.height * 3);
+
+		bool last = out.width == 1 && out.height == 1;
+		current.width = out.width;
+		current.height = out.height;
+		current.texels.resize(last ? 0 : (size_t)out.width * out.height * 4);
+
+		std::vector<FilterSpan> rows = area_filter(height, out.height);
+		std::vector<FilterSpan> columns = area_filter(width, out.width);
+		const Image* base = levels.empty() ? &image : nullptr;
+
+		/**
+		 * Split output rows evenly; the calling thread takes the first share.
+		 */
+		int workers = std::max(1, std::min(threads, out.height / MIP_ROWS_PER_WORKER));
+		std::vector<std::thread> pool;
+		for (int worker = 1; worker < workers; ++worker) {
+			int first_row = out.height * worker / workers;
+			int last_row = out.height * (worker + 1) / workers;
+			pool.emplace_back(reduce_rows, base, &previous, width, std::cref(rows), std::cref(columns), std::cref(kernels),
+				first_row, last_row, last ? nullptr : &current, std::ref(out));
+		}
+		reduce_rows(base, &previous, width, rows, columns, kernels, 0, out.height / workers, last ? nullptr : &current, out);
+		for (std::thread& worker : pool)
+			worker.join();
+
+		levels.push_back(std::move(out));
+		previous.texels.swap(current.texels);
+		width = levels.back().width;
+		height = levels.back().height;
+	}
+
+	++image_counters.mip_chains;
+	image_counters.mip_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	image_counters.mip_source_texels += (size_t)image.width * image.height;
+}
+
+void image_benchmark_mips(const Image& image, int iterations) {
+	using namespace glob;
+
+	ImageStats saved = image_counters;											// Keep benchmark runs out of the load statistics
+	int cores = std::max(1, (int)std::thread::hardware_concurrency());
+	std::vector<Image> levels;
+
+	for (int simd = IMAGE_SIMD_SCALAR; simd <= image_best_simd(); ++simd) {
+		for (int threads = 1; threads <= cores; threads = threads == cores ? cores + 1 : cores) {
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < iterations; ++i)
+				image_build_mips(image, levels, threads, (image_simd)simd);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / iterations;
+
+			std::cout << "Mip chain of " << image.width << "x" << image.height << ", " << image_simd_name((image_simd)simd) << ", "
+				<< threads << " thread(s): " << ms << " ms (" << (double)image.width * image.height / 1e6 / (ms / 1000.0) << " MP/s)" << std::endl;
+		}
+	}
+
+	image_counters = saved;
+}
+
+void image_set_max_dimension(int max_dimension) {
+	glob::image_default_max_dimension = std::max(0, max_dimension);
+}
+
+int image_max_dimension() {
+	return glob::image_default_max_dimension;
+}
+
+bool image_load(const std::string& path, Image& image, int max_dimension) {
+	using namespace glob;
+
+	if (max_dimension < 0)
+		max_dimension = image_default_max_dimension;
+
+	/**
+	 * stb_image cannot decode JPEGs at a reduced DCT scale, so the full image
+	 * is always decoded and then filtered down.
+	 */
+	auto start = std::chrono::high_resolution_clock::now();
+	int width, height, channels;
+	stbi_set_flip_vertically_on_load(true);
+	unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 3);
+	auto decoded = std::chrono::high_resolution_clock::now();
+	if (pixels == nullptr) {
+		std::cerr << "ERROR::IMAGE::LOADING_FAILED " << path << std::endl;
+		return false;
+	}
+
+	++image_counters.images;
+	image_counters.decode_ms += std::chrono::duration<double, std::milli>(decoded - start).count();
+	image_counters.source_bytes += (size_t)width * height * 3;
+
+	int largest = std::max(width, height);
+	if (max_dimension > 0 && largest > max_dimension) {
+		double scale = (double)max_dimension / largest;
+		image.width = std::max(1, (int)std::lround(width * scale));
+		image.height = std::max(1, (int)std::lround(height * scale));
+		image.texels.resize((size_t)image.width * image.height * 3);
+		downscale_texels(pixels, width, height, image.texels.data(), image.width, image.height);
+
+		++image_counters.downscaled;
+		image_counters.downscale_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - decoded).count();
+	}
+	else {
+		image.width = width;
+		image.height = height;
+		image.texels.assign(pixels, pixels + (size_t)width * height * 3);
+	}
+	stbi_image_free(pixels);
+
+	image_counters.loaded_bytes += image.texels.size();
+	return true;
+}
+
+Image image_downscale(const Image& source, int width, int height) {
+	Image image;
+	image.width = width;
+	image.height = height;
+	image.texels.resize((size_t)width * height * 3);
+	downscale_texels(source.texels.data(), source.width, source.height, image.texels.data(), width, height);
+	return image;
+}
+
+void image_sample_bilinear(const Image& image, float u, float v, float rgb[3]) {
+	float x = u * image.width - 0.5f, y = v * image.height - 0.5f;
+	float fx = std::floor(x), fy = std::floor(y);
+	float wx = x - fx, wy = y - fy;
+
+	const unsigned char* corners[4];
+	for (int i = 0; i < 4; ++i) {
+		int tx = std::min(std::max((int)fx + (i & 1), 0), image.width - 1);
+		int ty = std::min(std::max((int)fy + (i >> 1), 0), image.height - 1);
+		corners[i] = &image.texels[((size_t)ty * image.width + tx) * 3];
+	}
+	for (int c = 0; c < 3; ++c) {
+		float bottom = corners[0][c] + (corners[1][c] - corners[0][c]) * wx;
+		float top = corners[2][c] + (corners[3][c] - corners[2][c]) * wx;
+		rgb[c] = (bottom + (top - bottom) * wy) * (1.f / 255.f);
+	}
+}
+
+static unsigned int png_crc(const unsigned char* data, size_t size, unsigned int crc) {
+	static unsigned int table[256];
+	if (table[1] == 0) {
+		for (unsigned int n = 0; n < 256; ++n) {
+			unsigned int c = n;
+			for (int k = 0; k < 8; ++k)
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+	}
+	for (size_t i = 0; i < size; ++i)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static void png_chunk(FILE* file, const char* type, const std::vector<unsigned char>& data) {
+	unsigned char header[8] = { (unsigned char)(data.size() >> 24), (unsigned char)(data.size() >> 16), (unsigned char)(data.size() >> 8), (unsigned char)data.size(),
+		(unsigned char)type[0], (unsigned char)type[1], (unsigned char)type[2], (unsigned char)type[3] };
+	unsigned int crc = png_crc(header + 4, 4, 0xffffffffu);
+	crc = ~png_crc(data.data(), data.size(), crc);
+	unsigned char footer[4] = { (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc };
+	fwrite(header, 1, 8, file);
+	fwrite(data.data(), 1, data.size(), file);
+	fwrite(footer, 1, 4, file);
+}
+
+bool image_save_png(const Image& image, const char* path) {
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr) {
+		std::cerr << "ERROR::IMAGE::SAVE::CANNOT_OPEN " << path << std::endl;
+		return false;
+	}
+
+	/**
+	 * Scanlines run top to bottom, each led by filter type 0.
+	 */
+	size_t row_bytes = (size_t)image.width * 3;
+	std::vector<unsigned char> raw;
+	raw.reserve((row_bytes + 1) * image.height);
+	for (int row = image.height - 1; row >= 0; --row) {
+		raw.push_back(0);
+		raw.insert(raw.end(), &image.texels[row * row_bytes], &image.texels[row * row_bytes] + row_bytes);
+	}
+
+	/**
+	 * zlib stream of stored deflate blocks (at most 65535 bytes each), then
+	 * the Adler-32 of the raw data.
+	 */
+	std::vector<unsigned char> zlib = { 0x78, 0x01 };
+	for (size_t offset = 0; offset < raw.size() || offset == 0; offset += 65535) {
+		size_t size = std::min((size_t)65535, raw.size() - offset);
+		bool last = offset + size >= raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back((unsigned char)size);
+		zlib.push_back((unsigned char)(size >> 8));
+		zlib.push_back((unsigned char)~size);
+		zlib.push_back((unsigned char)(~size >> 8));
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+		if (last)
+			break;
+	}
+	unsigned int a = 1, b = 0;
+	for (unsigned char byte : raw) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	unsigned int adler = (b << 16) | a;
+	zlib.insert(zlib.end(), { (unsigned char)(adler >> 24), (unsigned char)(adler >> 16), (unsigned char)(adler >> 8), (unsigned char)adler });
+
+	const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	fwrite(signature, 1, 8, file);
+	std::vector<unsigned char> header = {
+		(unsigned char)(image.width >> 24), (unsigned char)(image.width >> 16), (unsigned char)(image.width >> 8), (unsigned char)image.width,
+		(unsigned char)(image.height >> 24), (unsigned char)(image.height >> 16), (unsigned char)(image.height >> 8), (unsigned char)image.height,
+		8, 2, 0, 0, 0 };					// 8 bits per channel, RGB, deflate, no filtering choices, not interlaced
+	png_chunk(file, "IHDR", header);
+	png_chunk(file, "IDAT", zlib);
+	png_chunk(file, "IEND", std::vector<unsigned char>());
+	fclose(file);
+	return true;
+}
+
+bool image_save_ppm(const Image& image, const char* path) {
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr) {
+		std::cerr << "ERROR::IMAGE::SAVE::CANNOT_OPEN " << path << std::endl;
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", image.width, image.height);
+	size_t row_bytes = (size_t)image.width * 3;
+	for (int row = image.height - 1; row >= 0; --row)
+		fwrite(&image.texels[row * row_bytes], 1, row_bytes, file);	// PPM rows run top to bottom
+	fclose(file);
+	return true;
+}
+
+double image_psnr(const Image& a, const Image& b) {
+	if (a.width != b.width || a.height != b.height || a.texels.size() != b.texels.size()) {
+		std::cerr << "ERROR::IMAGE::PSNR::SIZE_MISMATCH" << std::endl;
+		return 0.0;
+	}
+
+	double squared = 0.0;
+	for (size_t i = 0; i < a.texels.size(); ++i) {
+		double difference = (double)a.texels[i] - b.texels[i];
+		squared += difference * difference;
+	}
+	if (squared == 0.0)
+		return std::numeric_limits<double>::infinity();
+	double mse = squared / a.texels.size();
+	return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+/**
+ * Gaussian blur keeping only positions whose whole window fits, so the result
+ * is (width - 10) x (height - 10).
+ */
+static std::vector<float> blur_valid(const std::vector<float>& source, int width, int height, const float* kernel, int radius) {
+	int out_width = width - 2 * radius, out_height = height - 2 * radius;
+	std::vector<float> rows((size_t)out_width * height);
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < out_width; ++x) {
+			float sum = 0.f;
+			for (int k = 0; k <= 2 * radius; ++k)
+				sum += kernel[k] * source[(size_t)y * width + x + k];
+			rows[(size_t)y * out_width + x] = sum;
+		}
+	}
+	std::vector<float> out((size_t)out_width * out_height);
+	for (int y = 0; y < out_height; ++y) {
+		for (int x = 0; x < out_width; ++x) {
+			float sum = 0.f;
+			for (int k = 0; k <= 2 * radius; ++k)
+				sum += kernel[k] * rows[(size_t)(y + k) * out_width + x];
+			out[(size_t)y * out_width + x] = sum;
+		}
+	}
+	return out;
+}
+
+double image_ssim(const Image& a, const Image& b) {
+	const int radius = 5;
+	const float sigma = 1.5f;
+	const double c1 = (0.01 * 255.0) * (0.01 * 255.0), c2 = (0.03 * 255.0) * (0.03 * 255.0);
+
+	if (a.width != b.width || a.height != b.height || a.texels.size() != b.texels.size() || a.width <= 2 * radius || a.height <= 2 * radius) {
+		std::cerr << "ERROR::IMAGE::SSIM::SIZE_MISMATCH" << std::endl;
+		return 0.0;
+	}
+
+	float kernel[2 * radius + 1], total = 0.f;
+	for (int k = -radius; k <= radius; ++k)
+		total += kernel[k + radius] = std::exp(-(k * k) / (2.f * sigma * sigma));
+	for (float& weight : kernel)
+		weight /= total;
+
+	size_t pixels = (size_t)a.width * a.height;
+	std::vector<float> x(pixels), y(pixels), xx(pixels), yy(pixels), xy(pixels);
+	for (size_t i = 0; i < pixels; ++i) {
+		const unsigned char* pa = &a.texels[i * 3];
+		const unsigned char* pb = &b.texels[i * 3];
+		x[i] = 0.299f * pa[0] + 0.587f * pa[1] + 0.114f * pa[2];
+		y[i] = 0.299f * pb[0] + 0.587f * pb[1] + 0.114f * pb[2];
+		xx[i] = x[i] * x[i];
+		yy[i] = y[i] * y[i];
+		xy[i] = x[i] * y[i];
+	}
+
+	std::vector<float> mu_x = blur_valid(x, a.width, a.height, kernel, radius), mu_y = blur_valid(y, a.width, a.height, kernel, radius);
+	std::vector<float> s_xx = blur_valid(xx, a.width, a.height, kernel, radius), s_yy = blur_valid(yy, a.width, a.height, kernel, radius);
+	std::vector<float> s_xy = blur_valid(xy, a.width, a.height, kernel, radius);
+
+	double sum = 0.0;
+	for (size_t i = 0; i < mu_x.size(); ++i) {
+		double mx = mu_x[i], my = mu_y[i];
+		double vx = s_xx[i] - mx * mx, vy = s_yy[i] - my * my, cxy = s_xy[i] - mx * my;
+		sum += ((2.0 * mx * my + c1) * (2.0 * cxy + c2)) / ((mx * mx + my * my + c1) * (vx + vy + c2));
+	}
+	return sum / mu_x.size();
+}
+
+ImageStats image_stats() {
+	return glob::image_counters;
+}
+
+void image_report() {
+	ImageStats stats = image_stats();
+	const double MiB = 1024.0 * 1024.0;
+
+	/**
+	 * A full mip chain adds a third on top of level 0.
+	 */
+	std::cout << "Image loading: " << stats.images << " decoded in " << stats.decode_ms << " ms, "
+		<< stats.downscaled << " downscaled in " << stats.downscale_ms << " ms (max dimension "
+		<< (glob::image_default_max_dimension > 0 ? std::to_string(glob::image_default_max_dimension) : "unlimited") << ")\n"
+		<< "\tupload: " << stats.source_bytes / MiB << " MiB at source size -> " << stats.loaded_bytes / MiB << " MiB\n"
+		<< "\tVRAM with mips: " << stats.source_bytes * 4 / 3 / MiB << " MiB -> " << stats.loaded_bytes * 4 / 3 / MiB << " MiB\n"
+		<< "\tmip chains: " << stats.mip_chains << " built on the CPU (" << image_simd_name(image_best_simd()) << ") in " << stats.mip_ms << " ms, "
+		<< (stats.mip_ms > 0.0 ? stats.mip_source_texels / 1e6 / (stats.mip_ms / 1000.0) : 0.0) << " MP/s" << std::endl;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+#include <string>
+#include <vector>
+
+/**
+ * Decoded RGB8 image, rows bottom to top (the orientation every texture in
+ * this project is uploaded with).
+ */
+struct image {
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> texels;
+};
+typedef struct image Image;
+
+/**
+ * Instruction sets the mip builder can run on.
+ */
+enum image_simd {
+	IMAGE_SIMD_SCALAR,
+	IMAGE_SIMD_SSE2,
+	IMAGE_SIMD_AVX2
+};
+
+/**
+ * Counters for every image_load since startup. source_bytes is what the files
+ * decode to at full size, loaded_bytes what was handed back after downscaling.
+ */
+struct image_statistics {
+	unsigned int images;
+	unsigned int downscaled;
+	double decode_ms;
+	double downscale_ms;
+	size_t source_bytes;
+	size_t loaded_bytes;
+	unsigned int mip_chains;
+	double mip_ms;
+	size_t mip_source_texels;		// level 0 texels of every chain built
+};
+typedef struct image_statistics ImageStats;
+
+void image_set_max_dimension(int max_dimension);	// Default limit for image_load; 0 disables downscaling
+
+int image_max_dimension();
+
+/**
+ * Decode path as RGB, flipped to bottom-up rows. If either side is larger than
+ * max_dimension (-1 uses the default from image_set_max_dimension) the image is
+ * downscaled to fit, keeping its aspect ratio.
+ */
+bool image_load(const std::string& path, Image& image, int max_dimension = -1);
+
+/**
+ * Gamma-correct area (box) filter: sRGB texels are averaged in linear light,
+ * weighted by how much of each source texel an output texel covers, so
+ * non-integer ratios such as 6668 -> 2048 are handled exactly.
+ */
+Image image_downscale(const Image& source, int width, int height);
+
+/**
+ * Bilinear lookup at texture coordinate (u, v) with clamp to edge, as
+ * GL_LINEAR samples level 0. Writes RGB in [0, 1].
+ */
+void image_sample_bilinear(const Image& image, float u, float v, float rgb[3]);
+
+bool image_save_png(const Image& image, const char* path);	// 8-bit RGB PNG, uncompressed (stored deflate blocks)
+
+bool image_save_ppm(const Image& image, const char* path);	// Binary PPM, the cheapest format to write
+
+double image_psnr(const Image& a, const Image& b);			// Over RGB, in dB; infinite for identical images
+
+/**
+ * Mean structural similarity of the luma of a and b, over 11x11 Gaussian
+ * windows (sigma 1.5) with the usual constants for 8-bit data.
+ */
+double image_ssim(const Image& a, const Image& b);
+
+image_simd image_best_simd();				// Widest instruction set this CPU and OS support
+
+const char* image_simd_name(image_simd simd);
+
+/**
+ * Build mip levels 1..n (down to 1x1) of image into levels, replacing
+ * glGenerateMipmap. Each level reduces the previous one in linear light:
+ * 2x2 boxes along even sides and exact-coverage 3-tap boxes along odd ones,
+ * so 6668x3046 -> 3334x1523 -> 1667x761 weighs every texel equally. Rows are
+ * split across threads workers (<= 0 uses every core).
+ */
+void image_build_mips(const Image& image, std::vector<Image>& levels, int threads = 0, image_simd simd = image_best_simd());
+
+/**
+ * Time image_build_mips on every supported instruction set, on one thread and
+ * on every core, and print level 0 megapixels per second.
+ */
+void image_benchmark_mips(const Image& image, int iterations);
+
+ImageStats image_stats();
+
+void image_report();						// Print decode/downscale time, upload bytes and estimated VRAM before and after
+#endif//__IMAGE_H__
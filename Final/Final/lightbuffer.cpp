@@ -0,0 +1,293 @@
+#include <GLEW/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "lightbuffer.h"
+
+/**
+ * A light that reaches the sphere being shaded, and how bright it is there.
+ */
+struct light_candidate {
+	int index;
+	float brightness;
+};
+typedef struct light_candidate LightCandidate;
+
+namespace glob {
+	/**
+	 * Structure of arrays, one entry per light, in the order they are uploaded
+	 * (see the block layout in lightbuffer.h).
+	 */
+	std::vector<glm::vec4> light_position_range;
+	std::vector<glm::vec4> light_color_type;
+	std::vector<glm::vec4> light_direction_outer;
+	std::vector<glm::vec4> light_attenuation_inner;
+
+	unsigned int light_capacity = 0;
+	unsigned int light_max_capacity = 0;
+	unsigned int light_uploaded_capacity = 0;		// lightStride of the data currently on the GPU
+	bool lights_dirty = true;
+	unsigned long long light_version = 0;		// bumped by every change to the lights
+
+	unsigned int light_buffer = 0;
+	unsigned int light_texture = 0;
+
+	std::vector<LightCandidate> light_candidates;
+	LightBufferStats light_counters;
+}
+
+void lightbuffer_init(unsigned int capacity) {
+	using namespace glob;
+
+	GLint max_texels = 65536;				// GL 3.x minimum
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+	light_max_capacity = (unsigned int)max_texels / 4;
+	light_capacity = std::max(1u, std::min(capacity, light_max_capacity));
+
+	glGenBuffers(1, &light_buffer);
+	glGenTextures(1, &light_texture);
+	glBindBuffer(GL_TEXTURE_BUFFER, light_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)light_capacity * 4 * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+	glBindTexture(GL_TEXTURE_BUFFER, light_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, light_buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	light_uploaded_capacity = light_capacity;
+	light_counters = LightBufferStats();
+	lightbuffer_clear();
+}
+
+void lightbuffer_clear() {
+	using namespace glob;
+
+	light_position_range.clear();
+	light_color_type.clear();
+	light_direction_outer.clear();
+	light_attenuation_inner.clear();
+	lights_dirty = true;
+	++light_version;
+}
+
+void lightbuffer_truncate(unsigned int count) {
+	using namespace glob;
+
+	if (count >= light_position_range.size())
+		return;
+	light_position_range.resize(count);
+	light_color_type.resize(count);
+	light_direction_outer.resize(count);
+	light_attenuation_inner.resize(count);
+	lights_dirty = true;
+	++light_version;
+}
+
+float light_range(glm::vec3 color, glm::vec3 attenuation) {
+	/**
+	 * Solve brightest channel / (c + l * d + q * d^2) = LIGHT_CUTOFF for d.
+	 */
+	float intensity = std::max(color.r, std::max(color.g, color.b));
+	float target = intensity / LIGHT_CUTOFF - attenuation.x;
+	if (target <= 0.f)
+		return 0.f;									// Never bright enough to show
+	if (attenuation.z > 0.f)
+		return (-attenuation.y + sqrtf(attenuation.y * attenuation.y + 4.f * attenuation.z * target)) / (2.f * attenuation.z);
+	if (attenuation.y > 0.f)
+		return target / attenuation.y;
+	return 1e30f;									// Constant falloff reaches everywhere
+}
+
+static int lightbuffer_add(glm::vec4 position_range, glm::vec4 color_type, glm::vec4 direction_outer, glm::vec4 attenuation_inner) {
+	using namespace glob;
+
+	unsigned int count = (unsigned int)light_position_range.size();
+	if (count == light_max_capacity) {
+		std::cerr << "ERROR::LIGHTBUFFER::ADD::FULL " << light_max_capacity << std::endl;
+		return -1;
+	}
+	if (count == light_capacity)
+		light_capacity = std::min(light_capacity * 2, light_max_capacity);	// Reallocated by the next upload
+
+	light_position_range.push_back(position_range);
+	light_color_type.push_back(color_type);
+	light_direction_outer.push_back(direction_outer);
+	light_attenuation_inner.push_back(attenuation_inner);
+	lights_dirty = true;
+	++light_version;
+	return (int)count;
+}
+
+int lightbuffer_add_point(glm::vec3 position, glm::vec3 color, glm::vec3 attenuation) {
+	return lightbuffer_add(glm::vec4(position, light_range(color, attenuation)), glm::vec4(color, (float)LIGHT_POINT),
+		glm::vec4(0.f, 0.f, 0.f, -1.f), glm::vec4(attenuation, -1.f));
+}
+
+int lightbuffer_add_spot(glm::vec3 position, glm::vec3 direction, glm::vec3 color, glm::vec3 attenuation, float inner_degrees, float outer_degrees) {
+	return lightbuffer_add(glm::vec4(position, light_range(color, attenuation)), glm::vec4(color, (float)LIGHT_SPOT),
+		glm::vec4(glm::normalize(direction), cosf(glm::radians(outer_degrees))), glm::vec4(attenuation, cosf(glm::radians(inner_degrees))));
+}
+
+void lightbuffer_set_position(int light, glm::vec3 position) {
+	using namespace glob;
+
+	if (light < 0 || light >= (int)light_position_range.size())
+		return;
+	light_position_range[light] = glm::vec4(position, light_position_range[light].w);
+	lights_dirty = true;
+	++light_version;
+}
+
+void lightbuffer_set_color(int light, glm::vec3 color) {
+	using namespace glob;
+
+	if (light < 0 || light >= (int)light_color_type.size() || glm::vec3(light_color_type[light]) == color)
+		return;
+	light_color_type[light] = glm::vec4(color, light_color_type[light].w);
+	light_position_range[light].w = light_range(color, glm::vec3(light_attenuation_inner[light]));
+	lights_dirty = true;
+	++light_version;
+}
+
+unsigned int lightbuffer_count() {
+	return (unsigned int)glob::light_position_range.size();
+}
+
+const glm::vec4* lightbuffer_position_ranges() {
+	return glob::light_position_range.data();
+}
+
+const glm::vec4* lightbuffer_color_types() {
+	return glob::light_color_type.data();
+}
+
+const glm::vec4* lightbuffer_direction_outers() {
+	return glob::light_direction_outer.data();
+}
+
+const glm::vec4* lightbuffer_attenuations() {
+	return glob::light_attenuation_inner.data();
+}
+
+unsigned long long lightbuffer_version() {
+	return glob::light_version;
+}
+
+void lightbuffer_upload() {
+	using namespace glob;
+
+	if (!lights_dirty)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	/**
+	 * Orphan the old store instead of overwriting it, so draws from earlier
+	 * frames can keep reading their copy without the upload waiting on them.
+	 */
+	size_t count = light_position_range.size();
+	size_t block = (size_t)light_capacity * sizeof(glm::vec4);
+	glBindBuffer(GL_TEXTURE_BUFFER, light_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, block * 4, nullptr, GL_DYNAMIC_DRAW);
+	if (count > 0) {
+		glBufferSubData(GL_TEXTURE_BUFFER, 0 * block, count * sizeof(glm::vec4), light_position_range.data());
+		glBufferSubData(GL_TEXTURE_BUFFER, 1 * block, count * sizeof(glm::vec4), light_color_type.data());
+		glBufferSubData(GL_TEXTURE_BUFFER, 2 * block, count * sizeof(glm::vec4), light_direction_outer.data());
+		glBufferSubData(GL_TEXTURE_BUFFER, 3 * block, count * sizeof(glm::vec4), light_attenuation_inner.data());
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	light_uploaded_capacity = light_capacity;
+	lights_dirty = false;
+	++light_counters.uploads;
+	light_counters.upload_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int lightbuffer_select(glm::vec3 center, float radius, int* indices) {
+	using namespace glob;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	/**
+	 * Keep every light whose range sphere (and, for spot lights, cone) touches
+	 * the bounding sphere, scored by its brightness at the nearest point.
+	 */
+	light_candidates.clear();
+	int count = (int)light_position_range.size();
+	for (int i = 0; i < count; ++i) {
+		glm::vec3 to_center = center - glm::vec3(light_position_range[i]);
+		float distance = glm::length(to_center);
+		if (distance > light_position_range[i].w + radius)
+			continue;
+
+		if (light_color_type[i].w == (float)LIGHT_SPOT && distance > radius) {
+			float cos_angle = glm::dot(to_center / distance, glm::vec3(light_direction_outer[i]));
+			float cone = acosf(glm::clamp(light_direction_outer[i].w, -1.f, 1.f)) + asinf(radius / distance);
+			if (cone < 3.14159265f && cos_angle < cosf(cone))
+				continue;						// Sphere lies entirely outside the cone
+		}
+
+		const glm::vec4& attenuation = light_attenuation_inner[i];
+		float nearest = std::max(0.f, distance - radius);
+		float intensity = std::max(light_color_type[i].r, std::max(light_color_type[i].g, light_color_type[i].b));
+		light_candidates.push_back({ i, intensity / (attenuation.x + attenuation.y * nearest + attenuation.z * nearest * nearest) });
+	}
+
+	int selected = (int)std::min(light_candidates.size(), (size_t)MAX_LIGHTS_PER_DRAW);
+	auto brighter = [](const LightCandidate& a, const LightCandidate& b) { return a.brightness > b.brightness; };
+	if ((int)light_candidates.size() > selected)
+		std::nth_element(light_candidates.begin(), light_candidates.begin() + selected, light_candidates.end(), brighter);
+	std::sort(light_candidates.begin(), light_candidates.begin() + selected, brighter);
+	for (int i = 0; i < selected; ++i)
+		indices[i] = light_candidates[i].index;
+
+	++light_counters.selections;
+	light_counters.selected += selected;
+	light_counters.truncated += light_candidates.size() > (size_t)selected;
+	light_counters.select_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return selected;
+}
+
+void lightbuffer_bind(Shader* shader) {
+	using namespace glob;
+
+	glActiveTexture(GL_TEXTURE0 + LIGHT_BUFFER_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, light_texture);
+	glActiveTexture(GL_TEXTURE0);
+	shader->setInt("lights", LIGHT_BUFFER_TEXTURE_UNIT);
+	shader->setInt("lightStride", (int)light_uploaded_capacity);
+}
+
+LightBufferStats lightbuffer_stats() {
+	using namespace glob;
+
+	LightBufferStats stats = light_counters;
+	stats.lights = (unsigned int)light_position_range.size();
+	stats.spots = (unsigned int)std::count_if(light_color_type.begin(), light_color_type.end(),
+		[](const glm::vec4& color_type) { return color_type.w == (float)LIGHT_SPOT; });
+	stats.capacity = light_capacity;
+	stats.max_capacity = light_max_capacity;
+	return stats;
+}
+
+void lightbuffer_report() {
+	LightBufferStats stats = lightbuffer_stats();
+
+	std::cout << "Lights: " << stats.lights << " (" << stats.spots << " spot), capacity " << stats.capacity << " of " << stats.max_capacity
+		<< ", " << stats.uploads << " uploads (" << stats.upload_ms << " ms)\n"
+		<< "\t" << stats.selections << " per-draw light lists, "
+		<< (stats.selections ? (double)stats.selected / stats.selections : 0.0) << " lights each on average, "
+		<< stats.truncated << " capped at " << MAX_LIGHTS_PER_DRAW << " (" << stats.select_ms << " ms selecting)" << std::endl;
+}
+
+void lightbuffer_destroy() {
+	using namespace glob;
+
+	glDeleteTextures(1, &light_texture);
+	glDeleteBuffers(1, &light_buffer);
+	light_texture = light_buffer = 0;
+	lightbuffer_clear();
+}
@@ -0,0 +1,93 @@
+#pragma once
+#ifndef __LIGHTBUFFER_H__
+#define __LIGHTBUFFER_H__
+
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+const int MAX_LIGHTS_PER_DRAW = 16;			// Lights one draw shades at most, so fragment cost stays bounded however many exist
+const int LIGHT_BUFFER_TEXTURE_UNIT = 2;	// Texture unit the light texture buffer is bound to
+const float LIGHT_CUTOFF = 1.f / 256.f;		// Attenuated brightness below which a light no longer reaches (one 8-bit step)
+
+enum light_type {
+	LIGHT_POINT = 0,
+	LIGHT_SPOT = 1
+};
+
+/**
+ * GPU layout: one RGBA32F texture buffer holding four structure-of-arrays
+ * blocks of lightStride texels each, uploaded straight from the CPU arrays:
+ *
+ *	block 0: position.xyz, range			range is where attenuation drops below LIGHT_CUTOFF
+ *	block 1: color.rgb, type				type is a light_type
+ *	block 2: direction.xyz, cos(outer)		spot lights only
+ *	block 3: attenuation.xyz, cos(inner)	constant, linear and quadratic coefficients
+ */
+struct light_buffer_statistics {
+	unsigned int lights;
+	unsigned int spots;
+	unsigned int capacity;						// lights the buffer holds before it is reallocated
+	unsigned int max_capacity;					// GL_MAX_TEXTURE_BUFFER_SIZE / 4
+	unsigned long long uploads;
+	double upload_ms;
+	unsigned long long selections;			// per-draw light lists built
+	unsigned long long selected;				// light indices handed out
+	unsigned long long truncated;				// lists that hit MAX_LIGHTS_PER_DRAW
+	double select_ms;
+};
+typedef struct light_buffer_statistics LightBufferStats;
+
+void lightbuffer_init(unsigned int capacity);
+
+void lightbuffer_clear();
+
+void lightbuffer_truncate(unsigned int count);		// Drop every light added after the first count
+
+/**
+ * Add a light and return its index (-1 if the buffer is full). attenuation
+ * holds the constant, linear and quadratic coefficients, as in RadiantLight.
+ */
+int lightbuffer_add_point(glm::vec3 position, glm::vec3 color, glm::vec3 attenuation);
+
+int lightbuffer_add_spot(glm::vec3 position, glm::vec3 direction, glm::vec3 color, glm::vec3 attenuation, float inner_degrees, float outer_degrees);
+
+void lightbuffer_set_position(int light, glm::vec3 position);
+
+void lightbuffer_set_color(int light, glm::vec3 color);
+
+unsigned int lightbuffer_count();
+
+const glm::vec4* lightbuffer_position_ranges();	// Block 0 of every light (position and range), lightbuffer_count() entries
+
+const glm::vec4* lightbuffer_color_types();		// Block 1 of every light (color and type), lightbuffer_count() entries
+
+const glm::vec4* lightbuffer_direction_outers();	// Block 2 of every light (direction and cos(outer)), lightbuffer_count() entries
+
+const glm::vec4* lightbuffer_attenuations();	// Block 3 of every light (attenuation and cos(inner)), lightbuffer_count() entries
+
+unsigned long long lightbuffer_version();		// Changes whenever a light is added, removed, moved or recolored
+
+/**
+ * Distance at which a light of this color and attenuation falls below
+ * LIGHT_CUTOFF.
+ */
+float light_range(glm::vec3 color, glm::vec3 attenuation);
+
+void lightbuffer_upload();					// Call once per frame before drawing; only uploads after a change
+
+/**
+ * Write the indices of up to MAX_LIGHTS_PER_DRAW lights reaching the sphere
+ * (center, radius) into indices, brightest at the sphere first, and return
+ * how many were written.
+ */
+int lightbuffer_select(glm::vec3 center, float radius, int* indices);
+
+void lightbuffer_bind(Shader* shader);		// Bind the texture buffer and set the "lights" and "lightStride" uniforms
+
+LightBufferStats lightbuffer_stats();
+
+void lightbuffer_report();
+
+void lightbuffer_destroy();
+#endif//__LIGHTBUFFER_H__
@@ -0,0 +1,896 @@
+#include <GLEW/glew.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "lightmap.h"
+
+#include "geometry.h"
+
+#include "lightbuffer.h"
+
+#include "statics.h"
+
+#include "variants.h"
+
+const unsigned int LIGHTMAP_FILE_MAGIC = 0x50414d4c;	// "LMAP"
+const unsigned int LIGHTMAP_FILE_VERSION = 1;
+const float LIGHTMAP_RAY_OFFSET = 1e-4f;				// World units rays start off the surface they leave
+const float LIGHTMAP_EDGE_TOLERANCE = 1e-5f;			// Barycentric slack so texel centers on a shared edge land in a triangle
+const float LIGHTMAP_PI = 3.14159265f;
+
+/**
+ * Triangles that share a plane and an edge, laid out flat. Texel coordinates
+ * include LIGHTMAP_PADDING on every side.
+ */
+struct lightmap_chart {
+	int mesh;
+	std::vector<int> triangles;
+	glm::vec3 origin;
+	glm::vec3 axis_u;						// world direction of the chart's x
+	glm::vec3 axis_v;
+	glm::vec2 lower;						// bounds of the triangles along axis_u and axis_v, world units
+	glm::vec2 upper;
+	int x, y, width, height;
+};
+typedef struct lightmap_chart LightmapChart;
+
+/**
+ * A Model's mesh as read back from the arena, in world space.
+ */
+struct bake_mesh {
+	Model* model;
+	unsigned int stride;					// floats per vertex of the format it was read in
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<int> triangle_charts;		// chart of every triangle, -1 for degenerate ones
+};
+typedef struct bake_mesh BakeMesh;
+
+/**
+ * One texel to light and the surface point its center lands on.
+ */
+struct lightmap_sample {
+	int texel;
+	glm::vec3 position;
+	glm::vec3 normal;						// interpolated like the shaders' Normal
+	glm::vec3 face_normal;					// of the triangle, on the same side, for offsetting rays
+};
+typedef struct lightmap_sample LightmapSample;
+
+struct bake_job {
+	std::vector<BakeMesh> meshes;
+	std::vector<LightmapChart> charts;
+	std::vector<LightmapSample> samples;
+	RaycastScene scene;
+	float density;
+	glm::vec3 point_position;
+	glm::vec3 point_attenuation;
+	glm::vec3 dir_direction;
+};
+typedef struct bake_job BakeJob;
+
+/**
+ * Mesh of one baked Model in VERTEX_FORMAT_LIGHTMAPPED, as a remap of the
+ * vertices it was baked from. Saved as is, so a later launch can rebuild it.
+ */
+struct baked_model {
+	const Model* model;
+	MeshRange mesh;							// to recognise copies of the Model, which draws take by value
+	MeshRange source_mesh;					// the VERTEX_FORMAT_TEXTURED mesh it replaced, kept for re-baking
+	glm::mat4 transform;
+	unsigned int source_vertices;
+	float source_checksum;					// sum of every source position, to tell other meshes apart
+	std::vector<unsigned int> sources;		// source vertex of every new vertex
+	std::vector<glm::vec2> coordinates;		// lightmap coordinate of every new vertex
+	std::vector<unsigned int> indices;
+};
+typedef struct baked_model BakedModel;
+
+namespace glob {
+	unsigned int lightmap_texture = 0;
+	std::vector<BakedModel> baked_models;
+	int lightmap_point_light = -1;
+	glm::vec3 lightmap_point_position = glm::vec3(0.f);
+	glm::vec3 lightmap_point_attenuation = glm::vec3(0.f);
+	glm::vec3 lightmap_dir_direction = glm::vec3(0.f);
+
+	LightmapStats lightmap_counters;
+}
+
+static float position_checksum(const std::vector<float>& vertices, unsigned int stride) {
+	float sum = 0.f;
+	for (size_t i = 0; i + 2 < vertices.size(); i += stride)
+		sum += vertices[i] + vertices[i + 1] + vertices[i + 2];
+	return sum;
+}
+
+/**
+ * Read every static Model's mesh back and move it to world space.
+ */
+static bool read_meshes(const std::vector<Model*>& models, BakeJob& job) {
+	for (Model* model : models) {
+		if (!statics_object(*model) || model->mesh.format == VERTEX_FORMAT_COLORED)
+			continue;
+
+		BakeMesh mesh;
+		mesh.model = model;
+		mesh.stride = geometry_vertex_stride(model->mesh.format) / sizeof(float);
+		if (!geometry_read(model->mesh, mesh.vertices, mesh.indices))
+			continue;
+
+		glm::mat3 normal_model = glm::mat3(glm::transpose(glm::inverse(model->model)));
+		for (size_t i = 0; i < mesh.vertices.size(); i += mesh.stride) {
+			const float* vertex = &mesh.vertices[i];
+			mesh.positions.push_back(glm::vec3(model->model * glm::vec4(vertex[0], vertex[1], vertex[2], 1.f)));
+			glm::vec3 normal = normal_model * glm::vec3(vertex[3], vertex[4], vertex[5]);
+			mesh.normals.push_back(glm::length(normal) > 0.f ? glm::normalize(normal) : normal);
+		}
+		job.meshes.push_back(std::move(mesh));
+	}
+	return !job.meshes.empty();
+}
+
+static std::string position_key(const float* vertex) {
+	return std::string((const char*)vertex, 3 * sizeof(float));
+}
+
+/**
+ * Grow charts over shared edges (by position, so texture seams don't split
+ * them) while triangles stay within LIGHTMAP_CHART_COS of the first one.
+ */
+static void build_charts(BakeJob& job, int mesh_index) {
+	BakeMesh& mesh = job.meshes[mesh_index];
+	int triangles = (int)mesh.indices.size() / 3;
+
+	std::vector<glm::vec3> face_normals(triangles);
+	std::unordered_map<std::string, std::vector<int>> edges;
+	for (int t = 0; t < triangles; ++t) {
+		const unsigned int* corner = &mesh.indices[t * 3];
+		glm::vec3 cross = glm::cross(mesh.positions[corner[1]] - mesh.positions[corner[0]], mesh.positions[corner[2]] - mesh.positions[corner[0]]);
+		face_normals[t] = glm::length(cross) > 0.f ? glm::normalize(cross) : glm::vec3(0.f);
+
+		for (int e = 0; e < 3; ++e) {
+			std::string a = position_key(&mesh.vertices[corner[e] * mesh.stride]);
+			std::string b = position_key(&mesh.vertices[corner[(e + 1) % 3] * mesh.stride]);
+			edges[a < b ? a + b : b + a].push_back(t);
+		}
+	}
+
+	mesh.triangle_charts.assign(triangles, -1);
+	std::vector<int> pending;
+	for (int seed = 0; seed < triangles; ++seed) {
+		if (mesh.triangle_charts[seed] >= 0 || face_normals[seed] == glm::vec3(0.f))
+			continue;
+
+		LightmapChart chart;
+		chart.mesh = mesh_index;
+		glm::vec3 normal = face_normals[seed];
+		int index = (int)job.charts.size();
+
+		pending.assign(1, seed);
+		mesh.triangle_charts[seed] = index;
+		while (!pending.empty()) {
+			int t = pending.back();
+			pending.pop_back();
+			chart.triangles.push_back(t);
+
+			const unsigned int* corner = &mesh.indices[t * 3];
+			for (int e = 0; e < 3; ++e) {
+				std::string a = position_key(&mesh.vertices[corner[e] * mesh.stride]);
+				std::string b = position_key(&mesh.vertices[corner[(e + 1) % 3] * mesh.stride]);
+				for (int neighbour : edges[a < b ? a + b : b + a]) {
+					if (mesh.triangle_charts[neighbour] < 0 && glm::dot(face_normals[neighbour], normal) >= LIGHTMAP_CHART_COS) {
+						mesh.triangle_charts[neighbour] = index;
+						pending.push_back(neighbour);
+					}
+				}
+			}
+		}
+
+		/**
+		 * Project onto the chart's plane.
+		 */
+		chart.origin = mesh.positions[mesh.indices[seed * 3]];
+		glm::vec3 helper = std::abs(normal.y) < 0.99f ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(1.f, 0.f, 0.f);
+		chart.axis_u = glm::normalize(glm::cross(helper, normal));
+		chart.axis_v = glm::cross(normal, chart.axis_u);
+		chart.lower = glm::vec2(1e30f);
+		chart.upper = glm::vec2(-1e30f);
+		for (int t : chart.triangles) {
+			for (int c = 0; c < 3; ++c) {
+				glm::vec3 offset = mesh.positions[mesh.indices[t * 3 + c]] - chart.origin;
+				glm::vec2 flat = glm::vec2(glm::dot(offset, chart.axis_u), glm::dot(offset, chart.axis_v));
+				chart.lower = glm::min(chart.lower, flat);
+				chart.upper = glm::max(chart.upper, flat);
+			}
+		}
+		job.charts.push_back(std::move(chart));
+	}
+}
+
+/**
+ * Shelf-pack the charts, tallest first, at density texels per world unit.
+ */
+static bool pack_charts(std::vector<LightmapChart>& charts, float density) {
+	std::vector<int> order(charts.size());
+	for (size_t i = 0; i < charts.size(); ++i) {
+		LightmapChart& chart = charts[i];
+		glm::vec2 size = (chart.upper - chart.lower) * density;
+		chart.width = std::max(LIGHTMAP_MIN_CHART, (int)std::ceil(size.x)) + 2 * LIGHTMAP_PADDING;
+		chart.height = std::max(LIGHTMAP_MIN_CHART, (int)std::ceil(size.y)) + 2 * LIGHTMAP_PADDING;
+		order[i] = (int)i;
+	}
+	std::sort(order.begin(), order.end(), [&](int a, int b) {
+		return charts[a].height != charts[b].height ? charts[a].height > charts[b].height : charts[a].width > charts[b].width;
+	});
+
+	int x = 0, y = 0, shelf = 0;
+	for (int index : order) {
+		LightmapChart& chart = charts[index];
+		if (x + chart.width > LIGHTMAP_SIZE) {
+			y += shelf;
+			x = shelf = 0;
+		}
+		if (chart.width > LIGHTMAP_SIZE || y + chart.height > LIGHTMAP_SIZE)
+			return false;
+		chart.x = x;
+		chart.y = y;
+		x += chart.width;
+		shelf = std::max(shelf, chart.height);
+	}
+	return true;
+}
+
+/**
+ * Texel position (not yet divided by LIGHTMAP_SIZE) of a world point on the
+ * chart.
+ */
+static glm::vec2 chart_texel(const LightmapChart& chart, float density, glm::vec3 position) {
+	glm::vec3 offset = position - chart.origin;
+	glm::vec2 flat = glm::vec2(glm::dot(offset, chart.axis_u), glm::dot(offset, chart.axis_v));
+	return glm::vec2((float)(chart.x + LIGHTMAP_PADDING), (float)(chart.y + LIGHTMAP_PADDING)) + (flat - chart.lower) * density;
+}
+
+/**
+ * Find the surface point under the center of every texel inside a chart's
+ * triangles.
+ */
+static void place_samples(BakeJob& job) {
+	for (const LightmapChart& chart : job.charts) {
+		const BakeMesh& mesh = job.meshes[chart.mesh];
+
+		for (int t : chart.triangles) {
+			const unsigned int* corner = &mesh.indices[t * 3];
+			glm::vec2 a = chart_texel(chart, job.density, mesh.positions[corner[0]]);
+			glm::vec2 b = chart_texel(chart, job.density, mesh.positions[corner[1]]);
+			glm::vec2 c = chart_texel(chart, job.density, mesh.positions[corner[2]]);
+			float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+			if (area == 0.f)
+				continue;
+
+			glm::vec3 face_normal = glm::normalize(glm::cross(mesh.positions[corner[1]] - mesh.positions[corner[0]], mesh.positions[corner[2]] - mesh.positions[corner[0]]));
+			glm::vec2 lower = glm::floor(glm::min(a, glm::min(b, c)));
+			glm::vec2 upper = glm::ceil(glm::max(a, glm::max(b, c)));
+			for (int y = (int)lower.y; y < (int)upper.y; ++y) {
+				for (int x = (int)lower.x; x < (int)upper.x; ++x) {
+					glm::vec2 center = glm::vec2(x + 0.5f, y + 0.5f);
+					float wb = ((center.x - a.x) * (c.y - a.y) - (c.x - a.x) * (center.y - a.y)) / area;
+					float wc = ((b.x - a.x) * (center.y - a.y) - (center.x - a.x) * (b.y - a.y)) / area;
+					float wa = 1.f - wb - wc;
+					if (wa < -LIGHTMAP_EDGE_TOLERANCE || wb < -LIGHTMAP_EDGE_TOLERANCE || wc < -LIGHTMAP_EDGE_TOLERANCE)
+						continue;
+
+					LightmapSample sample;
+					sample.texel = y * LIGHTMAP_SIZE + x;
+					sample.position = mesh.positions[corner[0]] * wa + mesh.positions[corner[1]] * wb + mesh.positions[corner[2]] * wc;
+					sample.normal = mesh.normals[corner[0]] * wa + mesh.normals[corner[1]] * wb + mesh.normals[corner[2]] * wc;
+					sample.normal = glm::length(sample.normal) > 0.f ? glm::normalize(sample.normal) : face_normal;
+					sample.face_normal = glm::dot(face_normal, sample.normal) < 0.f ? -face_normal : face_normal;
+					job.samples.push_back(sample);
+				}
+			}
+		}
+	}
+
+	/**
+	 * Texels on an edge shared by two triangles were placed twice.
+	 */
+	std::stable_sort(job.samples.begin(), job.samples.end(), [](const LightmapSample& a, const LightmapSample& b) { return a.texel < b.texel; });
+	job.samples.erase(std::unique(job.samples.begin(), job.samples.end(), [](const LightmapSample& a, const LightmapSample& b) { return a.texel == b.texel; }), job.samples.end());
+}
+
+/**
+ * Read the Models, chart and pack them and build the ray casting scene.
+ */
+static bool prepare_bake(const std::vector<Model*>& models, int point_light, DirectionalLight dir_light, BakeJob& job) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (point_light < 0 || point_light >= (int)lightbuffer_count()) {
+		std::cerr << "ERROR::LIGHTMAP::NO_POINT_LIGHT " << point_light << std::endl;
+		return false;
+	}
+	job.point_position = glm::vec3(lightbuffer_position_ranges()[point_light]);
+	job.point_attenuation = glm::vec3(lightbuffer_attenuations()[point_light]);
+	job.dir_direction = dir_light.direction;
+
+	if (!read_meshes(models, job)) {
+		std::cerr << "ERROR::LIGHTMAP::NO_STATIC_MODELS" << std::endl;
+		return false;
+	}
+	for (int mesh = 0; mesh < (int)job.meshes.size(); ++mesh)
+		build_charts(job, mesh);
+
+	/**
+	 * Aim for LIGHTMAP_FILL of the texture, but no chart may be wider than it;
+	 * shrink until the shelves fit.
+	 */
+	double area = 0.0;
+	float fit = 1e30f;
+	for (const LightmapChart& chart : job.charts) {
+		glm::vec2 size = chart.upper - chart.lower;
+		area += (double)size.x * size.y;
+		fit = std::min(fit, (LIGHTMAP_SIZE - 2 * LIGHTMAP_PADDING - 1) / std::max(size.x, size.y));
+	}
+	job.density = std::min(fit, (float)std::sqrt(LIGHTMAP_FILL * LIGHTMAP_SIZE * LIGHTMAP_SIZE / std::max(area, 1e-12)));
+	while (!pack_charts(job.charts, job.density)) {
+		job.density *= 0.9f;
+		if (job.density * LIGHTMAP_SIZE < 1.f) {
+			std::cerr << "ERROR::LIGHTMAP::CHARTS_DO_NOT_FIT " << job.charts.size() << std::endl;
+			return false;
+		}
+	}
+	place_samples(job);
+
+	std::vector<glm::vec3> corners;
+	for (const BakeMesh& mesh : job.meshes) {
+		for (unsigned int index : mesh.indices)
+			corners.push_back(mesh.positions[index]);
+	}
+	job.scene = raycast_build(corners);
+
+	LightmapStats& stats = glob::lightmap_counters;
+	stats.models = (unsigned int)job.meshes.size();
+	stats.charts = (unsigned int)job.charts.size();
+	stats.triangles = job.scene.triangles;
+	stats.texels = (unsigned int)job.samples.size();
+	stats.density = job.density;
+	stats.bvh_nodes = (unsigned int)job.scene.nodes.size();
+	stats.prepare_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
+
+/**
+ * Uniform value in [0, 1) from two integers, so a bake is the same every run
+ * and on every path.
+ */
+static float hash_unit(unsigned int a, unsigned int b) {
+	unsigned int h = a * 0x9E3779B1u ^ (b + 0x7F4A7C15u) * 0x85EBCA77u;
+	h ^= h >> 15;
+	h *= 0x2C1B3C6Du;
+	h ^= h >> 12;
+	h *= 0x297A2D39u;
+	h ^= h >> 15;
+	return (h >> 8) * (1.f / 16777216.f);
+}
+
+/**
+ * The four baked terms of one texel (see lightmap.h).
+ */
+static glm::vec4 light_sample(const BakeJob& job, const LightmapSample& sample, raycast_simd simd, unsigned long long& rays) {
+	glm::vec3 origin = sample.position + sample.face_normal * LIGHTMAP_RAY_OFFSET;
+	glm::vec4 terms = glm::vec4(0.f);
+
+	glm::vec3 to_light = job.point_position - sample.position;
+	float distance = glm::length(to_light);
+	terms.g = 1.f / (job.point_attenuation.x + job.point_attenuation.y * distance + job.point_attenuation.z * distance * distance);
+	float diffuse = distance > 0.f ? glm::max(glm::dot(sample.normal, to_light / distance), 0.f) : 0.f;
+	if (diffuse > 0.f) {
+		glm::vec3 to_light_from_origin = job.point_position - origin;
+		float reach = glm::length(to_light_from_origin);
+		++rays;
+		if (!raycast_occluded(job.scene, origin, to_light_from_origin / reach, reach, simd))
+			terms.r = diffuse * terms.g;
+	}
+
+	glm::vec3 sun = -glm::normalize(job.dir_direction);
+	diffuse = glm::max(glm::dot(sample.normal, sun), 0.f);
+	if (diffuse > 0.f) {
+		++rays;
+		if (!raycast_occluded(job.scene, origin, sun, 1e30f, simd))
+			terms.b = diffuse;
+	}
+
+	/**
+	 * Cosine-weighted, stratified over the hemisphere around the normal.
+	 */
+	glm::vec3 helper = std::abs(sample.normal.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+	glm::vec3 tangent = glm::normalize(glm::cross(helper, sample.normal));
+	glm::vec3 bitangent = glm::cross(sample.normal, tangent);
+	int side = (int)std::sqrt((float)LIGHTMAP_AO_RAYS);
+	int occluded = 0;
+	for (int i = 0; i < LIGHTMAP_AO_RAYS; ++i) {
+		float a = ((i % side) + hash_unit(sample.texel, i * 2)) / side;
+		float b = ((i / side % side) + hash_unit(sample.texel, i * 2 + 1)) / side;
+		float radius = std::sqrt(a);
+		float angle = 2.f * LIGHTMAP_PI * b;
+		glm::vec3 direction = tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle)) + sample.normal * std::sqrt(std::max(0.f, 1.f - a));
+		if (glm::dot(direction, sample.face_normal) <= 0.f)
+			continue;						// below the flat triangle under an interpolated normal
+		++rays;
+		occluded += raycast_occluded(job.scene, origin, glm::normalize(direction), LIGHTMAP_AO_DISTANCE, simd);
+	}
+	terms.a = 1.f - (float)occluded / LIGHTMAP_AO_RAYS;
+	return terms;
+}
+
+/**
+ * Light every sample on threads workers, which claim LIGHTMAP_TEXELS_PER_TASK
+ * samples at a time. Returns the rays cast.
+ */
+static unsigned long long trace_samples(const BakeJob& job, std::vector<glm::vec4>& texels, int threads, raycast_simd simd) {
+	std::atomic<size_t> next(0);
+	std::vector<unsigned long long> rays(threads, 0);
+
+	auto work = [&](int worker) {
+		for (;;) {
+			size_t first = next.fetch_add(LIGHTMAP_TEXELS_PER_TASK);
+			if (first >= job.samples.size())
+				return;
+			size_t last = std::min(job.samples.size(), first + LIGHTMAP_TEXELS_PER_TASK);
+			unsigned long long task_rays = 0;				// Workers' counts share cache lines; touch them once per task
+			for (size_t i = first; i < last; ++i)
+				texels[job.samples[i].texel] = light_sample(job, job.samples[i], simd, task_rays);
+			rays[worker] += task_rays;
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (int worker = 1; worker < threads; ++worker)
+		pool.emplace_back(work, worker);
+	work(0);
+	for (std::thread& worker : pool)
+		worker.join();
+
+	unsigned long long total = 0;
+	for (unsigned long long count : rays)
+		total += count;
+	return total;
+}
+
+/**
+ * Grow each chart's lit texels over the rest of its rectangle, padding
+ * included, so bilinear filtering at chart edges only blends its own light.
+ */
+static void dilate_charts(const BakeJob& job, std::vector<glm::vec4>& texels) {
+	std::vector<unsigned char> lit(texels.size(), 0);
+	for (const LightmapSample& sample : job.samples)
+		lit[sample.texel] = 1;
+
+	std::vector<std::pair<int, glm::vec4>> grown;
+	for (const LightmapChart& chart : job.charts) {
+		for (bool growing = true; growing;) {
+			grown.clear();
+			for (int y = chart.y; y < chart.y + chart.height; ++y) {
+				for (int x = chart.x; x < chart.x + chart.width; ++x) {
+					if (lit[y * LIGHTMAP_SIZE + x])
+						continue;
+					glm::vec4 sum = glm::vec4(0.f);
+					int count = 0;
+					for (int dy = -1; dy <= 1; ++dy) {
+						for (int dx = -1; dx <= 1; ++dx) {
+							int nx = x + dx, ny = y + dy;
+							if (nx < chart.x || ny < chart.y || nx >= chart.x + chart.width || ny >= chart.y + chart.height || !lit[ny * LIGHTMAP_SIZE + nx])
+								continue;
+							sum += texels[ny * LIGHTMAP_SIZE + nx];
+							++count;
+						}
+					}
+					if (count > 0)
+						grown.push_back({ y * LIGHTMAP_SIZE + x, sum / (float)count });
+				}
+			}
+			for (const auto& texel : grown) {
+				texels[texel.first] = texel.second;
+				lit[texel.first] = 1;
+			}
+			growing = !grown.empty();
+		}
+	}
+}
+
+/**
+ * IEEE half from float, rounding to nearest; the lightmap is stored and
+ * uploaded as RGBA16F.
+ */
+static unsigned short float_to_half(float value) {
+	unsigned int bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	unsigned int sign = (bits >> 16) & 0x8000u;
+	int exponent = (int)((bits >> 23) & 0xffu) - 127 + 15;
+	unsigned int mantissa = bits & 0x7fffffu;
+
+	if (exponent >= 31)
+		return (unsigned short)(sign | 0x7c00u);						// too large (the bake never holds NaN)
+	if (exponent <= 0) {
+		if (exponent < -10)
+			return (unsigned short)sign;
+		mantissa |= 0x800000u;
+		unsigned int shift = (unsigned int)(14 - exponent);
+		return (unsigned short)(sign | ((mantissa + (1u << (shift - 1))) >> shift));
+	}
+	unsigned int half = sign | ((unsigned int)exponent << 10) | (mantissa >> 13);
+	return (unsigned short)(half + ((mantissa >> 12) & 1u));			// a carry into the exponent is still the right rounding
+}
+
+/**
+ * Remap the mesh so every chart has its own vertices, with lightmap
+ * coordinates from the chart's layout.
+ */
+static BakedModel remap_mesh(const BakeJob& job, const BakeMesh& mesh) {
+	BakedModel baked;
+	baked.model = mesh.model;
+	baked.transform = mesh.model->model;
+	baked.source_vertices = (unsigned int)(mesh.vertices.size() / mesh.stride);
+	baked.source_checksum = position_checksum(mesh.vertices, mesh.stride);
+
+	std::unordered_map<unsigned long long, unsigned int> remapped;
+	for (size_t t = 0; t * 3 < mesh.indices.size(); ++t) {
+		int chart = mesh.triangle_charts[t];
+		for (int c = 0; c < 3; ++c) {
+			unsigned int source = mesh.indices[t * 3 + c];
+			unsigned long long key = (unsigned long long)source << 32 | (unsigned int)(chart + 1);
+			auto found = remapped.find(key);
+			if (found == remapped.end()) {
+				found = remapped.emplace(key, (unsigned int)baked.sources.size()).first;
+				baked.sources.push_back(source);
+				baked.coordinates.push_back(chart < 0 ? glm::vec2(0.f) : chart_texel(job.charts[chart], job.density, mesh.positions[source]) / (float)LIGHTMAP_SIZE);
+			}
+			baked.indices.push_back(found->second);
+		}
+	}
+	return baked;
+}
+
+/**
+ * Re-upload a Model in VERTEX_FORMAT_LIGHTMAPPED from the vertices it was
+ * baked from (as read back, stride floats each).
+ */
+static bool apply_baked_model(Model& model, BakedModel& baked, const std::vector<float>& vertices, unsigned int stride) {
+	std::vector<float> lightmapped;
+	lightmapped.reserve(baked.sources.size() * 10);
+	for (size_t i = 0; i < baked.sources.size(); ++i) {
+		const float* source = &vertices[baked.sources[i] * stride];
+		lightmapped.insert(lightmapped.end(), source, source + 8);
+		lightmapped.push_back(baked.coordinates[i].x);
+		lightmapped.push_back(baked.coordinates[i].y);
+	}
+
+	MeshRange mesh = geometry_upload_indexed(VERTEX_FORMAT_LIGHTMAPPED, lightmapped.data(), (unsigned int)baked.sources.size(), baked.indices.data(), (unsigned int)baked.indices.size());
+	if (mesh.index_count == 0)
+		return false;
+	baked.source_mesh = model.mesh;
+	model.mesh = mesh;
+	baked.mesh = mesh;
+	return true;
+}
+
+/**
+ * Put the meshes the last bake replaced back on models, so a new bake reads
+ * and records the same meshes lightmap_load checks for.
+ */
+static void restore_source_models(const std::vector<Model*>& models) {
+	using namespace glob;
+
+	for (Model* model : models) {
+		auto baked = std::find_if(baked_models.begin(), baked_models.end(), [&](const BakedModel& entry) { return entry.model == model; });
+		if (baked == baked_models.end() || model->mesh.first_index != baked->mesh.first_index || model->mesh.base_vertex != baked->mesh.base_vertex)
+			continue;
+		geometry_free(model->mesh);
+		model->mesh = baked->source_mesh;
+	}
+	baked_models.clear();
+}
+
+static void upload_lightmap(const std::vector<unsigned short>& halves) {
+	using namespace glob;
+
+	if (lightmap_texture == 0)
+		glGenTextures(1, &lightmap_texture);
+	glBindTexture(GL_TEXTURE_2D, lightmap_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, LIGHTMAP_SIZE, LIGHTMAP_SIZE, 0, GL_RGBA, GL_HALF_FLOAT, halves.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);	// no mips: they would blend neighbouring charts
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	variants_prepare(SHADER_LIGHTMAP);
+}
+
+template <typename T>
+static void write_values(std::ofstream& file, const T* values, size_t count) {
+	file.write((const char*)values, count * sizeof(T));
+}
+
+template <typename T>
+static bool read_values(std::ifstream& file, T* values, size_t count) {
+	return (bool)file.read((char*)values, count * sizeof(T));
+}
+
+/**
+ * Layout: magic, version, size, Model count, the point light's position and
+ * attenuation and the directional light's direction, then per Model its
+ * transform, source vertex count and checksum, new vertex and index counts,
+ * source and coordinate of every vertex, the indices; then the RGBA16F texels.
+ * A Model that was not baked has zero vertices.
+ */
+static void save_lightmap(const char* path, const std::vector<Model*>& models, const std::vector<unsigned short>& halves) {
+	using namespace glob;
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		std::cerr << "ERROR::LIGHTMAP::NOT_WRITABLE " << path << std::endl;
+		return;
+	}
+
+	unsigned int header[4] = { LIGHTMAP_FILE_MAGIC, LIGHTMAP_FILE_VERSION, (unsigned int)LIGHTMAP_SIZE, (unsigned int)models.size() };
+	write_values(file, header, 4);
+	write_values(file, &lightmap_point_position[0], 3);
+	write_values(file, &lightmap_point_attenuation[0], 3);
+	write_values(file, &lightmap_dir_direction[0], 3);
+
+	for (const Model* model : models) {
+		auto baked = std::find_if(baked_models.begin(), baked_models.end(), [&](const BakedModel& entry) { return entry.model == model; });
+		BakedModel empty = BakedModel();
+		const BakedModel& entry = baked != baked_models.end() ? *baked : empty;
+
+		write_values(file, &entry.transform[0][0], 16);
+		unsigned int counts[3] = { entry.source_vertices, (unsigned int)entry.sources.size(), (unsigned int)entry.indices.size() };
+		write_values(file, &counts[0], 1);
+		write_values(file, &entry.source_checksum, 1);
+		write_values(file, &counts[1], 2);
+		write_values(file, entry.sources.data(), entry.sources.size());
+		write_values(file, (const float*)entry.coordinates.data(), entry.coordinates.size() * 2);
+		write_values(file, entry.indices.data(), entry.indices.size());
+	}
+	write_values(file, halves.data(), halves.size());
+}
+
+bool lightmap_bake(const std::vector<Model*>& models, int point_light, DirectionalLight dir_light, const char* path, int threads, raycast_simd simd) {
+	using namespace glob;
+
+	restore_source_models(models);
+	BakeJob job;
+	LightmapStats saved = lightmap_counters;
+	if (!prepare_bake(models, point_light, dir_light, job)) {
+		lightmap_counters = saved;
+		return false;
+	}
+
+	if (threads <= 0)
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+	simd = std::min(simd, raycast_best_simd());
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<glm::vec4> texels((size_t)LIGHTMAP_SIZE * LIGHTMAP_SIZE, glm::vec4(0.f));
+	lightmap_counters.rays = trace_samples(job, texels, threads, simd);
+	lightmap_counters.bake_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	lightmap_counters.threads = threads;
+	lightmap_counters.simd = simd;
+	lightmap_counters.loaded = false;
+
+	dilate_charts(job, texels);
+	std::vector<unsigned short> halves(texels.size() * 4);
+	for (size_t i = 0; i < texels.size(); ++i) {
+		for (int c = 0; c < 4; ++c)
+			halves[i * 4 + c] = float_to_half(texels[i][c]);
+	}
+
+	for (const BakeMesh& mesh : job.meshes) {
+		BakedModel baked = remap_mesh(job, mesh);
+		if (apply_baked_model(*mesh.model, baked, mesh.vertices, mesh.stride))
+			baked_models.push_back(std::move(baked));
+	}
+	lightmap_point_light = point_light;
+	lightmap_point_position = job.point_position;
+	lightmap_point_attenuation = job.point_attenuation;
+	lightmap_dir_direction = job.dir_direction;
+	upload_lightmap(halves);
+
+	if (path)
+		save_lightmap(path, models, halves);
+	return true;
+}
+
+bool lightmap_load(const std::vector<Model*>& models, int point_light, DirectionalLight dir_light, const char* path) {
+	using namespace glob;
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+	if (point_light < 0 || point_light >= (int)lightbuffer_count())
+		return false;
+
+	unsigned int header[4];
+	glm::vec3 point_position, point_attenuation, dir_direction;
+	if (!read_values(file, header, 4) || header[0] != LIGHTMAP_FILE_MAGIC || header[1] != LIGHTMAP_FILE_VERSION
+		|| header[2] != (unsigned int)LIGHTMAP_SIZE || header[3] != models.size())
+		return false;
+	if (!read_values(file, &point_position[0], 3) || !read_values(file, &point_attenuation[0], 3) || !read_values(file, &dir_direction[0], 3))
+		return false;
+	if (point_position != glm::vec3(lightbuffer_position_ranges()[point_light]) || point_attenuation != glm::vec3(lightbuffer_attenuations()[point_light])
+		|| dir_direction != dir_light.direction)
+		return false;						// baked for other lights
+
+	/**
+	 * Check every Model against what was baked before changing any of them.
+	 */
+	std::vector<BakedModel> loaded(models.size());
+	std::vector<std::vector<float>> sources(models.size());
+	for (size_t i = 0; i < models.size(); ++i) {
+		BakedModel& baked = loaded[i];
+		unsigned int counts[2];
+		if (!read_values(file, &baked.transform[0][0], 16) || !read_values(file, &baked.source_vertices, 1)
+			|| !read_values(file, &baked.source_checksum, 1) || !read_values(file, counts, 2))
+			return false;
+		baked.model = models[i];
+		baked.sources.resize(counts[0]);
+		baked.coordinates.resize(counts[0]);
+		baked.indices.resize(counts[1]);
+		if (!read_values(file, baked.sources.data(), counts[0]) || !read_values(file, (float*)baked.coordinates.data(), counts[0] * 2)
+			|| !read_values(file, baked.indices.data(), counts[1]))
+			return false;
+		if (baked.sources.empty())
+			continue;
+
+		const Model& model = *models[i];
+		std::vector<unsigned int> indices;
+		unsigned int stride = geometry_vertex_stride(model.mesh.format) / sizeof(float);
+		if (model.mesh.format != VERTEX_FORMAT_TEXTURED || model.mesh.vertex_count != baked.source_vertices || model.model != baked.transform
+			|| !geometry_read(model.mesh, sources[i], indices) || position_checksum(sources[i], stride) != baked.source_checksum)
+			return false;
+		for (unsigned int source : baked.sources) {
+			if (source >= baked.source_vertices)
+				return false;
+		}
+		for (unsigned int index : baked.indices) {
+			if (index >= baked.sources.size())
+				return false;
+		}
+	}
+
+	std::vector<unsigned short> halves((size_t)LIGHTMAP_SIZE * LIGHTMAP_SIZE * 4);
+	if (!read_values(file, halves.data(), halves.size()))
+		return false;
+
+	baked_models.clear();
+	for (size_t i = 0; i < models.size(); ++i) {
+		if (!loaded[i].sources.empty() && apply_baked_model(*models[i], loaded[i], sources[i], geometry_vertex_stride(VERTEX_FORMAT_TEXTURED) / sizeof(float)))
+			baked_models.push_back(std::move(loaded[i]));
+	}
+	lightmap_point_light = point_light;
+	lightmap_point_position = point_position;
+	lightmap_point_attenuation = point_attenuation;
+	lightmap_dir_direction = dir_direction;
+	upload_lightmap(halves);
+
+	lightmap_counters = LightmapStats();
+	lightmap_counters.loaded = true;
+	lightmap_counters.models = (unsigned int)baked_models.size();
+	return true;
+}
+
+bool lightmap_enabled() {
+	return glob::lightmap_texture != 0;
+}
+
+bool lightmap_usable(const Model& model, const DirectionalLight& dir_light) {
+	using namespace glob;
+
+	if (!lightmap_enabled() || model.mesh.format != VERTEX_FORMAT_LIGHTMAPPED)
+		return false;
+	auto baked = std::find_if(baked_models.begin(), baked_models.end(), [&](const BakedModel& entry) {
+		return entry.mesh.first_index == model.mesh.first_index && entry.mesh.base_vertex == model.mesh.base_vertex;
+	});
+	if (baked == baked_models.end())
+		return false;
+
+	/**
+	 * Any baked Model moving makes the whole bake stale: its shadows and
+	 * occlusion lie on its neighbours too.
+	 */
+	bool usable = dir_light.direction == lightmap_dir_direction
+		&& std::all_of(baked_models.begin(), baked_models.end(), [](const BakedModel& entry) { return entry.model->model == entry.transform; })
+		&& lightmap_point_light < (int)lightbuffer_count()
+		&& glm::vec3(lightbuffer_position_ranges()[lightmap_point_light]) == lightmap_point_position
+		&& glm::vec3(lightbuffer_attenuations()[lightmap_point_light]) == lightmap_point_attenuation;
+	++(usable ? lightmap_counters.baked_draws : lightmap_counters.fallback_draws);
+	return usable;
+}
+
+void lightmap_bind(Shader* shader, const DirectionalLight& dir_light) {
+	using namespace glob;
+
+	glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, lightmap_texture);
+	glActiveTexture(GL_TEXTURE0);
+
+	shader->setInt("lightmap", LIGHTMAP_TEXTURE_UNIT);
+	shader->setVec3("lightmapPointColor", glm::vec3(lightbuffer_color_types()[lightmap_point_light]));
+	shader->setVec3("lightmapDirColor", dir_light.color);
+}
+
+void lightmap_benchmark(const std::vector<Model*>& models, int point_light, DirectionalLight dir_light) {
+	using namespace glob;
+
+	LightmapStats saved = lightmap_counters;							// Keep benchmark runs out of the bake statistics
+	BakeJob job;
+	if (!prepare_bake(models, point_light, dir_light, job)) {
+		lightmap_counters = saved;
+		return;
+	}
+	std::cout << "Lightmap benchmark: " << job.samples.size() << " texels in " << job.charts.size() << " charts, "
+		<< job.scene.triangles << " triangles in " << job.scene.nodes.size() << " BVH nodes (built in " << job.scene.build_ms << " ms)" << std::endl;
+
+	int cores = std::max(1, (int)std::thread::hardware_concurrency());
+	std::vector<int> counts;
+	for (int threads = 1; threads < cores; threads *= 2)
+		counts.push_back(threads);
+	counts.push_back(cores);
+
+	std::vector<glm::vec4> texels((size_t)LIGHTMAP_SIZE * LIGHTMAP_SIZE);
+	for (int simd = RAYCAST_SIMD_SCALAR; simd <= raycast_best_simd(); ++simd) {
+		for (int threads : counts) {
+			auto start = std::chrono::high_resolution_clock::now();
+			unsigned long long rays = trace_samples(job, texels, threads, (raycast_simd)simd);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			std::cout << "\t" << raycast_simd_name((raycast_simd)simd) << ", " << threads << " thread(s): " << rays << " rays in " << ms << " ms ("
+				<< rays / 1e6 / (ms / 1000.0) << " Mrays/s)" << std::endl;
+		}
+	}
+
+	lightmap_counters = saved;
+}
+
+LightmapStats lightmap_stats() {
+	return glob::lightmap_counters;
+}
+
+void lightmap_report() {
+	if (!lightmap_enabled())
+		return;
+
+	LightmapStats stats = lightmap_stats();
+	std::cout << "Lightmap: " << LIGHTMAP_SIZE << "^2 RGBA16F, " << stats.models << " Models baked";
+	if (stats.loaded)
+		std::cout << " (loaded from file)";
+	else {
+		std::cout << " in " << stats.charts << " charts at " << stats.density << " texels per unit, " << stats.texels << " texels lit\n"
+			<< "\tprepared in " << stats.prepare_ms << " ms (" << stats.triangles << " triangles, " << stats.bvh_nodes << " BVH nodes), "
+			<< stats.rays << " rays in " << stats.bake_ms << " ms on " << stats.threads << " thread(s), " << raycast_simd_name(stats.simd) << " ("
+			<< (stats.bake_ms > 0.0 ? stats.rays / 1e6 / (stats.bake_ms / 1000.0) : 0.0) << " Mrays/s)";
+	}
+	std::cout << "\n\t" << stats.baked_draws << " draws sampled the bake, " << stats.fallback_draws << " fell back to per-fragment lighting" << std::endl;
+}
+
+void lightmap_destroy() {
+	using namespace glob;
+
+	if (lightmap_texture)
+		glDeleteTextures(1, &lightmap_texture);
+	lightmap_texture = 0;
+	baked_models.clear();
+	lightmap_point_light = -1;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#ifndef __LIGHTMAP_H__
+#define __LIGHTMAP_H__
+
+#include <vector>
+
+#include "shader.h"
+#include "models.h"
+#include "lights.h"
+#include "raycast.h"
+
+const int LIGHTMAP_SIZE = 1024;				// Texels per side of the lightmap
+const int LIGHTMAP_PADDING = 2;				// Texels kept around every chart, filled from its edge so filtering never reaches a neighbour
+const int LIGHTMAP_MIN_CHART = 2;			// Texels per side a chart gets at least, however small
+const float LIGHTMAP_FILL = 0.5f;			// Share of the lightmap the charts aim to cover
+const float LIGHTMAP_CHART_COS = 0.999f;	// Cosine of the largest angle between neighbouring triangles of one chart
+const int LIGHTMAP_AO_RAYS = 64;			// Hemisphere rays per texel for ambient occlusion
+const float LIGHTMAP_AO_DISTANCE = 0.2f;	// World units an occluder must be within to darken a texel
+const int LIGHTMAP_TEXELS_PER_TASK = 256;	// Texels a worker claims at a time
+const int LIGHTMAP_TEXTURE_UNIT = 10;		// Texture unit of the lightmap (sampler2D)
+
+/**
+ * Offline lighting for Models that never move. The baker reads their meshes
+ * back from the arena, cuts them into charts of neighbouring triangles that
+ * face the same way, and lays the charts out flat (UV2) in one
+ * LIGHTMAP_SIZE^2 texture at a uniform density. Every covered texel is then
+ * lit by casting rays through a BVH of the scene on every core:
+ *
+ *	R: point light diffuse for a white light, with attenuation and shadow
+ *	G: point light attenuation, for its ambient term
+ *	B: directional light diffuse for a white light, with shadow
+ *	A: ambient occlusion over LIGHTMAP_AO_DISTANCE
+ *
+ * Colors are left out of the bake and applied when drawing, so recoloring the
+ * lights (glob::pointLightColor) needs no re-bake. Moving a baked Model or a
+ * light does: from then on every baked Model goes back to per-fragment Phong,
+ * since a moved Model's shadows and occlusion lie on its neighbours too.
+ * Models that are dynamic (see statics.h) when baking are neither baked nor
+ * cast shadows into the bake.
+ *
+ * Baked Models are re-uploaded in VERTEX_FORMAT_LIGHTMAPPED and drawn with
+ * the LIGHTMAP variant of the lit shader: diffuse from the bake, no specular.
+ * Their original meshes stay in the arena, and a later bake starts from them.
+ */
+struct lightmap_statistics {
+	bool loaded;							// the lightmap came from a file rather than this run's bake
+	unsigned int models;
+	unsigned int charts;
+	unsigned int triangles;					// in the ray casting scene
+	unsigned int texels;					// covered by charts and lit
+	float density;							// texels per world unit
+	unsigned int bvh_nodes;
+	double prepare_ms;						// reading meshes, charting, packing and building the BVH
+	double bake_ms;							// casting rays
+	unsigned long long rays;
+	int threads;
+	raycast_simd simd;
+	unsigned long long baked_draws;			// draws that sampled the bake
+	unsigned long long fallback_draws;		// draws of baked Models that were shaded per fragment because the bake went stale
+};
+typedef struct lightmap_statistics LightmapStats;
+
+/**
+ * Bake models lit by the light buffer's point_light and dir_light, switch the
+ * static ones to the bake and save it to path (nullptr to keep it in memory).
+ * threads <= 0 uses every core.
+ */
+bool lightmap_bake(const std::vector<Model*>& models, int point_light, DirectionalLight dir_light, const char* path, int threads = 0, raycast_simd simd = raycast_best_simd());
+
+/**
+ * Apply a bake saved by lightmap_bake. Fails, leaving the Models untouched,
+ * when the file is missing or was baked from other meshes, transforms or
+ * light positions.
+ */
+bool lightmap_load(const std::vector<Model*>& models, int point_light, DirectionalLight dir_light, const char* path);
+
+bool lightmap_enabled();					// A bake is loaded
+
+bool lightmap_usable(const Model& model, const DirectionalLight& dir_light);	// model is baked and no baked Model or light moved since
+
+/**
+ * Bind the lightmap and set "lightmap", "lightmapPointColor" and
+ * "lightmapDirColor" from the lights' current colors.
+ */
+void lightmap_bind(Shader* shader, const DirectionalLight& dir_light);
+
+/**
+ * Prepare a bake of models once, then time the ray casting on every
+ * instruction set, on one thread and on every core, and print rays per second.
+ */
+void lightmap_benchmark(const std::vector<Model*>& models, int point_light, DirectionalLight dir_light);
+
+LightmapStats lightmap_stats();
+
+void lightmap_report();
+
+void lightmap_destroy();
+#endif//__LIGHTMAP_H__
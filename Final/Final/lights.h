@@ -4,10 +4,10 @@
 
 #include <glm/glm.hpp>
 #include "shader.h"
+#include "geometry.h"
 
 struct radiant_light_mesh {
-	unsigned int VAO;
-	unsigned int number_of_vertices;
+	MeshRange mesh;
 	glm::mat4 model;
 	glm::vec3 position;
 	glm::vec3 color;
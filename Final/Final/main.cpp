@@ -5,6 +5,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
 
 /**
 * Forward declares all functions in "main.cpp" for unit testing
@@ -32,6 +36,116 @@
 	*/
 #include "models.h"
 
+	/**
+	 * Contains the "Shader" class and its program binary cache
+	 */
+#include "shader.h"
+
+	/**
+	 * Contains the feature-bit variants of the lit uber-shader
+	 */
+#include "variants.h"
+
+	/**
+	 * Contains the shader file watcher that recompiles edited programs
+	 */
+#include "hotreload.h"
+
+	/**
+	 * Contains the point and spot light arrays and their texture buffer
+	 */
+#include "lightbuffer.h"
+
+	/**
+	 * Contains the clustered light grid the lit shaders take their lights from
+	 */
+#include "clusters.h"
+
+	/**
+	 * Contains the G-buffer and lighting pass of the deferred path
+	 */
+#include "deferred.h"
+
+	/**
+	 * Contains the cascaded and cube shadow maps
+	 */
+#include "shadows.h"
+
+	/**
+	 * Contains the tracking of static and dynamic Models and lights
+	 */
+#include "statics.h"
+
+	/**
+	 * Contains the depth pre-pass and the overdraw view
+	 */
+#include "prepass.h"
+
+	/**
+	 * Contains the offline lightmap baker for static Models
+	 */
+#include "lightmap.h"
+
+	/**
+	 * Contains the tile-based CPU rasterizer backend
+	 */
+#include "softraster.h"
+
+	/**
+	 * Contains the ray-traced reference renderer and its image comparison
+	 */
+#include "reference.h"
+
+	/**
+	 * Contains the asynchronous frame capture to disk
+	 */
+#include "capture.h"
+
+	/**
+	 * Contains the offline camera path renderer
+	 */
+#include "sequence.h"
+
+	/**
+	 * Contains the fixed-rate simulation and the snapshots it hands the renderer
+	 */
+#include "sim.h"
+
+	/**
+	 * Contains the frame limiter and the input to display latency histograms
+	 */
+#include "pacing.h"
+
+	/**
+	 * Contains the offscreen target whose resolution follows the GPU time
+	 */
+#include "dynres.h"
+
+	/**
+	 * Contains the multi-draw indirect path for static Models
+	 */
+#include "batch.h"
+
+	/**
+	 * Contains the per-frame transient GPU memory allocator
+	 */
+#include "ring.h"
+
+	/**
+	 * Contains the packed texture array shared by every Model
+	 */
+#include "atlas.h"
+
+	/**
+	 * Contains the VRAM budget and mip eviction for textures
+	 */
+#include "residency.h"
+
+	/**
+	 * Contains image decoding and the downscale-on-load policy
+	 */
+#include "image.h"
+
 	/**
 	 * All global variables (primarily for the camera)
 	 */
@@ -48,14 +162,15 @@ namespace glob {
 	float lastY = 600.0 / 2.0;
 	float fov = 45.0f;
 
-	//timing
-	float deltaTime = 0.0f;
-	float lastFrame = 0.0f;
+	SimInput input = SimInput();	// gathered by processInput and the callbacks for the next sim_tick
 
 	bool orthographic = false;
 	bool wireframe = false;
 	bool zoom = false;
 	int pointLightColor = 0;
+	bool multiDraw = false;
+	bool deferred = false;
+	bool showOverdraw = false;
 }
 
 /**
@@ -118,6 +233,97 @@ int main(int argc, char* argv[]) {
 	 */
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
+	/**
+	 * "--report" logs each module's statistics at exit; without it only
+	 * the modules asked for by their own flags do.
+	 */
+	bool report = false;
+	for (int i = 1; i < argc; ++i)
+		report |= strcmp(argv[i], "--report") == 0;
+
+	/**
+	 * Allocate the shared vertex/index buffers that every static mesh is
+	 * uploaded into.
+	 */
+	geometry_init(STATIC_VERTEX_ARENA_BYTES, STATIC_INDEX_ARENA_COUNT);
+
+	/**
+	 * Triple-buffered ring for data streamed to the GPU every frame.
+	 */
+	ring_init(FRAME_RING_BYTES);
+
+	/**
+	 * Every point and spot light lives in one texture buffer; each draw shades
+	 * the few that reach it.
+	 */
+	lightbuffer_init(LIGHT_BUFFER_CAPACITY);
+
+	/**
+	 * Linked programs are cached in shaders/cache/ between launches;
+	 * "--no-shader-cache" always compiles from source to compare startup time.
+	 * Programs compile while textures are decoded and meshes generated below,
+	 * unless "--serial-shader-compile" is given.
+	 */
+	bool parallel_shaders = true;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--no-shader-cache") == 0)
+			Shader::binaryCacheEnabled() = false;
+		if (strcmp(argv[i], "--serial-shader-compile") == 0)
+			parallel_shaders = false;
+	}
+	if (parallel_shaders)
+		Shader::beginParallelCompile();
+
+	/**
+	 * Slice the view frustum into clusters and shade each fragment with the
+	 * lights listed for its cluster. Where the context allows compute
+	 * shaders, the first builds time them against the CPU and keep the
+	 * faster, unless "--cpu-light-clusters" is given; "--no-light-clusters"
+	 * goes back to per-draw light lists. Build times are logged at exit with
+	 * "--cpu-light-clusters" or "--report". Must come before models_init and
+	 * batch_init, which pick their shaders by it.
+	 */
+	bool light_clusters = true, compute_clusters = true;
+	for (int i = 1; i < argc; ++i) {
+		light_clusters &= strcmp(argv[i], "--no-light-clusters") != 0;
+		compute_clusters &= strcmp(argv[i], "--cpu-light-clusters") != 0;
+	}
+	if (light_clusters)
+		clusters_init(compute_clusters);
+
+	/**
+	 * Shadow the directional light with cascades and the point light with a
+	 * cube, unless "--no-shadows" is given. Like the clusters, this picks the
+	 * lit shaders, so it comes before deferred_init, models_init and batch_init.
+	 */
+	bool shadows = true;
+	for (int i = 1; i < argc; ++i)
+		shadows &= strcmp(argv[i], "--no-shadows") != 0;
+	if (shadows)
+		shadows_init();
+
+	/**
+	 * "--deferred" renders the lit Models into a G-buffer and lights every
+	 * covered pixel once afterwards, instead of lighting them as they are drawn.
+	 */
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--deferred") == 0)
+			glob::deferred = deferred_init();
+	}
+
+	/**
+	 * "--depth-prepass" lays down depth for the forward paths before shading
+	 * them with GL_EQUAL ("Z" toggles it); "--show-overdraw" draws how many
+	 * fragments were shaded per pixel instead of the lit frame ("V" toggles it).
+	 */
+	prepass_init();
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--depth-prepass") == 0)
+			prepass_set_enabled(true);
+		if (strcmp(argv[i], "--show-overdraw") == 0)
+			glob::showOverdraw = true;
+	}
+
 	/**
 	 * Generate shaders for light sources after OpenGL and GLFW are intitialized.
 	 */
@@ -128,112 +334,528 @@ int main(int argc, char* argv[]) {
 	 */
 	models_init();
 
+	/**
+	 * Track texture memory against a budget; textures registered from here on
+	 * lose top mips when it is exceeded.
+	 */
+	size_t texture_budget = TEXTURE_BUDGET_BYTES;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], "--texture-budget-mb") == 0)
+			texture_budget = (size_t)atoi(argv[i + 1]) * 1024 * 1024;
+	}
+	residency_init(texture_budget);
+
+	/**
+	 * Downscale images larger than the window could ever show texel-for-texel
+	 * before they are uploaded.
+	 */
+	int max_texture_size = MAX_TEXTURE_DIMENSION;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], "--max-texture-size") == 0)
+			max_texture_size = atoi(argv[i + 1]);
+	}
+	image_set_max_dimension(max_texture_size);
+
+	/**
+	 * Pack every diffuse and specular map into one texture array so Models never switch
+	 * textures. "--pack-atlas" saves the pack to data/ for later launches.
+	 */
+	bool save_atlas = false;
+	for (int i = 1; i < argc; ++i)
+		save_atlas |= strcmp(argv[i], "--pack-atlas") == 0;
+	atlas_init({ "data/wood.jpg", "data/switch.jpg", "data/soda.jpg", "data/switch_specular_map.jpg" }, "data/atlas.txt", save_atlas);
+	if (report)
+		atlas_report();			// Log layer size and padding waste
+	if (report)
+		image_report();			// Log decode time and bytes saved by downscaling
+
 	/**
 	 * Create models
 	 */
 	RadiantLight light = get_point_light();
+	int point_light = lightbuffer_add_point(light.position, light.color, light.attenuation_coefficients);
 	DirectionalLight light2 = get_directional_light();
 
 	Model desk = get_desk_model("data/wood.jpg");
 	Model console = get_switch_model("data/switch.jpg");
 	Model soda = get_soda_model("data/soda.jpg");
 
-	Material console_mat;
-	console_mat.specular_map = load_wrap_texture("data/switch_specular_map.jpg");
-	console_mat.shine = 1.0f;
+	Material console_mat = get_material("data/switch_specular_map.jpg", 1.0f);
+
+	if (report)
+		geometry_report();		// Log how much of the static geometry arena the scene uses
 
 	/**
-	 * Main rendering loop
+	 * Wait for the programs submitted by lights_init and models_init.
 	 */
-	while (!glfwWindowShouldClose(window)) {
-		float curr_time = glfwGetTime();
-		glob::deltaTime = curr_time - glob::lastFrame;
-		glob::lastFrame = curr_time;
-
-		/**
-		 * Deal with keypresses
-		 */
-		processInput(window);
+	Shader::finishParallelCompile();
 
-		/**
-		 * Clear color and depth buffers before rendering.
-		 */
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		/**
-		 * Create projection, view and model matrices to pass to shader.
-		 */
+	/**
+	 * Use one glMultiDrawElementsIndirect for the static Models when the
+	 * context supports it ("B" toggles between the two paths).
+	 */
+	glob::multiDraw = batch_init();
 
-		struct viewport_t {
-			int x;
-			int y;
-			int width;
-			int height;
-		} viewport;																																// Struct instead of int [4] for field names
-		glGetIntegerv(GL_VIEWPORT, (int*)&viewport);																							// Cast viewport_t to int [4] for the sake of glGet
+	if (report)
+		Shader::reportCache();	// Log shader build time and how many programs came from the binary cache
+	if (report)
+		variants_report();		// Log each lit shader variant and what it cost to build
 
-		float aspect_ratio = (float)viewport.width / (float)viewport.height;																	// Calculate aspect ratio using viewport width and height
+	/**
+	 * Recompile programs whose sources in shaders/ are saved while running, so
+	 * shader edits don't need a restart ("--no-hot-reload" turns this off).
+	 */
+	bool hot_reload = true;
+	for (int i = 1; i < argc; ++i)
+		hot_reload &= strcmp(argv[i], "--no-hot-reload") != 0;
+	if (hot_reload)
+		hotreload_init("shaders");
 
-		glm::mat4 projection;
-		if (glob::orthographic) {																												// Create projection matrix depending on value of glob::orthographic
-			float ratio_size_per_depth = atan(glm::radians(glob::fov) / 2.f) * 2.f;																	// Multiply this variable by distance Z from the camera to get aspect ratio of ortho projection
-			float distance = glm::length(glob::cameraFront - glob::cameraPos);																		// Calculate distance Z between camera and focal point
-			float size_y = ratio_size_per_depth * distance;																							// Calculate height of projection
-			float size_x = ratio_size_per_depth * distance * aspect_ratio;																			// Calculate width of projection
+	/**
+	 * "--lightmap" lights the static Models from data/lightmap.bin, baking it
+	 * first when it is missing or stale; "--bake-lightmap" always re-bakes
+	 * instead of loading.
+	 */
+	bool use_lightmap = false, bake_lightmap = false;
+	for (int i = 1; i < argc; ++i) {
+		use_lightmap |= strcmp(argv[i], "--lightmap") == 0;
+		bake_lightmap |= strcmp(argv[i], "--bake-lightmap") == 0;
+	}
+	if (bake_lightmap || (use_lightmap && !lightmap_load({ &desk, &console, &soda }, point_light, light2, "data/lightmap.bin")))
+		lightmap_bake({ &desk, &console, &soda }, point_light, light2, "data/lightmap.bin");
 
-			projection = glm::ortho(-size_x, size_x, -size_y, size_y, 0.1f, 2.f * distance);														// Create orthographic projection matrix;
+	/**
+	 * "--benchmark-batching" compares both submission paths from the starting
+	 * camera before entering the render loop; "--benchmark-mips" times mip
+	 * chain generation on the largest texture; "--benchmark-lights" sweeps
+	 * the light buffer from 1 to 10k lights; "--benchmark-prepass" shades the
+	 * Models with and without the depth pre-pass; "--benchmark-lightmap" casts
+	 * the lightmap's rays on every instruction set and thread count.
+	 * "--software-render" draws the starting camera on the CPU into
+	 * software.ppm and "--benchmark-software" times that on 1 to N cores.
+	 * "--benchmark-reference" times the ray-traced reference with single rays
+	 * and with packets.
+	 */
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--benchmark-batching") == 0) {
+			std::vector<BatchItem> items = { { &desk, nullptr }, { &console, &console_mat }, { &soda, nullptr } };
+			glm::mat4 projection = glm::perspective(glm::radians(glob::fov), (float)GLFW_WINDOW_WIDTH / (float)GLFW_WINDOW_HEIGHT, 0.1f, 100.f);
+			glm::mat4 view = glm::lookAt(glob::cameraPos, glob::cameraPos + glob::cameraFront, glob::cameraUp);
+			lightbuffer_upload();
+			clusters_build(projection, view, GLFW_WINDOW_WIDTH, GLFW_WINDOW_HEIGHT);
+			batch_benchmark(items, projection, view, light2, glob::cameraPos, 500);
 		}
-		else {
-			projection = glm::perspective(glm::radians(glob::fov), aspect_ratio, 0.1f, 100.f);														// Create perspective projection matrix
+		if (strcmp(argv[i], "--benchmark-lights") == 0) {
+			std::vector<BatchItem> items = { { &desk, nullptr }, { &console, &console_mat }, { &soda, nullptr } };
+			glm::mat4 projection = glm::perspective(glm::radians(glob::fov), (float)GLFW_WINDOW_WIDTH / (float)GLFW_WINDOW_HEIGHT, 0.1f, 100.f);
+			glm::mat4 view = glm::lookAt(glob::cameraPos, glob::cameraPos + glob::cameraFront, glob::cameraUp);
+			batch_benchmark_lights(items, projection, view, light2, glob::cameraPos, 20);
+		}
+		if (strcmp(argv[i], "--benchmark-prepass") == 0) {
+			std::vector<BatchItem> items = { { &desk, nullptr }, { &console, &console_mat }, { &soda, nullptr } };
+			glm::mat4 projection = glm::perspective(glm::radians(glob::fov), (float)GLFW_WINDOW_WIDTH / (float)GLFW_WINDOW_HEIGHT, 0.1f, 100.f);
+			glm::mat4 view = glm::lookAt(glob::cameraPos, glob::cameraPos + glob::cameraFront, glob::cameraUp);
+			lightbuffer_upload();
+			clusters_build(projection, view, GLFW_WINDOW_WIDTH, GLFW_WINDOW_HEIGHT);
+			prepass_benchmark(items, projection, view, light2, glob::cameraPos, 100);
+		}
+		if (strcmp(argv[i], "--benchmark-mips") == 0)
+			benchmark_mip_generation("data/switch.jpg", 5);
+		if (strcmp(argv[i], "--benchmark-lightmap") == 0)
+			lightmap_benchmark({ &desk, &console, &soda }, point_light, light2);
+		if (strcmp(argv[i], "--software-render") == 0 || strcmp(argv[i], "--benchmark-software") == 0) {
+			std::vector<BatchItem> items = { { &desk, nullptr }, { &console, &console_mat }, { &soda, nullptr } };
+			glm::mat4 projection = glm::perspective(glm::radians(glob::fov), (float)GLFW_WINDOW_WIDTH / (float)GLFW_WINDOW_HEIGHT, 0.1f, 100.f);
+			glm::mat4 view = glm::lookAt(glob::cameraPos, glob::cameraPos + glob::cameraFront, glob::cameraUp);
+			if (!softraster_init(items))
+				continue;
+			if (strcmp(argv[i], "--software-render") == 0) {
+				SoftTarget target;
+				softraster_render(target, GLFW_WINDOW_WIDTH, GLFW_WINDOW_HEIGHT, projection, view, light2, glob::cameraPos);
+				softraster_save(target, "software.ppm");
+			}
+			else
+				softraster_benchmark(GLFW_WINDOW_WIDTH, GLFW_WINDOW_HEIGHT, projection, view, light2, glob::cameraPos, 5);
 		}
+		if (strcmp(argv[i], "--benchmark-reference") == 0) {
+			std::vector<BatchItem> items = { { &desk, nullptr }, { &console, &console_mat }, { &soda, nullptr } };
+			glm::mat4 projection = glm::perspective(glm::radians(glob::fov), (float)GLFW_WINDOW_WIDTH / (float)GLFW_WINDOW_HEIGHT, 0.1f, 100.f);
+			glm::mat4 view = glm::lookAt(glob::cameraPos, glob::cameraPos + glob::cameraFront, glob::cameraUp);
+			if (reference_init(items))
+				reference_benchmark(GLFW_WINDOW_WIDTH, GLFW_WINDOW_HEIGHT, projection, view, light2, glob::cameraPos);
+		}
+	}
+
+	/**
+	 * "--reference" ray traces the first frame on the CPU as well and compares
+	 * the GL frame against it, saving both as reference.png and gl.png.
+	 * "--reference-samples N" traces N x N rays per pixel.
+	 */
+	bool reference = false;
+	int reference_samples = 1;
+	for (int i = 1; i < argc; ++i) {
+		reference |= strcmp(argv[i], "--reference") == 0;
+		if (strcmp(argv[i], "--reference-samples") == 0 && i + 1 < argc)
+			reference_samples = atoi(argv[i + 1]);
+	}
+	if (reference)
+		reference = reference_init({ { &desk, nullptr }, { &console, &console_mat }, { &soda, nullptr } });
 
-		glm::mat4 view = glm::lookAt(glob::cameraPos, glob::cameraPos + glob::cameraFront, glob::cameraUp);										// Create view matrix									
+	/**
+	 * "--capture" writes every frame to capture/ as PPM, "--capture-png" as
+	 * PNG, read back without stalling and encoded on other threads.
+	 */
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--capture") == 0 || strcmp(argv[i], "--capture-png") == 0)
+			capture_init("capture", strcmp(argv[i], "--capture-png") == 0 ? CAPTURE_FORMAT_PNG : CAPTURE_FORMAT_PPM);
+	}
 
-		/**
-		 * Set polygon mode depending on value of wireframe
-		 */
-		if (glob::wireframe)
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		else
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	/**
+	 * "--dynamic-resolution MS" draws the scene offscreen at whatever fraction
+	 * of the window keeps its GPU time under MS milliseconds and upscales it,
+	 * sharpened by "--upscale-sharpness S" (0 for plain bilinear).
+	 */
+	float dynres_target_ms = 0.f, upscale_sharpness = DYNRES_DEFAULT_SHARPNESS;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], "--dynamic-resolution") == 0)
+			dynres_target_ms = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "--upscale-sharpness") == 0)
+			upscale_sharpness = (float)atof(argv[i + 1]);
+	}
+	if (dynres_target_ms > 0.f)
+		dynres_init(dynres_target_ms, upscale_sharpness);
 
-		/**
-		 * Set color of point light
-		 */
-		switch (glob::pointLightColor) {
-		case 0:
-			light.color = glm::vec3(0.831f, 0.921f, 1.f);
-			break;										// case 0: fluorescent light
-		case 1:
-			light.color = glm::vec3(1.f, 0.f, 0.f);
-			break;										// case 1: red light
-		case 2:
-			light.color = glm::vec3(0.f, 1.f, 0.f);
-			break;										// case 2: green light
-		case 3:
-			light.color = glm::vec3(0.f, 0.f, 1.f);
-			break;										// case 3: blue light
-		}
+	/**
+	 * Draw the Models and the light's marker into the bound framebuffer: a
+	 * whole width x height frame, or a tile of a larger one. Shadow cascades
+	 * are fitted to frame_projection, the whole frame's, so tiles match;
+	 * projection is the part of it being drawn.
+	 */
+	auto draw_scene = [&](glm::mat4 frame_projection, glm::mat4 projection, glm::mat4 view, int width, int height) {
+		lightbuffer_upload();					// Only re-uploads after a light changed
+		clusters_build(projection, view, width, height);	// Assign lights to this frame's clusters, unless nothing changed
+		shadows_update({ &desk, &console, &soda }, frame_projection, view, light2, point_light);	// Redraw shadow maps whose light moved, or their dynamic casters
 
 		/**
 		 * Draw models
 		 */
-		draw_radiant_light(light, projection, view);													// Draw light source
+		if (glob::deferred) {
+			deferred_begin(width, height);																// Bind and clear the G-buffer
+			deferred_draw(desk, nullptr, projection, view);												// Store desk Model
+			deferred_draw(console, &console_mat, projection, view);										// Store console Model
+			deferred_draw(soda, nullptr, projection, view);												// Store soda can Model
+			deferred_end(projection, view, light2, glob::cameraPos);									// Light every covered pixel
+			draw_radiant_light(light, projection, view);												// Draw light source, depth tested against the G-buffer
+		}
+		else {
+			prepass_begin(width, height);																	// Lay down depth first when the pre-pass is on
+			prepass_draw(desk, projection, view);
+			prepass_draw(console, projection, view);
+			prepass_draw(soda, projection, view);
+			prepass_end();																				// Shade only the nearest fragments from here
+
+			if (glob::multiDraw) {
+				batch_begin();
+				batch_add(desk);																		// Queue desk Model
+				batch_add(console, &console_mat);														// Queue console Model
+				batch_add(soda);																		// Queue soda can Model
+				batch_submit(projection, view, light2, glob::cameraPos);							// Cull and draw all three in one call
+			}
+			else {
+				draw_model(desk, projection, view, light2, glob::cameraPos);							// Draw desk Model
+				draw_material_model(console, console_mat, projection, view, light2, glob::cameraPos);	// Draw console Mode
+				draw_model(soda, projection, view, light2, glob::cameraPos);							// Draw soda can Model
+			}
+
+			prepass_finish();
+			draw_radiant_light(light, projection, view);												// Draw light source, not part of the pre-pass
+
+			if (glob::showOverdraw)
+				prepass_show_overdraw({ &desk, &console, &soda }, projection, view);					// Fragments shaded per pixel instead of the lit frame
+		}
+	};
 
-		draw_model(desk, projection, view, light, light2, glob::cameraPos);								// Draw desk Model
-		draw_material_model(console, console_mat, projection, view, light, light2, glob::cameraPos);	// Draw console Mode
-		draw_model(soda, projection, view, light, light2, glob::cameraPos);								// Draw soda can Model
+	/**
+	 * "--render-path file" renders the camera path in file offscreen into
+	 * sequence/ and exits instead of entering the render loop.
+	 * "--render-size WxH", "--render-tile N" and "--render-ppm" set the frame
+	 * size (1920x1080), the largest tile drawn at once and PPM over PNG.
+	 */
+	SequenceSettings sequence_settings;
+	const char* sequence_path = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--render-path") == 0 && i + 1 < argc)
+			sequence_path = argv[i + 1];
+		if (strcmp(argv[i], "--render-size") == 0 && i + 1 < argc)
+			sscanf(argv[i + 1], "%dx%d", &sequence_settings.width, &sequence_settings.height);
+		if (strcmp(argv[i], "--render-tile") == 0 && i + 1 < argc)
+			sequence_settings.tile_size = atoi(argv[i + 1]);
+		if (strcmp(argv[i], "--render-ppm") == 0)
+			sequence_settings.format = CAPTURE_FORMAT_PPM;
+	}
+	CameraPath camera_path;
+	if (sequence_path && sequence_load(sequence_path, camera_path)) {
+		sequence_render(camera_path, sequence_settings, [&](const CameraKey& camera, glm::mat4 projection, glm::mat4 tile_projection, glm::mat4 view, int width, int height) {
+			glob::cameraPos = camera.position;																	// The viewer the Models are lit for
+			ring_begin_frame();																					// Every tile is a frame to the ring and static tracking
+			statics_begin_frame();
+			draw_scene(projection, tile_projection, view, width, height);
+			ring_end_frame();
+		});
+		glfwSetWindowShouldClose(window, true);
+	}
 
+	/**
+	 * Input is polled and the camera stepped SIM_TICK_RATE times a second on
+	 * the main thread (GLFW only delivers events there), while the render
+	 * loop runs on its own thread with the context and draws the newest
+	 * snapshot, so slow frames no longer slow input down. "--sim-rate N"
+	 * steps N times a second; "--sim-on-render-thread" polls and steps at the
+	 * start of every frame instead, as before, to compare latency. Either,
+	 * or "--report", logs the steps and input latency at exit.
+	 */
+	double sim_rate = SIM_TICK_RATE;
+	bool sim_threaded = true;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--sim-rate") == 0 && i + 1 < argc)
+			sim_rate = atof(argv[i + 1]);
+		if (strcmp(argv[i], "--sim-on-render-thread") == 0)
+			sim_threaded = false;
+	}
+	SimState sim_start;
+	sim_start.position = glob::cameraPos;
+	sim_start.yaw = glob::yaw;
+	sim_start.pitch = glob::pitch;
+	sim_start.fov = glob::fov;
+	sim_start.speed = glob::cameraSpeed;
+	sim_start.orthographic = glob::orthographic;
+	sim_start.wireframe = glob::wireframe;
+	sim_start.multi_draw = glob::multiDraw;
+	sim_start.depth_prepass = prepass_enabled();
+	sim_start.show_overdraw = glob::showOverdraw;
+	sim_start.point_light_color = glob::pointLightColor;
+	sim_init(sim_start, glfwGetTime(), sim_rate, sim_threaded);
 
-		glfwSwapBuffers(window);				// Swaps front and back framebuffers (output to screen)
+	/**
+	 * Every frame is timed from its input to the GPU reaching its swap.
+	 * "--target-fps N" holds frames to N per second, "--late-input" sleeps
+	 * before sampling input instead of before swapping so frames show newer
+	 * input, and "--swap-interval N" sets the swap interval (vsync) instead
+	 * of leaving it to the driver. The latency histograms are logged at exit
+	 * with the first two, or "--report".
+	 */
+	double target_fps = 0.0;
+	int swap_interval = -1;
+	bool late_input = false;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--target-fps") == 0 && i + 1 < argc)
+			target_fps = atof(argv[i + 1]);
+		if (strcmp(argv[i], "--swap-interval") == 0 && i + 1 < argc)
+			swap_interval = atoi(argv[i + 1]);
+		late_input |= strcmp(argv[i], "--late-input") == 0;
+	}
+	pacing_init(target_fps, swap_interval, late_input);
 
-		glfwPollEvents();						// Check to see if any events were triggered and call
-													// the corresponding callback functions
+	/**
+	 * Main rendering loop
+	 */
+	auto render_loop = [&]() {
+		while (!glfwWindowShouldClose(window)) {
+			ring_begin_frame();						// Reclaim the ring section used RING_FRAMES frames ago
+			statics_begin_frame();					// Start a frame of static/dynamic tracking
+
+			hotreload_update();						// Swap in shaders edited on disk once they have compiled
+
+			int resized_width, resized_height;
+			if (events::take_framebuffer_size(&resized_width, &resized_height))
+				glViewport(0, 0, resized_width, resized_height);	// Resized since the last frame
+
+			/**
+			 * Deal with keypresses, then take the camera and toggles from the
+			 * newest snapshot as late as possible, right before they are needed.
+			 */
+			pacing_wait();							// Sleeps here with "--late-input"
+			if (!sim_threaded) {
+				glfwPollEvents();					// Check to see if any events were triggered and call
+														// the corresponding callback functions
+				processInput(window);
+				sim_tick(glob::input, glfwGetTime());	// Every step due since the last frame
+			}
+			SimState state = sim_frame_state(glfwGetTime());
+			glob::cameraPos = state.position;
+			glob::yaw = state.yaw;
+			glob::pitch = state.pitch;
+			glob::cameraFront = sim_front(state);
+			glob::fov = state.fov;
+			glob::cameraSpeed = state.speed;
+			glob::orthographic = state.orthographic;
+			glob::wireframe = state.wireframe;
+			glob::multiDraw = state.multi_draw;
+			glob::showOverdraw = state.show_overdraw;
+			glob::pointLightColor = state.point_light_color;
+			if (state.depth_prepass != prepass_enabled())
+				prepass_set_enabled(state.depth_prepass);
+
+			/**
+			 * Clear color and depth buffers before rendering.
+			 */
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			/**
+			 * Create projection, view and model matrices to pass to shader.
+			 */
+
+			struct viewport_t {
+				int x;
+				int y;
+				int width;
+				int height;
+			} viewport;																																// Struct instead of int [4] for field names
+			glGetIntegerv(GL_VIEWPORT, (int*)&viewport);																							// Cast viewport_t to int [4] for the sake of glGet
+
+			float aspect_ratio = (float)viewport.width / (float)viewport.height;																	// Calculate aspect ratio using viewport width and height
+
+			glm::mat4 projection;
+			if (glob::orthographic) {																												// Create projection matrix depending on value of glob::orthographic
+				float ratio_size_per_depth = atan(glm::radians(glob::fov) / 2.f) * 2.f;																	// Multiply this variable by distance Z from the camera to get aspect ratio of ortho projection
+				float distance = glm::length(glob::cameraFront - glob::cameraPos);																		// Calculate distance Z between camera and focal point
+				float size_y = ratio_size_per_depth * distance;																							// Calculate height of projection
+				float size_x = ratio_size_per_depth * distance * aspect_ratio;																			// Calculate width of projection
+
+				projection = glm::ortho(-size_x, size_x, -size_y, size_y, 0.1f, 2.f * distance);														// Create orthographic projection matrix;
+			}
+			else {
+				projection = glm::perspective(glm::radians(glob::fov), aspect_ratio, 0.1f, 100.f);														// Create perspective projection matrix
+			}
+
+			glm::mat4 view = glm::lookAt(glob::cameraPos, glob::cameraPos + glob::cameraFront, glob::cameraUp);										// Create view matrix									
+
+			/**
+			 * Set polygon mode depending on value of wireframe
+			 */
+			if (glob::wireframe)
+				glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+			else
+				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+			/**
+			 * Set color of point light
+			 */
+			switch (glob::pointLightColor) {
+			case 0:
+				light.color = glm::vec3(0.831f, 0.921f, 1.f);
+				break;										// case 0: fluorescent light
+			case 1:
+				light.color = glm::vec3(1.f, 0.f, 0.f);
+				break;										// case 1: red light
+			case 2:
+				light.color = glm::vec3(0.f, 1.f, 0.f);
+				break;										// case 2: green light
+			case 3:
+				light.color = glm::vec3(0.f, 0.f, 1.f);
+				break;										// case 3: blue light
+			}
+			lightbuffer_set_color(point_light, light.color);
+			statics_light(point_light);				// Track where the light is and how far it reaches
+			int scene_width, scene_height;
+			dynres_begin(viewport.width, viewport.height, &scene_width, &scene_height);	// Draw offscreen at a scale that fits the GPU time target, with "--dynamic-resolution"
+			draw_scene(projection, projection, view, scene_width, scene_height);	// Lights, shadows and the Models for this frame
+			dynres_end();							// Upscale it to the window
+
+
+			if (reference) {
+				Image traced, frame;
+				reference_render(traced, viewport.width, viewport.height, projection, view, light2, glob::cameraPos, reference_samples);	// Same camera and lights as this frame
+				if (read_framebuffer(viewport.width, viewport.height, frame)) {
+					reference_compare(traced, frame);
+					image_save_png(traced, "reference.png");
+					image_save_png(frame, "gl.png");
+				}
+				reference = false;
+			}
+
+			capture_frame(viewport.width, viewport.height);	// Queue the frame for the encoders when capturing
+			residency_update();						// Keep textures within the VRAM budget
+			ring_end_frame();						// Fence this frame's ring section
+
+			pacing_submit();						// Sleeps until the frame is due with "--target-fps"
+			glfwSwapBuffers(window);				// Swaps front and back framebuffers (output to screen)
+			pacing_presented(sim_presented(glfwGetTime()));	// Time the swap on the GPU for the newest input drawn
+		}
+	};
+
+	if (sim_threaded) {
+		glfwMakeContextCurrent(nullptr);		// The render thread takes the context
+		std::thread render_thread([&]() {
+			glfwMakeContextCurrent(window);
+			render_loop();
+			glfwMakeContextCurrent(nullptr);
+		});
+
+		while (!glfwWindowShouldClose(window)) {
+			glfwPollEvents();					// Run the callbacks for everything since the last tick
+			processInput(window);
+			sim_tick(glob::input, glfwGetTime());	// Step and publish a snapshot
+			sim_wait();
+		}
+
+		render_thread.join();
+		glfwMakeContextCurrent(window);			// Back for the reports and cleanup
 	}
+	else
+		render_loop();
 
 	/**
 	 * End execution
 	 */
+	capture_flush();	// Write the frames still being read back or encoded
+	if (report)
+		ring_report();		// Log ring buffer usage and stalls
+	if (report)
+		residency_report();	// Log texture memory against the budget
+	hotreload_report();	// Log shader reload latency
+	if (report)
+		lightbuffer_report();	// Log light count, uploads and per-draw light lists
+	if (report || !compute_clusters)
+		clusters_report();	// Log cluster build time and lights per cluster
+	deferred_report();	// Log G-buffer overdraw and estimated bandwidth
+	if (report)
+		shadows_report();	// Log per-cascade casters, re-renders and timings
+	if (report)
+		prepass_report();	// Log fragments shaded per pixel with and without the pre-pass
+	if (report)
+		statics_report();	// Log which Models and lights were cached as static
+	lightmap_report();	// Log bake cost and how many draws used it
+	softraster_report();	// Log the last CPU frame's triangles, bins and stage times
+	reference_report();	// Log ray counts and the GL frame's PSNR and SSIM against the reference
+	capture_report();	// Log frames written and what capturing cost the render thread
+	sequence_report();	// Log the camera path's frames per second
+	if (report || sim_rate != SIM_TICK_RATE || !sim_threaded)
+		sim_report();		// Log simulation steps, snapshots drawn and input latency
+	if (report || target_fps > 0.0 || late_input)
+		pacing_report();	// Log input to display latency histograms and missed frames
+	dynres_report();	// Log the resolution scale and the controller's GPU times
+
+	hotreload_destroy();	// Stop watching shaders/
+	variants_destroy();	// Release the lit shader variants
+	lightbuffer_destroy();	// Release the light texture buffer
+	clusters_destroy();	// Release the cluster grid and its compute shader
+	deferred_destroy();	// Release the G-buffer and its shaders
+	shadows_destroy();	// Release the shadow maps and their programs
+	prepass_destroy();	// Release the depth-only and overdraw programs
+	statics_destroy();	// Forget the tracked Models and lights
+	lightmap_destroy();	// Release the lightmap texture
+	softraster_destroy();	// Join the workers, drop the read-back meshes and textures
+	reference_destroy();	// Drop the reference's meshes, textures and BVH
+	capture_destroy();	// Stop the encoders and release the pixel buffers
+	pacing_destroy();	// Release the timestamp queries and fences
+	dynres_destroy();	// Release the offscreen target and the upscale shader
+
+	batch_destroy();	// Release the batched shader
+	atlas_destroy();	// Release the atlas texture array
+	residency_destroy();	// Stop tracking textures
+	ring_destroy();		// Unmap and release the frame ring
+	geometry_destroy();	// Release the shared vertex/index buffers and VAOs
 	glfwTerminate();	// Safely terminate GLFW
 	return 0;			// End execution with a good value
 }
@@ -267,7 +889,7 @@ GLFWwindow* create_glfw_window() {
 	glfwMakeContextCurrent(window);
 
 	return window;
-}
+}
 
 
 /**
@@ -335,40 +957,64 @@ void processInput(GLFWwindow* window)
 	static bool p_pressed = false;
 	static bool o_pressed = false;
 	static bool i_pressed = false;
+	static bool b_pressed = false;
+	static bool z_pressed = false;
+	static bool v_pressed = false;
 
 	using namespace glob;														// This method accesses and modifies global variables
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, true);									// When "ESC" is pressed, set the flag that tells main()'s render loop to exit
 
 	if (!p_pressed && glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
-		glob::orthographic ^= true;								// Toggle value of orthographic
+		glob::input.toggle_projection = true;					// Toggle value of orthographic on the next step
 		p_pressed = true;										// Set p_pressed to true
 	}																			// When "P" is pressed toggle between perspective and orthographic projection
 	if (p_pressed && glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE)
 		p_pressed = false;										// Set p_pressed to false
 
 	if (!o_pressed && glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
-		glob::wireframe ^= true;								// Toggle value of wireframe
+		glob::input.toggle_wireframe = true;					// Toggle value of wireframe on the next step
 		o_pressed = true;										// Set o_pressed to true
 	}																			// When "O" is pressed toggle wireframe mode On or Off
 	if (o_pressed && glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE)
 		o_pressed = false;										// Set o_pressed to false
 
 	if (!i_pressed && glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) {
-		glob::pointLightColor = (glob::pointLightColor + 1) % 4;	// Cycle through the directional light colors
+		glob::input.cycle_light_color = true;					// Cycle through the directional light colors
 		i_pressed = true;										// Set i_pressed to true
 	}																			// When "O" is pressed toggle wireframe mode On or Off
 	if (i_pressed && glfwGetKey(window, GLFW_KEY_I) == GLFW_RELEASE)
 		i_pressed = false;										// Set i_pressed to false
 
 	if (!i_pressed && glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) {
-		glob::pointLightColor = (glob::pointLightColor + 1) % 4;	// Cycle through the directional light colors
+		glob::input.cycle_light_color = true;					// Cycle through the directional light colors
 		i_pressed = true;									// Set i_pressed to true
 	}																			// When "O" is pressed toggle wireframe mode On or Off
 	if (i_pressed && glfwGetKey(window, GLFW_KEY_I) == GLFW_RELEASE)
 		i_pressed = false;								// Set i_pressed to false
 
 
+	if (!b_pressed && glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS) {
+		glob::input.toggle_multi_draw = true;					// Toggle multi-draw batching if the context supports it
+		b_pressed = true;										// Set b_pressed to true
+	}																			// When "B" is pressed toggle between batched and per-Model draws
+	if (b_pressed && glfwGetKey(window, GLFW_KEY_B) == GLFW_RELEASE)
+		b_pressed = false;										// Set b_pressed to false
+
+	if (!z_pressed && glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS) {
+		glob::input.toggle_prepass = true;						// Toggle the depth pre-pass
+		z_pressed = true;										// Set z_pressed to true
+	}																			// When "Z" is pressed toggle the depth pre-pass On or Off
+	if (z_pressed && glfwGetKey(window, GLFW_KEY_Z) == GLFW_RELEASE)
+		z_pressed = false;										// Set z_pressed to false
+
+	if (!v_pressed && glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS) {
+		glob::input.toggle_overdraw = true;						// Toggle the overdraw view
+		v_pressed = true;										// Set v_pressed to true
+	}																			// When "V" is pressed toggle between the lit frame and fragments shaded per pixel
+	if (v_pressed && glfwGetKey(window, GLFW_KEY_V) == GLFW_RELEASE)
+		v_pressed = false;										// Set v_pressed to false
+
 	if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS ||
 		glfwGetKey(window, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS)
 		zoom = true;															// When "Shift" is held, scrolling behavior becomes zooming in and out
@@ -377,19 +1023,29 @@ void processInput(GLFWwindow* window)
 		zoom = false;															// When "Shift" is released, scrolling behavior returns to speeding up and down
 
 
-	float speed = cameraSpeed * deltaTime;										// Adjust speed based on how many subframes have been skipped (deltaTime)
+	/**
+	 * Movement keys are only sampled here; sim_tick moves the camera by them
+	 * for every step until they are released.
+	 */
+	glm::vec3 move = glm::vec3(0.f);
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		cameraPos += speed * cameraFront;										// When "W" is pressed, move camera forwards, towards cameraFront
+		move.z += 1.f;															// When "W" is pressed, move camera forwards, towards cameraFront
 	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		cameraPos -= speed * cameraFront;										// When "S" is pressed, move camera backwards, away from cameraFront
+		move.z -= 1.f;															// When "S" is pressed, move camera backwards, away from cameraFront
 	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-		cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * speed;	// When "A" is pressed, move camera left, perpindicular to cameraFront
+		move.x -= 1.f;															// When "A" is pressed, move camera left, perpindicular to cameraFront
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * speed;	// When "D" is pressed, move camera right, perpindicular to cameraFront
+		move.x += 1.f;															// When "D" is pressed, move camera right, perpindicular to cameraFront
 	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-		cameraPos += cameraUp * speed;											// When "Q" is pressed, move camera up, towards to cameraUp
+		move.y += 1.f;															// When "Q" is pressed, move camera up, towards to cameraUp
 	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-		cameraPos -= cameraUp * speed;											// When "E" is pressed, move camera up, away from cameraUp
+		move.y -= 1.f;															// When "E" is pressed, move camera up, away from cameraUp
+	input.move = move;
+
+	bool toggled = input.toggle_projection || input.toggle_wireframe || input.cycle_light_color ||
+		input.toggle_multi_draw || input.toggle_prepass || input.toggle_overdraw;
+	if (input.time == 0.0 && (toggled || move != glm::vec3(0.f)))
+		input.time = glfwGetTime();												// Latency is measured from here
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -418,25 +1074,13 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 	xoffset *= sensitivity;
 	yoffset *= sensitivity;
 
-	yaw += xoffset;
-	pitch += yoffset;
-
-	// make sure that when pitch is out of bounds, screen doesn't get flipped
-	if (pitch > 89.0f)
-		pitch = 89.0f;
-	if (pitch < -89.0f)
-		pitch = -89.0f;
-
 	/**
-	 * Generate the new cameraFront from the new pitch and yaw.
-	 *
-	 * In other words, change where the camera is facing.
+	 * Leave turning the camera (and clamping its pitch) to the next step.
 	 */
-	glm::vec3 front;
-	front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-	front.y = sin(glm::radians(pitch));
-	front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-	cameraFront = glm::normalize(front);
+	input.look_x += xoffset;
+	input.look_y += yoffset;
+	if (input.time == 0.0)
+		input.time = glfwGetTime();
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
@@ -444,18 +1088,10 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
 	using namespace glob;					// This method access and modifies global variables
-	if (zoom) {
-		fov -= (float)yoffset;				// Zoom in on scroll up, out on scroll down
-		if (fov < 1.0f)
-			fov = 1.0f;						// Set FOV minimum
-		if (fov > 45.0f)
-			fov = 45.0f;					// Set FOV maximum
-	}
-	else {
-		cameraSpeed -= (float)yoffset;		// Speed up on scroll up, down on scroll down
-		if (cameraSpeed < 1.0f)
-			cameraSpeed = 1.0f;			// Set speed minimum
-		if (cameraSpeed > 5.0f)
-			cameraSpeed = 5.0f;			// Set speed maximum
-	}
+	if (zoom)
+		input.zoom += (float)yoffset;		// Zoom in on scroll up, out on scroll down, between 1 and 45 degrees
+	else
+		input.speed += (float)yoffset;		// Speed up on scroll up, down on scroll down, between 1 and 5
+	if (input.time == 0.0)
+		input.time = glfwGetTime();
 }
\ No newline at end of file
@@ -9,6 +9,12 @@
 const int LOCAL_GL_VERSION[2] = { 3, 3 };	// OpenGL version to use
 const int GLFW_WINDOW_WIDTH = 800;			// Initial width of GLFW render window
 const int GLFW_WINDOW_HEIGHT = 600;			// Initial height of GLFW render window
+const size_t STATIC_VERTEX_ARENA_BYTES = 4 * 1024 * 1024;	// Size of the shared static vertex buffer
+const size_t STATIC_INDEX_ARENA_COUNT = 1024 * 1024;		// Number of indices in the shared static index buffer
+const size_t FRAME_RING_BYTES = 1024 * 1024;				// Transient GPU memory available to each in-flight frame
+const size_t TEXTURE_BUDGET_BYTES = 256 * 1024 * 1024;		// VRAM textures may use before top mips are dropped ("--texture-budget-mb" overrides)
+const int MAX_TEXTURE_DIMENSION = 2048;					// Larger images are downscaled on load ("--max-texture-size" overrides, 0 disables)
+const unsigned int LIGHT_BUFFER_CAPACITY = 1024;				// Lights the light buffer holds before it grows
 
 GLFWwindow* create_glfw_window();			// Initialize GLFW and create the main render window
 
@@ -10,11 +10,22 @@
 
 #include "utils.h"
 
+#include "atlas.h"
+
+#include "residency.h"
+
+#include "variants.h"
+
+#include "lightbuffer.h"
+
+#include "clusters.h"
+
+#include "shadows.h"
+
+#include "lightmap.h"
+
 namespace glob {
-	Shader* universal_shader = nullptr;
-	Shader* material_shader = nullptr;
 	Shader* normals_shader = nullptr;
-	unsigned int number_of_textures = 0;
 
 	const float ambient_strength = 0.2f;
 	const glm::vec3 ambient_color = glm::vec3(1.f, 1.f, 1.f);
@@ -27,83 +38,62 @@ struct vertex {
 };
 
 void models_init() {
-	glob::universal_shader = new Shader("shaders/single_texture.vs.glsl", "shaders/single_texture.fs.glsl");
-	glob::material_shader = new Shader("shaders/single_texture.vs.glsl", "shaders/material_single_texture.fs.glsl");
-	glob::normals_shader = new Shader("shaders/draw_normals.vs.glsl", "shaders/draw_normals.fs.glsl", "shaders/draw_normals.gs.glsl");
-}
-
-void create_model(Model& model, std::vector<vertex> vertices, glm::mat4 model_matrix, const char* texture_path) {
-	const int floats_per_vertex = 3;
-	const int floats_per_normal = 3;
-	const int floats_per_texcoord = 2;
-
 	/**
-	 * Generate VAO, VBO and configure attributes for VAO
+	 * Every lit Model draws with a variant of one uber-shader. Submit the two
+	 * the scene starts with (the light list, from the clusters unless they are
+	 * disabled, plus the directional light, with and without a specular map);
+	 * others compile on first use.
 	 */
-	unsigned int VBO;
-	int stride = floats_per_vertex + floats_per_normal + floats_per_texcoord;
-
-	glGenVertexArrays(1, &model.VAO);					// Generate a VAO and set switch_VAO to the new VAO's ID number
-	glGenBuffers(1, &VBO);								// Generate a VBO and set switch_VBO to the new VBO's ID number
-
-	glBindVertexArray(model.VAO);						// Bind the VAO to the context, which saves the following function calls.
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);					// Bind the VBO to the context (and by extension the currently bound VAO).
-	glBufferData(GL_ARRAY_BUFFER,
-		vertices.size() * sizeof(vertex),
-		&vertices[0],
-		GL_STATIC_DRAW);								// Copy the data from vertices to the VBO.
+	variants_init("shaders/single_texture.vs.glsl", "shaders/lit.fs.glsl");
+	unsigned int scene_features = shader_features(false, true, true, clusters_enabled(), shadows_enabled());
+	variants_prepare(scene_features);
+	variants_prepare(scene_features | SHADER_SPECULAR_MAP);
 
-	glVertexAttribPointer(0, floats_per_vertex,
-		GL_FLOAT, GL_FALSE,
-		stride * sizeof(float),
-		(void*)0);										// Tells the context (and by extension the VAO) how to read the first attribute of the vertex buffer.
-	glEnableVertexAttribArray(0);						// Enable the above vertex attribute array.
+	glob::normals_shader = new Shader("shaders/draw_normals.vs.glsl", "shaders/draw_normals.fs.glsl", "shaders/draw_normals.gs.glsl");
+}
 
-	glVertexAttribPointer(1, floats_per_normal,
-		GL_FLOAT, GL_FALSE,
-		stride * sizeof(float),
-		(void*)(sizeof(float) * floats_per_vertex));	// Tells the context (and by extension the VAO) how to read the second attribute of the vertex buffer.
-	glEnableVertexAttribArray(1);						// Enable the above vertex attribute array.
+/**
+ * Look up the Model's diffuse map in the atlas, move the mesh's texture
+ * coordinates into that map's region and point the Model at the texture array.
+ */
+static void assign_atlas_texture(Model& model, vertex* vertices, size_t count, const char* texture_path) {
+	AtlasRegion region = atlas_region(texture_path);
 
-	glVertexAttribPointer(2, floats_per_texcoord,
-		GL_FLOAT, GL_FALSE,
-		stride * sizeof(float),
-		(void*)(sizeof(float) * (floats_per_vertex + floats_per_normal))
-	);											// Tells the context (and by extension the VAO) how to read the second attribute of the vertex buffer.
-	glEnableVertexAttribArray(2);						// Enable the above vertex attribute array.
+	for (size_t i = 0; i < count; ++i) {
+		vertices[i].s = region.rect.x + vertices[i].s * region.rect.z;
+		vertices[i].t = region.rect.y + vertices[i].t * region.rect.w;
+	}
 
-	glBindVertexArray(0);								// Unbind the VAO from the context.
+	model.texture = atlas_texture();
+	model.texture_layer = region.layer < 0 ? 0 : region.layer;
+	model.texture_region = region.rect;
+}
 
+void create_model(Model& model, std::vector<vertex> vertices, glm::mat4 model_matrix, const char* texture_path) {
 	/**
-	 * Set orange models number of vertices
+	 * Remap texture coordinates into the atlas before upload
 	 */
-	model.number_of_vertices = vertices.size();
+	assign_atlas_texture(model, &vertices[0], vertices.size(), texture_path);
 
 	/**
-	 * Assign model matrix
+	 * Copy vertices into the shared static geometry arena. The arena merges
+	 * duplicate vertices and hands back the mesh's base vertex and index range.
 	 */
-	model.model = model_matrix;
+	model.mesh = geometry_upload(VERTEX_FORMAT_TEXTURED, &vertices[0], vertices.size());
 
 	/**
-	 * Set up texture
+	 * Assign model matrix
 	 */
-	unsigned int console_texture = load_wrap_texture(texture_path);				// Generate texture with wrapping attributes (ideally it will be a web and should not repeat)
-
-	glob::universal_shader->use();												// Bind universal shader to context
-	glob::universal_shader->setInt("texture", glob::number_of_textures++);		// Tell shader where to find texture
-
-	model.texture_offset = glob::number_of_textures - 1;						// Assign offset from GL_TEXTURE0 texture unit
-	model.texture = console_texture;											// Assing handle to texture
+	model.model = model_matrix;
 }
 
 Model get_desk_model(const char* texture_path) {
 	Model plane;
 
 	/**
-	 * Set up VAO and number of vertices
+	 * Set up mesh
 	 */
-	const float plane_vertices[] = {
+	vertex plane_vertices[] = {
 	-1.0f, 0.0f, 1.0f,	-1.f, 1.f, 1.f,		0.0f, 0.0f,	// Front left
 	-1.0f, 0.0f, -1.0f,	-1.f, 1.f, -1.f,	0.0f, 1.0f,	// Back left, brown
 	1.0f, 0.0f, -1.0f,	1.f, 1.f, -1.f,		1.0f, 1.0f,	// Back right, brown
@@ -112,47 +102,11 @@ Model get_desk_model(const char* texture_path) {
 	1.0f, 0.0f, 1.0f,	1.f, 1.f, 1.f,		1.0f, 0.0f	// Front right, brown
 	};
 
-	const int floats_per_vertex = 3;
-	const int floats_per_normal = 3;
-	const int floats_per_texture = 2;
-	const int stride = floats_per_vertex + floats_per_normal + floats_per_texture;
-
-	unsigned int plane_VAO, plane_VBO;
-
-	glGenVertexArrays(1, &plane_VAO);					// Generate a VAO and set plane_VAO to the new VAO's ID number
-	glGenBuffers(1, &plane_VBO);						// Generate a VBO and set plane_VBO to the new VBO's ID number
+	assign_atlas_texture(plane, plane_vertices,
+		sizeof(plane_vertices) / sizeof(vertex), texture_path);	// Remap texture coordinates into the atlas
 
-	glBindVertexArray(plane_VAO);						// Bind the VAO to the context, which saves the following function calls.
-
-	glBindBuffer(GL_ARRAY_BUFFER, plane_VBO);			// Bind the VBO to the context (and by extension the currently bound VAO).
-	glBufferData(GL_ARRAY_BUFFER,
-		sizeof(plane_vertices),
-		plane_vertices,
-		GL_STATIC_DRAW);								// Copy the data from vertices to the VBO.
-
-	glVertexAttribPointer(0, floats_per_vertex,
-		GL_FLOAT, GL_FALSE,
-		stride * sizeof(float), (void*)0);				// Tells the context (and by extension the VAO) how to read the first attribute of the vertex buffer.
-	glEnableVertexAttribArray(0);						// Enable the above vertex attribute array.
-
-	glVertexAttribPointer(1, floats_per_normal,
-		GL_FLOAT, GL_FALSE,
-		stride * sizeof(float),
-		(void*)(sizeof(float) * floats_per_vertex));	// Tells the context (and by extension the VAO) how to read the second attribute of the vertex buffer.
-	glEnableVertexAttribArray(1);						// Enable the above vertex attribute array.
-
-	glVertexAttribPointer(2, floats_per_texture,
-		GL_FLOAT, GL_FALSE,
-		stride * sizeof(float),
-		(void*)(sizeof(float) * (floats_per_vertex + floats_per_normal))
-	);											// Tells the context (and by extension the VAO) how to read the second attribute of the vertex buffer.
-	glEnableVertexAttribArray(2);						// Enable the above vertex attribute array.
-
-	glBindVertexArray(0);								// Unbind the VAO from the context.
-
-	plane.VAO = plane_VAO;								// Assign VAO handle to Model
-	plane.number_of_vertices = sizeof(plane_vertices)
-		/ (sizeof(float) * stride);	// Assign number_of_vertices to Model
+	plane.mesh = geometry_upload(VERTEX_FORMAT_TEXTURED, plane_vertices,
+		sizeof(plane_vertices) / sizeof(vertex));					// Copy vertices into the static geometry arena
 
 /**
  * Define plane model matrix.
@@ -164,17 +118,6 @@ Model get_desk_model(const char* texture_path) {
 
 	plane.model = plane_model;																		// Assign model to Model
 
-	/**
-	 * Set up texture
-	 */
-	unsigned int plane_texture = load_wrap_texture(texture_path);									// Generate texture with wrapping attributes
-
-	glob::universal_shader->use();																	// Bind universal shader to context
-	glob::universal_shader->setInt("texture", glob::number_of_textures++);							// Tell shader where to find texture
-
-	plane.texture_offset = glob::number_of_textures - 1;											// Assign offset from GL_TEXTURE0 texture unit
-	plane.texture = plane_texture;																	// Assing handle to texture
-
 	plane.shine = 0.3f;
 
 	return plane;
@@ -191,9 +134,9 @@ Model get_switch_model(const char* texture_path) {
 	const float side_face_length = 0.07;
 
 	/**
-	 * Set up VAO and number of vertices
+	 * Set up mesh
 	 */
-	const float console_vertices[] = {
+	vertex console_vertices[] = {
 		// front face
 		-0.5f, 0.5882f, 1.0f,	0.f, 0.f, 1.f,	front_face_offset, front_face_height,	// Front top left
 		0.5f, 0.5882f, 1.0f,	0.f, 0.f, 1.f,	1.f, front_face_height, 				// Front top right
@@ -251,46 +194,11 @@ Model get_switch_model(const char* texture_path) {
 		-0.5f + (16.0f / 17.0f), -0.5f, 0.70f,						0.f, 1.05f, -1.7f,	front_face_offset, 0.0f		// Stand bottom right
 	};
 
-	const int floats_per_vertex = 3;
-	const int floats_per_normal = 3;
-	const int floats_per_texture = 2;
-	const int stride = floats_per_vertex + floats_per_normal + floats_per_texture;
-
-	unsigned int switch_VAO, switch_VBO;
-	glGenVertexArrays(1, &switch_VAO);					// Generate a VAO and set switch_VAO to the new VAO's ID number
-	glGenBuffers(1, &switch_VBO);						// Generate a VBO and set switch_VBO to the new VBO's ID number
-
-	glBindVertexArray(switch_VAO);						// Bind the VAO to the context, which saves the following function calls.
-
-	glBindBuffer(GL_ARRAY_BUFFER, switch_VBO);			// Bind the VBO to the context (and by extension the currently bound VAO).
-	glBufferData(GL_ARRAY_BUFFER,
-		sizeof(console_vertices),
-		console_vertices,
-		GL_STATIC_DRAW);								// Copy the data from vertices to the VBO.
+	assign_atlas_texture(console, console_vertices,
+		sizeof(console_vertices) / sizeof(vertex), texture_path);	// Remap texture coordinates into the atlas
 
-	glVertexAttribPointer(0, floats_per_vertex,
-		GL_FLOAT, GL_FALSE,
-		stride * sizeof(float), (void*)0);				// Tells the context (and by extension the VAO) how to read the first attribute of the vertex buffer.
-	glEnableVertexAttribArray(0);						// Enable the above vertex attribute array.
-
-	glVertexAttribPointer(1, floats_per_normal,
-		GL_FLOAT, GL_FALSE,
-		stride * sizeof(float),
-		(void*)(sizeof(float) * floats_per_vertex));	// Tells the context (and by extension the VAO) how to read the second attribute of the vertex buffer.
-	glEnableVertexAttribArray(1);						// Enable the above vertex attribute array.
-
-	glVertexAttribPointer(2, floats_per_texture,
-		GL_FLOAT, GL_FALSE,
-		stride * sizeof(float),
-		(void*)(sizeof(float) * (floats_per_vertex + floats_per_normal))
-	);											// Tells the context (and by extension the VAO) how to read the second attribute of the vertex buffer.
-	glEnableVertexAttribArray(2);						// Enable the above vertex attribute array.
-
-	glBindVertexArray(0);								// Unbind the VAO from the context.
-
-	console.VAO = switch_VAO;							// Assign VAO handle to model
-	console.number_of_vertices = sizeof(console_vertices)
-		/ (sizeof(float) * stride);						// Assign number_of_vertices to model
+	console.mesh = geometry_upload(VERTEX_FORMAT_TEXTURED, console_vertices,
+		sizeof(console_vertices) / sizeof(vertex));					// Copy vertices into the static geometry arena
 
 	/**
 	 * Define switch model matrix.
@@ -302,17 +210,6 @@ Model get_switch_model(const char* texture_path) {
 
 	console.model = switch_model;												// Assign model to Model
 
-	/**
-	 * Set up texture
-	 */
-	unsigned int console_texture = load_wrap_texture(texture_path);				// Generate texture with wrapping attributes (ideally it will be a web and should not repeat)
-
-	glob::universal_shader->use();												// Bind universal shader to context
-	glob::universal_shader->setInt("texture", glob::number_of_textures++);		// Tell shader where to find texture
-
-	console.texture_offset = glob::number_of_textures - 1;						// Assign offset from GL_TEXTURE0 texture unit
-	console.texture = console_texture;											// Assing handle to texture
-
 	return console;
 }
 
@@ -512,81 +409,123 @@ Model get_soda_model(const char* texture_path) {
 	return soda;
 }
 
-void draw_model(Model model, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos) {
-	using namespace glob;
+Material get_material(const char* specular_path, float shine) {
+	Material mat;
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, model.texture);
-
-	universal_shader->use();
-	universal_shader->setInt("aTexture", 0);
+	AtlasRegion region = atlas_region(specular_path);							// Specular maps share the atlas with diffuse maps
+	mat.specular_map = atlas_texture();
+	mat.specular_layer = region.layer < 0 ? 0 : region.layer;
+	mat.specular_region = region.rect;
+	mat.shine = shine;
 
-	universal_shader->setFloat("ambientStrength", ambient_strength);
-	universal_shader->setVec3("ambientColor", ambient_color);
-
-	universal_shader->setVec3("pointLight.position", point_light.position);
-	universal_shader->setVec3("pointLight.color", point_light.color);
-	universal_shader->setVec3("dirLight.direction", dir_light.direction);
-	universal_shader->setVec3("dirLight.color", dir_light.color);
-	universal_shader->setVec3("attenCoeff", point_light.attenuation_coefficients);
-	universal_shader->setMat3("normalModel", glm::mat3(glm::transpose(glm::inverse(model.model))));
+	return mat;
+}
 
-	universal_shader->setFloat("specularStrength", model.shine);
-	universal_shader->setVec3("viewPos", viewPos);
+/**
+ * Pick the uber-shader variant for a draw. A black directional light and an
+ * empty light buffer are compiled out instead of branched on, and baked
+ * Models need none of the lights.
+ */
+static Shader* lit_shader(bool specular_map, const DirectionalLight& dir_light, bool baked) {
+	if (baked)
+		return variants_get(SHADER_LIGHTMAP);
 
-	glBindVertexArray(model.VAO);
-	universal_shader->setMat4("projection", projection);
-	universal_shader->setMat4("view", view);
-	universal_shader->setMat4("model", model.model);
+	bool dir = dir_light.color != glm::vec3(0.f);
 
-	glDrawArrays(GL_TRIANGLES, 0, model.number_of_vertices);
+	return variants_get(shader_features(specular_map, dir, lightbuffer_count() > 0, clusters_enabled(), shadows_enabled()));
 }
 
-void draw_material_model(Model model, Material mat, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos) {
+/**
+ * Uniforms every variant shares, plus those of the lights it was compiled
+ * with. Each fragment shades the lights listed for its cluster, or without
+ * clusters the per-draw list of lights reaching the Model's bounding sphere.
+ * Baked draws read the lightmap instead.
+ */
+static void set_lit_uniforms(Shader* shader, const Model& model, float shine, glm::mat4 projection, glm::mat4 view, const DirectionalLight& dir_light, glm::vec3 viewPos, bool baked) {
 	using namespace glob;
 
-	material_shader->use();
+	shader->setInt("aTexture", 0);
+	shader->setFloat("textureLayer", (float)model.texture_layer);
+
+	shader->setFloat("ambientStrength", ambient_strength);
+
+	if (baked)
+		lightmap_bind(shader, dir_light);
+	else if (lightbuffer_count() > 0 && clusters_enabled()) {
+		lightbuffer_bind(shader);
+		clusters_bind(shader);
+	}
+	else if (lightbuffer_count() > 0) {
+		glm::vec3 center;
+		float radius;
+		int indices[MAX_LIGHTS_PER_DRAW];
+		geometry_world_sphere(model.mesh, model.model, center, radius);
+		int count = lightbuffer_select(center, radius, indices);
+
+		lightbuffer_bind(shader);
+		shader->setInt("lightCount", count);
+		shader->setIntArray("lightIndices", indices, count);
+	}
+	if (dir_light.color != glm::vec3(0.f) && !baked) {
+		shader->setVec3("dirLight.direction", dir_light.direction);
+		shader->setVec3("dirLight.color", dir_light.color);
+	}
+	if (shadows_enabled() && !baked)
+		shadows_bind(shader);
+	shader->setMat3("normalModel", glm::mat3(glm::transpose(glm::inverse(model.model))));
+
+	shader->setFloat("specularStrength", shine);
+	shader->setVec3("viewPos", viewPos);
+
+	shader->setMat4("projection", projection);
+	shader->setMat4("view", view);
+	shader->setMat4("model", model.model);
+}
+
+void draw_model(Model model, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos) {
+	bool baked = lightmap_usable(model, dir_light);
+	Shader* shader = lit_shader(false, dir_light, baked);
+	shader->use();
 
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, model.texture);
-	material_shader->setInt("aTexture", 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, model.texture);
+	residency_touch(model.texture);
 
-	material_shader->setFloat("ambientStrength", ambient_strength);
-	material_shader->setVec3("ambientColor", ambient_color);
+	set_lit_uniforms(shader, model, model.shine, projection, view, dir_light, viewPos, baked);
 
-	material_shader->setVec3("pointLight.position", point_light.position);
-	material_shader->setVec3("pointLight.color", point_light.color);
-	material_shader->setVec3("dirLight.direction", dir_light.direction);
-	material_shader->setVec3("dirLight.color", dir_light.color);
-	material_shader->setVec3("attenCoeff", point_light.attenuation_coefficients);
-	material_shader->setMat3("normalModel", glm::mat3(glm::transpose(glm::inverse(model.model))));
+	geometry_draw(model.mesh, GL_TRIANGLES);
+}
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, mat.specular_map);
-	material_shader->setInt("specularMap", 1);
-	material_shader->setFloat("specularStrength", mat.shine);
-	material_shader->setVec3("viewPos", viewPos);
+void draw_material_model(Model model, Material mat, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos) {
+	bool baked = lightmap_usable(model, dir_light);
+	Shader* shader = lit_shader(true, dir_light, baked);
+	shader->use();
 
-	glBindVertexArray(model.VAO);
-	material_shader->setMat4("projection", projection);
-	material_shader->setMat4("view", view);
-	material_shader->setMat4("model", model.model);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, model.texture);
+	residency_touch(model.texture);
+
+	set_lit_uniforms(shader, model, mat.shine, projection, view, dir_light, viewPos, baked);
 
-	glDrawArrays(GL_TRIANGLES, 0, model.number_of_vertices);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, mat.specular_map);
+	residency_touch(mat.specular_map);
+	shader->setInt("specularMap", 1);
+	shader->setFloat("specularLayer", (float)mat.specular_layer);
+	shader->setVec4("specularRegion", mat.specular_region);
+	shader->setVec4("textureRegion", model.texture_region);
+
+	geometry_draw(model.mesh, GL_TRIANGLES);
 }
 
 void draw_normals(Model model, glm::mat4 projection, glm::mat4 view) {
 	using namespace glob;
 
-	glActiveTexture(GL_TEXTURE0 + model.texture_offset);
-	glBindTexture(GL_TEXTURE_2D, model.texture);
-
 	normals_shader->use();
 
-	glBindVertexArray(model.VAO);
 	normals_shader->setMat4("projection", projection);
 	normals_shader->setMat4("view", view);
 	normals_shader->setMat4("model", model.model);
 
-	glDrawArrays(GL_TRIANGLES, 0, model.number_of_vertices);
+	geometry_draw(model.mesh, GL_TRIANGLES);
 }
\ No newline at end of file
@@ -5,12 +5,13 @@
 #include <glm/glm.hpp>
 
 #include "lights.h"
+#include "geometry.h"
 
 struct tex_mesh {
-	unsigned int texture;
-	unsigned int texture_offset;
-	unsigned int VAO;
-	unsigned int number_of_vertices;
+	unsigned int texture;				// Atlas texture array shared by every Model (see atlas.h)
+	int texture_layer;					// Layer holding this Model's diffuse map
+	glm::vec4 texture_region;			// Atlas offset (xy) and scale (zw) already applied to the mesh's texture coordinates
+	MeshRange mesh;
 	glm::mat4 model;
 
 	float shine = 0.f;
@@ -18,11 +19,18 @@ struct tex_mesh {
 typedef struct tex_mesh Model;
 
 struct material {
-	unsigned int specular_map;
+	unsigned int specular_map;				// Texture array holding the specular map (the atlas, see atlas.h)
+	int specular_layer;						// Layer holding the specular map
+	glm::vec4 specular_region;				// Atlas offset (xy) and scale (zw) of the specular map
 	float shine = 0.f;
 };
 typedef struct material Material;
 
+namespace glob {
+	extern const float ambient_strength;		// Shared by every lit shader
+	extern const glm::vec3 ambient_color;
+}
+
 void models_init();
 
 Model get_desk_model(const char* texture_path);
@@ -31,9 +39,11 @@ Model get_switch_model(const char* texture_path);
 
 Model get_soda_model(const char* texture_path);
 
-void draw_model(Model model, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos);
+Material get_material(const char* specular_path, float shine);
+
+void draw_model(Model model, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos);
 
-void draw_material_model(Model model, Material mat, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos);
+void draw_material_model(Model model, Material mat, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos);
 
 void draw_normals(Model model, glm::mat4 projection, glm::mat4 view);
 #endif//__MODELS_H__
@@ -0,0 +1,253 @@
+#include <GLEW/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "pacing.h"
+
+namespace glob {
+	/**
+	 * A presented frame waiting for the GPU to reach its swap.
+	 */
+	struct pacing_pending {
+		bool busy;
+		GLsync fence;
+		double input, submit;				// glfwGetTime()
+		double clock_offset;				// glfwGetTime() minus GL_TIMESTAMP seconds when it was presented
+	};
+	pacing_pending pacing_frames[PACING_FRAMES] = {};
+	unsigned int pacing_queries[PACING_FRAMES] = {};
+	int pacing_next = 0;					// Oldest slot, collected in order
+
+	double pacing_period = 0.0;				// seconds per frame, 0 when not limited
+	double pacing_deadline = 0.0;			// glfwGetTime() the next frame is due to swap
+	double pacing_sample = 0.0;
+	double pacing_submitted = 0.0;
+
+	PacingStats pacing_counters;
+}
+
+/**
+ * Sleep in 1 ms slices, then yield for the last couple of milliseconds,
+ * which sleeps could overshoot.
+ */
+static double wait_until(double time) {
+	double now = glfwGetTime(), start = now;
+	while (now < time) {
+		if (time - now > 0.002)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		else
+			std::this_thread::yield();
+		now = glfwGetTime();
+	}
+	if (now > start) {
+		++glob::pacing_counters.waits;
+		glob::pacing_counters.wait_ms += (now - start) * 1000.0;
+	}
+	return now;
+}
+
+void pacing_init(double target_fps, int swap_interval, bool late_sampling) {
+	using namespace glob;
+
+	pacing_counters = PacingStats();
+	pacing_counters.target_fps = target_fps > 0.0 ? target_fps : 0.0;
+	pacing_counters.swap_interval = swap_interval >= 0 ? swap_interval : -1;
+	pacing_counters.late_sampling = late_sampling && target_fps > 0.0;
+	if (late_sampling && target_fps <= 0.0)
+		std::cerr << "ERROR::PACING::LATE_SAMPLING_NEEDS_A_TARGET_RATE" << std::endl;
+
+	if (swap_interval >= 0)
+		glfwSwapInterval(swap_interval);
+
+	glGenQueries(PACING_FRAMES, pacing_queries);
+	pacing_next = 0;
+	pacing_period = pacing_counters.target_fps > 0.0 ? 1.0 / pacing_counters.target_fps : 0.0;
+	pacing_deadline = glfwGetTime() + pacing_period;
+	pacing_sample = pacing_submitted = 0.0;
+}
+
+void pacing_wait() {
+	using namespace glob;
+
+	double now = glfwGetTime();
+	if (pacing_counters.late_sampling)
+		now = wait_until(pacing_deadline - (pacing_counters.predicted_ms + PACING_LATE_MARGIN_MS) / 1000.0);
+	pacing_sample = now;
+}
+
+void pacing_submit() {
+	using namespace glob;
+
+	/**
+	 * Predict the next frame's cost from this one's, reacting to a slower
+	 * frame at once and to a faster one gradually, so one quick frame
+	 * doesn't make the next sample too late.
+	 */
+	double now = glfwGetTime();
+	double work_ms = (now - pacing_sample) * 1000.0;
+	double& predicted = pacing_counters.predicted_ms;
+	predicted = work_ms > predicted ? work_ms : predicted * 0.9 + work_ms * 0.1;
+
+	if (pacing_period > 0.0 && !pacing_counters.late_sampling)
+		now = wait_until(pacing_deadline);
+
+	if (pacing_period > 0.0) {
+		if (now > pacing_deadline + pacing_period * 0.5) {
+			++pacing_counters.missed;
+			pacing_deadline = now;				// Start over rather than rushing the frames after a stall
+		}
+		pacing_deadline += pacing_period;
+	}
+
+	pacing_counters.sample_to_submit.samples.push_back((float)((now - pacing_sample) * 1000.0));
+	if (pacing_submitted > 0.0)
+		pacing_counters.frame_interval.samples.push_back((float)((now - pacing_submitted) * 1000.0));
+	pacing_submitted = now;
+}
+
+/**
+ * Record the display times of finished frames, oldest first, stopping at
+ * the first the GPU hasn't reached.
+ */
+static void collect() {
+	using namespace glob;
+
+	while (pacing_frames[pacing_next].busy) {
+		pacing_pending& frame = pacing_frames[pacing_next];
+		GLenum status = glClientWaitSync(frame.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			return;
+
+		GLuint64 timestamp = 0;
+		glGetQueryObjectui64v(pacing_queries[pacing_next], GL_QUERY_RESULT, &timestamp);
+		double display = timestamp / 1e9 + frame.clock_offset;
+		pacing_counters.submit_to_display.samples.push_back((float)((display - frame.submit) * 1000.0));
+		if (frame.input > 0.0)
+			pacing_counters.input_to_display.samples.push_back((float)((display - frame.input) * 1000.0));
+		++pacing_counters.gpu_timed;
+
+		glDeleteSync(frame.fence);
+		frame.busy = false;
+		pacing_next = (pacing_next + 1) % PACING_FRAMES;
+	}
+}
+
+void pacing_presented(double input_time) {
+	using namespace glob;
+
+	++pacing_counters.frames;
+	if (input_time > 0.0)
+		pacing_counters.input_to_sample.samples.push_back((float)(std::max(pacing_sample - input_time, 0.0) * 1000.0));	// Keys polled right after pacing_wait count as sampled then
+
+	collect();
+
+	int slot = -1;
+	for (int i = 0; i < PACING_FRAMES && slot < 0; ++i) {
+		int candidate = (pacing_next + i) % PACING_FRAMES;
+		if (!pacing_frames[candidate].busy)
+			slot = candidate;
+	}
+	if (slot < 0) {
+		++pacing_counters.untimed;
+		return;
+	}
+
+	/**
+	 * GL_TIMESTAMP counts on the GPU's clock; pair it with glfwGetTime() now
+	 * to move the query's result onto the CPU's.
+	 */
+	GLint64 gpu_now = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+	pacing_pending& frame = pacing_frames[slot];
+	frame.clock_offset = glfwGetTime() - gpu_now / 1e9;
+	glQueryCounter(pacing_queries[slot], GL_TIMESTAMP);
+	frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame.input = input_time;
+	frame.submit = pacing_submitted;
+	frame.busy = true;
+}
+
+/**
+ * Percentile p (0 to 1) of sorted samples.
+ */
+static float percentile(const std::vector<float>& samples, double p) {
+	return samples[std::min(samples.size() - 1, (size_t)(p * (samples.size() - 1) + 0.5))];
+}
+
+static void print_histogram(const char* name, PacingHistogram histogram) {
+	std::vector<float>& samples = histogram.samples;
+	if (samples.empty())
+		return;
+	std::sort(samples.begin(), samples.end());
+
+	double sum = 0.0;
+	for (float sample : samples)
+		sum += sample;
+	std::cout << "\t" << name << ": " << samples.size() << " frames, " << sum / samples.size() << " ms average, p50 " << percentile(samples, 0.5)
+		<< ", p90 " << percentile(samples, 0.9) << ", p99 " << percentile(samples, 0.99) << ", max " << samples.back() << "\n\t\t";
+
+	/**
+	 * Buckets double up to 64 ms, the last one holds everything slower.
+	 */
+	const float edges[] = { 1.f, 2.f, 4.f, 8.f, 16.f, 32.f, 64.f };
+	const int buckets = sizeof(edges) / sizeof(edges[0]) + 1;
+	size_t counts[buckets] = {};
+	for (float sample : samples) {
+		int bucket = 0;
+		while (bucket < buckets - 1 && sample >= edges[bucket])
+			++bucket;
+		++counts[bucket];
+	}
+	for (int bucket = 0; bucket < buckets; ++bucket) {
+		if (bucket == 0)
+			std::cout << "<" << edges[0];
+		else if (bucket == buckets - 1)
+			std::cout << " " << edges[buckets - 2] << "+";
+		else
+			std::cout << " " << edges[bucket - 1] << "-" << edges[bucket];
+		std::cout << ": " << counts[bucket];
+	}
+	std::cout << "\n";
+}
+
+PacingStats pacing_stats() {
+	return glob::pacing_counters;
+}
+
+void pacing_report() {
+	PacingStats stats = pacing_stats();
+	if (stats.frames == 0)
+		return;
+
+	std::cout << "Frame pacing: " << stats.frames << " frames, ";
+	if (stats.target_fps > 0.0)
+		std::cout << "limited to " << stats.target_fps << " fps" << (stats.late_sampling ? " sampling input late" : "") << ", " << stats.missed << " missed, "
+			<< stats.wait_ms / stats.frames << " ms waited per frame";
+	else
+		std::cout << "not limited";
+	std::cout << ", swap interval " << (stats.swap_interval >= 0 ? std::to_string(stats.swap_interval) : std::string("default"))
+		<< ", " << stats.gpu_timed << " timed on the GPU, " << stats.untimed << " untimed\n";
+	print_histogram("input to display", stats.input_to_display);
+	print_histogram("input to sample", stats.input_to_sample);
+	print_histogram("sample to submit", stats.sample_to_submit);
+	print_histogram("submit to display", stats.submit_to_display);
+	print_histogram("frame interval", stats.frame_interval);
+	std::cout << std::flush;
+}
+
+void pacing_destroy() {
+	using namespace glob;
+
+	for (int i = 0; i < PACING_FRAMES; ++i) {
+		if (pacing_frames[i].busy)
+			glDeleteSync(pacing_frames[i].fence);
+		pacing_frames[i].busy = false;
+	}
+	glDeleteQueries(PACING_FRAMES, pacing_queries);
+}
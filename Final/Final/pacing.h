@@ -0,0 +1,74 @@
+#pragma once
+#ifndef __PACING_H__
+#define __PACING_H__
+
+#include <vector>
+
+const int PACING_FRAMES = 4;				// Frames whose GPU timestamps may be awaited at once; later frames go untimed
+const double PACING_LATE_MARGIN_MS = 2.0;	// Extra time late sampling leaves the frame beyond its predicted cost
+
+/**
+ * Milliseconds, one per sample, for percentiles and the histogram report.
+ */
+struct pacing_histogram {
+	std::vector<float> samples;
+};
+typedef struct pacing_histogram PacingHistogram;
+
+/**
+ * Counters since pacing_init. A frame's stages, all on glfwGetTime()'s clock:
+ *
+ *	input		the oldest input it shows arrived (mouse_callback, or the key poll)
+ *	sample		the render thread took the camera for it
+ *	submit		it was handed to glfwSwapBuffers
+ *	display		the GPU reached the swap: a GL_TIMESTAMP query issued right
+ *				after it, read back once a fence says the GPU got there
+ *
+ * Display is when the frame was handed to the display, not scanout, which
+ * with a swap interval can come up to a refresh later.
+ */
+struct pacing_statistics {
+	double target_fps;						// 0 when not limited
+	int swap_interval;						// -1 when left to the driver
+	bool late_sampling;
+	unsigned long long frames;
+	unsigned long long gpu_timed;			// frames whose display time was read back
+	unsigned long long untimed;				// frames presented while PACING_FRAMES were still awaited
+	unsigned long long missed;				// frames swapped after their deadline
+	unsigned long long waits;
+	double wait_ms;							// slept to hold the target rate
+	double predicted_ms;					// late sampling's latest estimate of sample to submit
+	PacingHistogram input_to_sample;
+	PacingHistogram sample_to_submit;
+	PacingHistogram submit_to_display;
+	PacingHistogram input_to_display;		// the end to end latency
+	PacingHistogram frame_interval;			// submit to submit, for pacing jitter
+};
+typedef struct pacing_statistics PacingStats;
+
+/**
+ * Time every frame, and with target_fps > 0 hold frames to that rate.
+ * swap_interval >= 0 is set on the current context. late_sampling sleeps
+ * before the frame samples input rather than before it swaps, leaving just
+ * the predicted frame cost until the deadline, so the frame shows input
+ * that much newer.
+ */
+void pacing_init(double target_fps = 0.0, int swap_interval = -1, bool late_sampling = false);
+
+void pacing_wait();							// Call right before the frame samples input
+
+void pacing_submit();						// Call right before glfwSwapBuffers
+
+/**
+ * Call right after glfwSwapBuffers with the glfwGetTime() of the oldest new
+ * input the frame showed, 0 for none. Also collects the display times of
+ * earlier frames the GPU has finished.
+ */
+void pacing_presented(double input_time);
+
+PacingStats pacing_stats();
+
+void pacing_report();
+
+void pacing_destroy();						// Release the queries and fences
+#endif//__PACING_H__
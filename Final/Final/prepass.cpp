@@ -0,0 +1,336 @@
+#include <GLEW/glew.h>
+
+#include <chrono>
+#include <iostream>
+
+#include "prepass.h"
+
+#include "shader.h"
+
+#include "geometry.h"
+
+#include "ring.h"
+
+const int PREPASS_QUERIES = 3;				// Frames of samples-passed queries in flight, read back later so they never stall
+
+namespace glob {
+	bool prepass_active = false;
+	bool prepass_frame = false;					// the current frame was begun with the pre-pass
+
+	Shader* depth_only_shader = nullptr;
+	Shader* overdraw_shader = nullptr;
+
+	unsigned int prepass_shaded_queries[PREPASS_QUERIES] = {};	// GL_SAMPLES_PASSED around the shading pass
+	unsigned int prepass_tested_queries[PREPASS_QUERIES] = {};	// GL_SAMPLES_PASSED around the pre-pass
+	bool prepass_query_pending[PREPASS_QUERIES] = {};
+	bool prepass_query_prepass[PREPASS_QUERIES] = {};			// the slot's frame ran the pre-pass
+	unsigned long long prepass_query_pixels[PREPASS_QUERIES] = {};
+	int prepass_query_index = 0;
+	bool prepass_query_active = false;							// the current frame's slot is being measured
+
+	PrepassStats prepass_counters;
+}
+
+void prepass_init() {
+	using namespace glob;
+
+	depth_only_shader = new Shader("shaders/depth_only.vs.glsl", "shaders/depth_only.fs.glsl");
+	overdraw_shader = new Shader("shaders/depth_only.vs.glsl", "shaders/overdraw.fs.glsl");
+
+	glGenQueries(PREPASS_QUERIES, prepass_shaded_queries);
+	glGenQueries(PREPASS_QUERIES, prepass_tested_queries);
+	prepass_counters = PrepassStats();
+}
+
+void prepass_set_enabled(bool enabled) {
+	glob::prepass_active = enabled && glob::depth_only_shader;
+}
+
+bool prepass_enabled() {
+	return glob::prepass_active;
+}
+
+static void draw_depth(Shader* shader, const Model& model, glm::mat4 projection, glm::mat4 view) {
+	if (model.mesh.index_count == 0)
+		return;
+
+	shader->use();
+	shader->setMat4("projection", projection);
+	shader->setMat4("view", view);
+	shader->setMat4("model", model.model);
+	geometry_draw(model.mesh, GL_TRIANGLES);
+}
+
+/**
+ * Depth state of the shading pass: only the nearest fragments, which the
+ * pre-pass already wrote, pass. Without it the lit draws test and write depth
+ * as usual.
+ */
+static void begin_shading(bool after_prepass) {
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	if (after_prepass) {
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+	}
+}
+
+static void end_shading() {
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+}
+
+/**
+ * Collect a slot's counts once the GPU is done with them; a slot still in
+ * flight stays pending and the frame reusing it goes unmeasured.
+ */
+static void collect_query(int slot) {
+	using namespace glob;
+
+	if (!prepass_query_pending[slot])
+		return;
+
+	GLuint available = 0;
+	glGetQueryObjectuiv(prepass_shaded_queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;
+
+	int mode = prepass_query_prepass[slot] ? 1 : 0;
+	GLuint64 samples = 0;
+	glGetQueryObjectui64v(prepass_shaded_queries[slot], GL_QUERY_RESULT, &samples);
+	prepass_counters.shaded[mode] += samples;
+	prepass_counters.screen[mode] += prepass_query_pixels[slot];
+	++prepass_counters.measured[mode];
+	if (mode) {
+		glGetQueryObjectui64v(prepass_tested_queries[slot], GL_QUERY_RESULT, &samples);
+		prepass_counters.depth_tested += samples;
+	}
+	prepass_query_pending[slot] = false;
+}
+
+void prepass_begin(int width, int height) {
+	using namespace glob;
+
+	if (!depth_only_shader)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	int slot = prepass_query_index;
+	collect_query(slot);
+
+	prepass_frame = prepass_active;
+	prepass_query_active = !prepass_query_pending[slot];
+	if (prepass_query_active) {
+		prepass_query_prepass[slot] = prepass_frame;
+		prepass_query_pixels[slot] = (unsigned long long)width * height;
+	}
+
+	if (prepass_frame) {
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		if (prepass_query_active)
+			glBeginQuery(GL_SAMPLES_PASSED, prepass_tested_queries[slot]);
+	}
+
+	prepass_counters.prepass_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void prepass_draw(const Model& model, glm::mat4 projection, glm::mat4 view) {
+	using namespace glob;
+
+	if (!prepass_frame)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	draw_depth(depth_only_shader, model, projection, view);
+	prepass_counters.prepass_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void prepass_end() {
+	using namespace glob;
+
+	if (!depth_only_shader)
+		return;
+
+	if (prepass_frame) {
+		if (prepass_query_active)
+			glEndQuery(GL_SAMPLES_PASSED);
+		++prepass_counters.frames;
+	}
+	begin_shading(prepass_frame);
+
+	if (prepass_query_active)
+		glBeginQuery(GL_SAMPLES_PASSED, prepass_shaded_queries[prepass_query_index]);
+}
+
+void prepass_finish() {
+	using namespace glob;
+
+	if (!depth_only_shader)
+		return;
+
+	if (prepass_query_active) {
+		glEndQuery(GL_SAMPLES_PASSED);
+		prepass_query_pending[prepass_query_index] = true;
+		prepass_query_index = (prepass_query_index + 1) % PREPASS_QUERIES;
+	}
+	prepass_query_active = false;
+	end_shading();
+}
+
+void prepass_show_overdraw(const std::vector<const Model*>& models, glm::mat4 projection, glm::mat4 view) {
+	using namespace glob;
+
+	if (!overdraw_shader)
+		return;
+
+	/**
+	 * Replay the shading pass's depth test: after a pre-pass the depth buffer
+	 * already holds the nearest surfaces and GL_EQUAL lets each through once;
+	 * without one, depth is cleared and the Models race in draw order again.
+	 */
+	glClear(prepass_frame ? GL_COLOR_BUFFER_BIT : GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	begin_shading(prepass_frame);
+
+	for (const Model* model : models)
+		draw_depth(overdraw_shader, *model, projection, view);
+
+	end_shading();
+	glDisable(GL_BLEND);
+}
+
+void prepass_benchmark(const std::vector<BatchItem>& items, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos, int frames) {
+	using namespace glob;
+
+	if (!depth_only_shader) {
+		std::cout << "Pre-pass benchmark skipped: prepass_init was not called" << std::endl;
+		return;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	double pixels = (double)viewport[2] * viewport[3];
+
+	unsigned int queries[3];
+	glGenQueries(3, queries);				// elapsed time, pre-pass fragments, fragments shaded
+
+	/**
+	 * Time both modes over the same frames, as batch_benchmark does. Queries
+	 * are read back every frame; the stall is the same for both modes.
+	 */
+	double cpu_ms[2], gpu_ms[2], shaded[2], depth_tested = 0.0;
+	for (int mode = 0; mode < 2; ++mode) {
+		glFinish();
+		auto start = std::chrono::high_resolution_clock::now();
+		unsigned long long gpu_ns = 0, shaded_samples = 0, tested_samples = 0;
+
+		for (int frame = 0; frame < frames; ++frame) {
+			ring_begin_frame();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+
+			if (mode == 1) {
+				glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+				glBeginQuery(GL_SAMPLES_PASSED, queries[1]);
+				for (const BatchItem& item : items)
+					draw_depth(depth_only_shader, *item.model, projection, view);
+				glEndQuery(GL_SAMPLES_PASSED);
+			}	// depth only
+
+			begin_shading(mode == 1);
+			glBeginQuery(GL_SAMPLES_PASSED, queries[2]);
+			for (const BatchItem& item : items) {
+				if (item.material)
+					draw_material_model(*item.model, *item.material, projection, view, dir_light, viewPos);
+				else
+					draw_model(*item.model, projection, view, dir_light, viewPos);
+			}
+			glEndQuery(GL_SAMPLES_PASSED);
+			end_shading();
+
+			glEndQuery(GL_TIME_ELAPSED);
+			ring_end_frame();
+
+			GLuint64 result = 0;
+			glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &result);
+			gpu_ns += result;
+			glGetQueryObjectui64v(queries[2], GL_QUERY_RESULT, &result);
+			shaded_samples += result;
+			if (mode == 1) {
+				glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &result);
+				tested_samples += result;
+			}
+		}
+
+		glFinish();
+		cpu_ms[mode] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / frames;
+		gpu_ms[mode] = gpu_ns / 1e6 / frames;
+		shaded[mode] = (double)shaded_samples / frames;
+		if (mode == 1)
+			depth_tested = (double)tested_samples / frames;
+	}
+
+	/**
+	 * With the pre-pass each covered pixel is shaded exactly once, so its
+	 * shaded count is the number of pixels covered in both modes.
+	 */
+	double covered = shaded[1] > 0.0 ? shaded[1] : 1.0;
+	for (int mode = 0; mode < 2; ++mode) {
+		std::cout << (mode == 0 ? "Without depth pre-pass: " : "With depth pre-pass:    ")
+			<< cpu_ms[mode] << " ms/frame wall, " << gpu_ms[mode] << " ms/frame GPU, "
+			<< shaded[mode] << " fragments shaded (" << shaded[mode] / covered << " per covered pixel, "
+			<< shaded[mode] / pixels << " per screen pixel)";
+		if (mode == 1)
+			std::cout << " after " << depth_tested << " depth-only fragments";
+		std::cout << std::endl;
+	}
+
+	glDeleteQueries(3, queries);
+}
+
+PrepassStats prepass_stats() {
+	PrepassStats stats = glob::prepass_counters;
+	stats.enabled = glob::prepass_active;
+	return stats;
+}
+
+void prepass_report() {
+	if (!glob::depth_only_shader)
+		return;
+
+	PrepassStats stats = prepass_stats();
+	double frames = stats.frames ? (double)stats.frames : 1.0;
+
+	std::cout << "Depth pre-pass: " << (stats.enabled ? "on" : "off") << ", " << stats.frames << " frames drawn with it, "
+		<< stats.prepass_ms / frames << " ms CPU per frame" << std::endl;
+	for (int mode = 0; mode < 2; ++mode) {
+		if (!stats.measured[mode])
+			continue;
+
+		double measured = (double)stats.measured[mode];
+		std::cout << (mode == 0 ? "\twithout: " : "\twith:    ") << stats.shaded[mode] / measured << " fragments shaded per frame over "
+			<< stats.measured[mode] << " frames, " << (double)stats.shaded[mode] / stats.screen[mode] << " per screen pixel";
+		if (mode == 1 && stats.shaded[mode])
+			std::cout << "; the pre-pass passed " << (double)stats.depth_tested / stats.shaded[mode]
+				<< " fragments per covered pixel, the overdraw shading would have had without it";
+		std::cout << std::endl;
+	}
+}
+
+void prepass_destroy() {
+	using namespace glob;
+
+	if (!depth_only_shader)
+		return;
+
+	glDeleteQueries(PREPASS_QUERIES, prepass_shaded_queries);
+	glDeleteQueries(PREPASS_QUERIES, prepass_tested_queries);
+	Shader* shaders[2] = { depth_only_shader, overdraw_shader };
+	for (Shader* shader : shaders) {
+		glDeleteProgram(shader->ID);
+		delete shader;
+	}
+	depth_only_shader = overdraw_shader = nullptr;
+	prepass_active = prepass_frame = false;
+}
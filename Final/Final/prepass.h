@@ -0,0 +1,80 @@
+#pragma once
+#ifndef __PREPASS_H__
+#define __PREPASS_H__
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "models.h"
+#include "batch.h"
+
+/**
+ * Depth pre-pass: the opaque Models are first drawn with a position-only
+ * program and color writes off, so the depth buffer holds the nearest surface
+ * of every pixel. The shading pass then runs with GL_EQUAL and depth writes
+ * off, and the lit fragment shaders run once per covered pixel instead of once
+ * per fragment that was nearest when it was drawn.
+ *
+ * Both passes must compute bit-identical depths; every vertex shader drawing
+ * into it declares gl_Position invariant and uses the same expression.
+ *
+ * Fragments shaded are counted with GL_SAMPLES_PASSED around the shading
+ * pass, with and without the pre-pass, read back a few frames late so they
+ * never stall. With the pre-pass every covered pixel is shaded once, and the
+ * fragments passing the pre-pass's GL_LESS test are the ones the shading pass
+ * would have run without it, so one frame measures overdraw before and after.
+ */
+struct prepass_statistics {
+	bool enabled;
+	unsigned long long frames;				// frames drawn with the pre-pass
+	unsigned long long measured[2];			// frames whose shaded fragments were read back, without and with the pre-pass
+	unsigned long long shaded[2];			// fragments shaded over those frames, without and with the pre-pass
+	unsigned long long depth_tested;		// fragments that passed the pre-pass's own GL_LESS test, over the frames measured with it
+	unsigned long long screen[2];			// viewport pixels over the frames measured, without and with the pre-pass
+	double prepass_ms;						// CPU time issuing the pre-pass
+};
+typedef struct prepass_statistics PrepassStats;
+
+void prepass_init();						// Build the depth-only and overdraw programs
+
+void prepass_set_enabled(bool enabled);
+
+bool prepass_enabled();
+
+/**
+ * Start a frame's opaque pass. With the pre-pass enabled, color writes are
+ * turned off until prepass_end; draw every opaque Model with prepass_draw.
+ */
+void prepass_begin(int width, int height);
+
+void prepass_draw(const Model& model, glm::mat4 projection, glm::mat4 view);
+
+/**
+ * Switch to the shading pass (GL_EQUAL, no depth writes when the pre-pass ran)
+ * and start counting fragments shaded. Draw the same Models lit, then call
+ * prepass_finish to restore GL_LESS and depth writes.
+ */
+void prepass_end();
+
+void prepass_finish();
+
+/**
+ * Replace the frame's color with one additive layer per fragment the shading
+ * pass ran for the given Models: dark gray is shaded once, white four times
+ * or more. Call after prepass_finish with the Models in the order they were drawn.
+ */
+void prepass_show_overdraw(const std::vector<const Model*>& models, glm::mat4 projection, glm::mat4 view);
+
+/**
+ * Draw the items with per-Model draws frames times without and then with the
+ * pre-pass, and print CPU and GPU time and fragments shaded per covered pixel
+ * (pixels shaded with the pre-pass) for both.
+ */
+void prepass_benchmark(const std::vector<BatchItem>& items, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos, int frames);
+
+PrepassStats prepass_stats();
+
+void prepass_report();
+
+void prepass_destroy();
+#endif//__PREPASS_H__
@@ -0,0 +1,514 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RAYCAST_SSE2
+#endif
+
+#include "raycast.h"
+
+/**
+ * Bounds and centroid of one input triangle while the tree is built.
+ */
+struct build_triangle {
+	glm::vec3 lower;
+	glm::vec3 upper;
+	glm::vec3 centroid;
+};
+typedef struct build_triangle BuildTriangle;
+
+struct sah_bin {
+	glm::vec3 lower = glm::vec3(1e30f);
+	glm::vec3 upper = glm::vec3(-1e30f);
+	int count = 0;
+};
+typedef struct sah_bin SahBin;
+
+static float surface_area(glm::vec3 lower, glm::vec3 upper) {
+	glm::vec3 size = glm::max(upper - lower, glm::vec3(0.f));
+	return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static void fill_group(TriangleGroup& group, const std::vector<glm::vec3>& corners, const int* order, int count) {
+	for (int lane = 0; lane < RAYCAST_LEAF_SIZE; ++lane) {
+		glm::vec3 v0 = glm::vec3(0.f), e1 = glm::vec3(0.f), e2 = glm::vec3(0.f);
+		group.triangle[lane] = -1;
+		if (lane < count) {
+			int triangle = order[lane];
+			v0 = corners[triangle * 3];
+			e1 = corners[triangle * 3 + 1] - v0;
+			e2 = corners[triangle * 3 + 2] - v0;
+			group.triangle[lane] = triangle;
+		}
+		for (int axis = 0; axis < 3; ++axis) {
+			group.v0[axis][lane] = v0[axis];
+			group.e1[axis][lane] = e1[axis];
+			group.e2[axis][lane] = e2[axis];
+		}
+	}
+}
+
+/**
+ * Fill nodes[node] from order[begin, end), splitting at the cheapest bin
+ * boundary. Sets of up to RAYCAST_LEAF_SIZE become a leaf.
+ */
+static void build_node(RaycastScene& scene, const std::vector<glm::vec3>& corners, const std::vector<BuildTriangle>& triangles, std::vector<int>& order, int node, int begin, int end) {
+	glm::vec3 lower = glm::vec3(1e30f), upper = glm::vec3(-1e30f);
+	glm::vec3 centroid_lower = glm::vec3(1e30f), centroid_upper = glm::vec3(-1e30f);
+	for (int i = begin; i < end; ++i) {
+		const BuildTriangle& triangle = triangles[order[i]];
+		lower = glm::min(lower, triangle.lower);
+		upper = glm::max(upper, triangle.upper);
+		centroid_lower = glm::min(centroid_lower, triangle.centroid);
+		centroid_upper = glm::max(centroid_upper, triangle.centroid);
+	}
+	scene.nodes[node].lower = lower;
+	scene.nodes[node].upper = upper;
+
+	int count = end - begin;
+	if (count <= RAYCAST_LEAF_SIZE) {
+		scene.nodes[node].first = (int)scene.groups.size();
+		scene.nodes[node].count = count;
+		scene.groups.emplace_back();
+		fill_group(scene.groups.back(), corners, &order[begin], count);
+		return;
+	}
+
+	/**
+	 * Cost of a split is the area of each side times the triangles on it.
+	 */
+	int best_axis = -1, best_split = 0;
+	float best_cost = 1e30f;
+	for (int axis = 0; axis < 3; ++axis) {
+		float extent = centroid_upper[axis] - centroid_lower[axis];
+		if (extent <= 0.f)
+			continue;
+
+		SahBin bins[RAYCAST_SAH_BINS];
+		for (int i = begin; i < end; ++i) {
+			const BuildTriangle& triangle = triangles[order[i]];
+			int bin = std::min(RAYCAST_SAH_BINS - 1, (int)((triangle.centroid[axis] - centroid_lower[axis]) / extent * RAYCAST_SAH_BINS));
+			bins[bin].lower = glm::min(bins[bin].lower, triangle.lower);
+			bins[bin].upper = glm::max(bins[bin].upper, triangle.upper);
+			++bins[bin].count;
+		}
+
+		float right_cost[RAYCAST_SAH_BINS] = {};
+		SahBin right;
+		for (int bin = RAYCAST_SAH_BINS - 1; bin > 0; --bin) {
+			right.lower = glm::min(right.lower, bins[bin].lower);
+			right.upper = glm::max(right.upper, bins[bin].upper);
+			right.count += bins[bin].count;
+			right_cost[bin] = right.count ? right.count * surface_area(right.lower, right.upper) : 0.f;
+		}
+
+		SahBin left;
+		for (int split = 1; split < RAYCAST_SAH_BINS; ++split) {
+			left.lower = glm::min(left.lower, bins[split - 1].lower);
+			left.upper = glm::max(left.upper, bins[split - 1].upper);
+			left.count += bins[split - 1].count;
+			if (left.count == 0 || left.count == count)
+				continue;
+			float cost = left.count * surface_area(left.lower, left.upper) + right_cost[split];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_split = split;
+			}
+		}
+	}
+
+	int middle = begin + count / 2;			// coincident centroids: any halving will do
+	if (best_axis >= 0) {
+		float extent = centroid_upper[best_axis] - centroid_lower[best_axis];
+		middle = (int)(std::partition(order.begin() + begin, order.begin() + end, [&](int index) {
+			float offset = (triangles[index].centroid[best_axis] - centroid_lower[best_axis]) / extent;
+			return std::min(RAYCAST_SAH_BINS - 1, (int)(offset * RAYCAST_SAH_BINS)) < best_split;
+		}) - order.begin());
+	}
+
+	int children = (int)scene.nodes.size();
+	scene.nodes.resize(children + 2);
+	scene.nodes[node].first = children;
+	scene.nodes[node].count = 0;
+	build_node(scene, corners, triangles, order, children, begin, middle);
+	build_node(scene, corners, triangles, order, children + 1, middle, end);
+}
+
+RaycastScene raycast_build(const std::vector<glm::vec3>& triangles) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	RaycastScene scene;
+	scene.triangles = (unsigned int)(triangles.size() / 3);
+
+	std::vector<BuildTriangle> bounds(scene.triangles);
+	std::vector<int> order(scene.triangles);
+	for (unsigned int i = 0; i < scene.triangles; ++i) {
+		const glm::vec3* corner = &triangles[i * 3];
+		bounds[i].lower = glm::min(corner[0], glm::min(corner[1], corner[2]));
+		bounds[i].upper = glm::max(corner[0], glm::max(corner[1], corner[2]));
+		bounds[i].centroid = (corner[0] + corner[1] + corner[2]) / 3.f;
+		order[i] = (int)i;
+	}
+
+	scene.nodes.reserve(scene.triangles / 2 + 1);
+	scene.nodes.resize(1);
+	build_node(scene, triangles, bounds, order, 0, 0, (int)scene.triangles);
+
+	scene.build_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return scene;
+}
+
+raycast_simd raycast_best_simd() {
+#ifdef RAYCAST_SSE2
+	return RAYCAST_SIMD_SSE2;
+#else
+	return RAYCAST_SIMD_SCALAR;
+#endif
+}
+
+const char* raycast_simd_name(raycast_simd simd) {
+	switch (simd) {
+	case RAYCAST_SIMD_SSE2: return "SSE2";
+	default: return "scalar";
+	}
+}
+
+/**
+ * Moller-Trumbore against every lane of a group, one lane at a time. Keeps
+ * the nearest hit closer than t_max and shrinks t_max to it.
+ */
+static bool intersect_group_scalar(const TriangleGroup& group, const float origin[3], const float direction[3], float& t_max, RayHit& hit) {
+	bool found = false;
+	for (int lane = 0; lane < RAYCAST_LEAF_SIZE; ++lane) {
+		float e1x = group.e1[0][lane], e1y = group.e1[1][lane], e1z = group.e1[2][lane];
+		float e2x = group.e2[0][lane], e2y = group.e2[1][lane], e2z = group.e2[2][lane];
+
+		float px = direction[1] * e2z - direction[2] * e2y;
+		float py = direction[2] * e2x - direction[0] * e2z;
+		float pz = direction[0] * e2y - direction[1] * e2x;
+		float det = e1x * px + e1y * py + e1z * pz;
+		if (det == 0.f)
+			continue;						// parallel, or an unused lane
+		float inv = 1.f / det;
+
+		float tx = origin[0] - group.v0[0][lane];
+		float ty = origin[1] - group.v0[1][lane];
+		float tz = origin[2] - group.v0[2][lane];
+		float u = (tx * px + ty * py + tz * pz) * inv;
+
+		float qx = ty * e1z - tz * e1y;
+		float qy = tz * e1x - tx * e1z;
+		float qz = tx * e1y - ty * e1x;
+		float v = (direction[0] * qx + direction[1] * qy + direction[2] * qz) * inv;
+		float t = (e2x * qx + e2y * qy + e2z * qz) * inv;
+
+		if (u >= 0.f && u <= 1.f && v >= 0.f && u + v <= 1.f && t > 0.f && t < t_max) {
+			t_max = t;
+			hit = { t, group.triangle[lane], u, v };
+			found = true;
+		}
+	}
+	return found;
+}
+
+#ifdef RAYCAST_SSE2
+/**
+ * The same test on all four lanes at once. Every step matches the scalar
+ * version operation for operation, so both find identical hits.
+ */
+static bool intersect_group_sse2(const TriangleGroup& group, const __m128 origin[3], const __m128 direction[3], float& t_max, RayHit& hit) {
+	__m128 e1x = _mm_loadu_ps(group.e1[0]), e1y = _mm_loadu_ps(group.e1[1]), e1z = _mm_loadu_ps(group.e1[2]);
+	__m128 e2x = _mm_loadu_ps(group.e2[0]), e2y = _mm_loadu_ps(group.e2[1]), e2z = _mm_loadu_ps(group.e2[2]);
+
+	__m128 px = _mm_sub_ps(_mm_mul_ps(direction[1], e2z), _mm_mul_ps(direction[2], e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(direction[2], e2x), _mm_mul_ps(direction[0], e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(direction[0], e2y), _mm_mul_ps(direction[1], e2x));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 inv = _mm_div_ps(_mm_set1_ps(1.f), det);
+
+	__m128 tx = _mm_sub_ps(origin[0], _mm_loadu_ps(group.v0[0]));
+	__m128 ty = _mm_sub_ps(origin[1], _mm_loadu_ps(group.v0[1]));
+	__m128 tz = _mm_sub_ps(origin[2], _mm_loadu_ps(group.v0[2]));
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv);
+
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(direction[0], qx), _mm_mul_ps(direction[1], qy)), _mm_mul_ps(direction[2], qz)), inv);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 valid = _mm_cmpneq_ps(det, zero);
+	valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, _mm_set1_ps(1.f))));
+	valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.f))));
+	valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, _mm_set1_ps(t_max))));
+
+	int mask = _mm_movemask_ps(valid);
+	if (mask == 0)
+		return false;
+
+	float ts[4], us[4], vs[4];
+	_mm_storeu_ps(ts, t);
+	_mm_storeu_ps(us, u);
+	_mm_storeu_ps(vs, v);
+	for (int lane = 0; lane < RAYCAST_LEAF_SIZE; ++lane) {
+		if ((mask & (1 << lane)) && ts[lane] < t_max) {
+			t_max = ts[lane];
+			hit = { ts[lane], group.triangle[lane], us[lane], vs[lane] };
+		}
+	}
+	return true;
+}
+#endif
+
+/**
+ * Distance the ray enters the box at, or false if it misses it or only
+ * enters at t_max or later.
+ */
+static bool intersect_box(const BvhNode& node, const float origin[3], const float inverse[3], float t_max, float& t_near) {
+	float enter = 0.f, leave = t_max;
+	for (int axis = 0; axis < 3; ++axis) {
+		float t0 = (node.lower[axis] - origin[axis]) * inverse[axis];
+		float t1 = (node.upper[axis] - origin[axis]) * inverse[axis];
+		enter = std::max(enter, std::min(t0, t1));
+		leave = std::min(leave, std::max(t0, t1));
+	}
+	t_near = enter;
+	return enter <= leave;
+}
+
+template <bool any_hit>
+static bool traverse(const RaycastScene& scene, glm::vec3 origin, glm::vec3 direction, float max_distance, RayHit& hit, raycast_simd simd) {
+	if (scene.groups.empty())
+		return false;
+
+	float o[3] = { origin.x, origin.y, origin.z };
+	float d[3] = { direction.x, direction.y, direction.z };
+	float inverse[3];
+	for (int axis = 0; axis < 3; ++axis)
+		inverse[axis] = 1.f / (std::abs(d[axis]) > 1e-20f ? d[axis] : std::copysign(1e-20f, d[axis]));
+#ifdef RAYCAST_SSE2
+	__m128 o4[3] = { _mm_set1_ps(o[0]), _mm_set1_ps(o[1]), _mm_set1_ps(o[2]) };
+	__m128 d4[3] = { _mm_set1_ps(d[0]), _mm_set1_ps(d[1]), _mm_set1_ps(d[2]) };
+#endif
+
+	float t_max = max_distance;
+	bool found = false;
+
+	int stack[RAYCAST_STACK_SIZE];
+	float stack_near[RAYCAST_STACK_SIZE];
+	int depth = 0;
+	float t_near;
+	if (!intersect_box(scene.nodes[0], o, inverse, t_max, t_near))
+		return false;
+	stack[depth] = 0;
+	stack_near[depth++] = t_near;
+
+	while (depth > 0) {
+		--depth;
+		if (stack_near[depth] >= t_max)
+			continue;						// a closer hit was found since this node was pushed
+		const BvhNode& node = scene.nodes[stack[depth]];
+
+		if (node.count > 0) {
+			const TriangleGroup& group = scene.groups[node.first];
+			bool group_hit;
+#ifdef RAYCAST_SSE2
+			if (simd == RAYCAST_SIMD_SSE2)
+				group_hit = intersect_group_sse2(group, o4, d4, t_max, hit);
+			else
+#endif
+				group_hit = intersect_group_scalar(group, o, d, t_max, hit);
+			found |= group_hit;
+			if (any_hit && found)
+				return true;
+			continue;
+		}
+
+		/**
+		 * Visit the nearer child first so its hits cull the other.
+		 */
+		float near_a, near_b;
+		bool hit_a = intersect_box(scene.nodes[node.first], o, inverse, t_max, near_a);
+		bool hit_b = intersect_box(scene.nodes[node.first + 1], o, inverse, t_max, near_b);
+		if (hit_a && hit_b && depth + 2 <= RAYCAST_STACK_SIZE) {
+			bool a_first = near_a <= near_b;
+			stack[depth] = a_first ? node.first + 1 : node.first;
+			stack_near[depth++] = a_first ? near_b : near_a;
+			stack[depth] = a_first ? node.first : node.first + 1;
+			stack_near[depth++] = a_first ? near_a : near_b;
+		}
+		else if ((hit_a || hit_b) && depth < RAYCAST_STACK_SIZE) {
+			stack[depth] = hit_a ? node.first : node.first + 1;
+			stack_near[depth++] = hit_a ? near_a : near_b;
+		}
+	}
+	return found;
+}
+
+bool raycast_closest(const RaycastScene& scene, glm::vec3 origin, glm::vec3 direction, float max_distance, RayHit& hit, raycast_simd simd) {
+	return traverse<false>(scene, origin, direction, max_distance, hit, simd);
+}
+
+bool raycast_occluded(const RaycastScene& scene, glm::vec3 origin, glm::vec3 direction, float max_distance, raycast_simd simd) {
+	RayHit hit;
+	return traverse<true>(scene, origin, direction, max_distance, hit, simd);
+}
+
+#ifdef RAYCAST_SSE2
+/**
+ * Entry distance of each ray in the packet into node's box, and a mask of
+ * the rays that enter it before their t_max.
+ */
+static __m128 intersect_box_packet(const BvhNode& node, const __m128 origin[3], const __m128 inverse[3], __m128 t_max, __m128& t_near) {
+	__m128 enter = _mm_setzero_ps(), leave = t_max;
+	for (int axis = 0; axis < 3; ++axis) {
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.lower[axis]), origin[axis]), inverse[axis]);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.upper[axis]), origin[axis]), inverse[axis]);
+		enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+		leave = _mm_min_ps(leave, _mm_max_ps(t0, t1));
+	}
+	t_near = enter;
+	return _mm_cmple_ps(enter, leave);
+}
+
+static float nearest_lane(__m128 t_near, int mask) {
+	float near[4];
+	_mm_storeu_ps(near, t_near);
+	float nearest = 1e30f;
+	for (int lane = 0; lane < RAYCAST_PACKET_SIZE; ++lane) {
+		if (mask & (1 << lane))
+			nearest = std::min(nearest, near[lane]);
+	}
+	return nearest;
+}
+
+/**
+ * One triangle of a group against every ray of the packet, the scalar test
+ * with rays in the lanes instead of triangles. Rays that hit it closer than
+ * their t_max take it as their hit.
+ */
+static void intersect_triangle_packet(const TriangleGroup& group, int lane, const __m128 origin[3], const __m128 direction[3], __m128& t_max, __m128i& triangle, __m128& hit_u, __m128& hit_v) {
+	__m128 e1x = _mm_set1_ps(group.e1[0][lane]), e1y = _mm_set1_ps(group.e1[1][lane]), e1z = _mm_set1_ps(group.e1[2][lane]);
+	__m128 e2x = _mm_set1_ps(group.e2[0][lane]), e2y = _mm_set1_ps(group.e2[1][lane]), e2z = _mm_set1_ps(group.e2[2][lane]);
+
+	__m128 px = _mm_sub_ps(_mm_mul_ps(direction[1], e2z), _mm_mul_ps(direction[2], e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(direction[2], e2x), _mm_mul_ps(direction[0], e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(direction[0], e2y), _mm_mul_ps(direction[1], e2x));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 inv = _mm_div_ps(_mm_set1_ps(1.f), det);
+
+	__m128 tx = _mm_sub_ps(origin[0], _mm_set1_ps(group.v0[0][lane]));
+	__m128 ty = _mm_sub_ps(origin[1], _mm_set1_ps(group.v0[1][lane]));
+	__m128 tz = _mm_sub_ps(origin[2], _mm_set1_ps(group.v0[2][lane]));
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv);
+
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(direction[0], qx), _mm_mul_ps(direction[1], qy)), _mm_mul_ps(direction[2], qz)), inv);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 valid = _mm_cmpneq_ps(det, zero);
+	valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, _mm_set1_ps(1.f))));
+	valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.f))));
+	valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, t_max)));
+	if (_mm_movemask_ps(valid) == 0)
+		return;
+
+	__m128i take = _mm_castps_si128(valid);
+	t_max = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, t_max));
+	hit_u = _mm_or_ps(_mm_and_ps(valid, u), _mm_andnot_ps(valid, hit_u));
+	hit_v = _mm_or_ps(_mm_and_ps(valid, v), _mm_andnot_ps(valid, hit_v));
+	triangle = _mm_or_si128(_mm_and_si128(take, _mm_set1_epi32(group.triangle[lane])), _mm_andnot_si128(take, triangle));
+}
+
+/**
+ * The packet walks the tree together: a node is entered when any of its rays
+ * reaches the box, and children are visited nearest first for the nearest
+ * active ray. Rays that miss a box just find nothing in it.
+ */
+static int traverse_packet(const RaycastScene& scene, const glm::vec3 origins[RAYCAST_PACKET_SIZE], const glm::vec3 directions[RAYCAST_PACKET_SIZE], float max_distance, RayHit hits[RAYCAST_PACKET_SIZE]) {
+	float o[3][RAYCAST_PACKET_SIZE], d[3][RAYCAST_PACKET_SIZE], inv[3][RAYCAST_PACKET_SIZE];
+	for (int ray = 0; ray < RAYCAST_PACKET_SIZE; ++ray) {
+		for (int axis = 0; axis < 3; ++axis) {
+			o[axis][ray] = origins[ray][axis];
+			d[axis][ray] = directions[ray][axis];
+			inv[axis][ray] = 1.f / (std::abs(d[axis][ray]) > 1e-20f ? d[axis][ray] : std::copysign(1e-20f, d[axis][ray]));
+		}
+	}
+	__m128 o4[3], d4[3], inverse[3];
+	for (int axis = 0; axis < 3; ++axis) {
+		o4[axis] = _mm_loadu_ps(o[axis]);
+		d4[axis] = _mm_loadu_ps(d[axis]);
+		inverse[axis] = _mm_loadu_ps(inv[axis]);
+	}
+
+	__m128 t_max = _mm_set1_ps(max_distance);
+	__m128i triangle = _mm_set1_epi32(-1);
+	__m128 hit_u = _mm_setzero_ps(), hit_v = _mm_setzero_ps();
+
+	int stack[RAYCAST_STACK_SIZE];
+	int depth = 0;
+	stack[depth++] = 0;
+
+	while (depth > 0) {
+		const BvhNode& node = scene.nodes[stack[--depth]];
+		__m128 t_near;
+		if (_mm_movemask_ps(intersect_box_packet(node, o4, inverse, t_max, t_near)) == 0)
+			continue;						// missed, or every ray found something closer since the push
+
+		if (node.count > 0) {
+			const TriangleGroup& group = scene.groups[node.first];
+			for (int lane = 0; lane < node.count; ++lane)
+				intersect_triangle_packet(group, lane, o4, d4, t_max, triangle, hit_u, hit_v);
+			continue;
+		}
+
+		__m128 near_a, near_b;
+		int mask_a = _mm_movemask_ps(intersect_box_packet(scene.nodes[node.first], o4, inverse, t_max, near_a));
+		int mask_b = _mm_movemask_ps(intersect_box_packet(scene.nodes[node.first + 1], o4, inverse, t_max, near_b));
+		if (mask_a && mask_b && depth + 2 <= RAYCAST_STACK_SIZE) {
+			bool a_first = nearest_lane(near_a, mask_a) <= nearest_lane(near_b, mask_b);
+			stack[depth++] = a_first ? node.first + 1 : node.first;
+			stack[depth++] = a_first ? node.first : node.first + 1;
+		}
+		else if ((mask_a || mask_b) && depth < RAYCAST_STACK_SIZE)
+			stack[depth++] = mask_a ? node.first : node.first + 1;
+	}
+
+	float ts[4], us[4], vs[4];
+	int triangles[4];
+	_mm_storeu_ps(ts, t_max);
+	_mm_storeu_ps(us, hit_u);
+	_mm_storeu_ps(vs, hit_v);
+	_mm_storeu_si128((__m128i*)triangles, triangle);
+	int found = 0;
+	for (int ray = 0; ray < RAYCAST_PACKET_SIZE; ++ray) {
+		if (triangles[ray] < 0)
+			continue;
+		hits[ray] = { ts[ray], triangles[ray], us[ray], vs[ray] };
+		found |= 1 << ray;
+	}
+	return found;
+}
+#endif
+
+int raycast_closest_packet(const RaycastScene& scene, const glm::vec3 origins[RAYCAST_PACKET_SIZE], const glm::vec3 directions[RAYCAST_PACKET_SIZE], float max_distance, RayHit hits[RAYCAST_PACKET_SIZE], raycast_simd simd) {
+	if (scene.groups.empty())
+		return 0;
+#ifdef RAYCAST_SSE2
+	if (simd == RAYCAST_SIMD_SSE2)
+		return traverse_packet(scene, origins, directions, max_distance, hits);
+#endif
+	int found = 0;
+	for (int ray = 0; ray < RAYCAST_PACKET_SIZE; ++ray) {
+		if (traverse<false>(scene, origins[ray], directions[ray], max_distance, hits[ray], simd))
+			found |= 1 << ray;
+	}
+	return found;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef __RAYCAST_H__
+#define __RAYCAST_H__
+
+#include <vector>
+#include <glm/glm.hpp>
+
+const int RAYCAST_LEAF_SIZE = 4;			// Triangles per BVH leaf, tested together as one SIMD group
+const int RAYCAST_SAH_BINS = 16;			// Centroid bins per axis when choosing a split
+const int RAYCAST_STACK_SIZE = 64;			// Deepest traversal a ray can need
+const int RAYCAST_PACKET_SIZE = 4;			// Rays traced together by raycast_closest_packet
+
+/**
+ * Instruction sets the triangle tests can run on.
+ */
+enum raycast_simd {
+	RAYCAST_SIMD_SCALAR,
+	RAYCAST_SIMD_SSE2
+};
+
+/**
+ * Interior nodes (count 0) have their children at first and first + 1;
+ * leaves point at one TriangleGroup.
+ */
+struct bvh_node {
+	glm::vec3 lower;
+	int first;
+	glm::vec3 upper;
+	int count;								// triangles in the leaf, 0 for interior nodes
+};
+typedef struct bvh_node BvhNode;
+
+/**
+ * Up to RAYCAST_LEAF_SIZE triangles as structure of arrays: first corner and
+ * the edges to the other two, one lane each. Unused lanes are degenerate and
+ * never hit.
+ */
+struct triangle_group {
+	float v0[3][RAYCAST_LEAF_SIZE];
+	float e1[3][RAYCAST_LEAF_SIZE];
+	float e2[3][RAYCAST_LEAF_SIZE];
+	int triangle[RAYCAST_LEAF_SIZE];		// index in the list raycast_build was given, -1 for unused lanes
+};
+typedef struct triangle_group TriangleGroup;
+
+struct raycast_scene {
+	std::vector<BvhNode> nodes;				// nodes[0] is the root
+	std::vector<TriangleGroup> groups;
+	unsigned int triangles = 0;
+	double build_ms = 0.0;
+};
+typedef struct raycast_scene RaycastScene;
+
+/**
+ * u and v weigh the triangle's second and third corner at the hit point.
+ */
+struct ray_hit {
+	float distance;
+	int triangle;
+	float u, v;
+};
+typedef struct ray_hit RayHit;
+
+/**
+ * Build a BVH over triangles, given as three world space corners each. Splits
+ * are chosen by the surface area heuristic over RAYCAST_SAH_BINS centroid bins.
+ */
+RaycastScene raycast_build(const std::vector<glm::vec3>& triangles);
+
+raycast_simd raycast_best_simd();			// Widest instruction set this build can run
+
+const char* raycast_simd_name(raycast_simd simd);
+
+/**
+ * Nearest hit along direction (normalized) closer than max_distance. Hits
+ * at distance 0 or less are ignored, so offset origins that lie on a surface.
+ */
+bool raycast_closest(const RaycastScene& scene, glm::vec3 origin, glm::vec3 direction, float max_distance, RayHit& hit, raycast_simd simd = raycast_best_simd());
+
+bool raycast_occluded(const RaycastScene& scene, glm::vec3 origin, glm::vec3 direction, float max_distance, raycast_simd simd = raycast_best_simd());	// Any hit, stops at the first one found
+
+/**
+ * raycast_closest for RAYCAST_PACKET_SIZE rays at once, which pays off for
+ * coherent rays such as neighbouring pixels': with SSE2 the rays share one
+ * walk of the tree and each box and triangle is tested against all of them
+ * together. Returns a mask of the rays that hit; hits of the others are left
+ * untouched.
+ */
+int raycast_closest_packet(const RaycastScene& scene, const glm::vec3 origins[RAYCAST_PACKET_SIZE], const glm::vec3 directions[RAYCAST_PACKET_SIZE], float max_distance, RayHit hits[RAYCAST_PACKET_SIZE], raycast_simd simd = raycast_best_simd());
+#endif//__RAYCAST_H__
@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+#include "reference.h"
+
+#include "cpulit.h"
+
+/**
+ * What shading a hit needs beyond the BVH: the triangle's world space normals
+ * and texture coordinates, corner by corner.
+ */
+struct reference_triangle {
+	glm::vec3 normal[3];
+	glm::vec2 coord[3];
+	glm::vec3 face_normal;					// of the flat triangle, to offset shadow rays along
+	int mesh;
+};
+typedef struct reference_triangle ReferenceTriangle;
+
+/**
+ * What every worker of one render reads.
+ */
+struct reference_frame {
+	int width, height;
+	int samples;
+	int tiles_x;
+	glm::mat4 inverse_view_projection;
+	raycast_simd simd;
+	CpuLights lights;
+};
+typedef struct reference_frame ReferenceFrame;
+
+namespace glob {
+	std::vector<CpuMesh> reference_meshes;
+	std::vector<CpuTexture> reference_textures;
+	std::vector<ReferenceTriangle> reference_triangles;
+	RaycastScene reference_scene;
+
+	ReferenceStats reference_counters;
+}
+
+bool reference_init(const std::vector<BatchItem>& items) {
+	using namespace glob;
+
+	cpulit_read(items, reference_meshes, reference_textures);
+	if (reference_meshes.empty()) {
+		std::cerr << "ERROR::REFERENCE::NO_MESHES" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Move every mesh into world space with its Model's current transform, as
+ * single_texture.vs does, and build the BVH over the result.
+ */
+static void build_scene() {
+	using namespace glob;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<glm::vec3> corners;
+	reference_triangles.clear();
+	for (int index = 0; index < (int)reference_meshes.size(); ++index) {
+		const CpuMesh& mesh = reference_meshes[index];
+		glm::mat4 model = mesh.item.model->model;
+		glm::mat3 normal_model = glm::mat3(glm::transpose(glm::inverse(model)));
+		for (size_t i = 0; i + 3 <= mesh.indices.size(); i += 3) {
+			ReferenceTriangle triangle;
+			glm::vec3 world[3];
+			for (int corner = 0; corner < 3; ++corner) {
+				unsigned int vertex = mesh.indices[i + corner];
+				world[corner] = glm::vec3(model * glm::vec4(mesh.positions[vertex], 1.f));
+				triangle.normal[corner] = normal_model * mesh.normals[vertex];
+				triangle.coord[corner] = mesh.coords[vertex];
+				corners.push_back(world[corner]);
+			}
+			glm::vec3 cross = glm::cross(world[1] - world[0], world[2] - world[0]);
+			float length = glm::length(cross);
+			triangle.face_normal = length > 0.f ? cross / length : glm::vec3(0.f);
+			triangle.mesh = index;
+			reference_triangles.push_back(triangle);
+		}
+	}
+	reference_scene = raycast_build(corners);
+
+	reference_counters.triangles = reference_scene.triangles;
+	reference_counters.bvh_nodes = (unsigned int)reference_scene.nodes.size();
+	reference_counters.build_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/**
+ * Ray from the near plane to the far plane through window position (x, y).
+ */
+static void camera_ray(const ReferenceFrame& frame, float x, float y, glm::vec3& origin, glm::vec3& direction, float& length) {
+	glm::vec2 ndc = glm::vec2(x / frame.width, y / frame.height) * 2.f - glm::vec2(1.f);
+	glm::vec4 near_point = frame.inverse_view_projection * glm::vec4(ndc.x, ndc.y, -1.f, 1.f);
+	glm::vec4 far_point = frame.inverse_view_projection * glm::vec4(ndc.x, ndc.y, 1.f, 1.f);
+	origin = glm::vec3(near_point) / near_point.w;
+	glm::vec3 end = glm::vec3(far_point) / far_point.w;
+	length = glm::length(end - origin);
+	direction = (end - origin) / length;
+}
+
+/**
+ * Nothing between world and a light distance away along light_dir.
+ */
+static bool light_visible(const ReferenceFrame& frame, const ReferenceTriangle& triangle, glm::vec3 world, glm::vec3 light_dir, float distance, unsigned long long& shadow_rays) {
+	float side = glm::dot(triangle.face_normal, light_dir) < 0.f ? -1.f : 1.f;
+	++shadow_rays;
+	return !raycast_occluded(glob::reference_scene, world + triangle.face_normal * (side * REFERENCE_RAY_OFFSET), light_dir, distance - REFERENCE_RAY_OFFSET, frame.simd);
+}
+
+/**
+ * The lit shader's main() at a camera ray's hit, with shadow rays in place
+ * of shadow maps.
+ */
+static glm::vec3 shade_hit(const ReferenceFrame& frame, glm::vec3 origin, glm::vec3 direction, const RayHit& hit, unsigned long long& shadow_rays) {
+	using namespace glob;
+
+	const ReferenceTriangle& triangle = reference_triangles[hit.triangle];
+	float weights[3] = { 1.f - hit.u - hit.v, hit.u, hit.v };
+	glm::vec3 normal = glm::vec3(0.f);
+	glm::vec2 coord = glm::vec2(0.f);
+	for (int i = 0; i < 3; ++i) {
+		normal += triangle.normal[i] * weights[i];
+		coord += triangle.coord[i] * weights[i];
+	}
+	glm::vec3 world = origin + direction * hit.distance;
+
+	return cpulit_shade(frame.lights, reference_meshes[triangle.mesh], reference_textures, world, normal, coord, [&](glm::vec3 light_dir, float distance) {
+		return light_visible(frame, triangle, world, light_dir, distance, shadow_rays);
+	});
+}
+
+/**
+ * Every pixel of one tile, one camera ray at a time or as 2x2 pixel packets
+ * (one packet per sample position). Samples are clamped to [0, 1] as the
+ * framebuffer would, then averaged.
+ */
+static void render_tile(const ReferenceFrame& frame, int tile, bool packets, Image& image, unsigned long long& camera_rays, unsigned long long& shadow_rays) {
+	using namespace glob;
+
+	int tile_x = tile % frame.tiles_x * REFERENCE_TILE_SIZE, tile_y = tile / frame.tiles_x * REFERENCE_TILE_SIZE;
+	int end_x = std::min(frame.width, tile_x + REFERENCE_TILE_SIZE), end_y = std::min(frame.height, tile_y + REFERENCE_TILE_SIZE);
+	float step = 1.f / frame.samples;
+
+	glm::vec3 sums[REFERENCE_TILE_SIZE * REFERENCE_TILE_SIZE];
+	std::fill(sums, sums + REFERENCE_TILE_SIZE * REFERENCE_TILE_SIZE, glm::vec3(0.f));
+
+	for (int sample = 0; sample < frame.samples * frame.samples; ++sample) {
+		float offset_x = (sample % frame.samples + 0.5f) * step, offset_y = (sample / frame.samples + 0.5f) * step;
+		if (!packets) {
+			for (int y = tile_y; y < end_y; ++y) {
+				for (int x = tile_x; x < end_x; ++x) {
+					glm::vec3 origin, direction;
+					float length;
+					RayHit hit;
+					camera_ray(frame, x + offset_x, y + offset_y, origin, direction, length);
+					++camera_rays;
+					if (raycast_closest(reference_scene, origin, direction, length, hit, frame.simd))
+						sums[(y - tile_y) * REFERENCE_TILE_SIZE + x - tile_x] += glm::clamp(shade_hit(frame, origin, direction, hit, shadow_rays), glm::vec3(0.f), glm::vec3(1.f));
+				}
+			}
+			continue;
+		}
+
+		for (int y = tile_y; y < end_y; y += 2) {
+			for (int x = tile_x; x < end_x; x += 2) {
+				glm::vec3 origins[RAYCAST_PACKET_SIZE], directions[RAYCAST_PACKET_SIZE];
+				float lengths[RAYCAST_PACKET_SIZE];
+				int pixels[RAYCAST_PACKET_SIZE];
+				float max_length = 0.f;
+				for (int ray = 0; ray < RAYCAST_PACKET_SIZE; ++ray) {
+					int px = x + (ray & 1), py = y + (ray >> 1);
+					pixels[ray] = px < end_x && py < end_y ? (py - tile_y) * REFERENCE_TILE_SIZE + px - tile_x : -1;	// -1 past the tile: traced, then dropped
+					camera_ray(frame, std::min(px, end_x - 1) + offset_x, std::min(py, end_y - 1) + offset_y, origins[ray], directions[ray], lengths[ray]);
+					max_length = std::max(max_length, lengths[ray]);
+					camera_rays += pixels[ray] >= 0;
+				}
+
+				RayHit hits[RAYCAST_PACKET_SIZE];
+				int found = raycast_closest_packet(reference_scene, origins, directions, max_length, hits, frame.simd);
+				for (int ray = 0; ray < RAYCAST_PACKET_SIZE; ++ray) {
+					if (pixels[ray] >= 0 && (found & (1 << ray)) && hits[ray].distance < lengths[ray])
+						sums[pixels[ray]] += glm::clamp(shade_hit(frame, origins[ray], directions[ray], hits[ray], shadow_rays), glm::vec3(0.f), glm::vec3(1.f));
+				}
+			}
+		}
+	}
+
+	float scale = 255.f / (frame.samples * frame.samples);
+	for (int y = tile_y; y < end_y; ++y) {
+		for (int x = tile_x; x < end_x; ++x) {
+			const glm::vec3& sum = sums[(y - tile_y) * REFERENCE_TILE_SIZE + x - tile_x];
+			unsigned char* texel = &image.texels[((size_t)y * frame.width + x) * 3];
+			for (int c = 0; c < 3; ++c)
+				texel[c] = (unsigned char)(sum[c] * scale + 0.5f);
+		}
+	}
+}
+
+void reference_render(Image& image, int width, int height, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos, int samples, int threads, bool packets, raycast_simd simd) {
+	using namespace glob;
+
+	ReferenceStats& stats = reference_counters;
+	if (threads <= 0)
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+	samples = std::max(1, samples);
+	simd = std::min(simd, raycast_best_simd());
+
+	image.width = width;
+	image.height = height;
+	image.texels.assign((size_t)width * height * 3, 0);
+	if (reference_meshes.empty() || width <= 0 || height <= 0)
+		return;
+
+	build_scene();
+
+	ReferenceFrame frame;
+	frame.width = width;
+	frame.height = height;
+	frame.samples = samples;
+	frame.tiles_x = (width + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE;
+	frame.inverse_view_projection = glm::inverse(projection * view);
+	frame.simd = simd;
+	cpulit_copy_lights(frame.lights, dir_light, viewPos);
+
+	/**
+	 * Workers claim tiles in order until none are left. Their ray counts sit
+	 * side by side, so each counts in locals and writes back once.
+	 */
+	auto start = std::chrono::high_resolution_clock::now();
+	int tiles = frame.tiles_x * ((height + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE);
+	std::atomic<int> next(0);
+	std::vector<unsigned long long> camera_rays(threads, 0), shadow_rays(threads, 0);
+	auto work = [&](int worker) {
+		unsigned long long worker_camera_rays = 0, worker_shadow_rays = 0;
+		for (int tile = next++; tile < tiles; tile = next++)
+			render_tile(frame, tile, packets, image, worker_camera_rays, worker_shadow_rays);
+		camera_rays[worker] = worker_camera_rays;
+		shadow_rays[worker] = worker_shadow_rays;
+	};
+
+	std::vector<std::thread> pool;
+	for (int worker = 1; worker < threads; ++worker)
+		pool.emplace_back(work, worker);
+	work(0);
+	for (std::thread& worker : pool)
+		worker.join();
+
+	++stats.frames;
+	stats.width = width;
+	stats.height = height;
+	stats.samples = samples;
+	stats.threads = threads;
+	stats.packets = packets;
+	stats.simd = simd;
+	stats.render_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	stats.camera_rays = stats.shadow_rays = 0;
+	for (int worker = 0; worker < threads; ++worker) {
+		stats.camera_rays += camera_rays[worker];
+		stats.shadow_rays += shadow_rays[worker];
+	}
+}
+
+void reference_compare(const Image& reference, const Image& frame) {
+	ReferenceStats& stats = glob::reference_counters;
+	stats.compared = true;
+	stats.psnr = image_psnr(reference, frame);
+	stats.ssim = image_ssim(reference, frame);
+	std::cout << "Reference comparison: " << frame.width << "x" << frame.height << " GL frame against the ray-traced reference, PSNR "
+		<< stats.psnr << " dB, SSIM " << stats.ssim << std::endl;
+}
+
+void reference_benchmark(int width, int height, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos) {
+	using namespace glob;
+
+	if (reference_meshes.empty()) {
+		std::cout << "Reference benchmark skipped: no meshes" << std::endl;
+		return;
+	}
+
+	ReferenceStats saved = reference_counters;
+	Image expected, image;
+	reference_render(expected, width, height, projection, view, dir_light, viewPos, 1, 1, false, RAYCAST_SIMD_SCALAR);
+	std::cout << "Reference benchmark: " << width << "x" << height << ", " << reference_counters.triangles << " triangles in "
+		<< reference_counters.bvh_nodes << " BVH nodes (built in " << reference_counters.build_ms << " ms)" << std::endl;
+
+	int cores = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int simd = RAYCAST_SIMD_SCALAR; simd <= raycast_best_simd(); ++simd) {
+		for (int packets = 0; packets <= 1; ++packets) {
+			for (int threads = 1; threads <= cores; threads = threads == cores ? cores + 1 : cores) {
+				reference_render(image, width, height, projection, view, dir_light, viewPos, 1, threads, packets != 0, (raycast_simd)simd);
+				const ReferenceStats& stats = reference_counters;
+				double rays = (double)(stats.camera_rays + stats.shadow_rays);
+				std::cout << "\t" << raycast_simd_name((raycast_simd)simd) << ", " << (packets ? "packets" : "single rays") << ", " << threads << " thread(s): "
+					<< stats.render_ms << " ms, " << stats.camera_rays / 1e6 / (stats.render_ms / 1000.0) << " M camera rays/s, "
+					<< rays / 1e6 / (stats.render_ms / 1000.0) << " M rays/s with shadows"
+					<< (image.texels == expected.texels ? "" : ", IMAGE DIFFERS from scalar single rays") << std::endl;
+			}
+		}
+	}
+
+	reference_counters = saved;
+}
+
+ReferenceStats reference_stats() {
+	return glob::reference_counters;
+}
+
+void reference_report() {
+	ReferenceStats stats = reference_stats();
+	if (stats.frames == 0)
+		return;
+
+	std::cout << "Reference renderer: " << stats.frames << " frames, last " << stats.width << "x" << stats.height << " at " << stats.samples * stats.samples
+		<< " samples per pixel on " << stats.threads << " thread(s), " << raycast_simd_name(stats.simd) << (stats.packets ? " packets" : " single rays") << ": "
+		<< stats.camera_rays << " camera and " << stats.shadow_rays << " shadow rays in " << stats.render_ms << " ms\n"
+		<< "\tBVH of " << stats.triangles << " triangles in " << stats.bvh_nodes << " nodes, built in " << stats.build_ms << " ms";
+	if (stats.compared)
+		std::cout << "\n\tGL frame against the reference: PSNR " << stats.psnr << " dB, SSIM " << stats.ssim;
+	std::cout << std::endl;
+}
+
+void reference_destroy() {
+	using namespace glob;
+
+	reference_meshes.clear();
+	reference_textures.clear();
+	reference_triangles.clear();
+	reference_scene = RaycastScene();
+}
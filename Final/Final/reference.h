@@ -0,0 +1,81 @@
+#pragma once
+#ifndef __REFERENCE_H__
+#define __REFERENCE_H__
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "lights.h"
+#include "batch.h"
+#include "image.h"
+#include "raycast.h"
+
+const int REFERENCE_TILE_SIZE = 16;			// Pixels per side of the tiles workers claim
+const float REFERENCE_RAY_OFFSET = 1e-3f;	// World units shadow rays start off the surface they leave
+
+/**
+ * Counters for the last reference_render and reference_compare calls.
+ */
+struct reference_statistics {
+	unsigned long long frames;				// since startup
+	int width, height;
+	int samples;							// per pixel side, so samples^2 camera rays per pixel
+	int threads;
+	bool packets;							// camera rays traced RAYCAST_PACKET_SIZE at a time
+	raycast_simd simd;
+	unsigned int triangles;
+	unsigned int bvh_nodes;
+	double build_ms;						// moving the meshes into world space and building the BVH
+	double render_ms;
+	unsigned long long camera_rays;
+	unsigned long long shadow_rays;
+	bool compared;
+	double psnr;							// dB, of the last frame compared against the reference
+	double ssim;
+};
+typedef struct reference_statistics ReferenceStats;
+
+/**
+ * Ground truth renderer for the lit Models, to measure what optimizations of
+ * the GL path cost in image quality. Meshes and textures are read back from
+ * the GPU once; every render then places them with the Models' current
+ * transforms in a BVH (see raycast.h) and traces it on every core:
+ *
+ *	- camera rays through samples^2 stratified positions per pixel, averaged
+ *	- shading as the lit shader (shaders/lit.fs.glsl): Phong for every light
+ *	  in the light buffer and the directional light with the Model's or its
+ *	  Material's shine and specular map, textures sampled bilinearly
+ *	- a shadow ray to every light instead of shadow maps, so shadows are exact
+ *	  and hard
+ *
+ * No material in this project reflects or refracts, so this is Whitted ray
+ * tracing without secondary bounces. Lightmaps and the light's marker are not
+ * drawn; the background is main()'s black clear color.
+ */
+bool reference_init(const std::vector<BatchItem>& items);
+
+/**
+ * Render into image, resized to width x height, on threads workers (every
+ * core if <= 0). Camera rays start on the near plane of projection and end at
+ * its far plane, like the GL frame.
+ */
+void reference_render(Image& image, int width, int height, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos, int samples = 1, int threads = 0, bool packets = true, raycast_simd simd = raycast_best_simd());
+
+/**
+ * PSNR and SSIM of frame against reference, kept for reference_report and
+ * printed.
+ */
+void reference_compare(const Image& reference, const Image& frame);
+
+/**
+ * Render on every instruction set with single rays and with packets, on one
+ * thread and on every core, and print camera rays per second.
+ */
+void reference_benchmark(int width, int height, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos);
+
+ReferenceStats reference_stats();
+
+void reference_report();
+
+void reference_destroy();
+#endif//__REFERENCE_H__
@@ -0,0 +1,287 @@
+#include <GLEW/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "residency.h"
+
+/**
+ * One tracked texture. level_bytes covers the full chain at full resolution;
+ * the first dropped entries are the levels currently evicted, so GL level l
+ * holds full-chain level l + dropped.
+ */
+struct resident_texture {
+	unsigned int handle;
+	unsigned int target;
+	int internal_format;
+	int width, height, layers;
+	std::vector<size_t> level_bytes;
+	int dropped;
+	unsigned long long last_visible;		// frame number of the last residency_touch
+	std::string source;
+	ResidencyRestreamFn restream;
+};
+typedef struct resident_texture ResidentTexture;
+
+namespace glob {
+	std::vector<ResidentTexture> resident_textures;
+	unsigned long long residency_frame = 1;
+	ResidencyStats residency_counters;
+}
+
+static size_t resident_bytes(const ResidentTexture& texture) {
+	size_t bytes = 0;
+	for (size_t level = texture.dropped; level < texture.level_bytes.size(); ++level)
+		bytes += texture.level_bytes[level];
+	return bytes;
+}
+
+static size_t full_bytes(const ResidentTexture& texture) {
+	size_t bytes = 0;
+	for (size_t level_size : texture.level_bytes)
+		bytes += level_size;
+	return bytes;
+}
+
+static size_t total_resident_bytes() {
+	size_t bytes = 0;
+	for (const ResidentTexture& texture : glob::resident_textures)
+		bytes += resident_bytes(texture);
+	return bytes;
+}
+
+void residency_init(size_t budget_bytes) {
+	using namespace glob;
+
+	resident_textures.clear();
+	residency_frame = 1;
+	residency_counters = ResidencyStats();
+	residency_counters.budget_bytes = budget_bytes;
+}
+
+void residency_set_budget(size_t budget_bytes) {
+	glob::residency_counters.budget_bytes = budget_bytes;
+}
+
+void residency_register(unsigned int texture, unsigned int target, const std::string& source, ResidencyRestreamFn restream) {
+	using namespace glob;
+
+	if (target != GL_TEXTURE_2D && target != GL_TEXTURE_2D_ARRAY) {
+		std::cerr << "ERROR::RESIDENCY::REGISTER::UNSUPPORTED_TARGET" << std::endl;
+		return;
+	}
+	residency_unregister(texture);
+
+	ResidentTexture entry;
+	entry.handle = texture;
+	entry.target = target;
+	entry.dropped = 0;
+	entry.last_visible = residency_frame;
+	entry.source = source;
+	entry.restream = restream;
+
+	/**
+	 * Size the chain from level 0; glGenerateMipmap always builds it down to 1x1.
+	 */
+	int red, green, blue, alpha;
+	glBindTexture(target, texture);
+	glGetTexLevelParameteriv(target, 0, GL_TEXTURE_INTERNAL_FORMAT, &entry.internal_format);
+	glGetTexLevelParameteriv(target, 0, GL_TEXTURE_WIDTH, &entry.width);
+	glGetTexLevelParameteriv(target, 0, GL_TEXTURE_HEIGHT, &entry.height);
+	glGetTexLevelParameteriv(target, 0, GL_TEXTURE_DEPTH, &entry.layers);
+	glGetTexLevelParameteriv(target, 0, GL_TEXTURE_RED_SIZE, &red);
+	glGetTexLevelParameteriv(target, 0, GL_TEXTURE_GREEN_SIZE, &green);
+	glGetTexLevelParameteriv(target, 0, GL_TEXTURE_BLUE_SIZE, &blue);
+	glGetTexLevelParameteriv(target, 0, GL_TEXTURE_ALPHA_SIZE, &alpha);
+	if (entry.width == 0 || entry.height == 0) {
+		std::cerr << "ERROR::RESIDENCY::REGISTER::NO_LEVEL_0 " << source << std::endl;
+		return;
+	}
+
+	size_t texel_bytes = (size_t)(red + green + blue + alpha + 7) / 8;
+	for (int width = entry.width, height = entry.height; ; width = std::max(1, width / 2), height = std::max(1, height / 2)) {
+		entry.level_bytes.push_back((size_t)width * height * entry.layers * texel_bytes);
+		if (width == 1 && height == 1)
+			break;
+	}
+
+	resident_textures.push_back(entry);
+}
+
+void residency_unregister(unsigned int texture) {
+	using namespace glob;
+
+	resident_textures.erase(std::remove_if(resident_textures.begin(), resident_textures.end(),
+		[texture](const ResidentTexture& entry) { return entry.handle == texture; }), resident_textures.end());
+}
+
+void residency_touch(unsigned int texture) {
+	using namespace glob;
+
+	for (ResidentTexture& entry : resident_textures) {
+		if (entry.handle == texture) {
+			entry.last_visible = residency_frame;
+			return;
+		}
+	}
+}
+
+/**
+ * Evict the top mip by shifting every remaining level down one slot. The
+ * texture keeps its handle and normalized coordinates, so nothing that
+ * samples it needs to know. Returns false if only one level is left.
+ */
+static bool residency_drop_level(ResidentTexture& texture) {
+	using namespace glob;
+
+	int levels = (int)texture.level_bytes.size() - texture.dropped;
+	if (levels <= 1)
+		return false;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	glBindTexture(texture.target, texture.handle);
+	std::vector<unsigned char> pixels;
+	for (int level = 1; level < levels; ++level) {
+		int width = std::max(1, texture.width >> (texture.dropped + level));
+		int height = std::max(1, texture.height >> (texture.dropped + level));
+		pixels.resize((size_t)width * height * texture.layers * 4);
+
+		glGetTexImage(texture.target, level, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		if (texture.target == GL_TEXTURE_2D_ARRAY)
+			glTexImage3D(texture.target, level - 1, texture.internal_format, width, height, texture.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		else
+			glTexImage2D(texture.target, level - 1, texture.internal_format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	}
+	glTexParameteri(texture.target, GL_TEXTURE_MAX_LEVEL, levels - 2);	// The old 1x1 level is now a duplicate past the end of the chain
+
+	++texture.dropped;
+	++residency_counters.dropped_levels;
+	residency_counters.drop_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
+
+static bool residency_restream(ResidentTexture& texture) {
+	using namespace glob;
+
+	if (texture.restream == nullptr)
+		return false;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	bool ok = texture.restream(texture.handle, texture.source);
+	residency_counters.restream_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	if (!ok) {
+		std::cerr << "ERROR::RESIDENCY::RESTREAM_FAILED " << texture.source << std::endl;
+		return false;
+	}
+
+	glBindTexture(texture.target, texture.handle);
+	glTexParameteri(texture.target, GL_TEXTURE_MAX_LEVEL, 1000);				// GL default
+	texture.dropped = 0;
+	++residency_counters.restreams;
+	return true;
+}
+
+/**
+ * Least recently visible texture that still has a level to drop, skipping
+ * anything seen at or after min_frame. Ties go to the largest texture.
+ */
+static ResidentTexture* residency_victim(unsigned long long min_frame) {
+	ResidentTexture* victim = nullptr;
+	for (ResidentTexture& texture : glob::resident_textures) {
+		if ((int)texture.level_bytes.size() - texture.dropped <= 1 || texture.last_visible >= min_frame)
+			continue;
+		if (victim == nullptr || texture.last_visible < victim->last_visible
+			|| (texture.last_visible == victim->last_visible && resident_bytes(texture) > resident_bytes(*victim)))
+			victim = &texture;
+	}
+	return victim;
+}
+
+void residency_update() {
+	using namespace glob;
+
+	size_t budget = residency_counters.budget_bytes;
+	size_t total = total_resident_bytes();
+
+	/**
+	 * Bring back textures that were visible this frame, making room at the
+	 * expense of textures that were not. Only restream when the whole chain
+	 * fits, otherwise the next pass would evict it again straight away.
+	 */
+	for (ResidentTexture& texture : resident_textures) {
+		if (texture.dropped == 0 || texture.last_visible != residency_frame || texture.restream == nullptr)
+			continue;
+
+		size_t needed = full_bytes(texture) - resident_bytes(texture);
+		while (total + needed > budget) {
+			ResidentTexture* victim = residency_victim(residency_frame);
+			if (victim == nullptr)
+				break;
+			size_t before = resident_bytes(*victim);
+			residency_drop_level(*victim);
+			total -= before - resident_bytes(*victim);
+		}
+		if (total + needed <= budget && residency_restream(texture))
+			total += needed;
+	}
+
+	/**
+	 * Enforce the budget, least recently visible first. Textures visible this
+	 * frame are only touched once nothing else is left to drop.
+	 */
+	while (total > budget) {
+		ResidentTexture* victim = residency_victim(residency_frame);
+		if (victim == nullptr)
+			victim = residency_victim(residency_frame + 1);
+		if (victim == nullptr)
+			break;
+		size_t before = resident_bytes(*victim);
+		residency_drop_level(*victim);
+		total -= before - resident_bytes(*victim);
+	}
+
+	++residency_frame;
+}
+
+ResidencyStats residency_stats() {
+	using namespace glob;
+
+	ResidencyStats stats = residency_counters;
+	stats.resident_bytes = 0;
+	stats.full_bytes = 0;
+	stats.textures = (unsigned int)resident_textures.size();
+	stats.degraded = 0;
+	for (const ResidentTexture& texture : resident_textures) {
+		stats.resident_bytes += resident_bytes(texture);
+		stats.full_bytes += full_bytes(texture);
+		stats.degraded += texture.dropped > 0;
+	}
+	return stats;
+}
+
+void residency_report() {
+	ResidencyStats stats = residency_stats();
+	const double MiB = 1024.0 * 1024.0;
+
+	std::cout << "Texture residency: " << stats.resident_bytes / MiB << " / " << stats.budget_bytes / MiB << " MiB budget ("
+		<< stats.full_bytes / MiB << " MiB at full resolution), "
+		<< stats.degraded << " of " << stats.textures << " textures degraded\n"
+		<< "\t" << stats.dropped_levels << " top mips dropped (" << stats.drop_ms << " ms), "
+		<< stats.restreams << " restreams (" << stats.restream_ms << " ms)" << std::endl;
+
+	for (const ResidentTexture& texture : glob::resident_textures) {
+		std::cout << "\t" << texture.source << ": " << std::max(1, texture.width >> texture.dropped) << "x" << std::max(1, texture.height >> texture.dropped)
+			<< (texture.layers > 1 ? "x" + std::to_string(texture.layers) : "") << ", "
+			<< resident_bytes(texture) / MiB << " MiB";
+		if (texture.dropped > 0)
+			std::cout << " (" << texture.dropped << " top mips dropped)";
+		std::cout << std::endl;
+	}
+}
+
+void residency_destroy() {
+	glob::resident_textures.clear();
+}
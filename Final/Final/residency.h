@@ -0,0 +1,57 @@
+#pragma once
+#ifndef __RESIDENCY_H__
+#define __RESIDENCY_H__
+
+#include <string>
+
+/**
+ * Re-upload texture at full resolution (level 0 plus a full mip chain) from
+ * source, which is whatever string the texture was registered with.
+ */
+typedef bool (*ResidencyRestreamFn)(unsigned int texture, const std::string& source);
+
+/**
+ * Byte counts use the texel size the driver reports for level 0.
+ */
+struct residency_statistics {
+	size_t budget_bytes;
+	size_t resident_bytes;			// bytes of every level currently in VRAM
+	size_t full_bytes;				// bytes if every texture had all of its levels
+	unsigned int textures;
+	unsigned int degraded;			// textures missing at least one top mip
+	unsigned long long dropped_levels;	// top mips evicted since residency_init
+	unsigned long long restreams;		// textures brought back to full resolution
+	double drop_ms;					// time spent reading back and re-specifying smaller chains
+	double restream_ms;				// time spent in restream callbacks
+};
+typedef struct residency_statistics ResidencyStats;
+
+void residency_init(size_t budget_bytes);
+
+void residency_set_budget(size_t budget_bytes);
+
+/**
+ * Start tracking a mip-mapped GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY whose full
+ * chain is currently uploaded. Textures must use mutable storage (glTexImage*),
+ * since dropping a top mip re-specifies every level. restream may be nullptr,
+ * in which case dropped levels are never brought back.
+ */
+void residency_register(unsigned int texture, unsigned int target, const std::string& source, ResidencyRestreamFn restream);
+
+void residency_unregister(unsigned int texture);
+
+void residency_touch(unsigned int texture);	// texture is sampled by a draw that survived culling this frame
+
+/**
+ * Call once per frame after drawing. Re-streams degraded textures seen this
+ * frame when the budget allows (evicting from textures that were not), then
+ * drops top mips of the least recently visible textures until the budget holds.
+ */
+void residency_update();
+
+ResidencyStats residency_stats();
+
+void residency_report();
+
+void residency_destroy();
+#endif//__RESIDENCY_H__
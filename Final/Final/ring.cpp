@@ -0,0 +1,163 @@
+#include <GLEW/glew.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "ring.h"
+
+namespace glob {
+	unsigned int ring_buffer = 0;
+	char* ring_mapping = nullptr;				// Persistent mapping of the whole buffer, or nullptr in fallback mode
+	std::vector<char> ring_staging;				// CPU copy written by subsystems in fallback mode
+
+	GLsync ring_fences[RING_FRAMES] = { 0 };
+	int ring_frame = 0;							// Frame section currently being filled
+	size_t ring_head = 0;						// Bump pointer inside the current section
+
+	RingStats ring_counters;
+}
+
+void ring_init(size_t bytes_per_frame) {
+	using namespace glob;
+
+	ring_counters = RingStats();
+	ring_counters.frame_capacity = bytes_per_frame;
+	ring_counters.persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+
+	size_t total = bytes_per_frame * RING_FRAMES;
+
+	glGenBuffers(1, &ring_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, ring_buffer);
+
+	if (ring_counters.persistent) {
+		/**
+		 * Map once for the lifetime of the buffer. Coherent mapping means
+		 * writes are visible to the GPU without explicit flushes; fences keep
+		 * the CPU from overwriting a section the GPU is still reading.
+		 */
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, total, NULL, flags);
+		ring_mapping = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags);
+		if (ring_mapping == nullptr) {
+			std::cerr << "ERROR::RING::MAP_FAILED" << std::endl;
+			ring_counters.persistent = false;
+			glDeleteBuffers(1, &ring_buffer);
+			glGenBuffers(1, &ring_buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, ring_buffer);
+		}
+	}
+
+	if (!ring_counters.persistent) {
+		glBufferData(GL_ARRAY_BUFFER, total, NULL, GL_STREAM_DRAW);
+		ring_staging.assign(total, 0);
+	}
+
+	ring_frame = 0;
+	ring_head = 0;
+}
+
+void ring_begin_frame() {
+	using namespace glob;
+
+	ring_head = 0;
+
+	GLsync fence = ring_fences[ring_frame];
+	if (fence == 0)
+		return;
+
+	/**
+	 * Poll first so a fence that has already signalled is not counted as a
+	 * stall, then block until the GPU is done with this section.
+	 */
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		auto start = std::chrono::high_resolution_clock::now();
+		do {
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);	// 1 ms per wait
+		} while (status == GL_TIMEOUT_EXPIRED);
+
+		++ring_counters.stalls;
+		ring_counters.stall_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	if (status == GL_WAIT_FAILED)
+		std::cerr << "ERROR::RING::FENCE_WAIT_FAILED" << std::endl;
+
+	glDeleteSync(fence);
+	ring_fences[ring_frame] = 0;
+}
+
+RingAllocation ring_alloc(size_t size, size_t alignment) {
+	using namespace glob;
+
+	RingAllocation allocation;
+
+	size_t aligned = (ring_head + alignment - 1) / alignment * alignment;
+	if (aligned + size > ring_counters.frame_capacity) {
+		++ring_counters.overflows;
+		std::cerr << "ERROR::RING::FRAME_SECTION_FULL" << std::endl;
+		return allocation;
+	}
+
+	size_t offset = ring_frame * ring_counters.frame_capacity + aligned;
+	ring_head = aligned + size;
+	if (ring_head > ring_counters.frame_peak)
+		ring_counters.frame_peak = ring_head;
+
+	allocation.ptr = ring_mapping ? ring_mapping + offset : &ring_staging[offset];
+	allocation.buffer = ring_buffer;
+	allocation.offset = offset;
+	allocation.size = size;
+	return allocation;
+}
+
+void ring_commit(const RingAllocation& allocation) {
+	using namespace glob;
+
+	if (ring_mapping != nullptr || allocation.ptr == nullptr)
+		return;
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ring_buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.offset, allocation.size, allocation.ptr);
+}
+
+void ring_end_frame() {
+	using namespace glob;
+
+	ring_fences[ring_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ring_frame = (ring_frame + 1) % RING_FRAMES;
+	++ring_counters.frames;
+}
+
+RingStats ring_stats() {
+	return glob::ring_counters;
+}
+
+void ring_report() {
+	RingStats stats = ring_stats();
+
+	std::cout << "Frame ring buffer (" << (stats.persistent ? "persistent mapped" : "glBufferSubData fallback") << "): "
+		<< stats.frame_peak << " / " << stats.frame_capacity << " bytes peak per frame, "
+		<< stats.stalls << " stalls in " << stats.frames << " frames ("
+		<< stats.stall_ms << " ms waiting), "
+		<< stats.overflows << " overflows" << std::endl;
+}
+
+void ring_destroy() {
+	using namespace glob;
+
+	for (int i = 0; i < RING_FRAMES; ++i) {
+		if (ring_fences[i] != 0)
+			glDeleteSync(ring_fences[i]);
+		ring_fences[i] = 0;
+	}
+
+	if (ring_mapping != nullptr) {
+		glBindBuffer(GL_ARRAY_BUFFER, ring_buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		ring_mapping = nullptr;
+	}
+	glDeleteBuffers(1, &ring_buffer);
+	ring_buffer = 0;
+	ring_staging.clear();
+}
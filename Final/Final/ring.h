@@ -0,0 +1,53 @@
+#pragma once
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <cstddef>
+
+const int RING_FRAMES = 3;					// Frames that may be in flight at once (triple buffering)
+
+/**
+ * A transient slice of the ring for the current frame. Write through ptr, call
+ * ring_commit, then bind buffer at offset for any target (vertex, uniform,
+ * storage, indirect...). The memory is only valid until the frame's fence
+ * signals, RING_FRAMES frames later.
+ */
+struct ring_allocation {
+	void* ptr = nullptr;
+	unsigned int buffer = 0;
+	size_t offset = 0;
+	size_t size = 0;
+};
+typedef struct ring_allocation RingAllocation;
+
+/**
+ * Counters since ring_init. A stall is a ring_begin_frame call whose fence
+ * had not yet signalled, meaning the CPU got RING_FRAMES ahead of the GPU.
+ */
+struct ring_statistics {
+	bool persistent;				// false when falling back to glBufferSubData
+	size_t frame_capacity;			// bytes per frame section
+	size_t frame_peak;				// most bytes used in one frame
+	unsigned long long frames;
+	unsigned long long stalls;
+	double stall_ms;				// total time spent waiting on fences
+	unsigned long long overflows;	// allocations rejected because the frame section was full
+};
+typedef struct ring_statistics RingStats;
+
+void ring_init(size_t bytes_per_frame);	// Persistent-mapped when GL 4.4 or ARB_buffer_storage is available
+
+void ring_begin_frame();					// Wait for the frame section about to be reused, then reset its bump pointer
+
+RingAllocation ring_alloc(size_t size, size_t alignment = 16);
+
+void ring_commit(const RingAllocation& allocation);	// Upload written data (no-op for coherent persistent mappings)
+
+void ring_end_frame();						// Fence everything submitted from this frame's section
+
+RingStats ring_stats();
+
+void ring_report();
+
+void ring_destroy();
+#endif//__RING_H__
@@ -0,0 +1,241 @@
+#include <GLEW/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "sequence.h"
+
+namespace glob {
+	SequenceStats sequence_counters;
+}
+
+bool sequence_load(const char* path, CameraPath& camera_path) {
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		std::cerr << "ERROR::SEQUENCE::CANNOT_OPEN " << path << std::endl;
+		return false;
+	}
+
+	camera_path = CameraPath();
+	std::string line;
+	for (int number = 1; std::getline(file, line); ++number) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream fields(line);
+		std::string first;
+		if (!(fields >> first))
+			continue;						// blank or comment
+
+		if (first == "fps") {
+			if (!(fields >> camera_path.fps) || camera_path.fps <= 0.f) {
+				std::cerr << "ERROR::SEQUENCE::BAD_FPS " << path << ":" << number << std::endl;
+				return false;
+			}
+			continue;
+		}
+
+		CameraKey key;
+		std::istringstream time(first);
+		if (!(time >> key.time) || !(fields >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch >> key.fov)) {
+			std::cerr << "ERROR::SEQUENCE::BAD_KEY " << path << ":" << number << std::endl;
+			return false;
+		}
+		camera_path.keys.push_back(key);
+	}
+
+	if (camera_path.keys.empty()) {
+		std::cerr << "ERROR::SEQUENCE::NO_KEYS " << path << std::endl;
+		return false;
+	}
+	std::stable_sort(camera_path.keys.begin(), camera_path.keys.end(), [](const CameraKey& a, const CameraKey& b) { return a.time < b.time; });
+	return true;
+}
+
+/**
+ * A key's fields as one vector, so every channel is interpolated alike.
+ */
+static void key_channels(const CameraKey& key, float channels[6]) {
+	channels[0] = key.position.x;
+	channels[1] = key.position.y;
+	channels[2] = key.position.z;
+	channels[3] = key.yaw;
+	channels[4] = key.pitch;
+	channels[5] = key.fov;
+}
+
+/**
+ * Slope of every channel at key i: across its neighbours, or towards the
+ * only neighbour at either end of the path.
+ */
+static void key_tangent(const std::vector<CameraKey>& keys, size_t i, float tangent[6]) {
+	size_t before = i > 0 ? i - 1 : i, after = i + 1 < keys.size() ? i + 1 : i;
+	float span = keys[after].time - keys[before].time;
+	float a[6], b[6];
+	key_channels(keys[before], a);
+	key_channels(keys[after], b);
+	for (int c = 0; c < 6; ++c)
+		tangent[c] = span > 0.f ? (b[c] - a[c]) / span : 0.f;
+}
+
+CameraKey sequence_sample(const CameraPath& camera_path, float time) {
+	const std::vector<CameraKey>& keys = camera_path.keys;
+	if (time <= keys.front().time)
+		return keys.front();
+	if (time >= keys.back().time)
+		return keys.back();
+
+	size_t i = 0;
+	while (keys[i + 1].time < time)
+		++i;
+
+	float span = keys[i + 1].time - keys[i].time;
+	float t = span > 0.f ? (time - keys[i].time) / span : 0.f;
+	float t2 = t * t, t3 = t2 * t;
+	float h00 = 2.f * t3 - 3.f * t2 + 1.f, h10 = t3 - 2.f * t2 + t, h01 = -2.f * t3 + 3.f * t2, h11 = t3 - t2;
+
+	float p0[6], p1[6], m0[6], m1[6], out[6];
+	key_channels(keys[i], p0);
+	key_channels(keys[i + 1], p1);
+	key_tangent(keys, i, m0);
+	key_tangent(keys, i + 1, m1);
+	for (int c = 0; c < 6; ++c)
+		out[c] = h00 * p0[c] + h10 * span * m0[c] + h01 * p1[c] + h11 * span * m1[c];
+
+	CameraKey key;
+	key.time = time;
+	key.position = glm::vec3(out[0], out[1], out[2]);
+	key.yaw = out[3];
+	key.pitch = glm::clamp(out[4], -89.f, 89.f);	// as the mouse limits it
+	key.fov = glm::clamp(out[5], 1.f, 179.f);
+	return key;
+}
+
+/**
+ * The part of projection that covers tile_width x tile_height pixels at
+ * (x, y) of a width x height frame, stretched over the whole clip space.
+ */
+static glm::mat4 crop_projection(glm::mat4 projection, int width, int height, int x, int y, int tile_width, int tile_height) {
+	glm::vec2 scale = glm::vec2((float)width / tile_width, (float)height / tile_height);
+	glm::vec2 center = glm::vec2((2.f * x + tile_width) / width - 1.f, (2.f * y + tile_height) / height - 1.f);
+	glm::mat4 crop = glm::mat4(1.f);
+	crop[0][0] = scale.x;
+	crop[1][1] = scale.y;
+	crop[3][0] = -center.x * scale.x;
+	crop[3][1] = -center.y * scale.y;
+	return crop * projection;
+}
+
+bool sequence_render(const CameraPath& camera_path, const SequenceSettings& settings, const SequenceDraw& draw) {
+	using namespace glob;
+
+	if (camera_path.keys.empty() || settings.width <= 0 || settings.height <= 0)
+		return false;
+
+	/**
+	 * Tiles are as large as the renderbuffers, the viewport and (for the
+	 * G-buffer) textures may be. Every tile is drawn at full tile size, also
+	 * where it overhangs the frame, so nothing is reallocated between tiles;
+	 * only the part inside the frame is read back.
+	 */
+	GLint max_renderbuffer = 0, max_texture = 0, max_viewport[2] = { 0, 0 };
+	glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_renderbuffer);
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture);
+	glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport);
+	int limit = std::min(max_renderbuffer, std::min(max_texture, std::min(max_viewport[0], max_viewport[1])));
+	if (settings.tile_size > 0)
+		limit = std::min(limit, settings.tile_size);
+	int tile_width = std::min(settings.width, limit), tile_height = std::min(settings.height, limit);
+	int tiles_x = (settings.width + tile_width - 1) / tile_width, tiles_y = (settings.height + tile_height - 1) / tile_height;
+
+	if (!capture_init(settings.directory, settings.format, settings.encoders))
+		return false;
+
+	unsigned int fbo = 0, renderbuffers[2] = { 0, 0 };
+	glGenFramebuffers(1, &fbo);
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, tile_width, tile_height);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, tile_width, tile_height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	SequenceStats& stats = sequence_counters;
+	stats = SequenceStats();
+	stats.width = settings.width;
+	stats.height = settings.height;
+	stats.tile_width = tile_width;
+	stats.tile_height = tile_height;
+	stats.tiles_x = tiles_x;
+	stats.tiles_y = tiles_y;
+
+	float duration = camera_path.keys.back().time - camera_path.keys.front().time;
+	unsigned int frames = (unsigned int)std::floor(duration * camera_path.fps + 1e-3f) + 1;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int frame = 0; complete && frame < frames; ++frame) {
+		CameraKey camera = sequence_sample(camera_path, camera_path.keys.front().time + frame / camera_path.fps);
+		glm::vec3 front = glm::normalize(glm::vec3(cos(glm::radians(camera.yaw)) * cos(glm::radians(camera.pitch)), sin(glm::radians(camera.pitch)),
+			sin(glm::radians(camera.yaw)) * cos(glm::radians(camera.pitch))));
+		glm::mat4 projection = glm::perspective(glm::radians(camera.fov), (float)settings.width / (float)settings.height, 0.1f, 100.f);
+		glm::mat4 view = glm::lookAt(camera.position, camera.position + front, glm::vec3(0.f, 1.f, 0.f));
+
+		capture_begin_frame(settings.width, settings.height);
+		for (int tile_y = 0; tile_y < tiles_y; ++tile_y) {
+			for (int tile_x = 0; tile_x < tiles_x; ++tile_x) {
+				int x = tile_x * tile_width, y = tile_y * tile_height;
+				glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+				glViewport(0, 0, tile_width, tile_height);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				draw(camera, projection, crop_projection(projection, settings.width, settings.height, x, y, tile_width, tile_height), view, tile_width, tile_height);
+
+				glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+				capture_tile(x, y, std::min(tile_width, settings.width - x), std::min(tile_height, settings.height - y));
+			}
+		}
+		capture_end_frame();
+		++stats.frames;
+	}
+	auto drawn = std::chrono::high_resolution_clock::now();
+	capture_flush();
+	auto end = std::chrono::high_resolution_clock::now();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteRenderbuffers(2, renderbuffers);
+	if (!complete) {
+		std::cerr << "ERROR::SEQUENCE::FRAMEBUFFER::INCOMPLETE " << tile_width << "x" << tile_height << std::endl;
+		return false;
+	}
+
+	stats.draw_ms = std::chrono::duration<double, std::milli>(drawn - start).count();
+	stats.drain_ms = std::chrono::duration<double, std::milli>(end - drawn).count();
+	stats.total_ms = std::chrono::duration<double, std::milli>(end - start).count();
+	stats.fps = stats.total_ms > 0.0 ? stats.frames / (stats.total_ms / 1000.0) : 0.0;
+	return capture_stats().failures == 0;
+}
+
+SequenceStats sequence_stats() {
+	return glob::sequence_counters;
+}
+
+void sequence_report() {
+	SequenceStats stats = sequence_stats();
+	if (stats.frames == 0)
+		return;
+
+	std::cout << "Camera path: " << stats.frames << " frames of " << stats.width << "x" << stats.height << " in " << stats.tiles_x << "x" << stats.tiles_y
+		<< " tiles of " << stats.tile_width << "x" << stats.tile_height << ", " << stats.total_ms / 1000.0 << " s, " << stats.fps << " frames per second\n"
+		<< "\t" << stats.draw_ms / stats.frames << " ms drawing per frame, " << stats.drain_ms << " ms writing the last frames after the final draw" << std::endl;
+}
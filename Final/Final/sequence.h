@@ -0,0 +1,90 @@
+#pragma once
+#ifndef __SEQUENCE_H__
+#define __SEQUENCE_H__
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "capture.h"
+
+const float SEQUENCE_DEFAULT_FPS = 30.f;	// Frame rate of paths without an "fps" line
+
+/**
+ * Camera state at one moment of a path, in the terms main()'s camera uses.
+ */
+struct camera_key {
+	float time;								// seconds from the start of the path
+	glm::vec3 position;
+	float yaw;								// degrees, not wrapped, so a turntable can run from 0 to 360
+	float pitch;
+	float fov;
+};
+typedef struct camera_key CameraKey;
+
+struct camera_path {
+	std::vector<CameraKey> keys;			// by time
+	float fps = SEQUENCE_DEFAULT_FPS;
+};
+typedef struct camera_path CameraPath;
+
+struct sequence_settings {
+	int width = 1920;
+	int height = 1080;
+	int tile_size = 0;						// largest tile side drawn at once, 0 for the largest the context allows
+	capture_format format = CAPTURE_FORMAT_PNG;
+	std::string directory = "sequence";
+	int encoders = 0;						// see capture_init
+};
+typedef struct sequence_settings SequenceSettings;
+
+/**
+ * Draws one tile of a frame into the bound framebuffer, which is cleared and
+ * has its viewport set to width x height. projection is the whole frame's,
+ * tile_projection the part of it the tile covers.
+ */
+typedef std::function<void(const CameraKey& camera, glm::mat4 projection, glm::mat4 tile_projection, glm::mat4 view, int width, int height)> SequenceDraw;
+
+/**
+ * Counters for the last sequence_render call.
+ */
+struct sequence_statistics {
+	unsigned int frames;
+	int width, height;
+	int tile_width, tile_height;
+	int tiles_x, tiles_y;
+	double draw_ms;							// render thread time drawing and issuing readbacks
+	double drain_ms;						// waiting for the last frames to be read back and written
+	double total_ms;
+	double fps;								// frames written per second, start to finish
+};
+typedef struct sequence_statistics SequenceStats;
+
+/**
+ * Read a path file: one key per line as "time x y z yaw pitch fov", an
+ * optional "fps N" line, and '#' comments. Keys are sorted by time.
+ */
+bool sequence_load(const char* path, CameraPath& camera_path);
+
+/**
+ * Camera at time, Hermite interpolated between the keys around it with
+ * tangents from their neighbours (Catmull-Rom for evenly spaced keys), so
+ * the camera moves smoothly through every key. Clamped outside the path.
+ */
+CameraKey sequence_sample(const CameraPath& camera_path, float time);
+
+/**
+ * Render the path at its frame rate into settings.directory, offscreen at
+ * settings.width x settings.height. Frames larger than the context's
+ * framebuffers are drawn in tiles with cropped projections and stitched
+ * together on readback. Nothing waits on the display: the render thread
+ * draws frame N while the readback of the frames before it completes in
+ * pixel buffers and encoder threads write older ones (see capture.h).
+ */
+bool sequence_render(const CameraPath& camera_path, const SequenceSettings& settings, const SequenceDraw& draw);
+
+SequenceStats sequence_stats();
+
+void sequence_report();
+#endif//__SEQUENCE_H__
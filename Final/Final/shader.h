@@ -8,98 +8,234 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// counters for every Shader built since startup, see Shader::reportCache()
+struct shader_cache_statistics {
+	unsigned int programs = 0;
+	unsigned int cacheHits = 0;
+	unsigned int cacheMisses = 0;			// compiled from source (cache empty, stale or rejected by the driver)
+	unsigned int cacheRejected = 0;			// binaries the driver refused
+	double ms = 0.0;						// main thread time spent submitting and finalizing programs
+	double waitMs = 0.0;					// part of ms spent in finishParallelCompile() waiting on the driver
+	double overlapMs = 0.0;					// other startup work done while programs were compiling
+	bool parallelStatus = false;			// driver reports GL_COMPLETION_STATUS_KHR
+};
+typedef struct shader_cache_statistics ShaderCacheStats;
 
 class Shader
 {
 public:
 	unsigned int ID;
-	// constructor generates the shader on the fly
+	double buildMs = 0.0;					// main thread time spent submitting and finalizing this program
+	// constructor generates the shader on the fly, or loads the program
+	// binary cached by an earlier launch. Between beginParallelCompile() and
+	// finishParallelCompile() it only submits the work and returns, so the
+	// driver can compile while the caller does something else. defines
+	// (e.g. "#define SPECULAR_MAP\n") are inserted after every stage's #version line
 	// ------------------------------------------------------------------------
-	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "")
 	{
+		auto start = std::chrono::high_resolution_clock::now();
 		// 1. retrieve the vertex/fragment source code from filePath
-		std::string vertexCode;
-		std::string fragmentCode;
-		std::string geometryCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		std::ifstream gShaderFile;
-		// ensure ifstream objects can throw exceptions:
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try
+		this->vertexPath = vertexPath;
+		this->fragmentPath = fragmentPath;
+		this->geometryPath = geometryPath != nullptr ? geometryPath : "";
+		this->defines = defines;
+		hasGeometry = geometryPath != nullptr;
+		build(start);
+	}
+	// compute-only program, e.g. Shader(Shader::COMPUTE, "shaders/clusters.cs.glsl").
+	// The compute stage takes the vertex stage's place everywhere below
+	// ------------------------------------------------------------------------
+	enum ComputeTag { COMPUTE };
+	Shader(ComputeTag, const char* computePath, const std::string& defines = "")
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		this->vertexPath = computePath;
+		this->defines = defines;
+		isCompute = true;
+		build(start);
+	}
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+	~Shader()
+	{
+		std::vector<Shader*>& queue = pending();
+		queue.erase(std::remove(queue.begin(), queue.end(), this), queue.end());
+		std::vector<Shader*>& live = instances();
+		live.erase(std::remove(live.begin(), live.end(), this), live.end());
+		cancelReload();
+	}
+	// true once the driver has finished compiling and linking, so finalize()
+	// will not block. Without KHR/ARB_parallel_shader_compile there is no way
+	// to ask, so this is always true
+	// ------------------------------------------------------------------------
+	bool isReady() const
+	{
+		if (finalized || !parallelStatusSupported())
+			return true;
+		GLint done = GL_FALSE;
+		glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+		return done == GL_TRUE;
+	}
+	// 4. check the results, falling back to source if the cached binary was
+	// rejected, and store the binary for the next launch
+	// ------------------------------------------------------------------------
+	void finalize()
+	{
+		if (finalized)
+			return;
+		auto start = std::chrono::high_resolution_clock::now();
+		if (fromBinary)
 		{
-			// open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
-			// if geometry shader path is present, also load a geometry shader
-			if (geometryPath != nullptr)
+			GLint success = 0;
+			glGetProgramiv(ID, GL_LINK_STATUS, &success);
+			if (success)
+				cacheStats().cacheHits++;
+			else
 			{
-				gShaderFile.open(geometryPath);
-				std::stringstream gShaderStream;
-				gShaderStream << gShaderFile.rdbuf();
-				gShaderFile.close();
-				geometryCode = gShaderStream.str();
+				// e.g. the driver was updated without changing its version string
+				glDeleteProgram(ID);
+				cacheStats().cacheRejected++;
+				fromBinary = false;
+				ID = submitCompile(vertex, fragment, geometry);
 			}
 		}
-		catch (std::ifstream::failure& e)
+		if (!fromBinary)
 		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			cacheStats().cacheMisses++;
+			checkCompileErrors(vertex, isCompute ? "COMPUTE" : "VERTEX");
+			if (!isCompute)
+				checkCompileErrors(fragment, "FRAGMENT");
+			if (hasGeometry)
+				checkCompileErrors(geometry, "GEOMETRY");
+			checkCompileErrors(ID, "PROGRAM");
+			saveBinary(ID, cachePath);
+			// delete the shaders as they're linked into our program now and no longer necessery
+			glDeleteShader(vertex);
+			if (!isCompute)
+				glDeleteShader(fragment);
+			if (hasGeometry)
+				glDeleteShader(geometry);
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
-		// 2. compile shaders
-		unsigned int vertex, fragment;
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-		// if geometry shader is given, compile geometry shader
-		unsigned int geometry;
-		if (geometryPath != nullptr)
+		releaseSources();
+		finalized = true;
+		cacheStats().programs++;
+		addTiming(start);
+	}
+	bool fromBinaryCache() const
+	{
+		return finalized && fromBinary;
+	}
+	bool computeOnly() const
+	{
+		return isCompute;
+	}
+
+	// hot reload: recompile from the files on disk into a second program while
+	// ID keeps drawing. pollReload() swaps ID only once the new program has
+	// linked; on any error the current program stays in use
+	// ------------------------------------------------------------------------
+	enum ReloadStatus { RELOAD_IDLE, RELOAD_COMPILING, RELOAD_SWAPPED, RELOAD_FAILED };
+	bool usesFile(const std::string& path) const
+	{
+		return path == vertexPath || path == fragmentPath || (hasGeometry && path == geometryPath);
+	}
+	const std::string& vertexSource() const
+	{
+		return vertexPath;
+	}
+	const std::string& fragmentSource() const
+	{
+		return fragmentPath;
+	}
+	const std::string& geometrySource() const
+	{
+		return geometryPath;
+	}
+	const std::string& sourceDefines() const
+	{
+		return defines;
+	}
+	bool reload()
+	{
+		cancelReload();
+		if (!readSources())
 		{
-			const char* gShaderCode = geometryCode.c_str();
-			geometry = glCreateShader(GL_GEOMETRY_SHADER);
-			glShaderSource(geometry, 1, &gShaderCode, NULL);
-			glCompileShader(geometry);
-			checkCompileErrors(geometry, "GEOMETRY");
+			releaseSources();
+			return false;
 		}
-		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		if (geometryPath != nullptr)
-			glAttachShader(ID, geometry);
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
-		// delete the shaders as they're linked into our program now and no longer necessery
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-		if (geometryPath != nullptr)
-			glDeleteShader(geometry);
-
+		reloadProgram = submitCompile(reloadVertex, reloadFragment, reloadGeometry);
+		return true;
+	}
+	// never blocks while the driver reports GL_COMPLETION_STATUS_KHR; without
+	// it the first poll waits for the compile like finalize() does
+	ReloadStatus pollReload()
+	{
+		if (reloadProgram == 0)
+			return RELOAD_IDLE;
+		if (parallelStatusSupported())
+		{
+			GLint done = GL_FALSE;
+			glGetProgramiv(reloadProgram, GL_COMPLETION_STATUS_KHR, &done);
+			if (done != GL_TRUE)
+				return RELOAD_COMPILING;
+		}
+		bool success = checkCompileErrors(reloadVertex, isCompute ? "COMPUTE" : "VERTEX");
+		if (!isCompute)
+			success &= checkCompileErrors(reloadFragment, "FRAGMENT");
+		if (hasGeometry)
+			success &= checkCompileErrors(reloadGeometry, "GEOMETRY");
+		success &= checkCompileErrors(reloadProgram, "PROGRAM");
+		if (success)
+		{
+			saveBinary(reloadProgram, binaryCachePath(vertexCode + '\0' + fragmentCode + '\0' + geometryCode));
+			glDeleteProgram(ID);
+			ID = reloadProgram;
+			reloadProgram = 0;
+		}
+		cancelReload();
+		releaseSources();
+		return success ? RELOAD_SWAPPED : RELOAD_FAILED;
+	}
+	// drop an in-flight reload (and the stages of a finished one)
+	void cancelReload()
+	{
+		if (reloadProgram != 0)
+			glDeleteProgram(reloadProgram);
+		if (reloadVertex != 0)
+			glDeleteShader(reloadVertex);
+		if (reloadFragment != 0)
+			glDeleteShader(reloadFragment);
+		if (reloadGeometry != 0)
+			glDeleteShader(reloadGeometry);
+		reloadProgram = reloadVertex = reloadFragment = reloadGeometry = 0;
+	}
+	// every Shader alive, e.g. to find those built from a changed file
+	static std::vector<Shader*>& instances()
+	{
+		static std::vector<Shader*> shaders;
+		return shaders;
 	}
 	// activate the shader
 	// ------------------------------------------------------------------------
 	void use()
 	{
+		if (!finalized)
+			finalize();
 		glUseProgram(ID);
 	}
 	// utility uniform functions
@@ -114,6 +250,11 @@ public:
 		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
 	}
 	// ------------------------------------------------------------------------
+	void setIntArray(const std::string& name, const int* values, int count) const
+	{
+		glUniform1iv(glGetUniformLocation(ID, name.c_str()), count, values);
+	}
+	// ------------------------------------------------------------------------
 	void setFloat(const std::string& name, float value) const
 	{
 		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
@@ -161,10 +302,329 @@ public:
 		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
 	}
 
+	// program binary cache
+	// ------------------------------------------------------------------------
+	static bool& binaryCacheEnabled()
+	{
+		static bool enabled = true;
+		return enabled;
+	}
+	static ShaderCacheStats& cacheStats()
+	{
+		static ShaderCacheStats stats;
+		return stats;
+	}
+	static void reportCache()
+	{
+		const ShaderCacheStats& stats = cacheStats();
+		std::cout << "Shader programs: " << stats.programs << " built in " << stats.ms << " ms ("
+			<< stats.cacheHits << " from the binary cache, " << stats.cacheMisses << " compiled";
+		if (stats.cacheRejected > 0)
+			std::cout << ", " << stats.cacheRejected << " cached binaries rejected";
+		if (!binaryCacheSupported())
+			std::cout << ", binary cache disabled or unsupported";
+		std::cout << ")" << std::endl;
+		if (stats.overlapMs > 0.0)
+			std::cout << "\tcompiled in parallel with " << stats.overlapMs << " ms of other startup work, then waited "
+				<< stats.waitMs << " ms for the rest (" << (stats.parallelStatus ? "polled with GL_COMPLETION_STATUS_KHR" : "no parallel compile extension, blocking on each program") << ")" << std::endl;
+	}
+
+	// parallel compilation: every Shader constructed after beginParallelCompile()
+	// is only submitted; finishParallelCompile() finalizes them all, in the
+	// order the driver completes them where it can tell us
+	// ------------------------------------------------------------------------
+	static void beginParallelCompile()
+	{
+		if (GLEW_KHR_parallel_shader_compile)
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);		// let the driver pick
+		else if (GLEW_ARB_parallel_shader_compile)
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		cacheStats().parallelStatus = parallelStatusSupported();
+		deferring() = true;
+		parallelStart() = std::chrono::high_resolution_clock::now();
+	}
+	static void finishParallelCompile()
+	{
+		if (!deferring())
+			return;
+		auto start = std::chrono::high_resolution_clock::now();
+		cacheStats().overlapMs += std::chrono::duration<double, std::milli>(start - parallelStart()).count();
+		deferring() = false;
+
+		double finalizeMs = cacheStats().ms;
+		std::vector<Shader*> queue;
+		queue.swap(pending());
+		while (!queue.empty())
+		{
+			bool progressed = false;
+			for (Shader* shader : queue)
+			{
+				if (shader->isReady())
+				{
+					shader->finalize();
+					progressed = true;
+				}
+			}
+			queue.erase(std::remove_if(queue.begin(), queue.end(), [](const Shader* shader) { return shader->finalized; }), queue.end());
+			if (!progressed)
+				std::this_thread::yield();
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		cacheStats().waitMs += ms;
+		cacheStats().ms += ms - (cacheStats().ms - finalizeMs);	// finalize() already counted its own time
+	}
+
 private:
+	std::string vertexPath;
+	std::string fragmentPath;
+	std::string geometryPath;
+	std::string defines;
+	std::string vertexCode;
+	std::string fragmentCode;
+	std::string geometryCode;
+	std::string cachePath;
+	unsigned int vertex = 0, fragment = 0, geometry = 0;
+	unsigned int reloadProgram = 0;
+	unsigned int reloadVertex = 0, reloadFragment = 0, reloadGeometry = 0;
+	bool hasGeometry = false;
+	bool isCompute = false;
+	bool fromBinary = false;
+	bool finalized = false;
+
+	// 1. read the sources, then 2./3. below; shared by both constructors
+	void build(std::chrono::high_resolution_clock::time_point start)
+	{
+		readSources();
+		// 2. reuse the linked program from an earlier launch if the driver accepts it,
+		// 3. otherwise compile. Neither step queries a status, which would block
+		cachePath = binaryCachePath(vertexCode + '\0' + fragmentCode + '\0' + geometryCode);
+		fromBinary = submitBinary(cachePath);
+		if (!fromBinary)
+			ID = submitCompile(vertex, fragment, geometry);
+		addTiming(start);
+
+		instances().push_back(this);
+		if (deferring())
+			pending().push_back(this);
+		else
+			finalize();
+	}
+	static bool& deferring()
+	{
+		static bool deferred = false;
+		return deferred;
+	}
+	static std::vector<Shader*>& pending()
+	{
+		static std::vector<Shader*> shaders;
+		return shaders;
+	}
+	static std::chrono::high_resolution_clock::time_point& parallelStart()
+	{
+		static std::chrono::high_resolution_clock::time_point start;
+		return start;
+	}
+	static bool parallelStatusSupported()
+	{
+		return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+	}
+	bool readSources()
+	{
+		std::ifstream vShaderFile;
+		std::ifstream fShaderFile;
+		std::ifstream gShaderFile;
+		// ensure ifstream objects can throw exceptions:
+		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		try
+		{
+			// open files
+			vShaderFile.open(vertexPath);
+			std::stringstream vShaderStream, fShaderStream;
+			// read file's buffer contents into streams
+			vShaderStream << vShaderFile.rdbuf();
+			// close file handlers
+			vShaderFile.close();
+			// convert stream into string
+			vertexCode = vShaderStream.str();
+			// a compute program has no fragment stage
+			if (!isCompute)
+			{
+				fShaderFile.open(fragmentPath);
+				fShaderStream << fShaderFile.rdbuf();
+				fShaderFile.close();
+				fragmentCode = fShaderStream.str();
+			}
+			// if geometry shader path is present, also load a geometry shader
+			if (hasGeometry)
+			{
+				gShaderFile.open(geometryPath);
+				std::stringstream gShaderStream;
+				gShaderStream << gShaderFile.rdbuf();
+				gShaderFile.close();
+				geometryCode = gShaderStream.str();
+			}
+		}
+		catch (std::ifstream::failure& e)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			return false;
+		}
+		if (!defines.empty())
+		{
+			insertDefines(vertexCode, defines);
+			if (!isCompute)
+				insertDefines(fragmentCode, defines);
+			if (hasGeometry)
+				insertDefines(geometryCode, defines);
+		}
+		return true;
+	}
+	// the sources are only needed until the program is known to be good
+	void releaseSources()
+	{
+		vertexCode.clear();
+		vertexCode.shrink_to_fit();
+		fragmentCode.clear();
+		fragmentCode.shrink_to_fit();
+		geometryCode.clear();
+		geometryCode.shrink_to_fit();
+	}
+	// #line keeps compiler messages pointing at the lines of the file on disk
+	// ------------------------------------------------------------------------
+	static void insertDefines(std::string& code, const std::string& defines)
+	{
+		if (code.compare(0, 8, "#version") != 0)
+		{
+			code = defines + "#line 1\n" + code;
+			return;
+		}
+		size_t end = code.find('\n');
+		if (end == std::string::npos)
+			end = code.size() - 1;
+		code.insert(end + 1, defines + "#line 2\n");
+	}
+	// the cache needs GL 4.1 / ARB_get_program_binary and at least one binary format
+	// ------------------------------------------------------------------------
+	static bool binaryCacheSupported()
+	{
+		if (!binaryCacheEnabled() || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+			return false;
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+	// cache file named by a 64-bit FNV-1a hash of the sources and the driver
+	// strings, so a new driver or any source edit misses the cache
+	// ------------------------------------------------------------------------
+	static std::string binaryCachePath(const std::string& sources)
+	{
+		std::string key = sources;
+		const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		for (GLenum name : strings)
+		{
+			const char* value = (const char*)glGetString(name);
+			key += '\0';
+			key += value ? value : "";
+		}
+		unsigned long long hash = 14695981039346656037ull;
+		for (unsigned char c : key)
+		{
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+		char name[64];
+		snprintf(name, sizeof(name), "shaders/cache/%016llx.bin", hash);
+		return name;
+	}
+	bool submitBinary(const std::string& path)
+	{
+		if (!binaryCacheSupported())
+			return false;
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+			return false;
+		GLenum format = 0;
+		std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (binary.size() <= sizeof(format))
+			return false;
+		memcpy(&format, binary.data(), sizeof(format));
+
+		ID = glCreateProgram();
+		glProgramBinary(ID, format, binary.data() + sizeof(format), (GLsizei)(binary.size() - sizeof(format)));
+		return true;
+	}
+	unsigned int submitCompile(unsigned int& vertex, unsigned int& fragment, unsigned int& geometry)
+	{
+		const char* vShaderCode = vertexCode.c_str();
+		const char* fShaderCode = fragmentCode.c_str();
+		// vertex (or compute) shader
+		vertex = glCreateShader(isCompute ? GL_COMPUTE_SHADER : GL_VERTEX_SHADER);
+		glShaderSource(vertex, 1, &vShaderCode, NULL);
+		glCompileShader(vertex);
+		// fragment Shader
+		if (!isCompute)
+		{
+			fragment = glCreateShader(GL_FRAGMENT_SHADER);
+			glShaderSource(fragment, 1, &fShaderCode, NULL);
+			glCompileShader(fragment);
+		}
+		// if geometry shader is given, compile geometry shader
+		if (hasGeometry)
+		{
+			const char* gShaderCode = geometryCode.c_str();
+			geometry = glCreateShader(GL_GEOMETRY_SHADER);
+			glShaderSource(geometry, 1, &gShaderCode, NULL);
+			glCompileShader(geometry);
+		}
+		// shader Program
+		unsigned int program = glCreateProgram();
+		glAttachShader(program, vertex);
+		if (!isCompute)
+			glAttachShader(program, fragment);
+		if (hasGeometry)
+			glAttachShader(program, geometry);
+		if (binaryCacheSupported())
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(program);
+		return program;
+	}
+	static void saveBinary(unsigned int program, const std::string& path)
+	{
+		GLint success = 0, length = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success || !binaryCacheSupported())
+			return;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+		GLenum format = 0;
+		std::vector<char> binary(sizeof(format) + length);
+		glGetProgramBinary(program, length, NULL, &format, binary.data() + sizeof(format));
+		memcpy(binary.data(), &format, sizeof(format));
+
+#ifdef _WIN32
+		_mkdir("shaders/cache");
+#else
+		mkdir("shaders/cache", 0755);
+#endif
+		std::ofstream file(path, std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cout << "ERROR::SHADER::CACHE_NOT_WRITABLE " << path << std::endl;
+			return;
+		}
+		file.write(binary.data(), binary.size());
+	}
+	void addTiming(std::chrono::high_resolution_clock::time_point start)
+	{
+		buildMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		cacheStats().ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
-	void checkCompileErrors(GLuint shader, std::string type)
+	bool checkCompileErrors(GLuint shader, std::string type)
 	{
 		GLint success;
 		GLchar infoLog[1024];
@@ -186,6 +646,7 @@ private:
 				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
 			}
 		}
+		return success != 0;
 	}
 };
 #endif
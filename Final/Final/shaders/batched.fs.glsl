@@ -0,0 +1,195 @@
+#version 430 core
+in vec2 TexCoord;
+in vec3 FragPos;
+in vec3 Normal;
+flat in int DrawID;
+out vec4 FragColor;
+
+struct DrawData {
+	mat4 model;
+	mat4 normalModel;
+	vec4 diffuseRegion;
+	vec4 specularRegion;
+	int diffuseLayer;
+	int specularLayer;
+	float specularStrength;
+	int lightList;
+};
+layout (std430, binding = 0) readonly buffer DrawBuffer {
+	DrawData draws[];
+};
+
+#ifdef LIGHT_CLUSTERS
+// each fragment shades the lights listed for its cluster (see clusters.h)
+uniform usamplerBuffer clusterGrid;													// First index and light count per cluster
+uniform usamplerBuffer clusterLights;												// Indices into lights
+uniform mat4 view;
+uniform vec2 clusterTileSize;														// Pixels per cluster column and row
+uniform vec2 clusterDepth;															// Slice = log(view depth) * x + y
+#else
+// per draw: a light count followed by that many indices into lights
+layout (std430, binding = 1) readonly buffer LightListBuffer {
+	int lightLists[];
+};
+#endif
+
+uniform float ambientStrength;
+
+struct DirectionalLight {
+	vec3 direction;
+	vec3 color;
+};
+uniform DirectionalLight dirLight;
+
+uniform samplerBuffer lights;														// Four SoA blocks of lightStride texels (see lightbuffer.h)
+uniform int lightStride;
+
+uniform vec3 viewPos;
+uniform sampler2DArray atlas;														// Diffuse and specular maps of every draw (see atlas.h)
+
+#ifdef SHADOWS
+// shadow maps of the directional and point light (see shadows.h)
+uniform sampler2DArrayShadow cascadeShadowMap;
+uniform mat4 cascadeMatrices[SHADOW_CASCADES];				// world to shadow map texture space, per cascade
+uniform float cascadeTexelSize[SHADOW_CASCADES];			// world units per texel, per cascade
+uniform samplerCubeShadow pointShadowMap;					// distance to the light over pointShadowFar
+uniform int pointShadowLight;								// light buffer index casting into the cube, -1 for none
+uniform float pointShadowFar;
+
+// share of the directional light reaching FragPos, 3x3 PCF in the first cascade holding it
+float CascadeShadow(vec3 norm) {
+	for (int i = 0; i < SHADOW_CASCADES; ++i) {
+		vec4 coord = cascadeMatrices[i] * vec4(FragPos + norm * cascadeTexelSize[i] * 1.5, 1.0);	// normal offset against acne
+		if (any(lessThan(coord.xyz, vec3(0.0))) || any(greaterThan(coord.xyz, vec3(1.0))))
+			continue;
+
+		float texel = 1.0 / float(textureSize(cascadeShadowMap, 0).x);
+		float lit = 0.0;
+		for (int x = -1; x <= 1; ++x)
+			for (int y = -1; y <= 1; ++y)
+				lit += texture(cascadeShadowMap, vec4(coord.xy + vec2(x, y) * texel, float(i), coord.z));
+		return lit / 9.0;
+	}
+	return 1.0;														// past the last cascade
+}
+
+// share of the cube's light reaching FragPos
+float PointShadow(vec3 lightPos, vec3 norm) {
+	vec3 offset = FragPos + norm * 0.01 - lightPos;
+	float lightDistance = length(offset);
+	if (lightDistance >= pointShadowFar)
+		return 1.0;
+	return texture(pointShadowMap, vec4(offset, (lightDistance - 0.02) / pointShadowFar));
+}
+#endif
+
+vec3 CalcListedLight(int index, vec3 specularFactor) {
+	vec4 positionRange = texelFetch(lights, index);
+	vec4 colorType = texelFetch(lights, index + lightStride);
+	vec4 attenuationInner = texelFetch(lights, index + 3 * lightStride);
+
+	// calculate attenuation coefficient based on distance from light
+	float lightDistance = length(positionRange.xyz - FragPos);
+	if (lightDistance > positionRange.w)
+		return vec3(0.0);
+	float attenuation = 1.0 / (attenuationInner.x + attenuationInner.y * lightDistance + attenuationInner.z * (lightDistance * lightDistance));
+	vec3 lightDir = normalize(positionRange.xyz - FragPos);
+
+	// calculate ambient lighting
+	vec3 ambient = colorType.rgb * ambientStrength * attenuation;
+
+	// spot lights fade out between the inner and outer cone
+	if (colorType.w > 0.5) {
+		vec4 directionOuter = texelFetch(lights, index + 2 * lightStride);
+		float theta = dot(-lightDir, directionOuter.xyz);
+		attenuation *= clamp((theta - directionOuter.w) / max(attenuationInner.w - directionOuter.w, 1e-4), 0.0, 1.0);
+	}
+
+	// calculate diffuse lighting
+	vec3 norm = normalize(Normal);
+	float diff = max(dot(norm, lightDir), 0.0);
+	vec3 diffuse = diff * colorType.rgb;
+
+	// calculate specular lighting
+	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 reflectDir = reflect(-lightDir, norm);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+
+	vec3 specular = spec * colorType.rgb * specularFactor;
+
+	// adjust for attenuation
+	diffuse *= attenuation;
+	specular *= attenuation;
+#ifdef SHADOWS
+	if (index == pointShadowLight) {
+		float shadow = PointShadow(positionRange.xyz, norm);
+		diffuse *= shadow;
+		specular *= shadow;
+	}
+#endif
+
+	return (ambient + diffuse + specular);
+}
+
+#ifdef LIGHT_CLUSTERS
+int ClusterIndex() {
+	float depth = -(view * vec4(FragPos, 1.0)).z;
+	int slice = clamp(int(log(depth) * clusterDepth.x + clusterDepth.y), 0, CLUSTER_GRID_Z - 1);
+	ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(0), ivec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+	return (slice * CLUSTER_GRID_Y + tile.y) * CLUSTER_GRID_X + tile.x;
+}
+#endif
+
+vec3 CalcDirLight(DirectionalLight light, vec3 specularFactor) {
+	// calculate light direction
+	vec3 lightDir = normalize(-light.direction);
+
+	// calculate ambient lighting
+	vec3 ambient = light.color * ambientStrength;
+
+	// calculate diffuse lighting
+	vec3 norm = normalize(Normal);
+	float diff = max(dot(norm, lightDir), 0.0);
+	vec3 diffuse = diff * light.color;
+
+	// calculate specular lighting
+	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 reflectDir = reflect(-lightDir, norm);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+
+	vec3 specular = spec * light.color * specularFactor;
+#ifdef SHADOWS
+	float shadow = CascadeShadow(norm);
+	diffuse *= shadow;
+	specular *= shadow;
+#endif
+
+	return (ambient + diffuse + specular);
+}
+
+void main()
+{
+	DrawData draw = draws[DrawID];
+
+	// move TexCoord from the diffuse map's atlas region into the specular map's
+	vec2 uv = (TexCoord - draw.diffuseRegion.xy) / draw.diffuseRegion.zw;
+	vec3 specularCoord = vec3(draw.specularRegion.xy + uv * draw.specularRegion.zw, draw.specularLayer);
+
+	// specular strength scaled by the specular map, if the draw has one
+	vec3 specularFactor = draw.specularStrength * (draw.specularLayer >= 0 ? vec3(texture(atlas, specularCoord)) : vec3(1.0));
+
+	// the cluster's (or draw's) lights, then the directional light
+	vec3 light = CalcDirLight(dirLight, specularFactor);
+#ifdef LIGHT_CLUSTERS
+	uvec2 cluster = texelFetch(clusterGrid, ClusterIndex()).xy;
+	for (uint i = 0u; i < cluster.y; ++i)
+		light += CalcListedLight(int(texelFetch(clusterLights, int(cluster.x + i)).x), specularFactor);
+#else
+	int lightCount = lightLists[draw.lightList];
+	for (int i = 1; i <= lightCount; ++i)
+		light += CalcListedLight(lightLists[draw.lightList + i], specularFactor);
+#endif
+
+	// calculate fragment color
+	FragColor = vec4(light, 1.0) * texture(atlas, vec3(TexCoord, draw.diffuseLayer));
+}
@@ -0,0 +1,39 @@
+#version 430 core																	// Multi-draw indirect path needs SSBOs (4.3) and gl_DrawIDARB
+#extension GL_ARB_shader_draw_parameters : require
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNorm;
+layout (location = 2) in vec2 aTexCoord;
+
+struct DrawData {
+	mat4 model;																		// Model matrix of the draw
+	mat4 normalModel;																// Model matrix for normals (upper 3x3 is used)
+	vec4 diffuseRegion;																// Atlas offset (xy) and scale (zw) baked into aTexCoord
+	vec4 specularRegion;															// Atlas offset (xy) and scale (zw) of the specular map
+	int diffuseLayer;																// Atlas layer of the diffuse map
+	int specularLayer;																// Atlas layer of the specular map, -1 when there is none
+	float specularStrength;
+	int lightList;																	// Offset of the draw's light list in the fragment shader's lightLists[] (unused with LIGHT_CLUSTERS)
+};
+layout (std430, binding = 0) readonly buffer DrawBuffer {
+	DrawData draws[];
+};
+
+out vec2 TexCoord;
+out vec3 FragPos;
+out vec3 Normal;
+flat out int DrawID;																// Index into draws[] for the fragment shader
+
+invariant gl_Position;																// Depths must match the depth pre-pass (see prepass.h)
+
+uniform mat4 view;																	// View matrix (uniform input)
+uniform mat4 projection;															// Projection matrix (uniform input)
+void main()
+{
+	DrawData draw = draws[gl_DrawIDARB];
+
+	gl_Position = projection * view * draw.model * vec4(aPos, 1.0);
+	TexCoord = aTexCoord;
+	FragPos = vec3(draw.model * vec4(aPos, 1.0));
+	Normal = mat3(draw.normalModel) * aNorm;
+	DrawID = gl_DrawIDARB;
+}
@@ -0,0 +1,58 @@
+#version 430 core
+// Assigns lights to the clusters of the view frustum (see clusters.h). One
+// invocation per cluster tests every light's range sphere against the
+// cluster's view-space box; the workgroup stages lights through shared memory
+// so each is fetched and transformed once per group. clusters.cpp inserts the
+// CLUSTER_GRID_* and MAX_LIGHTS_PER_CLUSTER defines.
+layout (local_size_x = 64) in;
+
+struct ClusterBounds {
+	vec4 low;
+	vec4 high;
+};
+layout (std430, binding = 0) readonly buffer BoundsBuffer {
+	ClusterBounds bounds[];
+};
+layout (std430, binding = 1) writeonly buffer GridBuffer {
+	uvec2 grid[];															// first index and count, per cluster
+};
+layout (std430, binding = 2) writeonly buffer IndexBuffer {
+	uint indices[];															// MAX_LIGHTS_PER_CLUSTER slots per cluster
+};
+
+uniform samplerBuffer lights;												// block 0 holds position and range (see lightbuffer.h)
+uniform int lightCount;
+uniform mat4 view;
+
+shared vec4 spheres[64];													// view-space center and range of the lights being tested
+
+void main()
+{
+	uint cluster = gl_GlobalInvocationID.x;
+	bool inGrid = cluster < uint(CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z);
+	vec3 low = inGrid ? bounds[cluster].low.xyz : vec3(0.0);
+	vec3 high = inGrid ? bounds[cluster].high.xyz : vec3(0.0);
+	uint first = cluster * uint(MAX_LIGHTS_PER_CLUSTER);
+	uint count = 0u;
+
+	for (int base = 0; base < lightCount; base += 64) {
+		int light = base + int(gl_LocalInvocationIndex);
+		if (light < lightCount) {
+			vec4 positionRange = texelFetch(lights, light);
+			spheres[gl_LocalInvocationIndex] = vec4((view * vec4(positionRange.xyz, 1.0)).xyz, positionRange.w);
+		}
+		barrier();
+
+		// lights are tested in buffer order, so a full cluster keeps the lowest indices
+		int batch = min(64, lightCount - base);
+		for (int i = 0; inGrid && i < batch && count < uint(MAX_LIGHTS_PER_CLUSTER); ++i) {
+			vec3 offset = clamp(spheres[i].xyz, low, high) - spheres[i].xyz;
+			if (dot(offset, offset) <= spheres[i].w * spheres[i].w)
+				indices[first + count++] = uint(base + i);
+		}
+		barrier();
+	}
+
+	if (inGrid)
+		grid[cluster] = uvec2(first, count);
+}
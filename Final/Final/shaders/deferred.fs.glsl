@@ -0,0 +1,183 @@
+#version 330 core
+// Lighting pass of the deferred path (see deferred.h): one full-screen
+// triangle that lights every covered pixel from the G-buffer, taking its
+// point and spot lights from the pixel's cluster (see clusters.h). clusters.cpp
+// supplies the CLUSTER_GRID_* defines, and shadows.cpp SHADOWS when enabled.
+in vec2 ScreenCoord;
+out vec4 FragColor;
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;									// depth buffer back to world space
+
+uniform float ambientStrength;
+
+struct DirectionalLight {
+	vec3 direction;
+	vec3 color;
+};
+uniform DirectionalLight dirLight;
+
+uniform samplerBuffer lights;										// four SoA blocks of lightStride texels (see lightbuffer.h)
+uniform int lightStride;
+uniform usamplerBuffer clusterGrid;									// first index and light count per cluster
+uniform usamplerBuffer clusterLights;								// indices into lights
+uniform mat4 view;
+uniform vec2 clusterTileSize;										// pixels per cluster column and row
+uniform vec2 clusterDepth;											// slice = log(view depth) * x + y
+
+uniform vec3 viewPos;
+
+// the surface being lit, read back from the G-buffer
+vec3 FragPos = vec3(0.0);
+vec3 Normal = vec3(0.0, 0.0, 1.0);
+
+vec3 OctDecode(vec2 encoded) {
+	vec2 f = encoded * 2.0 - 1.0;
+	vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+	float fold = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -fold : fold;
+	n.y += n.y >= 0.0 ? -fold : fold;
+	return normalize(n);
+}
+
+#ifdef SHADOWS
+// shadow maps of the directional and point light (see shadows.h)
+uniform sampler2DArrayShadow cascadeShadowMap;
+uniform mat4 cascadeMatrices[SHADOW_CASCADES];				// world to shadow map texture space, per cascade
+uniform float cascadeTexelSize[SHADOW_CASCADES];			// world units per texel, per cascade
+uniform samplerCubeShadow pointShadowMap;					// distance to the light over pointShadowFar
+uniform int pointShadowLight;								// light buffer index casting into the cube, -1 for none
+uniform float pointShadowFar;
+
+// share of the directional light reaching FragPos, 3x3 PCF in the first cascade holding it
+float CascadeShadow(vec3 norm) {
+	for (int i = 0; i < SHADOW_CASCADES; ++i) {
+		vec4 coord = cascadeMatrices[i] * vec4(FragPos + norm * cascadeTexelSize[i] * 1.5, 1.0);	// normal offset against acne
+		if (any(lessThan(coord.xyz, vec3(0.0))) || any(greaterThan(coord.xyz, vec3(1.0))))
+			continue;
+
+		float texel = 1.0 / float(textureSize(cascadeShadowMap, 0).x);
+		float lit = 0.0;
+		for (int x = -1; x <= 1; ++x)
+			for (int y = -1; y <= 1; ++y)
+				lit += texture(cascadeShadowMap, vec4(coord.xy + vec2(x, y) * texel, float(i), coord.z));
+		return lit / 9.0;
+	}
+	return 1.0;														// past the last cascade
+}
+
+// share of the cube's light reaching FragPos
+float PointShadow(vec3 lightPos, vec3 norm) {
+	vec3 offset = FragPos + norm * 0.01 - lightPos;
+	float lightDistance = length(offset);
+	if (lightDistance >= pointShadowFar)
+		return 1.0;
+	return texture(pointShadowMap, vec4(offset, (lightDistance - 0.02) / pointShadowFar));
+}
+#endif
+
+vec3 CalcListedLight(int index, vec3 specularFactor) {
+	vec4 positionRange = texelFetch(lights, index);
+	vec4 colorType = texelFetch(lights, index + lightStride);
+	vec4 attenuationInner = texelFetch(lights, index + 3 * lightStride);
+
+	// calculate attenuation coefficient based on distance from light
+	float lightDistance = length(positionRange.xyz - FragPos);
+	if (lightDistance > positionRange.w)
+		return vec3(0.0);
+	float attenuation = 1.0 / (attenuationInner.x + attenuationInner.y * lightDistance + attenuationInner.z * (lightDistance * lightDistance));
+	vec3 lightDir = normalize(positionRange.xyz - FragPos);
+
+	// calculate ambient lighting
+	vec3 ambient = colorType.rgb * ambientStrength * attenuation;
+
+	// spot lights fade out between the inner and outer cone
+	if (colorType.w > 0.5) {
+		vec4 directionOuter = texelFetch(lights, index + 2 * lightStride);
+		float theta = dot(-lightDir, directionOuter.xyz);
+		attenuation *= clamp((theta - directionOuter.w) / max(attenuationInner.w - directionOuter.w, 1e-4), 0.0, 1.0);
+	}
+
+	// calculate diffuse lighting
+	float diff = max(dot(Normal, lightDir), 0.0);
+	vec3 diffuse = diff * colorType.rgb;
+
+	// calculate specular lighting
+	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 reflectDir = reflect(-lightDir, Normal);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+
+	vec3 specular = spec * colorType.rgb * specularFactor;
+
+	// adjust for attenuation
+	diffuse *= attenuation;
+	specular *= attenuation;
+#ifdef SHADOWS
+	if (index == pointShadowLight) {
+		float shadow = PointShadow(positionRange.xyz, Normal);
+		diffuse *= shadow;
+		specular *= shadow;
+	}
+#endif
+
+	return (ambient + diffuse + specular);
+}
+
+vec3 CalcDirLight(DirectionalLight light, vec3 specularFactor) {
+	// calculate light direction
+	vec3 lightDir = normalize(-light.direction);
+
+	// calculate ambient lighting
+	vec3 ambient = light.color * ambientStrength;
+
+	// calculate diffuse lighting
+	float diff = max(dot(Normal, lightDir), 0.0);
+	vec3 diffuse = diff * light.color;
+
+	// calculate specular lighting
+	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 reflectDir = reflect(-lightDir, Normal);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+
+	vec3 specular = spec * light.color * specularFactor;
+#ifdef SHADOWS
+	float shadow = CascadeShadow(Normal);
+	diffuse *= shadow;
+	specular *= shadow;
+#endif
+
+	return (ambient + diffuse + specular);
+}
+
+int ClusterIndex() {
+	float depth = -(view * vec4(FragPos, 1.0)).z;
+	int slice = clamp(int(log(depth) * clusterDepth.x + clusterDepth.y), 0, CLUSTER_GRID_Z - 1);
+	ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(0), ivec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+	return (slice * CLUSTER_GRID_Y + tile.y) * CLUSTER_GRID_X + tile.x;
+}
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gDepth, texel, 0).r;
+	if (depth == 1.0)
+		discard;													// nothing was drawn here
+
+	vec4 world = inverseViewProjection * vec4(ScreenCoord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	FragPos = world.xyz / world.w;
+	Normal = OctDecode(texelFetch(gNormal, texel, 0).rg);
+	vec4 albedoSpecular = texelFetch(gAlbedoSpecular, texel, 0);
+	vec3 specularFactor = vec3(albedoSpecular.a);
+
+	// the cluster's lights, then the directional light
+	vec3 light = CalcDirLight(dirLight, specularFactor);
+	uvec2 cluster = texelFetch(clusterGrid, ClusterIndex()).xy;
+	for (uint i = 0u; i < cluster.y; ++i)
+		light += CalcListedLight(int(texelFetch(clusterLights, int(cluster.x + i)).x), specularFactor);
+
+	// the geometry pass already rejected hidden surfaces; keep the depth for forward draws after this
+	FragColor = vec4(light * albedoSpecular.rgb, 1.0);
+	gl_FragDepth = depth;
+}
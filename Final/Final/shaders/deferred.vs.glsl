@@ -0,0 +1,10 @@
+#version 330 core
+// One triangle covering the screen, generated from gl_VertexID (no vertex buffer)
+out vec2 ScreenCoord;
+
+void main()
+{
+	vec2 corner = vec2(gl_VertexID == 1 ? 3.0 : -1.0, gl_VertexID == 2 ? 3.0 : -1.0);
+	ScreenCoord = corner * 0.5 + 0.5;
+	gl_Position = vec4(corner, 0.0, 1.0);
+}
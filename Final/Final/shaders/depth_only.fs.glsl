@@ -0,0 +1,4 @@
+#version 330 core																	// Color writes are off during the pre-pass; only depth is kept
+void main()
+{
+}
@@ -0,0 +1,12 @@
+#version 330 core																	// Position-only program of the depth pre-pass (see prepass.h)
+layout (location = 0) in vec3 aPos;
+
+invariant gl_Position;																// Must match the lit vertex shaders bit for bit, or GL_EQUAL drops fragments
+
+uniform mat4 model;																	// Model matrix (uniform input)
+uniform mat4 view;																	// View matrix (uniform input)
+uniform mat4 projection;															// Projection matrix (uniform input)
+void main()
+{
+	gl_Position = projection * view * model * vec4(aPos.x, aPos.y, aPos.z, 1.0);	// Same expression as single_texture.vs.glsl
+}
@@ -0,0 +1,46 @@
+#version 330 core
+// Geometry pass of the deferred path (see deferred.h): writes surface
+// attributes instead of lighting them. SPECULAR_MAP is defined for Models
+// drawn with a Material.
+in vec2 TexCoord;
+in vec3 FragPos;
+in vec3 Normal;
+layout (location = 0) out vec4 AlbedoSpecular;						// diffuse color, specular strength
+layout (location = 1) out vec2 OctNormal;							// octahedral world-space normal, remapped to [0, 1]
+
+uniform float specularStrength;
+uniform sampler2DArray aTexture;									// diffuse atlas (see atlas.h)
+uniform float textureLayer;
+
+#ifdef SPECULAR_MAP
+uniform sampler2DArray specularMap;
+uniform float specularLayer;
+uniform vec4 specularRegion;										// atlas offset (xy) and scale (zw) of the specular map
+uniform vec4 textureRegion;											// atlas offset (xy) and scale (zw) baked into TexCoord
+
+// move TexCoord from the diffuse map's atlas region into the specular map's
+vec3 SpecularCoord() {
+	vec2 uv = (TexCoord - textureRegion.xy) / textureRegion.zw;
+	return vec3(specularRegion.xy + uv * specularRegion.zw, specularLayer);
+}
+#endif
+
+// fold the unit sphere onto an octahedron and unwrap it into a square
+vec2 OctEncode(vec3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 folded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return folded * 0.5 + 0.5;
+}
+
+void main()
+{
+	// specular maps are grayscale, so one channel keeps all of it
+#ifdef SPECULAR_MAP
+	float specularSample = texture(specularMap, SpecularCoord()).r;
+#else
+	float specularSample = 1.0;
+#endif
+
+	AlbedoSpecular = vec4(texture(aTexture, vec3(TexCoord, textureLayer)).rgb, specularStrength * specularSample);
+	OctNormal = OctEncode(normalize(Normal));
+}
@@ -0,0 +1,223 @@
+#version 330 core
+// Uber-shader for every lit, textured Model. variants.cpp inserts the features a
+// draw needs as #defines after the #version line, so unused lighting is compiled out:
+//	SPECULAR_MAP	scale specular highlights by a specular map in the atlas
+//	DIR_LIGHT		add the directional light
+//	LIGHT_LIST		add the point and spot lights listed in lightIndices (see lightbuffer.h)
+//	LIGHT_CLUSTERS	take that list from the fragment's cluster instead (see clusters.h)
+//	SHADOWS			shadow the directional light and the point light with a cube (see shadows.h)
+//	LIGHTMAP		take diffuse light from the baked lightmap instead of the lights (see lightmap.h)
+in vec2 TexCoord;
+in vec3 FragPos;
+in vec3 Normal;
+out vec4 FragColor;
+
+uniform float ambientStrength;
+
+#ifdef LIGHTMAP
+in vec2 LightmapCoord;
+uniform sampler2D lightmap;									// point diffuse, point attenuation, directional diffuse, occlusion
+uniform vec3 lightmapPointColor;
+uniform vec3 lightmapDirColor;
+#endif
+
+struct DirectionalLight {
+	vec3 direction;
+	vec3 color;
+};
+#ifdef DIR_LIGHT
+uniform DirectionalLight dirLight;
+#endif
+
+#ifdef LIGHT_LIST
+uniform samplerBuffer lights;								// four SoA blocks of lightStride texels (see lightbuffer.h)
+uniform int lightStride;
+#ifdef LIGHT_CLUSTERS
+uniform usamplerBuffer clusterGrid;							// first index and light count per cluster
+uniform usamplerBuffer clusterLights;						// indices into lights
+uniform mat4 view;
+uniform vec2 clusterTileSize;								// pixels per cluster column and row
+uniform vec2 clusterDepth;									// slice = log(view depth) * x + y
+#else
+uniform int lightCount;
+uniform int lightIndices[MAX_LIGHTS_PER_DRAW];
+#endif
+#endif
+
+uniform float specularStrength;
+uniform vec3 viewPos;
+uniform sampler2DArray aTexture;							// diffuse atlas (see atlas.h)
+uniform float textureLayer;
+
+#ifdef SPECULAR_MAP
+uniform sampler2DArray specularMap;
+uniform float specularLayer;
+uniform vec4 specularRegion;							// atlas offset (xy) and scale (zw) of the specular map
+uniform vec4 textureRegion;								// atlas offset (xy) and scale (zw) baked into TexCoord
+
+// move TexCoord from the diffuse map's atlas region into the specular map's
+vec3 SpecularCoord() {
+	vec2 uv = (TexCoord - textureRegion.xy) / textureRegion.zw;
+	return vec3(specularRegion.xy + uv * specularRegion.zw, specularLayer);
+}
+#endif
+
+#ifdef SHADOWS
+// shadow maps of the directional and point light (see shadows.h)
+uniform sampler2DArrayShadow cascadeShadowMap;
+uniform mat4 cascadeMatrices[SHADOW_CASCADES];				// world to shadow map texture space, per cascade
+uniform float cascadeTexelSize[SHADOW_CASCADES];			// world units per texel, per cascade
+uniform samplerCubeShadow pointShadowMap;					// distance to the light over pointShadowFar
+uniform int pointShadowLight;								// light buffer index casting into the cube, -1 for none
+uniform float pointShadowFar;
+
+// share of the directional light reaching FragPos, 3x3 PCF in the first cascade holding it
+float CascadeShadow(vec3 norm) {
+	for (int i = 0; i < SHADOW_CASCADES; ++i) {
+		vec4 coord = cascadeMatrices[i] * vec4(FragPos + norm * cascadeTexelSize[i] * 1.5, 1.0);	// normal offset against acne
+		if (any(lessThan(coord.xyz, vec3(0.0))) || any(greaterThan(coord.xyz, vec3(1.0))))
+			continue;
+
+		float texel = 1.0 / float(textureSize(cascadeShadowMap, 0).x);
+		float lit = 0.0;
+		for (int x = -1; x <= 1; ++x)
+			for (int y = -1; y <= 1; ++y)
+				lit += texture(cascadeShadowMap, vec4(coord.xy + vec2(x, y) * texel, float(i), coord.z));
+		return lit / 9.0;
+	}
+	return 1.0;														// past the last cascade
+}
+
+// share of the cube's light reaching FragPos
+float PointShadow(vec3 lightPos, vec3 norm) {
+	vec3 offset = FragPos + norm * 0.01 - lightPos;
+	float lightDistance = length(offset);
+	if (lightDistance >= pointShadowFar)
+		return 1.0;
+	return texture(pointShadowMap, vec4(offset, (lightDistance - 0.02) / pointShadowFar));
+}
+#endif
+
+#ifdef LIGHT_LIST
+vec3 CalcListedLight(int index, vec3 specularSample) {
+	vec4 positionRange = texelFetch(lights, index);
+	vec4 colorType = texelFetch(lights, index + lightStride);
+	vec4 attenuationInner = texelFetch(lights, index + 3 * lightStride);
+
+	// calculate attenuation coefficient based on distance from light
+	float lightDistance = length(positionRange.xyz - FragPos);
+	if (lightDistance > positionRange.w)
+		return vec3(0.0);											// out of range, contribution is below one 8-bit step
+	float attenuation = 1.0 / (attenuationInner.x + attenuationInner.y * lightDistance + attenuationInner.z * (lightDistance * lightDistance));
+	vec3 lightDir = normalize(positionRange.xyz - FragPos);		// calculate direction of ray hitting fragment and
+																	// normalize the result
+
+	// calculate ambient lighting
+	vec3 ambient = colorType.rgb * ambientStrength * attenuation;
+
+	// spot lights fade out between the inner and outer cone
+	if (colorType.w > 0.5) {
+		vec4 directionOuter = texelFetch(lights, index + 2 * lightStride);
+		float theta = dot(-lightDir, directionOuter.xyz);
+		attenuation *= clamp((theta - directionOuter.w) / max(attenuationInner.w - directionOuter.w, 1e-4), 0.0, 1.0);
+	}
+
+	// calculate diffuse lighting
+	vec3 norm = normalize(Normal);								// normalize Normal vector incase does not already
+																	// have a magnitude of 1
+	float diff = max(dot(norm, lightDir), 0.0);					// calculate how bright the fragment should be based
+																	// on the angle between the normal and ray of light
+	vec3 diffuse = diff * colorType.rgb;
+
+	// calculate specular lighting
+	vec3 viewDir = normalize(viewPos - FragPos);				// calculate view direction and normalize
+	vec3 reflectDir = reflect(-lightDir, norm);					// calculate direction of reflected light
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);	// calculate specular constant
+
+	vec3 specular = specularStrength * spec * colorType.rgb * specularSample;
+
+	// adjust for attenuation
+	diffuse *= attenuation;
+	specular *= attenuation;
+#ifdef SHADOWS
+	if (index == pointShadowLight) {
+		float shadow = PointShadow(positionRange.xyz, norm);
+		diffuse *= shadow;
+		specular *= shadow;
+	}
+#endif
+
+	return (ambient + diffuse + specular);
+}
+#endif
+
+#ifdef LIGHT_CLUSTERS
+// texel of the cluster this fragment falls in, see the layout in clusters.h
+int ClusterIndex() {
+	float depth = -(view * vec4(FragPos, 1.0)).z;
+	int slice = clamp(int(log(depth) * clusterDepth.x + clusterDepth.y), 0, CLUSTER_GRID_Z - 1);
+	ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(0), ivec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+	return (slice * CLUSTER_GRID_Y + tile.y) * CLUSTER_GRID_X + tile.x;
+}
+#endif
+
+#ifdef DIR_LIGHT
+vec3 CalcDirLight(DirectionalLight light, vec3 specularSample) {
+	// calculate light direction
+	vec3 lightDir = normalize(-light.direction);
+
+	// calculate ambient lighting
+	vec3 ambient = light.color * ambientStrength;
+
+	// calculate diffuse lighting
+	vec3 norm = normalize(Normal);								// normalize Normal vector incase does not already
+																	// have a magnitude of 1
+	float diff = max(dot(norm, lightDir), 0.0);					// calculate how bright the fragment should be based
+																	// on the angle between the normal and ray of light
+	vec3 diffuse = diff * light.color;
+
+	// calculate specular lighting
+	vec3 viewDir = normalize(viewPos - FragPos);				// calculate view direction and normalize
+	vec3 reflectDir = reflect(-lightDir, norm);					// calculate direction of reflected light
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);	// calculate specular constant
+
+	vec3 specular = specularStrength * spec * light.color * specularSample;
+#ifdef SHADOWS
+	float shadow = CascadeShadow(norm);
+	diffuse *= shadow;
+	specular *= shadow;
+#endif
+
+	return (ambient + diffuse + specular);
+}
+#endif
+
+void main()
+{
+	// specular highlights are scaled by the map when the material has one
+#ifdef SPECULAR_MAP
+	vec3 specularSample = vec3(texture(specularMap, SpecularCoord()));
+#else
+	vec3 specularSample = vec3(1.0);
+#endif
+
+	vec3 light = vec3(0.0);
+#if defined(LIGHTMAP)
+	// the bake is for white lights, so the current colors still apply; occlusion only darkens the ambient term
+	vec4 baked = texture(lightmap, LightmapCoord);
+	light = lightmapPointColor * (baked.r + ambientStrength * baked.g * baked.a) + lightmapDirColor * (baked.b + ambientStrength * baked.a);
+#elif defined(LIGHT_CLUSTERS)
+	uvec2 cluster = texelFetch(clusterGrid, ClusterIndex()).xy;
+	for (uint i = 0u; i < cluster.y; ++i)
+		light += CalcListedLight(int(texelFetch(clusterLights, int(cluster.x + i)).x), specularSample);
+#elif defined(LIGHT_LIST)
+	for (int i = 0; i < lightCount; ++i)
+		light += CalcListedLight(lightIndices[i], specularSample);
+#endif
+#ifdef DIR_LIGHT
+	light += CalcDirLight(dirLight, specularSample);
+#endif
+
+	// calculate fragment color
+	FragColor = vec4(light, 1.0) * texture(aTexture, vec3(TexCoord, textureLayer));
+}
@@ -0,0 +1,7 @@
+#version 330 core																	// Overdraw view: added once per fragment with GL_ONE, GL_ONE blending
+out vec4 FragColor;
+
+void main()
+{
+	FragColor = vec4(0.25, 0.25, 0.25, 1.0);										// four layers saturate to white
+}
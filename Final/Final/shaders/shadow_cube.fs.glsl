@@ -0,0 +1,10 @@
+#version 330 core																	// Stores distance to the light over its range as depth, so every face compares alike
+in vec3 FragPos;
+
+uniform vec3 lightPos;
+uniform float farPlane;																// Range of the light
+
+void main()
+{
+	gl_FragDepth = length(FragPos - lightPos) / farPlane;
+}
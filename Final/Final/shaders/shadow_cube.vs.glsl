@@ -0,0 +1,14 @@
+#version 330 core																	// Renders one face of the point light's shadow cube (see shadows.h)
+layout (location = 0) in vec3 aPos;
+
+out vec3 FragPos;
+
+uniform mat4 model;																	// Model matrix (uniform input)
+uniform mat4 view;																	// The face's view from the light
+uniform mat4 projection;															// 90 degree projection over the light's range
+void main()
+{
+	vec4 world = model * vec4(aPos, 1.0);
+	FragPos = world.xyz;
+	gl_Position = projection * view * world;
+}
@@ -2,11 +2,17 @@
 layout (location = 0) in vec3 aPos;													// Define the input parameter (the current vertex coordinate) and its index.
 layout (location = 1) in vec3 aNorm;
 layout (location = 2) in vec2 aTexCoord;
+#ifdef LIGHTMAP
+layout (location = 3) in vec2 aLightmapCoord;
+out vec2 LightmapCoord;
+#endif
 
 out vec2 TexCoord;																	// Define the output parameter (taken by the fragment shader to texture the fragment).
 out vec3 FragPos;
 out vec3 Normal;
 
+invariant gl_Position;																// Depths must match the depth pre-pass (see prepass.h)
+
 uniform mat4 model;																	// Model matrix (uniform input)
 uniform mat4 view;																	// View matrix (uniform input)
 uniform mat4 projection;															// Projection matrix (uniform input)
@@ -17,4 +23,7 @@ void main()
 	TexCoord = aTexCoord;
 	FragPos = vec3(model * vec4(aPos, 1.0));
 	Normal = vec3(normalModel * vec3(aNorm));
+#ifdef LIGHTMAP
+	LightmapCoord = aLightmapCoord;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,42 @@
+#version 330 core
+// Upscale pass of dynamic resolution (see dynres.h): stretches the rendered
+// part of the scene texture over the window bilinearly, then sharpens it
+// against its four neighbours one scene texel away. The result is clamped
+// to their range so edges don't ring.
+in vec2 ScreenCoord;
+out vec4 FragColor;
+
+uniform sampler2D scene;
+uniform vec2 sceneScale;											// rendered size over texture size
+uniform vec2 texelSize;												// 1 / texture size
+uniform float sharpness;											// 0 for plain bilinear
+
+vec3 fetch(vec2 uv)
+{
+	return texture(scene, clamp(uv, 0.5 * texelSize, sceneScale - 0.5 * texelSize)).rgb;	// never filter in texels that weren't rendered
+}
+
+void main()
+{
+	if (sceneScale == vec2(1.0)) {
+		FragColor = vec4(texelFetch(scene, ivec2(gl_FragCoord.xy), 0).rgb, 1.0);	// drawn at full size, copy it exactly
+		return;
+	}
+
+	vec2 uv = ScreenCoord * sceneScale;
+	vec3 center = fetch(uv);
+	if (sharpness <= 0.0) {
+		FragColor = vec4(center, 1.0);
+		return;
+	}
+
+	vec3 left = fetch(uv - vec2(texelSize.x, 0.0));
+	vec3 right = fetch(uv + vec2(texelSize.x, 0.0));
+	vec3 down = fetch(uv - vec2(0.0, texelSize.y));
+	vec3 up = fetch(uv + vec2(0.0, texelSize.y));
+
+	vec3 low = min(center, min(min(left, right), min(down, up)));
+	vec3 high = max(center, max(max(left, right), max(down, up)));
+	vec3 sharpened = center + sharpness * (center - 0.25 * (left + right + down + up));
+	FragColor = vec4(clamp(sharpened, low, high), 1.0);
+}
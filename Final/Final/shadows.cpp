@@ -0,0 +1,528 @@
+#include <GLEW/glew.h>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shadows.h"
+
+#include "geometry.h"
+
+#include "lightbuffer.h"
+
+#include "statics.h"
+
+const int SHADOW_CUBE_PASS = SHADOW_CASCADES;	// Index of the cube in the per-map arrays
+
+/**
+ * Depth range [-1, 1] and texture coordinates [-1, 1] of a light's clip space
+ * to the [0, 1] the shadow samplers compare in.
+ */
+const glm::mat4 SHADOW_BIAS = glm::mat4(
+	0.5f, 0.f, 0.f, 0.f,
+	0.f, 0.5f, 0.f, 0.f,
+	0.f, 0.f, 0.5f, 0.f,
+	0.5f, 0.5f, 0.5f, 1.f);
+
+namespace glob {
+	bool shadows_active = false;
+
+	Shader* shadow_depth_shader = nullptr;		// cascades: depth only
+	Shader* shadow_cube_shader = nullptr;		// cube: distance to the light as depth
+
+	unsigned int shadow_fbo = 0;
+	unsigned int shadow_static_fbo = 0;
+	unsigned int cascade_map = 0;
+	unsigned int shadow_cube_map = 0;
+	unsigned int cascade_static_map = 0;		// static casters only, restored into cascade_map
+	unsigned int shadow_cube_static_map = 0;	// static casters only, restored into shadow_cube_map
+
+	glm::mat4 cascade_matrices[SHADOW_CASCADES];	// world to shadow texture space, as last rendered
+	float cascade_texel_size[SHADOW_CASCADES] = {};	// world units per texel, for the receiver's normal offset
+	int shadow_light = -1;							// light buffer index of the cube's light
+	float shadow_cube_far = 1.f;
+	glm::vec4 shadow_cube_light = glm::vec4(0.f);	// position and range the cube was rendered for
+
+	bool shadow_rendered[SHADOW_CASCADES + 1] = {};
+	bool shadow_static_valid[SHADOW_CASCADES + 1] = {};				// the copy holds the static casters for the map's current light
+	bool shadow_dynamic_drawn[SHADOW_CASCADES + 1] = {};			// the map holds dynamic casters from the last update
+	unsigned long long shadow_generation[SHADOW_CASCADES + 1] = {};	// statics_generation (the casters') the map was last drawn with
+	std::vector<const Model*> shadow_casters;						// casters the maps were drawn from
+
+	unsigned int shadow_queries[SHADOW_CASCADES + 1] = {};
+	bool shadow_query_pending[SHADOW_CASCADES + 1] = {};
+
+	ShadowStats shadow_counters;
+}
+
+static unsigned int shadow_texture(GLenum target, int size, int layers) {
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(target, texture);
+	if (target == GL_TEXTURE_2D_ARRAY)
+		glTexImage3D(target, 0, GL_DEPTH_COMPONENT24, size, size, layers, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+	else {
+		for (int face = 0; face < 6; ++face)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+		glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+
+	/**
+	 * Hardware comparison with bilinear filtering gives 2x2 PCF per fetch.
+	 */
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(target, 0);
+	return texture;
+}
+
+/**
+ * Attach a cascade's layer, or one face of the cube, of the map or its static
+ * copy as the depth attachment of the framebuffer bound to target.
+ */
+static void attach(GLenum target, int map, int face, bool static_copy) {
+	using namespace glob;
+
+	if (map == SHADOW_CUBE_PASS)
+		glFramebufferTexture2D(target, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, static_copy ? shadow_cube_static_map : shadow_cube_map, 0);
+	else
+		glFramebufferTextureLayer(target, GL_DEPTH_ATTACHMENT, static_copy ? cascade_static_map : cascade_map, 0, map);
+}
+
+void shadows_init() {
+	using namespace glob;
+
+	shadow_depth_shader = new Shader("shaders/depth_only.vs.glsl", "shaders/depth_only.fs.glsl");
+	shadow_cube_shader = new Shader("shaders/shadow_cube.vs.glsl", "shaders/shadow_cube.fs.glsl");
+
+	cascade_map = shadow_texture(GL_TEXTURE_2D_ARRAY, SHADOW_MAP_SIZE, SHADOW_CASCADES);
+	shadow_cube_map = shadow_texture(GL_TEXTURE_CUBE_MAP, SHADOW_CUBE_SIZE, 6);
+	cascade_static_map = shadow_texture(GL_TEXTURE_2D_ARRAY, SHADOW_MAP_SIZE, SHADOW_CASCADES);
+	shadow_cube_static_map = shadow_texture(GL_TEXTURE_CUBE_MAP, SHADOW_CUBE_SIZE, 6);
+
+	unsigned int fbos[2];
+	glGenFramebuffers(2, fbos);
+	shadow_fbo = fbos[0];
+	shadow_static_fbo = fbos[1];
+	for (unsigned int fbo : fbos) {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+
+	/**
+	 * Start every map fully lit, for draws before the first shadows_update.
+	 */
+	glBindFramebuffer(GL_FRAMEBUFFER, shadow_fbo);
+	for (int map = 0; map <= SHADOW_CASCADES; ++map) {
+		for (int face = 0; face < (map == SHADOW_CUBE_PASS ? 6 : 1); ++face) {
+			attach(GL_FRAMEBUFFER, map, face, false);
+			glClear(GL_DEPTH_BUFFER_BIT);
+		}
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenQueries(SHADOW_CASCADES + 1, shadow_queries);
+
+	for (int i = 0; i < SHADOW_CASCADES; ++i)
+		cascade_matrices[i] = glm::mat4(1.f);
+	shadow_counters = ShadowStats();
+	shadows_active = true;
+}
+
+bool shadows_enabled() {
+	return glob::shadows_active;
+}
+
+std::string shadow_defines() {
+	return "#define SHADOWS\n#define SHADOW_CASCADES " + std::to_string(SHADOW_CASCADES) + "\n";
+}
+
+/**
+ * View depth of the camera's near and far planes, taken from the projection
+ * so perspective and orthographic cameras are treated alike.
+ */
+static void camera_depth_range(const glm::mat4& projection, float& near_depth, float& far_depth) {
+	glm::mat4 inverse = glm::inverse(projection);
+	glm::vec4 n = inverse * glm::vec4(0.f, 0.f, -1.f, 1.f);
+	glm::vec4 f = inverse * glm::vec4(0.f, 0.f, 1.f, 1.f);
+	near_depth = -n.z / n.w;
+	far_depth = -f.z / f.w;
+}
+
+static float ndc_depth(const glm::mat4& projection, float view_depth) {
+	glm::vec4 clip = projection * glm::vec4(0.f, 0.f, -view_depth, 1.f);
+	return clip.z / clip.w;
+}
+
+/**
+ * Bounding sphere of the camera frustum between two view depths. Its radius
+ * only depends on the projection and depths, so the cascade keeps its size
+ * (and texel size) however the camera turns.
+ */
+static void slice_sphere(const glm::mat4& projection, const glm::mat4& view, float near_depth, float far_depth, glm::vec3& center, float& radius) {
+	glm::mat4 inverse = glm::inverse(projection * view);
+	float depths[2] = { ndc_depth(projection, near_depth), ndc_depth(projection, far_depth) };
+
+	glm::vec3 corners[8];
+	center = glm::vec3(0.f);
+	for (int i = 0; i < 8; ++i) {
+		glm::vec4 corner = inverse * glm::vec4(i & 1 ? 1.f : -1.f, i & 2 ? 1.f : -1.f, depths[i >> 2], 1.f);
+		corners[i] = glm::vec3(corner) / corner.w;
+		center += corners[i] / 8.f;
+	}
+
+	radius = 0.f;
+	for (const glm::vec3& corner : corners)
+		radius = glm::max(radius, glm::length(corner - center));
+	radius = std::ceil(radius * 16.f) / 16.f;	// round off float noise so the size stays put
+}
+
+static void draw_casters(Shader* shader, const std::vector<const Model*>& casters, const glm::mat4& projection, const glm::mat4& view, ShadowPassStats& pass) {
+	shader->setMat4("projection", projection);
+	shader->setMat4("view", view);
+
+	Frustum frustum = geometry_frustum(projection * view);
+	for (const Model* caster : casters) {
+		if (caster->mesh.index_count == 0 || !geometry_visible(frustum, caster->mesh, caster->model)) {
+			++pass.culled;
+			continue;
+		}
+		shader->setMat4("model", caster->model);
+		geometry_draw(caster->mesh, GL_TRIANGLES);
+		++pass.casters;
+	}
+}
+
+/**
+ * Collect a map's GPU time from its previous render once available; while
+ * one is in flight the next render goes untimed.
+ */
+static void collect_timing(int map) {
+	using namespace glob;
+
+	if (!shadow_query_pending[map])
+		return;
+
+	GLuint available = 0;
+	glGetQueryObjectuiv(shadow_queries[map], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;
+
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(shadow_queries[map], GL_QUERY_RESULT, &elapsed);
+	shadow_counters.passes[map].gpu_ms += elapsed / 1e6;
+	++shadow_counters.passes[map].gpu_timed;
+	shadow_query_pending[map] = false;
+}
+
+static bool begin_render(int map) {
+	using namespace glob;
+
+	bool timed = !shadow_query_pending[map];
+	if (timed)
+		glBeginQuery(GL_TIME_ELAPSED, shadow_queries[map]);
+
+	ShadowPassStats& pass = shadow_counters.passes[map];
+	pass.casters = pass.culled = pass.dynamic_casters = 0;
+	return timed;
+}
+
+static void end_render(int map, bool timed, std::chrono::high_resolution_clock::time_point start) {
+	using namespace glob;
+
+	if (timed) {
+		glEndQuery(GL_TIME_ELAPSED);
+		shadow_query_pending[map] = true;
+	}
+	shadow_rendered[map] = true;
+	shadow_counters.passes[map].cpu_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/**
+ * Bring one map up to date; faces is 1 for a cascade and 6 for the cube.
+ * moved tells whether the map's light-space matrices differ from the ones it
+ * was last drawn with.
+ */
+static void update_map(int map, const glm::mat4& projection, const glm::mat4* views, int faces, bool moved,
+	const std::vector<const Model*>& static_casters, const std::vector<const Model*>& dynamic_casters) {
+	using namespace glob;
+
+	ShadowPassStats& pass = shadow_counters.passes[map];
+	Shader* shader = map == SHADOW_CUBE_PASS ? shadow_cube_shader : shadow_depth_shader;
+	unsigned long long generation = statics_generation();
+
+	if (moved || generation != shadow_generation[map])
+		shadow_static_valid[map] = false;
+	if (!moved && generation == shadow_generation[map] && dynamic_casters.empty() && !shadow_dynamic_drawn[map]) {
+		++pass.reuses;
+		return;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	bool timed = begin_render(map);
+	shader->use();
+
+	/**
+	 * A moved map has nothing worth keeping, and without dynamic casters the
+	 * static ones are all there is: draw everything straight into the map.
+	 * Otherwise restore the static copy, drawing it first if it is stale, and
+	 * add the dynamic casters on top.
+	 */
+	if (moved || dynamic_casters.empty()) {
+		glBindFramebuffer(GL_FRAMEBUFFER, shadow_fbo);
+		for (int face = 0; face < faces; ++face) {
+			attach(GL_FRAMEBUFFER, map, face, false);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			draw_casters(shader, static_casters, projection, views[face], pass);
+			draw_casters(shader, dynamic_casters, projection, views[face], pass);
+		}
+		++pass.renders;
+	}
+	else {
+		if (!shadow_static_valid[map]) {
+			glBindFramebuffer(GL_FRAMEBUFFER, shadow_static_fbo);
+			for (int face = 0; face < faces; ++face) {
+				attach(GL_FRAMEBUFFER, map, face, true);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				draw_casters(shader, static_casters, projection, views[face], pass);
+			}
+			shadow_static_valid[map] = true;
+			++pass.static_renders;
+		}
+
+		unsigned int drawn = pass.casters;
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, shadow_static_fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadow_fbo);
+		int size = map == SHADOW_CUBE_PASS ? SHADOW_CUBE_SIZE : SHADOW_MAP_SIZE;
+		for (int face = 0; face < faces; ++face) {
+			attach(GL_READ_FRAMEBUFFER, map, face, true);
+			attach(GL_DRAW_FRAMEBUFFER, map, face, false);
+			glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			draw_casters(shader, dynamic_casters, projection, views[face], pass);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, shadow_fbo);
+		pass.dynamic_casters = pass.casters - drawn;
+		++pass.restores;
+	}
+
+	shadow_dynamic_drawn[map] = !dynamic_casters.empty();
+	shadow_generation[map] = generation;
+	end_render(map, timed, start);
+}
+
+static void update_cascades(const std::vector<const Model*>& static_casters, const std::vector<const Model*>& dynamic_casters, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light) {
+	using namespace glob;
+
+	float near_depth, far_depth;
+	camera_depth_range(projection, near_depth, far_depth);
+	far_depth = glm::min(far_depth, SHADOW_DISTANCE);
+
+	glm::vec3 direction = glm::normalize(dir_light.direction);
+	glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+	glm::mat4 light_view = glm::lookAt(glm::vec3(0.f), direction, up);	// rotation only, so snapping is in a fixed grid
+
+	/**
+	 * Light-space depth the casters reach towards the light; every cascade's
+	 * near plane is pulled back to it so nothing between the light and the
+	 * slice is clipped away.
+	 */
+	float caster_top = -1e30f;
+	for (const std::vector<const Model*>* casters : { &static_casters, &dynamic_casters }) {
+		for (const Model* caster : *casters) {
+			glm::vec3 center;
+			float radius;
+			geometry_world_sphere(caster->mesh, caster->model, center, radius);
+			caster_top = glm::max(caster_top, (light_view * glm::vec4(center, 1.f)).z + radius);
+		}
+	}
+
+	float split_near = near_depth;
+	for (int cascade = 0; cascade < SHADOW_CASCADES; ++cascade) {
+		float t = (float)(cascade + 1) / SHADOW_CASCADES;
+		float split_log = near_depth * std::pow(far_depth / near_depth, t);
+		float split_uniform = near_depth + (far_depth - near_depth) * t;
+		float split_far = SHADOW_SPLIT_LAMBDA * split_log + (1.f - SHADOW_SPLIT_LAMBDA) * split_uniform;
+
+		glm::vec3 center;
+		float radius;
+		slice_sphere(projection, view, split_near, split_far, center, radius);
+
+		float texel = 2.f * radius / SHADOW_MAP_SIZE;
+		glm::vec3 light_center = glm::vec3(light_view * glm::vec4(center, 1.f));
+		light_center.x = std::floor(light_center.x / texel) * texel;
+		light_center.y = std::floor(light_center.y / texel) * texel;
+		float top = glm::max(light_center.z + radius, caster_top) + texel;
+		float bottom = light_center.z - radius;
+
+		glm::mat4 light_projection = glm::ortho(light_center.x - radius, light_center.x + radius, light_center.y - radius, light_center.y + radius, -top, -bottom);
+		glm::mat4 matrix = SHADOW_BIAS * light_projection * light_view;
+
+		ShadowPassStats& pass = shadow_counters.passes[cascade];
+		pass.split = split_far;
+		split_near = split_far;
+
+		bool moved = !shadow_rendered[cascade] || matrix != cascade_matrices[cascade];
+		update_map(cascade, light_projection, &light_view, 1, moved, static_casters, dynamic_casters);
+
+		cascade_matrices[cascade] = matrix;
+		cascade_texel_size[cascade] = texel;
+	}
+}
+
+static void update_cube(const std::vector<const Model*>& static_casters, const std::vector<const Model*>& dynamic_casters, int point_light) {
+	using namespace glob;
+
+	ShadowPassStats& pass = shadow_counters.passes[SHADOW_CUBE_PASS];
+	shadow_light = point_light >= 0 && point_light < (int)lightbuffer_count() ? point_light : -1;
+	if (shadow_light < 0)
+		return;
+
+	glm::vec4 position_range = lightbuffer_position_ranges()[shadow_light];
+	pass.split = position_range.w;
+
+	/**
+	 * Faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X order, with the up vectors the
+	 * cube map convention expects.
+	 */
+	const glm::vec3 targets[6] = { { 1.f, 0.f, 0.f }, { -1.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, { 0.f, -1.f, 0.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f, -1.f } };
+	const glm::vec3 ups[6] = { { 0.f, -1.f, 0.f }, { 0.f, -1.f, 0.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f, -1.f }, { 0.f, -1.f, 0.f }, { 0.f, -1.f, 0.f } };
+
+	glm::vec3 position = glm::vec3(position_range);
+	shadow_cube_far = position_range.w;
+	glm::mat4 face_projection = glm::perspective(glm::radians(90.f), 1.f, 0.05f, shadow_cube_far);
+	glm::mat4 face_views[6];
+	for (int face = 0; face < 6; ++face)
+		face_views[face] = glm::lookAt(position, position + targets[face], ups[face]);
+
+	shadow_cube_shader->use();
+	shadow_cube_shader->setVec3("lightPos", position);
+	shadow_cube_shader->setFloat("farPlane", shadow_cube_far);
+
+	bool moved = !shadow_rendered[SHADOW_CUBE_PASS] || position_range != shadow_cube_light;
+	update_map(SHADOW_CUBE_PASS, face_projection, face_views, 6, moved, static_casters, dynamic_casters);
+	shadow_cube_light = position_range;
+}
+
+void shadows_update(const std::vector<const Model*>& casters, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, int point_light) {
+	using namespace glob;
+
+	if (!shadows_active)
+		return;
+
+	for (int map = 0; map <= SHADOW_CASCADES; ++map)
+		collect_timing(map);
+
+	/**
+	 * A different set of casters leaves nothing drawn earlier usable.
+	 */
+	if (casters != shadow_casters) {
+		shadow_casters = casters;
+		for (int map = 0; map <= SHADOW_CASCADES; ++map)
+			shadow_rendered[map] = shadow_static_valid[map] = false;
+	}
+
+	std::vector<const Model*> static_casters, dynamic_casters;
+	for (const Model* caster : casters)
+		(statics_object(*caster) ? static_casters : dynamic_casters).push_back(caster);
+
+	GLint viewport[4], polygon_mode[2], target;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);	// the default framebuffer, or an offscreen one
+
+	glBindFramebuffer(GL_FRAMEBUFFER, shadow_fbo);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(1.f, 2.f);				// slope-scaled bias against acne; receivers add a normal offset on top
+
+	glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+	if (dir_light.color != glm::vec3(0.f))
+		update_cascades(static_casters, dynamic_casters, projection, view, dir_light);
+
+	glViewport(0, 0, SHADOW_CUBE_SIZE, SHADOW_CUBE_SIZE);
+	update_cube(static_casters, dynamic_casters, point_light);
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+	glBindFramebuffer(GL_FRAMEBUFFER, target);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	++shadow_counters.updates;
+}
+
+void shadows_bind(Shader* shader) {
+	using namespace glob;
+
+	glActiveTexture(GL_TEXTURE0 + SHADOW_CASCADE_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, cascade_map);
+	glActiveTexture(GL_TEXTURE0 + SHADOW_CUBE_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, shadow_cube_map);
+	glActiveTexture(GL_TEXTURE0);
+
+	shader->setInt("cascadeShadowMap", SHADOW_CASCADE_TEXTURE_UNIT);
+	shader->setInt("pointShadowMap", SHADOW_CUBE_TEXTURE_UNIT);
+	for (int i = 0; i < SHADOW_CASCADES; ++i) {
+		std::string index = "[" + std::to_string(i) + "]";
+		shader->setMat4("cascadeMatrices" + index, cascade_matrices[i]);
+		shader->setFloat("cascadeTexelSize" + index, cascade_texel_size[i]);
+	}
+	shader->setInt("pointShadowLight", shadow_light);
+	shader->setFloat("pointShadowFar", shadow_cube_far);
+}
+
+ShadowStats shadows_stats() {
+	return glob::shadow_counters;
+}
+
+void shadows_report() {
+	if (!shadows_enabled())
+		return;
+
+	ShadowStats stats = shadows_stats();
+	std::cout << "Shadows: " << stats.updates << " updates, " << SHADOW_CASCADES << " cascades of " << SHADOW_MAP_SIZE << "^2, cube faces of "
+		<< SHADOW_CUBE_SIZE << "^2" << std::endl;
+	for (int i = 0; i <= SHADOW_CASCADES; ++i) {
+		const ShadowPassStats& pass = stats.passes[i];
+		double renders = pass.renders + pass.restores ? (double)(pass.renders + pass.restores) : 1.0;
+		double timed = pass.gpu_timed ? (double)pass.gpu_timed : 1.0;
+
+		if (i < SHADOW_CASCADES)
+			std::cout << "\tcascade " << i << " to depth " << pass.split;
+		else
+			std::cout << "\tpoint light cube, range " << pass.split;
+		std::cout << ": " << pass.renders << " renders, " << pass.restores << " restores from " << pass.static_renders << " static renders, "
+			<< pass.reuses << " reused, last drew " << pass.casters << " casters (" << pass.dynamic_casters << " dynamic, " << pass.culled << " culled), "
+			<< pass.cpu_ms / renders << " ms CPU, " << pass.gpu_ms / timed << " ms GPU per render" << std::endl;
+	}
+}
+
+void shadows_destroy() {
+	using namespace glob;
+
+	if (!shadows_active)
+		return;
+
+	glDeleteQueries(SHADOW_CASCADES + 1, shadow_queries);
+	unsigned int fbos[2] = { shadow_fbo, shadow_static_fbo };
+	glDeleteFramebuffers(2, fbos);
+	unsigned int textures[4] = { cascade_map, shadow_cube_map, cascade_static_map, shadow_cube_static_map };
+	glDeleteTextures(4, textures);
+	Shader* shaders[2] = { shadow_depth_shader, shadow_cube_shader };
+	for (Shader* shader : shaders) {
+		glDeleteProgram(shader->ID);
+		delete shader;
+	}
+	shadow_depth_shader = shadow_cube_shader = nullptr;
+	shadow_fbo = shadow_static_fbo = cascade_map = shadow_cube_map = cascade_static_map = shadow_cube_static_map = 0;
+	shadow_casters.clear();
+	for (int map = 0; map <= SHADOW_CASCADES; ++map)
+		shadow_rendered[map] = shadow_static_valid[map] = shadow_dynamic_drawn[map] = false;
+	shadows_active = false;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef __SHADOWS_H__
+#define __SHADOWS_H__
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "models.h"
+
+const int SHADOW_CASCADES = 3;				// Cascades the directional light's shadow is split into along the view
+const int SHADOW_MAP_SIZE = 1024;			// Texels per side of each cascade
+const int SHADOW_CUBE_SIZE = 512;			// Texels per side of each face of the point light's cube
+const float SHADOW_DISTANCE = 20.f;			// View depth the last cascade ends at; farther fragments are unshadowed
+const float SHADOW_SPLIT_LAMBDA = 0.75f;	// Blend of logarithmic (1) and uniform (0) cascade splits
+const int SHADOW_CASCADE_TEXTURE_UNIT = 8;	// Texture unit of the cascade array (sampler2DArrayShadow)
+const int SHADOW_CUBE_TEXTURE_UNIT = 9;		// Texture unit of the point light's cube (samplerCubeShadow)
+
+/**
+ * Cascades: one DEPTH24 layer each, fit to a bounding sphere of their slice of
+ * the camera frustum so their size never changes as the camera turns, and
+ * snapped to whole texels in light space so shadow edges don't crawl as it
+ * moves. Their near planes are pulled back to the casters' bounds.
+ *
+ * Cube: one light buffer light (the scene's point light) casts into a depth
+ * cube holding distance to the light over its range.
+ *
+ * Casters are split into static and dynamic ones by statics_object. A map
+ * whose light-space matrix changed is re-rendered whole. Otherwise the static
+ * casters are kept in a copy of the map, drawn again only when the static set
+ * changes, and each update restores the map from it and draws just the
+ * dynamic casters; with no dynamic casters the map is reused as it is.
+ * Casters are culled per cascade and per cube face against that map's
+ * frustum.
+ *
+ * Index SHADOW_CASCADES of ShadowStats::passes is the cube, with counts
+ * summed over its six faces.
+ */
+struct shadow_pass_statistics {
+	float split;							// far view depth of the cascade, range of the cube
+	unsigned int casters;					// drawn in the last render
+	unsigned int culled;					// rejected in the last render
+	unsigned int dynamic_casters;			// of casters, drawn over the static copy
+	unsigned long long renders;				// updates that drew every caster
+	unsigned long long restores;			// updates that restored the static copy and drew the dynamic casters
+	unsigned long long static_renders;		// times the static casters were drawn into the copy
+	unsigned long long reuses;				// updates that kept the map drawn earlier
+	double cpu_ms;							// CPU time issuing renders
+	double gpu_ms;							// GPU time of the renders that were timed
+	unsigned long long gpu_timed;
+};
+typedef struct shadow_pass_statistics ShadowPassStats;
+
+struct shadow_statistics {
+	unsigned long long updates;
+	ShadowPassStats passes[SHADOW_CASCADES + 1];
+};
+typedef struct shadow_statistics ShadowStats;
+
+void shadows_init();						// Allocate the cascade array and cube and build the depth programs
+
+bool shadows_enabled();
+
+/**
+ * Refit the cascades to the camera and bring every map up to date with its
+ * light and casters. point_light is the light buffer index casting into the
+ * cube (-1 for none). Call once per frame after lightbuffer_upload, before
+ * drawing; binds the default framebuffer and restores the viewport.
+ */
+void shadows_update(const std::vector<const Model*>& casters, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, int point_light);
+
+/**
+ * Bind both maps and set the "cascadeShadowMap", "cascadeMatrices",
+ * "cascadeTexelSize", "pointShadowMap", "pointShadowLight" and
+ * "pointShadowFar" uniforms.
+ */
+void shadows_bind(Shader* shader);
+
+std::string shadow_defines();				// "#define SHADOWS" and the cascade count, for shaders reading the maps
+
+ShadowStats shadows_stats();
+
+void shadows_report();
+
+void shadows_destroy();
+#endif//__SHADOWS_H__
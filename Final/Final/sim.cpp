@@ -0,0 +1,208 @@
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "sim.h"
+#include "batch.h"
+
+const int SIM_FRESH = 4;					// Set on sim_ready until the render thread takes the slot
+
+namespace glob {
+	/**
+	 * Triple buffer: the simulation fills sim_slots[sim_write] and swaps it
+	 * with sim_ready, the render thread swaps sim_read with sim_ready when
+	 * SIM_FRESH says there is something new. Neither side ever waits for the
+	 * other or touches the slot the other one owns.
+	 */
+	SimSnapshot sim_slots[3];
+	std::atomic<int> sim_ready(2);
+	int sim_write = 1;						// owned by the simulation
+	int sim_read = 0;						// owned by the render thread
+
+	SimState sim_working;					// the simulation's own copy
+	double sim_step_seconds = 1.0 / SIM_TICK_RATE;
+	double sim_next = 0.0;					// glfwGetTime() the next step is due
+	unsigned long long sim_steps = 0;
+
+	unsigned long long sim_drawn_step = 0;	// step of the snapshot the last frame used
+	double sim_measured_input = 0.0;		// input_time already counted by sim_presented
+
+	SimStats sim_counters;
+}
+
+glm::vec3 sim_front(const SimState& state) {
+	glm::vec3 front;
+	front.x = cos(glm::radians(state.yaw)) * cos(glm::radians(state.pitch));
+	front.y = sin(glm::radians(state.pitch));
+	front.z = sin(glm::radians(state.yaw)) * cos(glm::radians(state.pitch));
+	return glm::normalize(front);
+}
+
+static void publish(const SimSnapshot& snapshot) {
+	using namespace glob;
+
+	sim_slots[sim_write] = snapshot;
+	sim_write = sim_ready.exchange(sim_write | SIM_FRESH, std::memory_order_acq_rel) & ~SIM_FRESH;
+	++sim_counters.published;
+}
+
+void sim_init(const SimState& state, double time, double rate, bool threaded) {
+	using namespace glob;
+
+	sim_counters = SimStats();
+	sim_counters.threaded = threaded;
+	sim_counters.rate = rate > 0.0 ? rate : SIM_TICK_RATE;
+	sim_step_seconds = 1.0 / sim_counters.rate;
+	sim_working = state;
+	sim_next = time + sim_step_seconds;
+	sim_steps = 0;
+	sim_drawn_step = 0;
+	sim_measured_input = 0.0;
+
+	sim_ready.store(2);
+	sim_write = 1;
+	sim_read = 0;
+	sim_slots[sim_read] = { state, state, time, 0, 0.0 };
+}
+
+/**
+ * Advance state by dt seconds: what processInput and the mouse callbacks
+ * used to do to the camera directly.
+ */
+static void step(SimState& state, const SimInput& input, float dt, bool first) {
+	if (first) {
+		state.orthographic ^= input.toggle_projection;
+		state.wireframe ^= input.toggle_wireframe;
+		if (input.cycle_light_color)
+			state.point_light_color = (state.point_light_color + 1) % 4;
+		if (input.toggle_multi_draw)
+			state.multi_draw = !state.multi_draw && batch_supported();
+		state.depth_prepass ^= input.toggle_prepass;
+		state.show_overdraw ^= input.toggle_overdraw;
+
+		state.yaw += input.look_x;
+		state.pitch = glm::clamp(state.pitch + input.look_y, -89.f, 89.f);	// so the screen doesn't get flipped
+		state.fov = glm::clamp(state.fov - input.zoom, 1.f, 45.f);
+		state.speed = glm::clamp(state.speed - input.speed, 1.f, 5.f);
+	}
+
+	glm::vec3 front = sim_front(state), up = glm::vec3(0.f, 1.f, 0.f);
+	glm::vec3 right = glm::normalize(glm::cross(front, up));
+	state.position += (right * input.move.x + up * input.move.y + front * input.move.z) * (state.speed * dt);
+}
+
+bool sim_tick(SimInput& input, double time) {
+	using namespace glob;
+
+	if (time < sim_next)
+		return false;
+
+	SimSnapshot snapshot;
+	int steps = 0;
+	for (; sim_next <= time && steps < SIM_MAX_STEPS; ++steps) {
+		snapshot.previous = sim_working;
+		step(sim_working, input, (float)sim_step_seconds, steps == 0);
+		sim_next += sim_step_seconds;
+	}
+	if (sim_next <= time) {
+		unsigned long long behind = (unsigned long long)((time - sim_next) / sim_step_seconds) + 1;
+		sim_counters.dropped_steps += behind;
+		sim_next += behind * sim_step_seconds;
+	}
+	sim_steps += steps;
+
+	snapshot.current = sim_working;
+	snapshot.time = sim_next - sim_step_seconds;
+	snapshot.step = sim_steps;
+	snapshot.input_time = input.time;
+	publish(snapshot);
+
+	glm::vec3 held = input.move;
+	input = SimInput();
+	input.move = held;						// Keys stay down until the next poll says otherwise
+
+	++sim_counters.ticks;
+	sim_counters.steps += steps;
+	return true;
+}
+
+void sim_wait() {
+	using namespace glob;
+
+	/**
+	 * Sleep in 1 ms slices while the step is far off and yield for the rest,
+	 * since sleeps can overshoot by a scheduler quantum.
+	 */
+	double now = glfwGetTime();
+	while (now < sim_next) {
+		if (sim_next - now > 0.002)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		else
+			std::this_thread::yield();
+		now = glfwGetTime();
+	}
+	sim_counters.oversleep_ms += (now - sim_next) * 1000.0;
+}
+
+SimState sim_frame_state(double time) {
+	using namespace glob;
+
+	if (sim_ready.load(std::memory_order_acquire) & SIM_FRESH)
+		sim_read = sim_ready.exchange(sim_read, std::memory_order_acq_rel) & ~SIM_FRESH;
+	const SimSnapshot& snapshot = sim_slots[sim_read];
+
+	++sim_counters.frames;
+	if (snapshot.step != sim_drawn_step)
+		++sim_counters.snapshots_drawn;
+	sim_drawn_step = snapshot.step;
+
+	/**
+	 * previous was the state one step before snapshot.time; drawing at
+	 * time - one step puts the frame between the two.
+	 */
+	float alpha = (float)std::min(std::max((time - snapshot.time) / sim_step_seconds, 0.0), 1.0);
+	SimState state = snapshot.current;
+	state.position = glm::mix(snapshot.previous.position, snapshot.current.position, alpha);
+	state.yaw = glm::mix(snapshot.previous.yaw, snapshot.current.yaw, alpha);
+	state.pitch = glm::mix(snapshot.previous.pitch, snapshot.current.pitch, alpha);
+	state.fov = glm::mix(snapshot.previous.fov, snapshot.current.fov, alpha);
+	return state;
+}
+
+double sim_presented(double time) {
+	using namespace glob;
+
+	double input_time = sim_slots[sim_read].input_time;
+	if (input_time <= 0.0 || input_time == sim_measured_input)
+		return 0.0;
+
+	double latency = (time - input_time) * 1000.0;
+	++sim_counters.latency_samples;
+	sim_counters.latency_ms += latency;
+	sim_counters.latency_max_ms = std::max(sim_counters.latency_max_ms, latency);
+	sim_measured_input = input_time;
+	return input_time;
+}
+
+SimStats sim_stats() {
+	return glob::sim_counters;
+}
+
+void sim_report() {
+	SimStats stats = sim_stats();
+	if (stats.steps == 0)
+		return;
+
+	std::cout << "Simulation: " << stats.steps << " steps at " << stats.rate << " Hz " << (stats.threaded ? "on the input thread" : "on the render thread")
+		<< " in " << stats.ticks << " ticks, " << stats.dropped_steps << " dropped catching up";
+	if (stats.threaded)
+		std::cout << ", " << (stats.ticks > 0 ? stats.oversleep_ms / stats.ticks : 0.0) << " ms late per tick";
+	std::cout << "\n\t" << stats.published << " snapshots published, " << stats.snapshots_drawn << " drawn by " << stats.frames << " frames";
+	if (stats.latency_samples > 0)
+		std::cout << ", input to swap " << stats.latency_ms / stats.latency_samples << " ms average, " << stats.latency_max_ms << " ms worst over " << stats.latency_samples << " inputs";
+	std::cout << std::endl;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <glm/glm.hpp>
+
+const double SIM_TICK_RATE = 120.0;			// Simulation steps per second ("--sim-rate" overrides)
+const int SIM_MAX_STEPS = 30;				// Steps one sim_tick may run to catch up; time beyond that is dropped
+
+/**
+ * Everything input changes: the camera and the toggles main() draws by.
+ */
+struct sim_state {
+	glm::vec3 position;
+	float yaw;								// degrees
+	float pitch;
+	float fov;
+	float speed;							// world units per second
+	bool orthographic;
+	bool wireframe;
+	bool multi_draw;
+	bool depth_prepass;
+	bool show_overdraw;
+	int point_light_color;
+};
+typedef struct sim_state SimState;
+
+/**
+ * Input gathered between two ticks on the thread polling GLFW. Held keys
+ * apply to every step of a tick, everything else to its first step only.
+ */
+struct sim_input {
+	glm::vec3 move;							// held keys: x right, y up, z forwards, each -1, 0 or 1
+	float look_x, look_y;					// mouse movement, degrees of yaw and pitch
+	float zoom;								// wheel steps scrolled with Shift held
+	float speed;							// wheel steps scrolled without it
+	bool toggle_projection;
+	bool toggle_wireframe;
+	bool cycle_light_color;
+	bool toggle_multi_draw;
+	bool toggle_prepass;
+	bool toggle_overdraw;
+	double time;							// glfwGetTime() of the oldest input not yet stepped, 0 for none
+};
+typedef struct sim_input SimInput;
+
+/**
+ * What one tick publishes: the state before and after its last step, so the
+ * render thread can interpolate between them, never reading state the
+ * simulation is still writing.
+ */
+struct sim_snapshot {
+	SimState previous;
+	SimState current;
+	double time;							// glfwGetTime() current was stepped to
+	unsigned long long step;				// steps since sim_init
+	double input_time;						// oldest input current reflects, 0 for none
+};
+typedef struct sim_snapshot SimSnapshot;
+
+/**
+ * Counters since sim_init. The simulation side is written by the thread
+ * calling sim_tick, the rest by the render thread.
+ */
+struct sim_statistics {
+	bool threaded;							// stepped on its own thread rather than at the start of every frame
+	double rate;							// steps per second
+	unsigned long long ticks;				// sim_tick calls that stepped at least once
+	unsigned long long steps;
+	unsigned long long dropped_steps;		// skipped after more than SIM_MAX_STEPS fell due at once
+	double oversleep_ms;					// summed lateness of sim_wait wakeups
+	unsigned long long published;			// snapshots
+	unsigned long long frames;
+	unsigned long long snapshots_drawn;		// frames that picked up a new snapshot
+	unsigned long long latency_samples;		// frames that showed input for the first time
+	double latency_ms;						// summed time from that input to the frame's swap
+	double latency_max_ms;
+};
+typedef struct sim_statistics SimStats;
+
+/**
+ * Start stepping from state at time with rate steps per second. threaded
+ * only labels the report; sim_tick may be called from any one thread.
+ */
+void sim_init(const SimState& state, double time, double rate = SIM_TICK_RATE, bool threaded = true);
+
+/**
+ * Run every step due by time with input, then publish the result through a
+ * lock-free triple buffer and clear input's one-off fields. Returns false
+ * when no step was due yet.
+ */
+bool sim_tick(SimInput& input, double time);
+
+void sim_wait();							// Sleep until the next step is due
+
+/**
+ * The render thread's state for a frame drawn at time: the newest snapshot,
+ * interpolated one step behind so motion stays smooth whatever the frame
+ * rate. Picks up a new snapshot whenever one was published since the last
+ * call.
+ */
+SimState sim_frame_state(double time);
+
+/**
+ * Call once the frame from sim_frame_state has been swapped at time, to
+ * measure how long its newest input took to reach the screen. Returns that
+ * input's time, or 0 when the frame showed no input an earlier frame hadn't.
+ */
+double sim_presented(double time);
+
+glm::vec3 sim_front(const SimState& state);	// Unit vector the camera looks along
+
+SimStats sim_stats();
+
+void sim_report();
+#endif//__SIM_H__
@@ -0,0 +1,813 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFTRASTER_SSE2
+#endif
+
+#include "softraster.h"
+
+#include "cpulit.h"
+
+const int SOFTRASTER_SUBPIXELS = 1 << SOFTRASTER_SUBPIXEL_BITS;
+const int SOFTRASTER_CLIP_PLANES = 6;
+const int SOFTRASTER_MAX_CLIPPED = 3 + SOFTRASTER_CLIP_PLANES;	// Corners a triangle can have after clipping
+
+/**
+ * A vertex after the vertex stage: what single_texture.vs hands the lit shader.
+ */
+struct soft_vertex {
+	glm::vec4 clip;
+	glm::vec3 world;
+	glm::vec3 normal;
+	glm::vec2 coord;
+};
+typedef struct soft_vertex SoftVertex;
+
+/**
+ * A triangle ready to rasterize. Edge i is opposite corner i, and is
+ * E(x, y) = a * x + b * y + c over subpixel sample positions; inside the
+ * triangle every edge exceeds its threshold (-1 for top-left edges, 0 else).
+ */
+struct soft_triangle {
+	int a[3], b[3];
+	long long c[3];
+	int threshold[3];
+	float inv_area;
+	int min_x, min_y, max_x, max_y;			// pixels, clamped to the target
+	float z[3];								// window depth
+	float inv_w[3];
+	glm::vec3 world[3];
+	glm::vec3 normal[3];
+	glm::vec2 coord[3];
+	int mesh;
+};
+typedef struct soft_triangle SoftTriangle;
+
+/**
+ * Triangles of one binning task, with the entries of every tile they reach
+ * sorted by tile: tile t owns entries[offsets[t]] to entries[offsets[t + 1]].
+ */
+struct bin_chunk {
+	int mesh;
+	unsigned int first;						// first triangle of the mesh
+	unsigned int count;
+	std::vector<SoftTriangle> triangles;
+	std::vector<std::pair<int, int>> pairs;	// tile and triangle, in submission order
+	std::vector<int> offsets;
+	std::vector<int> entries;
+	unsigned int culled;
+	unsigned int clipped;
+};
+typedef struct bin_chunk BinChunk;
+
+struct task_queue {
+	std::mutex lock;
+	std::deque<int> tasks;
+};
+typedef struct task_queue TaskQueue;
+
+/**
+ * What every stage of one frame reads.
+ */
+struct soft_frame {
+	int width, height;
+	int tiles_x, tiles_y;
+	glm::vec2 guard;						// clip space x and y limits over w
+	glm::mat4 view_projection;
+	softraster_simd simd;
+	CpuLights lights;
+};
+typedef struct soft_frame SoftFrame;
+
+namespace glob {
+	std::vector<CpuMesh> soft_meshes;
+	std::vector<CpuTexture> soft_textures;
+	std::vector<std::vector<SoftVertex>> soft_vertices;		// per mesh, kept between frames
+	std::vector<BinChunk> soft_chunks;
+
+	/**
+	 * Workers 1 to N - 1 live from softraster_init to softraster_destroy; the
+	 * thread that renders is worker 0.
+	 */
+	std::vector<std::thread> soft_workers;
+	std::mutex soft_pool_lock;				// guards everything below
+	std::condition_variable soft_pool_start;	// a stage was handed out, or the workers should stop
+	std::condition_variable soft_pool_done;	// the last worker finished its share of a stage
+	const std::function<void(int)>* soft_pool_stage = nullptr;
+	unsigned long long soft_pool_generation = 0;	// stages handed out so far
+	int soft_pool_threads = 0;				// workers the current stage runs on
+	int soft_pool_running = 0;				// pool workers still in it
+	bool soft_pool_stopping = false;
+
+	SoftRasterStats softraster_counters;
+}
+
+/**
+ * Pool thread: run worker's part of every stage handed out after stage seen
+ * that uses it.
+ */
+static void pool_worker(int worker, unsigned long long seen) {
+	using namespace glob;
+
+	for (;;) {
+		const std::function<void(int)>* stage;
+		{
+			std::unique_lock<std::mutex> lock(soft_pool_lock);
+			soft_pool_start.wait(lock, [&] { return soft_pool_stopping || soft_pool_generation != seen; });
+			if (soft_pool_stopping)
+				return;
+			seen = soft_pool_generation;
+			if (worker >= soft_pool_threads)
+				continue;
+			stage = soft_pool_stage;
+		}
+
+		(*stage)(worker);
+		std::lock_guard<std::mutex> lock(soft_pool_lock);
+		if (--soft_pool_running == 0)
+			soft_pool_done.notify_one();
+	}
+}
+
+/**
+ * Start pool workers until threads can run at once.
+ */
+static void pool_grow(int threads) {
+	using namespace glob;
+
+	std::lock_guard<std::mutex> lock(soft_pool_lock);
+	while ((int)soft_workers.size() < threads - 1)
+		soft_workers.emplace_back(pool_worker, (int)soft_workers.size() + 1, soft_pool_generation);
+}
+
+/**
+ * Run tasks 0 to tasks - 1 on threads workers of the pool. Each worker starts
+ * with a contiguous share of the tasks and takes from the front of its own
+ * queue; once it runs dry it steals from the back of the others'. Returns the
+ * steals.
+ */
+static unsigned long long run_stealing(int threads, int tasks, const std::function<void(int)>& run) {
+	std::vector<TaskQueue> queues(threads);
+	for (int worker = 0; worker < threads; ++worker) {
+		for (int task = (int)((long long)tasks * worker / threads); task < (int)((long long)tasks * (worker + 1) / threads); ++task)
+			queues[worker].tasks.push_back(task);
+	}
+
+	std::atomic<unsigned long long> steals(0);
+	auto work = [&](int worker) {
+		for (;;) {
+			int task = -1;
+			{
+				std::lock_guard<std::mutex> guard(queues[worker].lock);
+				if (!queues[worker].tasks.empty()) {
+					task = queues[worker].tasks.front();
+					queues[worker].tasks.pop_front();
+				}
+			}
+			for (int i = 1; task < 0 && i < threads; ++i) {
+				TaskQueue& victim = queues[(worker + i) % threads];
+				std::lock_guard<std::mutex> guard(victim.lock);
+				if (!victim.tasks.empty()) {
+					task = victim.tasks.back();
+					victim.tasks.pop_back();
+					++steals;
+				}
+			}
+			if (task < 0)
+				return;								// no task is ever added, so every queue stays empty
+			run(task);
+		}
+	};
+
+	if (threads == 1) {
+		work(0);
+		return steals;
+	}
+
+	pool_grow(threads);
+	std::function<void(int)> stage = work;
+	{
+		std::lock_guard<std::mutex> lock(glob::soft_pool_lock);
+		glob::soft_pool_stage = &stage;
+		glob::soft_pool_threads = threads;
+		glob::soft_pool_running = threads - 1;
+		++glob::soft_pool_generation;
+	}
+	glob::soft_pool_start.notify_all();
+	work(0);
+
+	std::unique_lock<std::mutex> lock(glob::soft_pool_lock);
+	glob::soft_pool_done.wait(lock, [] { return glob::soft_pool_running == 0; });
+	glob::soft_pool_stage = nullptr;
+	return steals;
+}
+
+bool softraster_init(const std::vector<BatchItem>& items) {
+	using namespace glob;
+
+	cpulit_read(items, soft_meshes, soft_textures);
+	soft_vertices.assign(soft_meshes.size(), std::vector<SoftVertex>());
+	pool_grow(std::max(1, (int)std::thread::hardware_concurrency()));
+
+	if (soft_meshes.empty()) {
+		std::cerr << "ERROR::SOFTRASTER::NO_MESHES" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+softraster_simd softraster_best_simd() {
+#ifdef SOFTRASTER_SSE2
+	return SOFTRASTER_SIMD_SSE2;
+#else
+	return SOFTRASTER_SIMD_SCALAR;
+#endif
+}
+
+const char* softraster_simd_name(softraster_simd simd) {
+	switch (simd) {
+	case SOFTRASTER_SIMD_SCALAR: return "scalar";
+	case SOFTRASTER_SIMD_SSE2: return "SSE2";
+	}
+	return "unknown";
+}
+
+static SoftVertex lerp_vertex(const SoftVertex& from, const SoftVertex& to, float t) {
+	SoftVertex vertex;
+	vertex.clip = from.clip + (to.clip - from.clip) * t;
+	vertex.world = from.world + (to.world - from.world) * t;
+	vertex.normal = from.normal + (to.normal - from.normal) * t;
+	vertex.coord = from.coord + (to.coord - from.coord) * t;
+	return vertex;
+}
+
+/**
+ * Signed distance to clip plane i: near, far, then the guard band's left,
+ * right, bottom and top. Inside is >= 0.
+ */
+static float plane_distance(const SoftFrame& frame, const glm::vec4& clip, int plane) {
+	switch (plane) {
+	case 0: return clip.z + clip.w;
+	case 1: return clip.w - clip.z;
+	case 2: return clip.x + frame.guard.x * clip.w;
+	case 3: return frame.guard.x * clip.w - clip.x;
+	case 4: return clip.y + frame.guard.y * clip.w;
+	default: return frame.guard.y * clip.w - clip.y;
+	}
+}
+
+/**
+ * Snap to subpixels and find the edges. Returns false for triangles without
+ * area or off the target.
+ */
+static bool setup_triangle(const SoftFrame& frame, const SoftVertex* corners[3], int mesh, SoftTriangle& triangle) {
+	int x[3], y[3];
+	for (int i = 0; i < 3; ++i) {
+		const SoftVertex& corner = *corners[i];
+		float inv_w = 1.f / corner.clip.w;
+		float sx = (corner.clip.x * inv_w * 0.5f + 0.5f) * frame.width;
+		float sy = (corner.clip.y * inv_w * 0.5f + 0.5f) * frame.height;
+		x[i] = (int)std::floor(sx * SOFTRASTER_SUBPIXELS + 0.5f);
+		y[i] = (int)std::floor(sy * SOFTRASTER_SUBPIXELS + 0.5f);
+		triangle.z[i] = corner.clip.z * inv_w * 0.5f + 0.5f;
+		triangle.inv_w[i] = inv_w;
+		triangle.world[i] = corner.world;
+		triangle.normal[i] = corner.normal;
+		triangle.coord[i] = corner.coord;
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		int from = (i + 1) % 3, to = (i + 2) % 3;
+		triangle.a[i] = y[from] - y[to];
+		triangle.b[i] = x[to] - x[from];
+		triangle.c[i] = (long long)x[from] * y[to] - (long long)y[from] * x[to];
+	}
+	long long area = triangle.a[0] * (long long)x[0] + triangle.b[0] * (long long)y[0] + triangle.c[0];
+	if (area == 0)
+		return false;
+	if (area < 0) {
+		for (int i = 0; i < 3; ++i) {
+			triangle.a[i] = -triangle.a[i];
+			triangle.b[i] = -triangle.b[i];
+			triangle.c[i] = -triangle.c[i];
+		}
+		area = -area;
+	}	// no face culling: clockwise triangles are drawn the same way
+
+	/**
+	 * An edge shared by two triangles has opposite coefficients in each, so
+	 * exactly one of them owns the samples on it.
+	 */
+	for (int i = 0; i < 3; ++i)
+		triangle.threshold[i] = (triangle.a[i] > 0 || (triangle.a[i] == 0 && triangle.b[i] < 0)) ? -1 : 0;
+	triangle.inv_area = (float)(1.0 / (double)area);
+
+	int low_x = std::min(x[0], std::min(x[1], x[2])), high_x = std::max(x[0], std::max(x[1], x[2]));
+	int low_y = std::min(y[0], std::min(y[1], y[2])), high_y = std::max(y[0], std::max(y[1], y[2]));
+	triangle.min_x = std::max(0, (low_x - SOFTRASTER_SUBPIXELS / 2) >> SOFTRASTER_SUBPIXEL_BITS);
+	triangle.min_y = std::max(0, (low_y - SOFTRASTER_SUBPIXELS / 2) >> SOFTRASTER_SUBPIXEL_BITS);
+	triangle.max_x = std::min(frame.width - 1, (high_x - SOFTRASTER_SUBPIXELS / 2) >> SOFTRASTER_SUBPIXEL_BITS);
+	triangle.max_y = std::min(frame.height - 1, (high_y - SOFTRASTER_SUBPIXELS / 2) >> SOFTRASTER_SUBPIXEL_BITS);
+	triangle.mesh = mesh;
+	return triangle.min_x <= triangle.max_x && triangle.min_y <= triangle.max_y;
+}
+
+static long long sample_position(int pixel) {
+	return (long long)pixel * SOFTRASTER_SUBPIXELS + SOFTRASTER_SUBPIXELS / 2;
+}
+
+/**
+ * Range of edge over the pixel centers of a rectangle (corners suffice, it is
+ * linear).
+ */
+static void edge_range(const SoftTriangle& triangle, int edge, int x0, int y0, int x1, int y1, long long& low, long long& high) {
+	long long ax0 = triangle.a[edge] * sample_position(x0), ax1 = triangle.a[edge] * sample_position(x1);
+	long long by0 = triangle.b[edge] * sample_position(y0), by1 = triangle.b[edge] * sample_position(y1);
+	low = std::min(ax0, ax1) + std::min(by0, by1) + triangle.c[edge];
+	high = std::max(ax0, ax1) + std::max(by0, by1) + triangle.c[edge];
+}
+
+/**
+ * Append triangle to the chunk and to every tile it may cover.
+ */
+static void bin_triangle(const SoftFrame& frame, BinChunk& chunk, const SoftTriangle& triangle) {
+	int index = (int)chunk.triangles.size();
+	chunk.triangles.push_back(triangle);
+
+	for (int ty = triangle.min_y / SOFTRASTER_TILE_SIZE; ty <= triangle.max_y / SOFTRASTER_TILE_SIZE; ++ty) {
+		for (int tx = triangle.min_x / SOFTRASTER_TILE_SIZE; tx <= triangle.max_x / SOFTRASTER_TILE_SIZE; ++tx) {
+			int x0 = std::max(triangle.min_x, tx * SOFTRASTER_TILE_SIZE), x1 = std::min(triangle.max_x, (tx + 1) * SOFTRASTER_TILE_SIZE - 1);
+			int y0 = std::max(triangle.min_y, ty * SOFTRASTER_TILE_SIZE), y1 = std::min(triangle.max_y, (ty + 1) * SOFTRASTER_TILE_SIZE - 1);
+			bool outside = false;
+			for (int edge = 0; edge < 3 && !outside; ++edge) {
+				long long low, high;
+				edge_range(triangle, edge, x0, y0, x1, y1, low, high);
+				outside = high <= triangle.threshold[edge];
+			}	// large triangles skip the tiles beside their edges
+			if (!outside)
+				chunk.pairs.push_back({ ty * frame.tiles_x + tx, index });
+		}
+	}
+}
+
+/**
+ * Clip one triangle against the planes it crosses (Sutherland-Hodgman) and
+ * bin the fan that remains.
+ */
+static void clip_triangle(const SoftFrame& frame, BinChunk& chunk, const SoftVertex* corners[3]) {
+	SoftVertex polygon[2][SOFTRASTER_MAX_CLIPPED];
+	int count = 3;
+	for (int i = 0; i < 3; ++i)
+		polygon[0][i] = *corners[i];
+
+	int current = 0;
+	for (int plane = 0; plane < SOFTRASTER_CLIP_PLANES && count > 0; ++plane) {
+		const SoftVertex* in = polygon[current];
+		SoftVertex* out = polygon[1 - current];
+		int kept = 0;
+		for (int i = 0; i < count; ++i) {
+			const SoftVertex& from = in[i];
+			const SoftVertex& to = in[(i + 1) % count];
+			float d_from = plane_distance(frame, from.clip, plane), d_to = plane_distance(frame, to.clip, plane);
+			if (d_from >= 0.f)
+				out[kept++] = from;
+			if ((d_from >= 0.f) != (d_to >= 0.f))
+				out[kept++] = lerp_vertex(from, to, d_from / (d_from - d_to));
+		}
+		count = kept;
+		current = 1 - current;
+	}
+
+	for (int i = 1; i + 1 < count; ++i) {
+		const SoftVertex* fan[3] = { &polygon[current][0], &polygon[current][i], &polygon[current][i + 1] };
+		SoftTriangle triangle;
+		if (setup_triangle(frame, fan, chunk.mesh, triangle))
+			bin_triangle(frame, chunk, triangle);
+	}
+}
+
+static void bin_triangles(const SoftFrame& frame, BinChunk& chunk) {
+	using namespace glob;
+
+	const CpuMesh& mesh = soft_meshes[chunk.mesh];
+	const std::vector<SoftVertex>& vertices = soft_vertices[chunk.mesh];
+	chunk.triangles.clear();
+	chunk.pairs.clear();
+	chunk.culled = chunk.clipped = 0;
+
+	for (unsigned int t = chunk.first; t < chunk.first + chunk.count; ++t) {
+		const SoftVertex* corners[3] = { &vertices[mesh.indices[t * 3]], &vertices[mesh.indices[t * 3 + 1]], &vertices[mesh.indices[t * 3 + 2]] };
+
+		bool outside = false, crossing = false;
+		for (int plane = 0; plane < SOFTRASTER_CLIP_PLANES; ++plane) {
+			int out = 0;
+			for (int i = 0; i < 3; ++i)
+				out += plane_distance(frame, corners[i]->clip, plane) < 0.f;
+			outside |= out == 3;
+			crossing |= out > 0;
+		}
+		if (outside) {
+			++chunk.culled;
+			continue;
+		}
+
+		size_t before = chunk.triangles.size();
+		if (crossing) {
+			++chunk.clipped;
+			clip_triangle(frame, chunk, corners);
+		}
+		else {
+			SoftTriangle triangle;
+			if (setup_triangle(frame, corners, chunk.mesh, triangle))
+				bin_triangle(frame, chunk, triangle);
+		}
+		chunk.culled += chunk.triangles.size() == before;
+	}
+
+	/**
+	 * Counting sort by tile keeps submission order within each tile, so depth
+	 * ties resolve the same way as on the GPU whatever the thread count.
+	 */
+	int tiles = frame.tiles_x * frame.tiles_y;
+	chunk.offsets.assign(tiles + 1, 0);
+	for (const auto& pair : chunk.pairs)
+		++chunk.offsets[pair.first + 1];
+	for (int tile = 0; tile < tiles; ++tile)
+		chunk.offsets[tile + 1] += chunk.offsets[tile];
+	chunk.entries.resize(chunk.pairs.size());
+	std::vector<int> cursor(chunk.offsets.begin(), chunk.offsets.end() - 1);
+	for (const auto& pair : chunk.pairs)
+		chunk.entries[cursor[pair.first]++] = pair.second;
+}
+
+/**
+ * Visible surface of one pixel of a tile.
+ */
+struct tile_sample {
+	const SoftTriangle* triangle;
+	float b1, b2;							// screen space weights of corners 1 and 2
+};
+typedef struct tile_sample TileSample;
+
+static void depth_test(const SoftTriangle& triangle, int x, int y, SoftTarget& target, TileSample& sample) {
+	long long sx = sample_position(x), sy = sample_position(y);
+	float b0 = (float)(triangle.a[0] * sx + triangle.b[0] * sy + triangle.c[0]) * triangle.inv_area;
+	float b1 = (float)(triangle.a[1] * sx + triangle.b[1] * sy + triangle.c[1]) * triangle.inv_area;
+	float b2 = (float)(triangle.a[2] * sx + triangle.b[2] * sy + triangle.c[2]) * triangle.inv_area;
+	float z = triangle.z[0] * b0 + triangle.z[1] * b1 + triangle.z[2] * b2;
+
+	float& depth = target.depth[(size_t)y * target.width + x];
+	if (z < depth) {
+		depth = z;
+		sample.triangle = &triangle;
+		sample.b1 = b1;
+		sample.b2 = b2;
+	}	// GL_LESS
+}
+
+static void raster_scalar(const SoftTriangle& triangle, int x0, int y0, int x1, int y1, int tile_x, int tile_y, SoftTarget& target, TileSample* samples) {
+	for (int y = y0; y <= y1; ++y) {
+		long long row[3];
+		for (int edge = 0; edge < 3; ++edge)
+			row[edge] = triangle.a[edge] * sample_position(x0) + triangle.b[edge] * sample_position(y) + triangle.c[edge];
+
+		for (int x = x0; x <= x1; ++x) {
+			if (row[0] > triangle.threshold[0] && row[1] > triangle.threshold[1] && row[2] > triangle.threshold[2])
+				depth_test(triangle, x, y, target, samples[(y - tile_y) * SOFTRASTER_TILE_SIZE + x - tile_x]);
+			for (int edge = 0; edge < 3; ++edge)
+				row[edge] += triangle.a[edge] * SOFTRASTER_SUBPIXELS;
+		}
+	}
+}
+
+#ifdef SOFTRASTER_SSE2
+/**
+ * Four pixels of a row per test. Edges that pass over the whole rectangle are
+ * skipped; the others only take values within a few tiles of their threshold,
+ * which fit 32-bit lanes (see SOFTRASTER_GUARD_BAND).
+ */
+static void raster_sse2(const SoftTriangle& triangle, int x0, int y0, int x1, int y1, int tile_x, int tile_y, SoftTarget& target, TileSample* samples) {
+	int edges[3], tested = 0;
+	for (int edge = 0; edge < 3; ++edge) {
+		long long low, high;
+		edge_range(triangle, edge, x0, y0, x1, y1, low, high);
+		if (low <= triangle.threshold[edge])
+			edges[tested++] = edge;
+	}
+
+	__m128i step[3], threshold[3];
+	for (int i = 0; i < tested; ++i) {
+		int a = triangle.a[edges[i]] * SOFTRASTER_SUBPIXELS;
+		step[i] = _mm_set_epi32(3 * a, 2 * a, a, 0);
+		threshold[i] = _mm_set1_epi32(triangle.threshold[edges[i]]);
+	}
+	const __m128i lane = _mm_set_epi32(3, 2, 1, 0);
+
+	for (int y = y0; y <= y1; ++y) {
+		int row[3];
+		for (int i = 0; i < tested; ++i)
+			row[i] = (int)(triangle.a[edges[i]] * sample_position(x0) + triangle.b[edges[i]] * sample_position(y) + triangle.c[edges[i]]);
+
+		for (int x = x0; x <= x1; x += 4) {
+			__m128i inside = _mm_cmplt_epi32(lane, _mm_set1_epi32(x1 - x + 1));		// lanes past the rectangle
+			for (int i = 0; i < tested; ++i) {
+				__m128i value = _mm_add_epi32(_mm_set1_epi32(row[i] + (x - x0) * triangle.a[edges[i]] * SOFTRASTER_SUBPIXELS), step[i]);
+				inside = _mm_and_si128(inside, _mm_cmpgt_epi32(value, threshold[i]));
+			}
+
+			int mask = _mm_movemask_ps(_mm_castsi128_ps(inside));
+			while (mask) {
+				int bit = 0;
+				while (!(mask & (1 << bit)))
+					++bit;
+				mask &= ~(1 << bit);
+				depth_test(triangle, x + bit, y, target, samples[(y - tile_y) * SOFTRASTER_TILE_SIZE + x + bit - tile_x]);
+			}
+		}
+	}
+}
+#endif
+
+/**
+ * The lit shader's main() without shadows, for one visible sample.
+ */
+static glm::vec3 shade_sample(const SoftFrame& frame, const TileSample& sample) {
+	using namespace glob;
+
+	const SoftTriangle& triangle = *sample.triangle;
+	float weights[3] = { (1.f - sample.b1 - sample.b2) * triangle.inv_w[0], sample.b1 * triangle.inv_w[1], sample.b2 * triangle.inv_w[2] };
+	float sum = weights[0] + weights[1] + weights[2];
+	glm::vec3 world = glm::vec3(0.f), normal = glm::vec3(0.f);
+	glm::vec2 coord = glm::vec2(0.f);
+	for (int i = 0; i < 3; ++i) {
+		float weight = weights[i] / sum;		// perspective correct
+		world += triangle.world[i] * weight;
+		normal += triangle.normal[i] * weight;
+		coord += triangle.coord[i] * weight;
+	}
+
+	return cpulit_shade(frame.lights, soft_meshes[triangle.mesh], soft_textures, world, normal, coord, [](glm::vec3, float) { return true; });
+}
+
+/**
+ * Clear one tile, resolve visibility for every triangle binned to it in
+ * submission order, then shade each covered pixel once. Returns the pixels
+ * shaded, counted here rather than in the caller's per-tile slots, which
+ * neighbouring tiles on other workers share cache lines with.
+ */
+static unsigned long long raster_tile(const SoftFrame& frame, int tile, SoftTarget& target) {
+	using namespace glob;
+
+	int tile_x = tile % frame.tiles_x * SOFTRASTER_TILE_SIZE, tile_y = tile / frame.tiles_x * SOFTRASTER_TILE_SIZE;
+	int end_x = std::min(frame.width, tile_x + SOFTRASTER_TILE_SIZE) - 1, end_y = std::min(frame.height, tile_y + SOFTRASTER_TILE_SIZE) - 1;
+
+	TileSample samples[SOFTRASTER_TILE_SIZE * SOFTRASTER_TILE_SIZE];
+	for (int y = tile_y; y <= end_y; ++y) {
+		std::fill(&target.depth[(size_t)y * target.width + tile_x], &target.depth[(size_t)y * target.width + end_x] + 1, 1.f);
+		for (int x = tile_x; x <= end_x; ++x)
+			samples[(y - tile_y) * SOFTRASTER_TILE_SIZE + x - tile_x].triangle = nullptr;
+	}
+
+	for (const BinChunk& chunk : soft_chunks) {
+		for (int entry = chunk.offsets[tile]; entry < chunk.offsets[tile + 1]; ++entry) {
+			const SoftTriangle& triangle = chunk.triangles[chunk.entries[entry]];
+			int x0 = std::max(tile_x, triangle.min_x), x1 = std::min(end_x, triangle.max_x);
+			int y0 = std::max(tile_y, triangle.min_y), y1 = std::min(end_y, triangle.max_y);
+#ifdef SOFTRASTER_SSE2
+			if (frame.simd == SOFTRASTER_SIMD_SSE2) {
+				raster_sse2(triangle, x0, y0, x1, y1, tile_x, tile_y, target, samples);
+				continue;
+			}
+#endif
+			raster_scalar(triangle, x0, y0, x1, y1, tile_x, tile_y, target, samples);
+		}
+	}
+
+	unsigned long long shaded = 0;
+	for (int y = tile_y; y <= end_y; ++y) {
+		for (int x = tile_x; x <= end_x; ++x) {
+			const TileSample& sample = samples[(y - tile_y) * SOFTRASTER_TILE_SIZE + x - tile_x];
+			glm::vec3 color = glm::vec3(0.f);			// main()'s clear color
+			if (sample.triangle) {
+				color = glm::clamp(shade_sample(frame, sample), glm::vec3(0.f), glm::vec3(1.f));
+				++shaded;
+			}
+			unsigned char* pixel = &target.color[((size_t)y * target.width + x) * 4];
+			for (int c = 0; c < 3; ++c)
+				pixel[c] = (unsigned char)(color[c] * 255.f + 0.5f);
+			pixel[3] = 255;
+		}
+	}
+	return shaded;
+}
+
+void softraster_render(SoftTarget& target, int width, int height, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos, int threads, softraster_simd simd) {
+	using namespace glob;
+
+	if (threads <= 0)
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+	SoftRasterStats& stats = softraster_counters;
+	++stats.frames;
+	stats.threads = threads;
+	stats.simd = simd = std::min(simd, softraster_best_simd());
+	stats.steals = 0;
+
+	target.width = width;
+	target.height = height;
+	target.color.resize((size_t)width * height * 4);
+	target.depth.resize((size_t)width * height);
+
+	SoftFrame frame;
+	frame.width = width;
+	frame.height = height;
+	frame.tiles_x = (width + SOFTRASTER_TILE_SIZE - 1) / SOFTRASTER_TILE_SIZE;
+	frame.tiles_y = (height + SOFTRASTER_TILE_SIZE - 1) / SOFTRASTER_TILE_SIZE;
+	frame.guard = glm::vec2(1.f + 2.f * SOFTRASTER_GUARD_BAND / width, 1.f + 2.f * SOFTRASTER_GUARD_BAND / height);
+	frame.view_projection = projection * view;
+	frame.simd = simd;
+	cpulit_copy_lights(frame.lights, dir_light, viewPos);
+
+	/**
+	 * Vertex stage, as single_texture.vs.
+	 */
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<std::pair<int, unsigned int>> vertex_tasks;
+	for (int mesh = 0; mesh < (int)soft_meshes.size(); ++mesh) {
+		soft_vertices[mesh].resize(soft_meshes[mesh].positions.size());
+		for (unsigned int first = 0; first < soft_meshes[mesh].positions.size(); first += SOFTRASTER_VERTICES_PER_TASK)
+			vertex_tasks.push_back({ mesh, first });
+	}
+	stats.steals += run_stealing(threads, (int)vertex_tasks.size(), [&](int task) {
+		const CpuMesh& mesh = soft_meshes[vertex_tasks[task].first];
+		std::vector<SoftVertex>& out = soft_vertices[vertex_tasks[task].first];
+		glm::mat4 model = mesh.item.model->model;
+		glm::mat4 model_view_projection = frame.view_projection * model;
+		glm::mat3 normal_model = glm::mat3(glm::transpose(glm::inverse(model)));
+		unsigned int first = vertex_tasks[task].second;
+		unsigned int last = std::min((unsigned int)mesh.positions.size(), first + SOFTRASTER_VERTICES_PER_TASK);
+		for (unsigned int i = first; i < last; ++i) {
+			glm::vec4 position = glm::vec4(mesh.positions[i], 1.f);
+			out[i].clip = model_view_projection * position;
+			out[i].world = glm::vec3(model * position);
+			out[i].normal = normal_model * mesh.normals[i];
+			out[i].coord = mesh.coords[i];
+		}
+	});
+	auto vertex_end = std::chrono::high_resolution_clock::now();
+
+	/**
+	 * Clip and bin. Chunks keep their storage between frames.
+	 */
+	size_t chunks = 0;
+	for (int mesh = 0; mesh < (int)soft_meshes.size(); ++mesh) {
+		unsigned int triangles = (unsigned int)soft_meshes[mesh].indices.size() / 3;
+		for (unsigned int first = 0; first < triangles; first += SOFTRASTER_TRIANGLES_PER_TASK, ++chunks) {
+			if (soft_chunks.size() <= chunks)
+				soft_chunks.emplace_back();
+			soft_chunks[chunks].mesh = mesh;
+			soft_chunks[chunks].first = first;
+			soft_chunks[chunks].count = std::min((unsigned int)SOFTRASTER_TRIANGLES_PER_TASK, triangles - first);
+		}
+	}
+	soft_chunks.resize(chunks);
+	stats.steals += run_stealing(threads, (int)chunks, [&](int task) { bin_triangles(frame, soft_chunks[task]); });
+	auto bin_end = std::chrono::high_resolution_clock::now();
+
+	/**
+	 * Raster and shade, one tile per task.
+	 */
+	int tiles = frame.tiles_x * frame.tiles_y;
+	std::vector<unsigned long long> shaded(tiles, 0);
+	stats.steals += run_stealing(threads, tiles, [&](int tile) { shaded[tile] = raster_tile(frame, tile, target); });
+	auto raster_end = std::chrono::high_resolution_clock::now();
+
+	stats.triangles = stats.culled = stats.clipped = stats.bin_entries = stats.tiles = 0;
+	stats.pixels_shaded = 0;
+	for (const BinChunk& chunk : soft_chunks) {
+		stats.triangles += chunk.count;
+		stats.culled += chunk.culled;
+		stats.clipped += chunk.clipped;
+		stats.bin_entries += (unsigned int)chunk.entries.size();
+	}
+	for (int tile = 0; tile < tiles; ++tile) {
+		bool reached = false;
+		for (const BinChunk& chunk : soft_chunks)
+			reached |= chunk.offsets[tile + 1] > chunk.offsets[tile];
+		stats.tiles += reached;
+		stats.pixels_shaded += shaded[tile];
+	}
+	stats.vertex_ms = std::chrono::duration<double, std::milli>(vertex_end - start).count();
+	stats.bin_ms = std::chrono::duration<double, std::milli>(bin_end - vertex_end).count();
+	stats.raster_ms = std::chrono::duration<double, std::milli>(raster_end - bin_end).count();
+}
+
+/**
+ * PPM stores rows top to bottom while the target is bottom to top.
+ */
+bool softraster_save(const SoftTarget& target, const char* path) {
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr) {
+		std::cerr << "ERROR::SOFTRASTER::SAVE::CANNOT_OPEN " << path << std::endl;
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", target.width, target.height);
+	std::vector<unsigned char> row((size_t)target.width * 3);
+	for (int y = target.height - 1; y >= 0; --y) {
+		for (int x = 0; x < target.width; ++x)
+			memcpy(&row[(size_t)x * 3], &target.color[((size_t)y * target.width + x) * 4], 3);
+		fwrite(row.data(), 1, row.size(), file);
+	}
+	fclose(file);
+	return true;
+}
+
+void softraster_benchmark(int width, int height, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos, int frames) {
+	using namespace glob;
+
+	if (soft_meshes.empty()) {
+		std::cout << "Software rasterizer benchmark skipped: no meshes" << std::endl;
+		return;
+	}
+
+	int cores = std::max(1, (int)std::thread::hardware_concurrency());
+	std::vector<int> counts;
+	for (int threads = 1; threads < cores; threads *= 2)
+		counts.push_back(threads);
+	counts.push_back(cores);
+
+	SoftTarget reference, target;
+	softraster_render(reference, width, height, projection, view, dir_light, viewPos, 1, SOFTRASTER_SIMD_SCALAR);
+	std::cout << "Software rasterizer benchmark: " << width << "x" << height << ", " << softraster_counters.triangles << " triangles, "
+		<< softraster_counters.pixels_shaded << " pixels shaded, " << frames << " frames per run" << std::endl;
+
+	for (int simd = SOFTRASTER_SIMD_SCALAR; simd <= softraster_best_simd(); ++simd) {
+		double single_ms = 0.0;
+		for (int threads : counts) {
+			softraster_render(target, width, height, projection, view, dir_light, viewPos, threads, (softraster_simd)simd);	// warm up
+			double vertex_ms = 0.0, bin_ms = 0.0, raster_ms = 0.0;
+			unsigned long long steals = 0;
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int frame = 0; frame < frames; ++frame) {
+				softraster_render(target, width, height, projection, view, dir_light, viewPos, threads, (softraster_simd)simd);
+				vertex_ms += softraster_counters.vertex_ms;
+				bin_ms += softraster_counters.bin_ms;
+				raster_ms += softraster_counters.raster_ms;
+				steals += softraster_counters.steals;
+			}
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / frames;
+			if (threads == 1)
+				single_ms = ms;
+
+			bool matches = target.color == reference.color;
+			std::cout << "\t" << softraster_simd_name((softraster_simd)simd) << ", " << threads << " thread(s): " << ms << " ms/frame (vertex "
+				<< vertex_ms / frames << ", bin " << bin_ms / frames << ", raster " << raster_ms / frames << "), " << single_ms / ms << "x one core, "
+				<< (double)steals / frames << " steals/frame" << (matches ? "" : ", IMAGE DIFFERS from scalar on one thread") << std::endl;
+		}
+	}
+}
+
+SoftRasterStats softraster_stats() {
+	return glob::softraster_counters;
+}
+
+void softraster_report() {
+	SoftRasterStats stats = softraster_stats();
+	if (stats.frames == 0)
+		return;
+
+	std::cout << "Software rasterizer: " << stats.frames << " frames, last on " << stats.threads << " thread(s), " << softraster_simd_name(stats.simd) << ": "
+		<< stats.triangles << " triangles (" << stats.culled << " culled, " << stats.clipped << " clipped), " << stats.bin_entries << " bin entries over "
+		<< stats.tiles << " tiles, " << stats.pixels_shaded << " pixels shaded, " << stats.steals << " steals\n"
+		<< "\tvertex " << stats.vertex_ms << " ms, bin " << stats.bin_ms << " ms, raster " << stats.raster_ms << " ms" << std::endl;
+}
+
+void softraster_destroy() {
+	using namespace glob;
+
+	{
+		std::lock_guard<std::mutex> lock(soft_pool_lock);
+		soft_pool_stopping = true;
+	}
+	soft_pool_start.notify_all();
+	for (std::thread& worker : soft_workers)
+		worker.join();
+	soft_workers.clear();
+	soft_pool_stopping = false;
+
+	soft_meshes.clear();
+	soft_textures.clear();
+	soft_vertices.clear();
+	soft_chunks.clear();
+}
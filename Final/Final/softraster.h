@@ -0,0 +1,94 @@
+#pragma once
+#ifndef __SOFTRASTER_H__
+#define __SOFTRASTER_H__
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "lights.h"
+#include "batch.h"
+
+const int SOFTRASTER_TILE_SIZE = 32;				// Pixels per side of a screen tile, the unit of raster work
+const int SOFTRASTER_SUBPIXEL_BITS = 4;				// Vertices snap to 1/16 pixel, so edge tests are exact integers
+const int SOFTRASTER_GUARD_BAND = 4096;				// Pixels past the screen edges triangles may reach before they are clipped
+const int SOFTRASTER_VERTICES_PER_TASK = 1024;		// Vertices a worker transforms at a time
+const int SOFTRASTER_TRIANGLES_PER_TASK = 512;		// Triangles a worker clips and bins at a time
+
+/**
+ * Instruction sets the coverage tests can run on.
+ */
+enum softraster_simd {
+	SOFTRASTER_SIMD_SCALAR,
+	SOFTRASTER_SIMD_SSE2
+};
+
+/**
+ * Color and depth of one software frame. Rows run bottom to top, like the
+ * default framebuffer, and color is RGBA8.
+ */
+struct soft_target {
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> color;
+	std::vector<float> depth;					// window depth in [0, 1], cleared to 1
+};
+typedef struct soft_target SoftTarget;
+
+/**
+ * Counters for the last softraster_render call.
+ */
+struct softraster_statistics {
+	unsigned long long frames;					// since startup
+	int threads;
+	softraster_simd simd;
+	unsigned int triangles;						// submitted
+	unsigned int culled;						// outside the frustum or without area
+	unsigned int clipped;						// crossing a clip plane, split before setup
+	unsigned int bin_entries;					// triangle-tile pairs
+	unsigned int tiles;							// tiles at least one triangle reached
+	unsigned long long pixels_shaded;			// once per covered pixel, after depth testing
+	unsigned long long steals;					// tasks a worker took from another's queue
+	double vertex_ms;
+	double bin_ms;
+	double raster_ms;
+};
+typedef struct softraster_statistics SoftRasterStats;
+
+/**
+ * CPU backend for the lit Models: items' meshes and textures are read back
+ * from the GPU once, then frames are drawn without it. Triangles are
+ * transformed, clipped and binned into SOFTRASTER_TILE_SIZE tiles; each tile is
+ * then rasterized with half-space tests, depth tested so every pixel is shaded
+ * once, and shaded like the lit shader (shaders/lit.fs.glsl): Phong for every
+ * light in the light buffer and the directional light, diffuse and specular
+ * maps sampled bilinearly. Shadows, lightmaps and the light's marker are left
+ * out. Every stage runs on a work-stealing pool of std::threads, started here
+ * with one per core and joined by softraster_destroy, and the result does not
+ * depend on the thread count or instruction set.
+ */
+bool softraster_init(const std::vector<BatchItem>& items);
+
+softraster_simd softraster_best_simd();			// Widest instruction set this build can run
+
+const char* softraster_simd_name(softraster_simd simd);
+
+/**
+ * Draw the Models into target, resized to width x height, on threads workers
+ * (every core if <= 0).
+ */
+void softraster_render(SoftTarget& target, int width, int height, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos, int threads = 0, softraster_simd simd = softraster_best_simd());
+
+bool softraster_save(const SoftTarget& target, const char* path);	// Write the color buffer as a binary PPM
+
+/**
+ * Draw frames frames on every instruction set with 1, 2, 4, ... and all cores,
+ * and print time per frame, each stage's share and the speedup over one core.
+ */
+void softraster_benchmark(int width, int height, glm::mat4 projection, glm::mat4 view, DirectionalLight dir_light, glm::vec3 viewPos, int frames);
+
+SoftRasterStats softraster_stats();
+
+void softraster_report();
+
+void softraster_destroy();
+#endif//__SOFTRASTER_H__
@@ -0,0 +1,136 @@
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "statics.h"
+
+#include "lightbuffer.h"
+
+/**
+ * What was last seen of one tracked item. state holds a Model's transform, or
+ * a light's position, range, type, direction and cone.
+ */
+struct static_entry {
+	float state[16];
+	unsigned long long changed_frame;		// frame of the last change, 0 if it never changed
+	unsigned long long seen_frame;
+	bool is_static;
+};
+typedef struct static_entry StaticEntry;
+
+namespace glob {
+	unsigned long long statics_frame = 0;
+	unsigned long long statics_generation_count = 0;
+	unsigned long long statics_light_generation_count = 0;
+	unsigned long long statics_changes = 0;
+
+	std::unordered_map<const Model*, StaticEntry> static_objects;
+	std::vector<StaticEntry> static_lights;		// by light buffer index
+}
+
+void statics_begin_frame() {
+	++glob::statics_frame;
+}
+
+/**
+ * Compare state with what the entry last saw and update its classification,
+ * moving generation when it does. A fresh entry is static until it first
+ * changes.
+ */
+static bool statics_track(StaticEntry& entry, bool fresh, const float* state, unsigned long long& generation) {
+	using namespace glob;
+
+	if (fresh) {
+		std::memcpy(entry.state, state, sizeof(entry.state));
+		entry.changed_frame = 0;
+		entry.is_static = true;
+	}
+	else if (std::memcmp(entry.state, state, sizeof(entry.state)) != 0) {
+		std::memcpy(entry.state, state, sizeof(entry.state));
+		entry.changed_frame = statics_frame;
+		++statics_changes;
+		if (entry.is_static) {
+			entry.is_static = false;
+			++generation;
+		}
+	}
+	else if (!entry.is_static && statics_frame - entry.changed_frame >= STATIC_FRAMES) {
+		entry.is_static = true;
+		++generation;
+	}
+
+	entry.seen_frame = statics_frame;
+	return entry.is_static;
+}
+
+bool statics_object(const Model& model) {
+	using namespace glob;
+
+	bool fresh = static_objects.find(&model) == static_objects.end();
+	return statics_track(static_objects[&model], fresh, &model.model[0][0], statics_generation_count);
+}
+
+bool statics_light(int light) {
+	using namespace glob;
+
+	if (light < 0 || light >= (int)lightbuffer_count())
+		return false;
+
+	float state[16] = {};
+	std::memcpy(state, &lightbuffer_position_ranges()[light], sizeof(glm::vec4));
+	state[4] = lightbuffer_color_types()[light].w;
+	std::memcpy(state + 5, &lightbuffer_direction_outers()[light], sizeof(glm::vec4));
+	state[9] = lightbuffer_attenuations()[light].w;			// inner cone
+
+	bool fresh = light >= (int)static_lights.size();
+	if (fresh)
+		static_lights.resize(light + 1);
+	return statics_track(static_lights[light], fresh, state, statics_light_generation_count);
+}
+
+unsigned long long statics_generation() {
+	return glob::statics_generation_count;
+}
+
+unsigned long long statics_light_generation() {
+	return glob::statics_light_generation_count;
+}
+
+StaticStats statics_stats() {
+	using namespace glob;
+
+	StaticStats stats = StaticStats();
+	stats.frames = statics_frame;
+	stats.generation = statics_generation_count;
+	stats.light_generation = statics_light_generation_count;
+	stats.changes = statics_changes;
+	for (const auto& object : static_objects) {
+		++stats.objects;
+		stats.dynamic_objects += object.second.is_static ? 0 : 1;
+	}
+	for (const StaticEntry& light : static_lights) {
+		if (light.seen_frame == 0)
+			continue;					// index never tracked
+		++stats.lights;
+		stats.dynamic_lights += light.is_static ? 0 : 1;
+	}
+	return stats;
+}
+
+void statics_report() {
+	StaticStats stats = statics_stats();
+	if (stats.objects == 0 && stats.lights == 0)
+		return;
+
+	std::cout << "Static content: " << stats.objects - stats.dynamic_objects << " of " << stats.objects << " Models and "
+		<< stats.lights - stats.dynamic_lights << " of " << stats.lights << " lights static after " << stats.frames << " frames, "
+		<< stats.changes << " changes seen, static Models changed " << stats.generation << " times, static lights " << stats.light_generation << std::endl;
+}
+
+void statics_destroy() {
+	using namespace glob;
+
+	static_objects.clear();
+	static_lights.clear();
+}
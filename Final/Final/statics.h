@@ -0,0 +1,49 @@
+#pragma once
+#ifndef __STATICS_H__
+#define __STATICS_H__
+
+#include "models.h"
+
+const int STATIC_FRAMES = 60;				// Frames a moved Model or light must stay put before it is cached as static again
+
+/**
+ * Tells static scene content from dynamic so work on it can be cached. Models
+ * are tracked by address and their transform, lights by where their light
+ * buffer entry puts them (position, range, type and spot direction and cone;
+ * not color, which casts no different shadow). Everything starts out static;
+ * a change makes it dynamic until it has been unchanged for STATIC_FRAMES
+ * frames.
+ *
+ * Generations count changes to the static set, one for Models and one for
+ * lights: each moves whenever a static item of its kind changes (and so turns
+ * dynamic) or a dynamic one settles. Caches of static content compare the one
+ * they depend on to know they are stale.
+ */
+struct static_statistics {
+	unsigned long long frames;
+	unsigned long long generation;			// of the Models
+	unsigned long long light_generation;
+	unsigned int objects;					// Models seen
+	unsigned int dynamic_objects;			// Models that changed within the last STATIC_FRAMES frames
+	unsigned int lights;					// lights seen
+	unsigned int dynamic_lights;
+	unsigned long long changes;				// times a tracked item was seen changed
+};
+typedef struct static_statistics StaticStats;
+
+void statics_begin_frame();					// Call once per frame before anything is tracked
+
+bool statics_object(const Model& model);	// Track a Model this frame; true while it is static
+
+bool statics_light(int light);				// Track a light buffer entry this frame; true while it is static
+
+unsigned long long statics_generation();	// Models' static set
+
+unsigned long long statics_light_generation();
+
+StaticStats statics_stats();
+
+void statics_report();
+
+void statics_destroy();
+#endif//__STATICS_H__
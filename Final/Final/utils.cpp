@@ -1,11 +1,52 @@
 #include <GLEW/glew.h>
+#include <chrono>
 #include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #include "utils.h"
 
-unsigned int load_wrap_texture(const char* texture_path) {
+#include "image.h"
+
+#include "residency.h"
+
+namespace glob {
+	std::unordered_map<unsigned int, int> wrap_texture_limits;		// max_dimension each texture was loaded with, reused when restreaming
+}
+
+/**
+ * (Re)specify texture from the image at texture_path, downscaled to the
+ * texture's size limit, with a CPU-built mip chain. Also the residency
+ * manager's restream callback.
+ */
+static bool upload_wrap_texture(unsigned int texture, const std::string& texture_path) {
+	glBindTexture(GL_TEXTURE_2D, texture);														// Bind texture to the context as a GL_TEXTURE_2D
+
+	Image img;
+	bool loaded = image_load(texture_path, img, glob::wrap_texture_limits[texture]);			// Decode (flipped on y-axis because of XY -> rowcol shenanigans) and downscale
+	if (loaded)
+	{
+		std::vector<Image> mips;
+		image_build_mips(img, mips);															// Build the mip chain on the CPU instead of glGenerateMipmap
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);													// RGB rows are not padded to 4 bytes
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, img.width, img.height, 0, GL_RGB, GL_UNSIGNED_BYTE, img.texels.data());
+		for (size_t level = 0; level < mips.size(); ++level)
+			glTexImage2D(GL_TEXTURE_2D, (int)level + 1, GL_RGB, mips[level].width, mips[level].height, 0, GL_RGB, GL_UNSIGNED_BYTE, mips[level].texels.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}																							// On sucess, bind img to currently bound texture (texture1)
+	else
+	{
+		std::cerr << "ERROR::TEXTURE::DATA::LOADING_FAILED" << std::endl;
+	}																							// On sucess, print to stderr
+
+	return loaded;
+}
+
+unsigned int load_wrap_texture(const char* texture_path, int max_dimension) {
 	unsigned int texture;
 
 	glGenTextures(1, &texture);																	// Generate texture and set texture1 to new texture's ID number
@@ -16,19 +57,100 @@ unsigned int load_wrap_texture(const char* texture_path) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	int width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true);														// Tell stb_image.h to flip image on y-axis (because of XY -> rowcol shenanigans)
-	unsigned char* img_data = stbi_load(texture_path, &width, &height, &nrChannels, 0);			// Load raw image data to img_data and populate width, height and nrChannels
-	if (img_data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, img_data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}																							// On sucess, bind img_data to currently bound texture (texture1)
-	else
-	{
-		std::cerr << "ERROR::TEXTURE::DATA::LOADING_FAILED" << std::endl;
-	}																							// On sucess, print to stderr
-	stbi_image_free(img_data);																	// Free img_data from RAM, as it has been copied to VRAM
+	glob::wrap_texture_limits[texture] = max_dimension < 0 ? image_max_dimension() : max_dimension;
+	if (upload_wrap_texture(texture, texture_path))
+		residency_register(texture, GL_TEXTURE_2D, texture_path, upload_wrap_texture);			// Count its bytes against the VRAM budget and let it lose top mips under pressure
 
 	return texture;
-}
\ No newline at end of file
+}
+
+void free_texture(unsigned int texture) {
+	residency_unregister(texture);
+	glob::wrap_texture_limits.erase(texture);
+	glDeleteTextures(1, &texture);
+}
+
+void benchmark_mip_generation(const char* texture_path, int iterations) {
+	Image img;
+	if (!image_load(texture_path, img, 0))														// Full source size, the worst case for the driver
+		return;
+
+	image_benchmark_mips(img, iterations);
+
+	/**
+	 * Compare against the driver: upload level 0 and let glGenerateMipmap build
+	 * the rest, versus building on the CPU and uploading every level. glFinish
+	 * makes sure the GPU side is included in both.
+	 */
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for (int path = 0; path < 2; ++path) {
+		glFinish();
+		auto start = std::chrono::high_resolution_clock::now();
+
+		for (int i = 0; i < iterations; ++i) {
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, img.width, img.height, 0, GL_RGB, GL_UNSIGNED_BYTE, img.texels.data());
+			if (path == 0) {
+				glGenerateMipmap(GL_TEXTURE_2D);
+			}
+			else {
+				std::vector<Image> mips;
+				image_build_mips(img, mips);
+				for (size_t level = 0; level < mips.size(); ++level)
+					glTexImage2D(GL_TEXTURE_2D, (int)level + 1, GL_RGB, mips[level].width, mips[level].height, 0, GL_RGB, GL_UNSIGNED_BYTE, mips[level].texels.data());
+			}
+			glFinish();
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / iterations;
+		std::cout << (path == 0 ? "Upload + glGenerateMipmap:  " : "Upload + CPU mip chain:     ") << ms << " ms ("
+			<< (double)img.width * img.height / 1e6 / (ms / 1000.0) << " MP/s)" << std::endl;
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glDeleteTextures(1, &texture);
+}
+
+bool read_texture_layers(unsigned int texture, std::vector<Image>& layers) {
+	int width = 0, height = 0, depth = 0;
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_HEIGHT, &height);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_DEPTH, &depth);
+	if (width <= 0 || height <= 0 || depth <= 0) {
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		std::cerr << "ERROR::TEXTURE::NOT_READABLE " << texture << std::endl;
+		return false;
+	}
+
+	std::vector<unsigned char> texels((size_t)width * height * depth * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);										// Rows of RGB texels are not padded to 4 bytes
+	glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, GL_UNSIGNED_BYTE, texels.data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	size_t layer_bytes = (size_t)width * height * 3;
+	layers.assign(depth, Image());
+	for (int layer = 0; layer < depth; ++layer) {
+		layers[layer].width = width;
+		layers[layer].height = height;
+		layers[layer].texels.assign(texels.begin() + layer * layer_bytes, texels.begin() + (layer + 1) * layer_bytes);
+	}
+	return true;
+}
+
+bool read_framebuffer(int width, int height, Image& image) {
+	if (width <= 0 || height <= 0)
+		return false;
+
+	image.width = width;
+	image.height = height;
+	image.texels.resize((size_t)width * height * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, image.texels.data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	return true;
+}
@@ -2,6 +2,18 @@
 #ifndef __UTILS_H__
 #define __UTILS_H__
 
-unsigned int load_wrap_texture(const char* texture_path);
+#include <vector>
+
+#include "image.h"
+
+unsigned int load_wrap_texture(const char* texture_path, int max_dimension = -1);	// -1 uses image_max_dimension(), 0 keeps the source size
+
+void free_texture(unsigned int texture);	// Stop tracking and delete a texture from load_wrap_texture
+
+void benchmark_mip_generation(const char* texture_path, int iterations);	// Print CPU mip builder throughput per instruction set and against glGenerateMipmap
+
+bool read_texture_layers(unsigned int texture, std::vector<Image>& layers);	// Read level 0 of every layer of a GL_TEXTURE_2D_ARRAY back as RGB8
+
+bool read_framebuffer(int width, int height, Image& image);	// Read the bound read buffer's lower left width x height pixels as RGB8
 
 #endif//__UTILS_H__
\ No newline at end of file
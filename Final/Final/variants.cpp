@@ -0,0 +1,136 @@
+#include <GLEW/glew.h>
+
+#include <iostream>
+#include <map>
+
+#include "variants.h"
+
+#include "lightbuffer.h"
+
+#include "clusters.h"
+
+#include "shadows.h"
+
+/**
+ * One compiled permutation. lazy is set when the variant was first asked for
+ * at draw time rather than prepared during startup, i.e. it cost a hitch.
+ */
+struct shader_variant {
+	Shader* shader;
+	bool lazy;
+};
+typedef struct shader_variant ShaderVariant;
+
+namespace glob {
+	std::string variants_vertex_path;
+	std::string variants_fragment_path;
+	std::map<unsigned int, ShaderVariant> shader_variants;
+}
+
+unsigned int shader_features(bool specular_map, bool dir_light, bool light_list, bool light_clusters, bool shadows) {
+	unsigned int features = 0;
+	if (specular_map)
+		features |= SHADER_SPECULAR_MAP;
+	if (dir_light)
+		features |= SHADER_DIR_LIGHT;
+	if (light_list)
+		features |= SHADER_LIGHT_LIST;
+	if (light_list && light_clusters)
+		features |= SHADER_LIGHT_CLUSTERS;
+	if (shadows && (dir_light || light_list))
+		features |= SHADER_SHADOWS;
+	return features;
+}
+
+std::string shader_defines(unsigned int features) {
+	std::string defines;
+	if (features & SHADER_SPECULAR_MAP)
+		defines += "#define SPECULAR_MAP\n";
+	if (features & SHADER_DIR_LIGHT)
+		defines += "#define DIR_LIGHT\n";
+	if (features & SHADER_LIGHT_LIST)
+		defines += "#define LIGHT_LIST\n#define MAX_LIGHTS_PER_DRAW " + std::to_string(MAX_LIGHTS_PER_DRAW) + "\n";
+	if (features & SHADER_LIGHT_CLUSTERS)
+		defines += "#define LIGHT_CLUSTERS\n" + cluster_defines();
+	if (features & SHADER_SHADOWS)
+		defines += shadow_defines();
+	if (features & SHADER_LIGHTMAP)
+		defines += "#define LIGHTMAP\n";
+	return defines;
+}
+
+void variants_init(const char* vertex_path, const char* fragment_path) {
+	using namespace glob;
+
+	variants_destroy();
+	variants_vertex_path = vertex_path;
+	variants_fragment_path = fragment_path;
+}
+
+static ShaderVariant& variants_submit(unsigned int features, bool lazy) {
+	using namespace glob;
+
+	auto found = shader_variants.find(features);
+	if (found != shader_variants.end())
+		return found->second;
+
+	ShaderVariant variant;
+	variant.shader = new Shader(variants_vertex_path.c_str(), variants_fragment_path.c_str(), nullptr, shader_defines(features));
+	variant.lazy = lazy;
+	return shader_variants[features] = variant;
+}
+
+void variants_prepare(unsigned int features) {
+	variants_submit(features, false);
+}
+
+Shader* variants_get(unsigned int features) {
+	return variants_submit(features, true).shader;
+}
+
+void variants_report() {
+	using namespace glob;
+
+	double total_ms = 0.0;
+	unsigned int lazy = 0;
+	for (const auto& entry : shader_variants) {
+		total_ms += entry.second.shader->buildMs;
+		lazy += entry.second.lazy;
+	}
+
+	std::cout << "Shader variants of " << variants_fragment_path << ": " << shader_variants.size() << " built in " << total_ms << " ms";
+	if (lazy > 0)
+		std::cout << " (" << lazy << " compiled on first draw)";
+	std::cout << std::endl;
+
+	for (const auto& entry : shader_variants) {
+		const Shader* shader = entry.second.shader;
+		std::string names;
+		if (entry.first & SHADER_SPECULAR_MAP)
+			names += "SPECULAR_MAP ";
+		if (entry.first & SHADER_DIR_LIGHT)
+			names += "DIR_LIGHT ";
+		if (entry.first & SHADER_LIGHT_LIST)
+			names += "LIGHT_LIST ";
+		if (entry.first & SHADER_LIGHT_CLUSTERS)
+			names += "LIGHT_CLUSTERS ";
+		if (entry.first & SHADER_SHADOWS)
+			names += "SHADOWS ";
+		if (entry.first & SHADER_LIGHTMAP)
+			names += "LIGHTMAP ";
+		names = names.empty() ? "no features" : names.substr(0, names.size() - 1);
+		std::cout << "\t0x" << std::hex << entry.first << std::dec << " [" << names << "]: "
+			<< shader->buildMs << " ms" << (shader->fromBinaryCache() ? ", from the binary cache" : "")
+			<< (entry.second.lazy ? ", compiled on first draw" : "") << std::endl;
+	}
+}
+
+void variants_destroy() {
+	using namespace glob;
+
+	for (auto& entry : shader_variants) {
+		glDeleteProgram(entry.second.shader->ID);
+		delete entry.second.shader;
+	}
+	shader_variants.clear();
+}
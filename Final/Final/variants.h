@@ -0,0 +1,46 @@
+#pragma once
+#ifndef __VARIANTS_H__
+#define __VARIANTS_H__
+
+#include <string>
+
+#include "shader.h"
+
+/**
+ * Feature bits of the lit uber-shader (shaders/lit.fs.glsl). Every bit becomes
+ * a #define, so a variant only contains the lighting its draws use.
+ */
+enum shader_feature {
+	SHADER_SPECULAR_MAP = 1 << 0,			// SPECULAR_MAP
+	SHADER_DIR_LIGHT = 1 << 1,				// DIR_LIGHT
+	SHADER_LIGHT_LIST = 1 << 2,				// LIGHT_LIST: per-draw list of point and spot lights (see lightbuffer.h)
+	SHADER_LIGHT_CLUSTERS = 1 << 3,			// LIGHT_CLUSTERS: take the list from the fragment's cluster instead (see clusters.h)
+	SHADER_SHADOWS = 1 << 4,				// SHADOWS: shadow maps of the directional and point light (see shadows.h)
+	SHADER_LIGHTMAP = 1 << 5				// LIGHTMAP: diffuse light from the baked lightmap instead of the lights (see lightmap.h)
+};
+
+unsigned int shader_features(bool specular_map, bool dir_light, bool light_list, bool light_clusters, bool shadows);
+
+std::string shader_defines(unsigned int features);	// "#define ..." lines for features
+
+/**
+ * Every variant is compiled from vertex_path and the uber-source fragment_path.
+ */
+void variants_init(const char* vertex_path, const char* fragment_path);
+
+/**
+ * Submit a variant ahead of its first draw, so it compiles in parallel with the
+ * rest of startup (see Shader::beginParallelCompile).
+ */
+void variants_prepare(unsigned int features);
+
+/**
+ * The program for features, compiled (and finalized) on first use and cached
+ * by bitmask afterwards.
+ */
+Shader* variants_get(unsigned int features);
+
+void variants_report();						// Print every variant's defines and compile cost
+
+void variants_destroy();
+#endif//__VARIANTS_H__